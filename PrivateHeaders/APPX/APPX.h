@@ -7,27 +7,147 @@
 
 #pragma once
 
+#include <APPX/BlockMemo.h>
+#include <APPX/CachePolicy.h>
+#include <APPX/ContentGroup.h>
+#include <APPX/ContentType.h>
+#include <APPX/Digest.h>
 #include <APPX/File.h>
+#include <APPX/FileList.h>
+#include <APPX/InputSource.h>
+#include <cstddef>
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <zlib.h>
 
 namespace facebook {
 namespace appx {
+    // Options controlling how WriteAppx creates a package.
+    struct APPXOptions
+    {
+        // If non-empty, causes the APPX to be signed. certPath points to the
+        // path to the PKCS12 certificate file containing the private signing
+        // key.
+        std::string certPath;
+
+        // How much to compress individual files. Z_DEFAULT_COMPRESSION,
+        // any value between Z_NO_COMPRESSION and Z_BEST_COMPRESSION, and
+        // kExhaustiveCompression are accepted.
+        int compressionLevel = Z_NO_COMPRESSION;
+
+        // If positive, a compression level is chosen for each file (instead
+        // of using compressionLevel) to make the package as small as
+        // possible while writing the files takes about this many seconds.
+        // Metadata files still use compressionLevel.
+        double timeBudget = 0;
+
+        // If true, timeBudget is CPU time summed across threads. Otherwise,
+        // it is wall-clock time.
+        bool timeBudgetIsCPU = false;
+
+        // If true, create an APPXBUNDLE instead of an APPX.
+        bool isBundle = false;
+
+        // Number of threads compressing files. If greater than one and the
+        // output is seekable, compressed files are written concurrently to
+        // their final positions in the output. 0 means one thread per CPU.
+        //
+        // The output is identical regardless of the number of threads.
+        unsigned jobs = 1;
+
+        // Limit, in bytes, on memory used for buffering and compressing
+        // files. When the limit is reached, fewer files are compressed at
+        // once and buffers are spilled to temporary files. 0 means
+        // unlimited.
+        std::size_t maxMemory = 0;
+
+        // How reading input files and writing the package use the page
+        // cache.
+        CachePolicy cachePolicy = CachePolicy::Default;
+
+        // Where input files are read from. If null, the local paths of the
+        // file list are read from the file system.
+        InputSource *inputSource = nullptr;
+
+        // If not null, compressed blocks are remembered in blockMemo and
+        // reused for repeated blocks instead of compressing them again. The
+        // output is the same.
+        BlockMemo *blockMemo = nullptr;
+
+        // If not null, the package's bytes are hashed into outputDigests in
+        // order as they are written. Parts of the package kept from before
+        // (when resuming, building incrementally, or appending) are read
+        // back.
+        DigestSink *outputDigests = nullptr;
+
+        // If not empty, files are laid out in content group order and
+        // AppxMetadata/AppxContentGroupMap.xml is added to the package.
+        // Not supported for bundles.
+        ContentGroupMap contentGroups;
+
+        // Content types declared in [Content_Types].xml for file
+        // extensions, in addition to (or overriding) the built-in ones.
+        ContentTypeRegistry contentTypes;
+
+        // If not empty, the written file records are recorded periodically
+        // in a checkpoint at this path, which is deleted once the package
+        // is complete. The output must be seekable.
+        std::string checkpointPath;
+
+        // If true and the checkpoint exists, the output (opened for reading
+        // and writing) is validated against the checkpoint and the build
+        // continues after the last recorded file. The result is the same
+        // as an uninterrupted build.
+        bool resume = false;
+
+        // If not empty, an IncrementalBuild sidecar at this path describes
+        // the output's file records. If the output (opened for reading and
+        // writing) is unchanged since, the records of the leading inputs
+        // which are unchanged are kept, and the rest are written after them.
+        // The result is the same as a full build. The sidecar is replaced
+        // once the package is complete. The output must be seekable.
+        std::string incrementalPath;
+
+        // If not empty, an index of the package's entries and blocks is
+        // written to this path once the package is complete: JSON if the
+        // path ends in ".json", and binary otherwise. See IndexFormat.
+        std::string indexPath;
+    };
+
+    // Returns true if WriteAppx generates the file with the given archive
+    // name (the block map, content types, signature, and code integrity
+    // catalog).
+    bool IsGeneratedAppxFile(const std::string &archiveName);
+
+    // Returns true if archiveName names a bundle's manifest, which WriteAppx
+    // writes after the bundle's packages.
+    bool IsAppxBundleManifest(const std::string &archiveName);
+
     // Creates and optionally signs an APPX file.
     //
-    // fileNames maps APPX archive names to local filesystem paths.
-    //
-    // certPath, if specified, causes the APPX to be signed. certPath points to
-    // the path to the PKCS12 certificate file containing the private signing
-    // key.
-    //
-    // compressionLevel indicates how much to compress individual files.
-    // Z_DEFAULT_COMPRESSION and any value between Z_NO_COMPRESSION and
-    // Z_BEST_COMPRESSION are accepted.
-    void WriteAppx(
-        const FilePtr &zip,
-        const std::unordered_map<std::string, std::string> &fileNames,
-        const std::string *certPath, int compressionLevel, bool bundle);
+    // fileNames maps APPX archive names to local filesystem paths. Files are
+    // written in the order of fileNames. For a given fileNames and options,
+    // the output is the same on every run (except for the signature's
+    // signing time, and the levels chosen for a time budget).
+    void WriteAppx(const FilePtr &zip,
+                   const std::vector<FileListEntry> &fileNames,
+                   const APPXOptions &options);
+
+    // Like WriteAppx, but files are written as another thread adds them to
+    // fileNames, and closes it. This overlaps discovering the inputs with
+    // packaging them. A bundle's manifest is written after the other files
+    // regardless of when it is added. Content groups, time budgets, and
+    // checkpoints are not supported. Cancels fileNames on failure.
+    void WriteAppx(const FilePtr &zip, FileListQueue &fileNames,
+                   const APPXOptions &options);
+
+    // Adds files to an APPX written by WriteAppx, in place. Only the new
+    // files and the generated files (block map, content types, signature,
+    // and directory) are written; the existing files are kept. The package
+    // is signed only if options.certPath is set, which requires reading
+    // the existing files once to hash them.
+    void AppendAppx(const std::string &packagePath,
+                    const std::vector<FileListEntry> &fileNames,
+                    const APPXOptions &options);
 }
 }
@@ -0,0 +1,90 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/FileList.h>
+#include <APPX/InputSource.h>
+#include <APPX/Tuning.h>
+#include <APPX/ZIPReader.h>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // Size and compression measurements for a file or a group of files.
+    struct SizeAnalysis
+    {
+        enum
+        {
+            // Sampled blocks are counted by compressed/uncompressed ratio
+            // in steps of 1/kRatioBuckets. The last bucket also counts
+            // blocks which do not compress.
+            kRatioBuckets = 10,
+        };
+
+        off_t size = 0;
+        // Size in the analyzed package, or -1 if not analyzing a package.
+        off_t compressedSize = -1;
+        off_t blocks = 0;
+        off_t sampledBlocks = 0;
+        off_t blockRatios[kRatioBuckets] = {};
+        // Estimated compressed size and CPU seconds to write at each of
+        // CompressionTuner::kLevels.
+        double estimatedSize[CompressionTuner::kLevelCount] = {};
+        double estimatedSeconds[CompressionTuner::kLevelCount] = {};
+        // Blocks (and their bytes) also found in the reference package.
+        off_t referenceBlocks = 0;
+        off_t referenceBytes = 0;
+
+        void Add(const SizeAnalysis &other);
+    };
+
+    struct FileAnalysis : SizeAnalysis
+    {
+        std::string archiveName;
+        // Index of the first file with the same contents, or -1.
+        std::ptrdiff_t duplicateOf = -1;
+    };
+
+    struct ExtensionAnalysis : SizeAnalysis
+    {
+        std::string extension;
+        std::size_t files = 0;
+    };
+
+    struct Analysis
+    {
+        std::string packagePath;
+        std::string referencePath;
+        std::vector<FileAnalysis> files;
+        // Sorted by size, largest first.
+        std::vector<ExtensionAnalysis> extensions;
+        SizeAnalysis total;
+    };
+
+    // Measures inputs read from source using up to 'jobs' threads. Every
+    // block is hashed to find duplicate files and blocks shared with the
+    // reference package; compression is estimated from a sample of blocks.
+    //
+    // If package is not null, inputs are files in the package, and the
+    // analysis includes their compressed sizes. If referencePath is not
+    // empty, it names a package whose block map is compared with the
+    // inputs.
+    Analysis Analyze(const std::vector<FileListEntry> &inputs,
+                     InputSource &source, const ZIPReader *package,
+                     const std::string &referencePath, unsigned jobs);
+
+    void WriteAnalysisJSON(std::ostream &, const Analysis &);
+
+    // Writes a human-readable summary of the largest files and extensions.
+    void WriteAnalysisSummary(std::ostream &, const Analysis &);
+}
+}
@@ -0,0 +1,95 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/Hash.h>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // Remembers compressed blocks by the SHA-256 of their uncompressed data
+    // (the hash the block map needs anyway) and compression level, so
+    // repeated blocks are compressed once. Blocks are compressed
+    // independently of each other (see DeflateSink::Flush), so reusing a
+    // block's compressed bytes does not change the output.
+    //
+    // The least recently used blocks are forgotten to keep the memory used
+    // under a limit. Safe to use from multiple threads.
+    class BlockMemo
+    {
+    public:
+        struct Stats
+        {
+            std::uint64_t hits = 0;
+            std::uint64_t misses = 0;
+            // Uncompressed bytes of the blocks found.
+            std::uint64_t hitBytes = 0;
+            std::uint64_t evictions = 0;
+        };
+
+        explicit BlockMemo(std::size_t limit) : limit(limit)
+        {
+        }
+
+        BlockMemo(const BlockMemo &) = delete;
+        BlockMemo &operator=(const BlockMemo &) = delete;
+
+        // If a block with the given hash was compressed at compressionLevel,
+        // copies its compressed bytes to compressed and returns true.
+        // uncompressedSize is only used for Stats.
+        bool Find(const SHA256Hash &sha256, int compressionLevel,
+                  std::size_t uncompressedSize,
+                  std::vector<std::uint8_t> &compressed);
+
+        void Add(const SHA256Hash &sha256, int compressionLevel,
+                 std::vector<std::uint8_t> compressed);
+
+        Stats GetStats() const;
+
+    private:
+        struct Key
+        {
+            SHA256Hash sha256;
+            int compressionLevel;
+
+            bool operator==(const Key &other) const
+            {
+                return this->sha256 == other.sha256 &&
+                       this->compressionLevel == other.compressionLevel;
+            }
+        };
+
+        struct KeyHash
+        {
+            std::size_t operator()(const Key &key) const;
+        };
+
+        struct Entry
+        {
+            Key key;
+            std::vector<std::uint8_t> compressed;
+        };
+
+        // Memory used by an entry, including bookkeeping.
+        static std::size_t EntrySize(const Entry &entry);
+
+        const std::size_t limit;
+        mutable std::mutex mutex;
+        // Most recently used first.
+        std::list<Entry> entries;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        std::size_t used = 0;
+        Stats stats;
+    };
+}
+}
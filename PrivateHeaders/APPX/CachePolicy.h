@@ -0,0 +1,158 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/Zeros.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+
+namespace facebook {
+namespace appx {
+    // How file I/O interacts with the operating system's page cache.
+    enum class CachePolicy
+    {
+        // Let the operating system decide.
+        Default,
+        // Read ahead of input files and drop input and output data from the
+        // page cache once it has been used, so packaging does not evict
+        // other processes' data.
+        NoCache,
+        // Like NoCache, but read input files bypassing the page cache
+        // entirely (O_DIRECT). Falls back to NoCache where unsupported.
+        Direct,
+    };
+
+    // Parses "default", "nocache", or "direct". Returns false if the name
+    // is not recognized.
+    bool ParseCachePolicy(const std::string &name, CachePolicy &policy);
+
+    // An input file which is read sequentially according to a cache policy.
+    class InputFile
+    {
+    public:
+        InputFile(const std::string &path, CachePolicy policy);
+        ~InputFile();
+
+        InputFile(const InputFile &) = delete;
+        InputFile &operator=(const InputFile &) = delete;
+
+        // Copies all bytes from the file into a sink. Holes in sparse files
+        // are not read, and zero blocks at multiples of kZeroBlockSize are
+        // not written; both are passed to WriteZeroBytes instead.
+        template <typename TSink>
+        void CopyTo(TSink &sink)
+        {
+            for (;;) {
+                off_t holeSize = this->SkipHole();
+                if (holeSize > 0) {
+                    WriteZeroBytes(sink, holeSize);
+                }
+                std::size_t read = this->Read();
+                if (read == 0) {
+                    break;
+                }
+                this->WriteBuffer(sink, read);
+            }
+        }
+
+    private:
+        // If the file is sparse and the next bytes are a hole, seeks past
+        // the hole and returns its size. Otherwise, returns 0.
+        off_t SkipHole();
+
+        // Reads the next bytes of the file (up to the next hole) into
+        // buffer, returning the number of bytes read, or 0 at the end of
+        // the file.
+        std::size_t Read();
+
+        // Writes the size bytes just read into buffer to sink.
+        template <typename TSink>
+        void WriteBuffer(TSink &sink, std::size_t size)
+        {
+            // Offset in buffer of the first multiple of kZeroBlockSize.
+            off_t start = this->offset - static_cast<off_t>(size);
+            std::size_t pos = static_cast<std::size_t>(
+                (kZeroBlockSize - start % kZeroBlockSize) % kZeroBlockSize);
+            std::size_t written = 0;
+            for (; pos + kZeroBlockSize <= size; pos += kZeroBlockSize) {
+                if (!IsZero(kZeroBlockSize, this->buffer + pos)) {
+                    continue;
+                }
+                if (pos > written) {
+                    sink.Write(pos - written, this->buffer + written);
+                }
+                WriteZeroBytes(sink, kZeroBlockSize);
+                written = pos + kZeroBlockSize;
+            }
+            if (size > written) {
+                sink.Write(size - written, this->buffer + written);
+            }
+        }
+
+        struct BufferDeleter
+        {
+            void operator()(std::uint8_t *buffer);
+        };
+
+        std::string path;
+        CachePolicy policy;
+        int fd;
+        std::unique_ptr<std::uint8_t, BufferDeleter> bufferStorage;
+        std::uint8_t *buffer;
+        std::size_t bufferSize;
+        // Bytes of the file read so far.
+        off_t offset = 0;
+        // Bytes of the file dropped from the page cache so far.
+        off_t dropped = 0;
+        // The size of the file when it was opened.
+        off_t size;
+        // The end of the data after offset, where the next hole starts.
+        // Unknown (and 0) if the file is sparse and the hole after offset
+        // has not been found yet.
+        off_t dataEnd;
+    };
+
+    // Keeps written data of a file from accumulating in the page cache.
+    //
+    // Writeback of each written range is started immediately. Once more than
+    // kWindowSize bytes are being written back, the oldest ranges are waited
+    // for and dropped from the page cache. Thread-safe.
+    class WriteBehind
+    {
+    public:
+        enum : off_t
+        {
+            kWindowSize = 8 * 1024 * 1024
+        };
+
+        explicit WriteBehind(int fd) : fd(fd)
+        {
+        }
+
+        // Informs that the given range was written with write or pwrite.
+        void Written(off_t offset, off_t size);
+
+        // Waits for all written ranges and drops them from the page cache.
+        void Finish();
+
+    private:
+        void Drop(off_t offset, off_t size);
+
+        int fd;
+        std::mutex mutex;
+        std::deque<std::pair<off_t, off_t>> ranges;
+        off_t pending = 0;
+    };
+}
+}
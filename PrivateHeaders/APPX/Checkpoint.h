@@ -0,0 +1,109 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/File.h>
+#include <APPX/Hash.h>
+#include <APPX/InputSource.h>
+#include <APPX/Sink.h>
+#include <APPX/ZIP.h>
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // A journal of the file records written to a package, so an
+    // interrupted build can continue after the last recorded file.
+    //
+    // Each record holds the file's ZIPFileEntry (with its block hashes),
+    // the offset following its file record, and the AXPC hash state after
+    // it, followed in the journal by its input's InputSource::Stamp. Records
+    // are queued and written periodically, after flushing the package, so
+    // the journal never describes bytes which were not written.
+    //
+    // Not thread-safe.
+    class Checkpoint
+    {
+    public:
+        struct Record
+        {
+            ZIPFileEntry entry;
+            off_t endOffset;
+            SHA256Sink axpcSink;
+        };
+
+        // Seconds between writes of queued records.
+        static const std::chrono::seconds kInterval;
+
+        // Opens the checkpoint at path for the package written to output.
+        // fingerprint identifies the build; see Fingerprint. stamps are the
+        // inputs' stamps, in order.
+        //
+        // If resume is true and the checkpoint exists, it must have the
+        // same fingerprint, and its records are loaded up to the first
+        // whose input's stamp changed; the rest are dropped. (Inputs with
+        // empty stamps are assumed unchanged if their sizes are.)
+        // Otherwise, the checkpoint is created or replaced.
+        Checkpoint(std::string path, const SHA256Hash &fingerprint,
+                   std::vector<std::string> stamps, bool resume,
+                   FILE *output);
+
+        // Records loaded when resuming, in order.
+        const std::vector<Record> &Resumed() const
+        {
+            return this->resumed;
+        }
+
+        // Queues a record for a file record written at the end of the
+        // package, writing queued records if kInterval has passed.
+        void Add(const ZIPFileEntry &entry, off_t endOffset,
+                 const SHA256Sink &axpcSink);
+
+        // Flushes the package, then writes queued records.
+        void Flush();
+
+        // Deletes the checkpoint, once the package is complete.
+        void Remove();
+
+        // Writes a record as a line of text, without the newline.
+        static void FormatRecord(std::ostream &out, const Record &record);
+
+        // Reads a record written by FormatRecord, appending it to records.
+        // Returns false if it is malformed.
+        static bool ReadRecord(std::istream &in, std::vector<Record> &records);
+
+        // Hashes what determines the bytes of a package's file records:
+        // the compression level and each input's archive name, local path,
+        // and size.
+        static SHA256Hash Fingerprint(
+            int compressionLevel,
+            const std::vector<std::pair<std::string, std::string>> &inputs,
+            InputSource &source);
+
+    private:
+        void Load(const SHA256Hash &fingerprint);
+        void WriteHeader(const SHA256Hash &fingerprint);
+        void WriteRecord(const Record &record);
+
+        std::string path;
+        std::vector<std::string> stamps;
+        FILE *output;
+        FilePtr file;
+        // Number of records written to file.
+        std::size_t written = 0;
+        std::vector<Record> resumed;
+        std::vector<Record> queued;
+        std::chrono::steady_clock::time_point lastFlush;
+    };
+}
+}
@@ -0,0 +1,97 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/Hash.h>
+#include <APPX/OpenSSL.h>
+#include <APPX/Sink.h>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <openssl/pkcs7.h>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // The archive name of a package's code integrity catalog.
+    extern const char kCodeIntegrityCatalogName[];
+
+    // Computes the Authenticode (SHA-256) hash of a PE image as it is
+    // written: every byte except the checksum, the certificate table's data
+    // directory entry, and the certificate table.
+    //
+    // Unlike the Authenticode specification, sections are not reordered by
+    // file offset, so images whose sections are not in file order (which
+    // linkers do not produce) hash differently than signtool's.
+    class PEImageHashSink
+    {
+    public:
+        void Write(std::size_t size, const std::uint8_t *bytes);
+
+        // Returns false if the data written is not a PE image.
+        bool IsPEImage();
+
+        // The image's hash. Only valid if IsPEImage returns true.
+        SHA256Hash SHA256() const;
+
+    private:
+        enum class State
+        {
+            Header,
+            Image,
+            NotImage,
+        };
+
+        // Parses the buffered header. If it is complete, decides whether
+        // the data is an image and hashes the header.
+        void ParseHeader(bool isEnd);
+
+        // Hashes bytes at offset, skipping excluded ranges.
+        void Hash(off_t offset, std::size_t size, const std::uint8_t *bytes);
+
+        State state = State::Header;
+        std::vector<std::uint8_t> header;
+        off_t offset = 0;
+        // [begin, end) ranges not hashed, in order.
+        std::vector<std::pair<off_t, off_t>> excluded;
+        SHA256Sink sha256Sink;
+    };
+
+    // Collects the hashes of a package's binaries (.exe and .dll files)
+    // while they are written, and creates AppxMetadata/CodeIntegrity.cat
+    // from them. Thread-safe.
+    class CodeIntegrityCatalog
+    {
+    public:
+        // Returns true if archiveName is a binary listed in the catalog.
+        static bool IsMember(const std::string &archiveName);
+
+        // Adds a binary. Files which are not PE images are not listed.
+        void Add(const std::string &archiveName, PEImageHashSink &hashSink);
+
+        // Adds a binary with the given image hash.
+        void Add(const std::string &archiveName, const SHA256Hash &imageHash);
+
+        // Returns pairs of the binaries' archive names and image hashes.
+        std::vector<std::pair<std::string, SHA256Hash>> Members() const;
+
+        bool Empty() const;
+
+        // Creates the catalog, signed using the given certificate.
+        OpenSSLPtr<PKCS7, PKCS7_free> Sign(const std::string &certPath) const;
+
+    private:
+        mutable std::mutex mutex;
+        // Pairs of archive names and image hashes.
+        std::vector<std::pair<std::string, SHA256Hash>> members;
+    };
+}
+}
@@ -0,0 +1,68 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/FileList.h>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // An assignment of files to content groups. Content groups let Windows
+    // launch an app once its required files are downloaded, streaming the
+    // other groups in order afterwards.
+    //
+    // https://msdn.microsoft.com/en-us/windows/uwp/packaging/streaming-install
+    class ContentGroupMap
+    {
+    public:
+        // The group which must be installed before the app can launch. Files
+        // not assigned to a group are put into this group.
+        static const char kRequiredGroupName[];
+
+        // Archive name of the content group map inside the package.
+        static const char kArchiveName[];
+
+        ContentGroupMap();
+
+        // Assigns files to a group. pattern is either an archive name or a
+        // prefix of archive names followed by '*'. If a file matches several
+        // patterns, an archive name wins over a prefix, and a longer prefix
+        // wins over a shorter one.
+        //
+        // Groups are ordered by the first call to Add naming them, except
+        // the required group, which always comes first.
+        void Add(const std::string &groupName, std::string pattern);
+
+        bool Empty() const
+        {
+            return this->patternCount == 0;
+        }
+
+        // Returns the index of the group containing the given file.
+        std::size_t GroupOf(const std::string &archiveName) const;
+
+        // Stably reorders files so files of earlier groups come first.
+        void Layout(std::vector<FileListEntry> &files) const;
+
+        // Returns the contents of AppxContentGroupMap.xml given the archive
+        // names of all files in the package, in the order they are written.
+        std::string XML(const std::vector<std::string> &archiveNames) const;
+
+    private:
+        std::size_t GroupIndex(const std::string &groupName);
+
+        std::vector<std::string> groupNames;
+        std::unordered_map<std::string, std::size_t> archiveNameGroups;
+        std::vector<std::pair<std::string, std::size_t>> prefixGroups;
+        std::size_t patternCount = 0;
+    };
+}
+}
@@ -0,0 +1,68 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/InputSource.h>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace facebook {
+namespace appx {
+    // Reads inputs from a content-addressed store: a directory of blobs
+    // named by their hashes in hex, either directly in the directory or
+    // in subdirectories named by the hashes' first two digits (as in
+    // Bazel's disk cache). Other inputs are read from a base source.
+    //
+    // Blobs are named by digests of the form "hash/size", where hash is a
+    // SHA-256 hash in hex (of either case). Their sizes and stamps are the
+    // digests' rather than the files', so inputs are not materialized into
+    // a tree and digests are not recomputed.
+    class ContentStoreInputSource : public InputSource
+    {
+    public:
+        ContentStoreInputSource(std::string directory, InputSource &base);
+
+        // Returns the local path of the blob with the given digest, to use
+        // in a file list. Throws std::runtime_error if the digest is
+        // malformed or the blob is not in the store.
+        std::string AddBlob(const std::string &digest);
+
+        off_t Size(const std::string &path) override;
+        // The blob's digest.
+        std::string Stamp(const std::string &path) override;
+        // Throws std::runtime_error if a blob's size does not match its
+        // digest.
+        void Read(const std::string &path, CachePolicy policy,
+                  const WriteFunc &write) override;
+        void ReadSparse(const std::string &path, CachePolicy policy,
+                        const WriteFunc &write,
+                        const WriteZerosFunc &writeZeros) override;
+        std::size_t ReadAt(const std::string &path, off_t offset,
+                           std::size_t size, std::uint8_t *bytes) override;
+
+    private:
+        struct Blob
+        {
+            std::string digest;
+            off_t size;
+        };
+
+        // Returns the blob with the given local path, or null for other
+        // inputs.
+        const Blob *Find(const std::string &path);
+
+        std::string directory;
+        InputSource &base;
+        // Blobs by local path. Blobs are added while inputs are read.
+        std::mutex mutex;
+        std::unordered_map<std::string, Blob> blobs;
+    };
+}
+}
@@ -0,0 +1,44 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+namespace facebook {
+namespace appx {
+    // Maps file extensions to the content types [Content_Types].xml
+    // declares for them. Built-in types can be overridden, and others added.
+    //
+    // Extensions are given without the dot, and are compared ignoring ASCII
+    // case, as OPC requires.
+    class ContentTypeRegistry
+    {
+    public:
+        // The content type of files with no known type.
+        static const char kDefaultContentType[];
+
+        // Sets the content type of files with the given extension. Throws
+        // std::runtime_error if either is empty or the extension contains
+        // '.' or '/'.
+        void Add(const std::string &extension, std::string contentType);
+
+        // Returns the content type of files with the given extension, which
+        // must be lower case. The type of "xml" depends on whether the
+        // package is a bundle.
+        const std::string &Find(const std::string &lowerExtension,
+                                bool isBundle) const;
+
+        // Lowers the ASCII letters of an extension, in place.
+        static void ToLower(std::string &extension);
+
+    private:
+        std::unordered_map<std::string, std::string> types;
+    };
+}
+}
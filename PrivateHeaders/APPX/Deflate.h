@@ -0,0 +1,140 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/BlockMemo.h>
+#include <APPX/Hash.h>
+#include <APPX/Parallel.h>
+#include <APPX/Zeros.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <sys/types.h>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // A compression level, beyond Z_BEST_COMPRESSION, which compresses with
+    // ExhaustiveDeflate.
+    enum
+    {
+        kExhaustiveCompression = 10,
+    };
+
+    // Compresses bytes as raw DEFLATE, trying much harder than zlib:
+    // matches are chosen by iterated optimal parsing, and the data is split
+    // into DEFLATE blocks where that is smaller. The result is never larger
+    // than zlib's at Z_BEST_COMPRESSION.
+    //
+    // Like deflate with Z_FULL_FLUSH on a new stream, the result does not
+    // refer to earlier data and ends on a byte boundary without a final
+    // block, so results can be concatenated.
+    std::vector<std::uint8_t> ExhaustiveDeflate(std::size_t size,
+                                                const std::uint8_t *bytes);
+
+    // A sink which compresses into another sink with ExhaustiveDeflate, one
+    // block of blockSize bytes at a time, using up to 'jobs' threads. Close
+    // must be called after writing data. If memo is not null, compressed
+    // blocks are looked up in and added to memo.
+    //
+    // The output is the same as DeflateSink's if Flush were called after
+    // every block, except smaller.
+    template <typename TSink>
+    class ExhaustiveDeflateSink
+    {
+    public:
+        // Called for each block, in order, with the hash of the block's
+        // uncompressed data and the block's compressed size.
+        typedef std::function<void(const SHA256Hash &, off_t)> BlockCallback;
+
+        ExhaustiveDeflateSink(std::size_t blockSize, unsigned jobs,
+                              TSink &sink, BlockCallback blockCallback,
+                              BlockMemo *memo = nullptr)
+            : blockSize(blockSize),
+              jobs(jobs),
+              batchSize(2 * EffectiveJobCount(jobs)),
+              sink(sink),
+              blockCallback(std::move(blockCallback)),
+              memo(memo)
+        {
+        }
+
+        void Write(std::size_t size, const std::uint8_t *bytes)
+        {
+            while (size > 0) {
+                if (this->blocks.empty() ||
+                    this->blocks.back().size() == this->blockSize) {
+                    if (this->blocks.size() == this->batchSize) {
+                        this->CompressBlocks();
+                    }
+                    this->blocks.emplace_back();
+                    this->blocks.back().reserve(this->blockSize);
+                }
+                std::vector<std::uint8_t> &block = this->blocks.back();
+                std::size_t count =
+                    std::min(size, this->blockSize - block.size());
+                block.insert(block.end(), bytes, bytes + count);
+                bytes += count;
+                size -= count;
+            }
+        }
+
+        void Close()
+        {
+            this->CompressBlocks();
+            // An empty final block, as written by deflate with Z_FINISH.
+            static const std::uint8_t finalBlock[] = {0x03, 0x00};
+            this->sink.Write(sizeof(finalBlock), finalBlock);
+        }
+
+    private:
+        void CompressBlocks()
+        {
+            std::vector<std::vector<std::uint8_t>> compressed(
+                this->blocks.size());
+            std::vector<SHA256Hash> hashes(this->blocks.size());
+            ParallelFor(this->blocks.size(), this->jobs, [&](std::size_t i) {
+                const std::vector<std::uint8_t> &block = this->blocks[i];
+                if (block.size() == kZeroBlockSize &&
+                    IsZero(block.size(), block.data())) {
+                    hashes[i] = ZeroBlockSHA256();
+                    compressed[i] = CompressedZeroBlock(kExhaustiveCompression);
+                    return;
+                }
+                hashes[i] =
+                    SHA256Hash::DigestFromBytes(block.size(), block.data());
+                if (this->memo &&
+                    this->memo->Find(hashes[i], kExhaustiveCompression,
+                                     block.size(), compressed[i])) {
+                    return;
+                }
+                compressed[i] = ExhaustiveDeflate(block.size(), block.data());
+                if (this->memo) {
+                    this->memo->Add(hashes[i], kExhaustiveCompression,
+                                    compressed[i]);
+                }
+            });
+            for (std::size_t i = 0; i < this->blocks.size(); ++i) {
+                this->sink.Write(compressed[i].size(), compressed[i].data());
+                this->blockCallback(hashes[i],
+                                    static_cast<off_t>(compressed[i].size()));
+            }
+            this->blocks.clear();
+        }
+
+        const std::size_t blockSize;
+        const unsigned jobs;
+        const std::size_t batchSize;
+        TSink &sink;
+        BlockCallback blockCallback;
+        BlockMemo *const memo;
+        std::vector<std::vector<std::uint8_t>> blocks;
+    };
+}
+}
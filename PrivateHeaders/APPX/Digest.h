@@ -0,0 +1,56 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <openssl/evp.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // A sink which computes digests with several algorithms at once, such
+    // as those of a whole package for uploading it.
+    class DigestSink
+    {
+    public:
+        // Algorithms are named as in OpenSSL, ignoring case: "sha256",
+        // "md5", "sha1", "sha512", "sha3-256", "blake2b512", etc. Throws
+        // std::runtime_error if an algorithm is not supported.
+        explicit DigestSink(const std::vector<std::string> &algorithms);
+
+        DigestSink(const DigestSink &) = delete;
+        DigestSink &operator=(const DigestSink &) = delete;
+
+        void Write(std::size_t size, const std::uint8_t *bytes);
+
+        // Returns pairs of the algorithms' names (in lower case) and the
+        // digests of the bytes written so far, in hex.
+        std::vector<std::pair<std::string, std::string>> HexDigests() const;
+
+    private:
+        struct ContextDeleter
+        {
+            void operator()(EVP_MD_CTX *context)
+            {
+                EVP_MD_CTX_free(context);
+            }
+        };
+
+        std::vector<std::string> algorithms;
+        std::vector<std::unique_ptr<EVP_MD_CTX, ContextDeleter>> contexts;
+    };
+
+    // Parses a comma-separated list of digest algorithms, such as
+    // "sha256,md5". Throws std::runtime_error if the list is empty.
+    std::vector<std::string> ParseDigestAlgorithms(const std::string &list);
+}
+}
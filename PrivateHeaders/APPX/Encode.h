@@ -7,10 +7,13 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <limits>
 #include <stdexcept>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 namespace facebook {
 namespace appx {
@@ -36,6 +39,51 @@ namespace appx {
             return static_cast<TTarget>(x);
         }
     };
+
+    // Encodes bytes as lower-case hexadecimal.
+    inline std::string HexString(const std::uint8_t *bytes, std::size_t size)
+    {
+        static const char kDigits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(size * 2);
+        for (std::size_t i = 0; i < size; ++i) {
+            hex += kDigits[bytes[i] >> 4];
+            hex += kDigits[bytes[i] & 0xf];
+        }
+        return hex;
+    }
+
+    inline int HexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+
+    // Decodes a string written by HexString. Returns false if it is
+    // malformed.
+    inline bool ParseHexString(const std::string &hex,
+                               std::vector<std::uint8_t> &bytes)
+    {
+        if (hex.size() % 2 != 0) {
+            return false;
+        }
+        bytes.clear();
+        bytes.reserve(hex.size() / 2);
+        for (std::size_t i = 0; i < hex.size(); i += 2) {
+            int high = HexDigit(hex[i]);
+            int low = HexDigit(hex[i + 1]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            bytes.push_back(static_cast<std::uint8_t>(high << 4 | low));
+        }
+        return true;
+    }
 }
 }
 
@@ -0,0 +1,66 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/APPX.h>
+#include <APPX/FileList.h>
+#include <ostream>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // An estimated size or offset, with bounds.
+    struct SizeEstimate
+    {
+        off_t estimate = 0;
+        off_t low = 0;
+        off_t high = 0;
+
+        bool IsExact() const
+        {
+            return this->low == this->high;
+        }
+    };
+
+    struct EntryEstimate
+    {
+        std::string archiveName;
+        SizeEstimate headerOffset;
+        off_t uncompressedSize = 0;
+        SizeEstimate compressedSize;
+    };
+
+    struct PackageEstimate
+    {
+        // The package's files (including generated files), in order.
+        std::vector<EntryEstimate> entries;
+        SizeEstimate size;
+        off_t inputBytes = 0;
+        // Input bytes compressed to make the estimate.
+        off_t sampledBytes = 0;
+    };
+
+    // Estimates the layout of the package WriteAppx would write, without
+    // writing it. Stored files, and deflated files small enough to compress
+    // whole when sampled, are exact. Other deflated files are estimated
+    // from blocks sampled from the largest files; their bounds are the
+    // lowest and highest compression ratios seen in the samples, so they
+    // are likely but not guaranteed. Generated files are written (to
+    // nowhere) for the estimated, lowest, and highest layouts.
+    //
+    // Time budgets and checkpoints are not supported.
+    PackageEstimate EstimateAppx(const std::vector<FileListEntry> &fileNames,
+                                 const APPXOptions &options);
+
+    // Writes a table of the entries' offsets and sizes, and the package's
+    // size.
+    void WriteEstimate(std::ostream &, const PackageEstimate &);
+}
+}
@@ -12,6 +12,7 @@
 #include <cstring>
 #include <errno.h>
 #include <memory>
+#include <stdexcept>
 #include <string>
 
 namespace facebook {
@@ -55,6 +56,10 @@ namespace appx {
         return file;
     }
 
+    // Creates and opens an anonymous temporary file for reading and writing,
+    // like tmpfile. The file is created in $TMPDIR if set.
+    FilePtr OpenTemporaryFile();
+
     // Seeks to a position in a file, like fseek.
     inline void Seek(const FilePtr &file, off_t pos, int whence)
     {
@@ -91,6 +96,15 @@ namespace appx {
         }
     }
 
+    // Writes bytes to a file descriptor at the given offset, like pwrite.
+    // Unlike pwrite, never performs a partial write.
+    void PWrite(int fd, std::size_t size, const void *bytes, off_t offset);
+
+    // Reserves disk space for the given byte range of a file, like
+    // posix_fallocate. Does nothing if the file system does not support
+    // preallocation.
+    void Preallocate(int fd, off_t offset, off_t size);
+
     // Copies all bytes (starting from the current position) from a file into a
     // sink.
     template <typename TSink>
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // A pair of an APPX archive name and a local filesystem path.
+    using FileListEntry = std::pair<std::string, std::string>;
+
+    // Returns the lowercase extension of an archive name, or an empty
+    // string.
+    std::string ArchiveNameExtension(const std::string &archiveName);
+
+    // An ordered list of files to put into a package. Files are written to
+    // the package in list order, so the order must not depend on hash tables
+    // or directory traversal order if the package should be reproducible.
+    class FileList
+    {
+    public:
+        // Adds a file to the end of the list. If a file with the same archive
+        // name was already added, does nothing and returns false.
+        bool Add(std::string archiveName, std::string localPath);
+
+        bool Contains(const std::string &archiveName) const
+        {
+            return this->archiveNames.count(archiveName) != 0;
+        }
+
+        bool Empty() const
+        {
+            return this->files.empty();
+        }
+
+        std::size_t Size() const
+        {
+            return this->files.size();
+        }
+
+        const std::vector<FileListEntry> &Files() const
+        {
+            return this->files;
+        }
+
+        // Sorts files by archive name, comparing bytes.
+        void Sort();
+
+        // Moves the files with the given archive names to the front of the
+        // list, in the given order. The remaining files are sorted by archive
+        // name. Throws std::runtime_error if a name is not in the list.
+        void Reorder(const std::vector<std::string> &archiveNames);
+
+    private:
+        std::vector<FileListEntry> files;
+        std::unordered_set<std::string> archiveNames;
+    };
+
+    // A file list which is consumed while another thread is still adding to
+    // it, so packaging can start before all inputs are discovered. Files
+    // are removed in the order they were added. Add blocks while
+    // 'capacity' files are waiting.
+    class FileListQueue
+    {
+    public:
+        explicit FileListQueue(std::size_t capacity) : capacity(capacity)
+        {
+        }
+
+        // Like FileList::Add. Throws the error the queue was cancelled
+        // with.
+        bool Add(std::string archiveName, std::string localPath);
+
+        // Marks the end of the list. If error is not null, Next rethrows it
+        // instead of returning false.
+        void Close(std::exception_ptr error = nullptr);
+
+        // Removes the next file, waiting for one to be added. Returns false
+        // once the queue is closed and empty.
+        bool Next(FileListEntry &file);
+
+        // Stops the producer: further calls to Add throw error, or
+        // std::runtime_error if it is null.
+        void Cancel(std::exception_ptr error = nullptr);
+
+    private:
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<FileListEntry> files;
+        std::unordered_set<std::string> archiveNames;
+        std::size_t capacity;
+        bool closed = false;
+        bool cancelled = false;
+        std::exception_ptr error;
+        std::exception_ptr cancelError;
+    };
+}
+}
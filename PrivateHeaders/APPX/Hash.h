@@ -34,6 +34,17 @@ namespace appx {
             return SHA256Hash(hash);
         }
 
+        bool operator==(const SHA256Hash &other) const
+        {
+            return std::memcmp(this->bytes, other.bytes,
+                               sizeof(this->bytes)) == 0;
+        }
+
+        bool operator!=(const SHA256Hash &other) const
+        {
+            return !(*this == other);
+        }
+
         std::uint8_t bytes[SHA256_DIGEST_LENGTH];
     };
 }
@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/Checkpoint.h>
+#include <APPX/FileList.h>
+#include <APPX/Hash.h>
+#include <APPX/ZIP.h>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // A sidecar to a package describing how its inputs' file records were
+    // written, so the next build of the package can keep the records of
+    // unchanged inputs in place instead of writing and hashing them again.
+    //
+    // For each input, in order, the sidecar holds its file record (as in a
+    // checkpoint: the entry, the offset following it, and the AXPC hash
+    // state after it), its local path and InputSource::Stamp, its code
+    // integrity image hash, and the number of builds in which it changed.
+    // If the first K inputs of a build are unchanged and the package was
+    // not modified since the sidecar was written, the build keeps their
+    // records and resumes hashing from the state after the Kth, so its
+    // cost is proportional to the changed suffix. Appending to a package
+    // described by its sidecar likewise resumes hashing after its records.
+    class IncrementalBuild
+    {
+    public:
+        struct Input
+        {
+            Checkpoint::Record record;
+            std::string localPath;
+            std::string stamp;
+            // Set for binaries listed in the code integrity catalog.
+            bool hasImageHash;
+            SHA256Hash imageHash;
+            // Number of builds which added or changed the input.
+            unsigned changes;
+        };
+
+        // Loads the sidecar at path, if it exists. Throws if it is
+        // malformed.
+        explicit IncrementalBuild(std::string path);
+
+        // Inputs of the last build, in order.
+        const std::vector<Input> &Inputs() const
+        {
+            return this->inputs;
+        }
+
+        int CompressionLevel() const
+        {
+            return this->compressionLevel;
+        }
+
+        // True if the last build listed binaries' image hashes.
+        bool IsSigned() const
+        {
+            return this->isSigned;
+        }
+
+        // Returns true if the last build's inputs' records are entries, in
+        // order, and output was not modified since.
+        bool Describes(const std::vector<ZIPFileEntry> &entries,
+                       FILE *output) const;
+
+        // Returns how many of inputs, in order, have records in output
+        // which can be kept: those of the last build, if it had the same
+        // compression level and signing and output was not modified since,
+        // whose archive name, local path, and stamp (in stamps) are
+        // unchanged.
+        std::size_t ReusablePrefix(int compressionLevel, bool isSigned,
+                                   const std::vector<FileListEntry> &inputs,
+                                   const std::vector<std::string> &stamps,
+                                   FILE *output) const;
+
+        // Returns the archive names of the last build's inputs, those which
+        // changed in the fewest builds first, then by archive name. Laying
+        // out files in this order puts files which change often last.
+        std::vector<std::string> StableOrder() const;
+
+        // Replaces the sidecar with one describing output, which must be
+        // complete and flushed. The inputs' change counts are computed
+        // from the last build's.
+        void Save(int compressionLevel, bool isSigned,
+                  std::vector<Input> inputs, FILE *output);
+
+    private:
+        std::string path;
+        std::vector<Input> inputs;
+        int compressionLevel = 0;
+        bool isSigned = false;
+        // Identifies the package as written, to detect later changes.
+        std::string packageStamp;
+    };
+}
+}
@@ -0,0 +1,53 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/ZIP.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    enum class IndexFormat
+    {
+        // Little-endian, like ZIP:
+        //
+        //   "APPXIDX1"
+        //   u32 entry count
+        //   for each entry, in package order:
+        //     u16 name length, name (archive name, UTF-8)
+        //     u64 file record header offset
+        //     u32 file record header size
+        //     u64 compressed size
+        //     u64 uncompressed size
+        //     u32 CRC-32
+        //     u16 compression method (0 stored, 8 deflate)
+        //     u32 block count
+        //     for each block:
+        //       32 bytes SHA-256 of the uncompressed block
+        //       u64 offset of the block's data in the package
+        //       u32 size of the block's data in the package
+        //
+        // Block i covers uncompressed bytes [i * 64K, (i + 1) * 64K) of its
+        // file. Generated files have no blocks.
+        Binary,
+        // The same fields as an object, with base64 hashes (as in
+        // AppxBlockMap.xml).
+        JSON,
+    };
+
+    // Returns JSON for paths ending in ".json", and Binary otherwise.
+    IndexFormat IndexFormatForPath(const std::string &path);
+
+    // Writes an index of a package's entries, so tools can locate files
+    // and blocks without parsing the package.
+    void WritePackageIndex(std::ostream &, const std::vector<ZIPFileEntry> &,
+                           IndexFormat);
+}
+}
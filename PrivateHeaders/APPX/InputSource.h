@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/CachePolicy.h>
+#include <APPX/Zeros.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+
+namespace facebook {
+namespace appx {
+    // Where WriteAppx reads the data of input files, named by the local
+    // paths in a file list. All methods must be thread-safe.
+    class InputSource
+    {
+    public:
+        // Called with consecutive pieces of an input's data.
+        typedef std::function<void(std::size_t, const std::uint8_t *)>
+            WriteFunc;
+
+        // Called with the size of a run of zero bytes in an input's data.
+        typedef std::function<void(off_t)> WriteZerosFunc;
+
+        virtual ~InputSource()
+        {
+        }
+
+        // Returns the size of an input, in bytes.
+        virtual off_t Size(const std::string &path) = 0;
+
+        // Returns a string which changes whenever an input's data changes,
+        // or an empty string if the source cannot tell.
+        virtual std::string Stamp(const std::string &)
+        {
+            return std::string();
+        }
+
+        // Reads all of an input's data according to a cache policy.
+        virtual void Read(const std::string &path, CachePolicy policy,
+                          const WriteFunc &write) = 0;
+
+        // Like Read, but runs of zero bytes (such as holes in sparse files)
+        // may be passed to writeZeros instead of write.
+        virtual void ReadSparse(const std::string &path, CachePolicy policy,
+                                const WriteFunc &write,
+                                const WriteZerosFunc &)
+        {
+            this->Read(path, policy, write);
+        }
+
+        // Reads up to size bytes of an input starting at offset into bytes,
+        // returning the number of bytes read.
+        virtual std::size_t ReadAt(const std::string &path, off_t offset,
+                                   std::size_t size, std::uint8_t *bytes) = 0;
+    };
+
+    // Reads inputs from the local file system.
+    class FileSystemInputSource : public InputSource
+    {
+    public:
+        off_t Size(const std::string &path) override;
+        // The file's size, modification and change times, and inode.
+        std::string Stamp(const std::string &path) override;
+        void Read(const std::string &path, CachePolicy policy,
+                  const WriteFunc &write) override;
+        void ReadSparse(const std::string &path, CachePolicy policy,
+                        const WriteFunc &write,
+                        const WriteZerosFunc &writeZeros) override;
+        std::size_t ReadAt(const std::string &path, off_t offset,
+                           std::size_t size, std::uint8_t *bytes) override;
+    };
+
+    // Helper for WriteZIPFileEntry which reads an input from an InputSource.
+    struct WriteInputSourceFunc
+    {
+        template <typename TSink>
+        void operator()(TSink &sink) const
+        {
+            this->source.ReadSparse(
+                this->path, this->cachePolicy,
+                [&sink](std::size_t size, const std::uint8_t *bytes) {
+                    sink.Write(size, bytes);
+                },
+                [&sink](off_t size) { WriteZeroBytes(sink, size); });
+        }
+
+        InputSource &source;
+        const std::string &path;
+        CachePolicy cachePolicy;
+    };
+}
+}
@@ -0,0 +1,19 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <ostream>
+#include <string>
+
+namespace facebook {
+namespace appx {
+    // Writes a string as a quoted JSON string. Bytes are written as-is, so
+    // UTF-8 strings give valid JSON.
+    void WriteJSONString(std::ostream &, const std::string &);
+}
+}
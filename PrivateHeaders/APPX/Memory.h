@@ -0,0 +1,130 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace facebook {
+namespace appx {
+    // Accounts for memory used by large buffers and working sets across
+    // threads, keeping the total under a limit.
+    //
+    // There are two kinds of reservations:
+    //
+    // * Working set reservations (Acquire) wait until enough of the budget
+    //   is free. This throttles the number of concurrently running tasks.
+    //   To avoid deadlock, a working set reservation never waits if no other
+    //   working set is reserved.
+    // * Buffer reservations (TryAcquire) never wait. If the budget is
+    //   exhausted, the caller should spill its buffer to disk instead.
+    //
+    // A limit of 0 means unlimited.
+    class MemoryBudget
+    {
+    public:
+        explicit MemoryBudget(std::size_t limit = 0) : limit(limit)
+        {
+        }
+
+        MemoryBudget(const MemoryBudget &) = delete;
+        MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+        // Reserves a working set, waiting until the budget allows it. Must
+        // be matched with a call to ReleaseWorkingSet.
+        void AcquireWorkingSet(std::size_t size);
+        void ReleaseWorkingSet(std::size_t size);
+
+        // Reserves buffer memory if the budget allows it, returning true.
+        // Otherwise, returns false. Must be matched with a call to Release
+        // if successful.
+        bool TryAcquire(std::size_t size);
+
+        // Reserves memory which cannot be spilled, even if the budget does
+        // not allow it. Must be matched with a call to Release.
+        void Charge(std::size_t size);
+
+        void Release(std::size_t size);
+
+        std::size_t Limit() const
+        {
+            return this->limit;
+        }
+
+        // The most memory reserved at once.
+        std::size_t Peak() const;
+
+    private:
+        void Add(std::size_t size);
+
+        const std::size_t limit;
+        mutable std::mutex mutex;
+        std::condition_variable released;
+        std::size_t used = 0;
+        std::size_t peak = 0;
+        std::size_t workingSets = 0;
+    };
+
+    // Reserves a working set for the lifetime of the object.
+    class WorkingSetReservation
+    {
+    public:
+        WorkingSetReservation(MemoryBudget *budget, std::size_t size)
+            : budget(budget), size(size)
+        {
+            if (this->budget) {
+                this->budget->AcquireWorkingSet(this->size);
+            }
+        }
+
+        ~WorkingSetReservation()
+        {
+            if (this->budget) {
+                this->budget->ReleaseWorkingSet(this->size);
+            }
+        }
+
+        WorkingSetReservation(const WorkingSetReservation &) = delete;
+        WorkingSetReservation &operator=(const WorkingSetReservation &) =
+            delete;
+
+    private:
+        MemoryBudget *budget;
+        std::size_t size;
+    };
+
+    // Charges memory which cannot be spilled for the lifetime of the
+    // object.
+    class MemoryCharge
+    {
+    public:
+        MemoryCharge(MemoryBudget *budget, std::size_t size)
+            : budget(budget), size(size)
+        {
+            if (this->budget) {
+                this->budget->Charge(this->size);
+            }
+        }
+
+        ~MemoryCharge()
+        {
+            if (this->budget) {
+                this->budget->Release(this->size);
+            }
+        }
+
+        MemoryCharge(const MemoryCharge &) = delete;
+        MemoryCharge &operator=(const MemoryCharge &) = delete;
+
+    private:
+        MemoryBudget *budget;
+        std::size_t size;
+    };
+}
+}
@@ -0,0 +1,120 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/APPX.h>
+#include <APPX/File.h>
+#include <APPX/FileList.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // Creates a package from entries pushed by the caller as their data
+    // arrives, e.g. from an event loop. No method waits for compression or
+    // for the output (except Wait): data is buffered and compressed on a
+    // background thread, which uses options.jobs threads if the output is
+    // seekable. Entries are written in the order they are begun, and the
+    // package is the same as WriteAppx would write for those files.
+    //
+    // One entry is open at a time. Except for Wait, methods must be called
+    // from one thread at a time.
+    class PackageWriter
+    {
+    public:
+        // Called on a background thread when buffered data drops below half
+        // of the limit, after Write returned false.
+        typedef std::function<void()> ReadyFunc;
+
+        // Called once the package is complete, with the error if writing it
+        // failed.
+        typedef std::function<void(std::exception_ptr)> DoneFunc;
+
+        // Write returns false while more than bufferLimit bytes of entry
+        // data are buffered. Content groups, time budgets, checkpoints, and
+        // options.inputSource are not supported.
+        PackageWriter(FilePtr zip, APPXOptions options,
+                      std::size_t bufferLimit, ReadyFunc ready = nullptr);
+
+        // Abandons the package if Finish was not called, and waits for the
+        // background thread.
+        ~PackageWriter();
+
+        PackageWriter(const PackageWriter &) = delete;
+        PackageWriter &operator=(const PackageWriter &) = delete;
+
+        // Starts a file with the given archive name. Throws if an entry is
+        // open, the name was already used, or writing the package failed.
+        void BeginEntry(std::string archiveName);
+
+        // Appends data to the open entry. Returns false if the caller should
+        // stop writing until the ready callback is called. (The data is
+        // buffered either way.)
+        bool Write(std::size_t size, const std::uint8_t *bytes);
+
+        // Ends the open entry.
+        void EndEntry();
+
+        // Ends the list of entries. done is called once the generated files
+        // and directory are written: on the background thread, or from
+        // Finish if writing already failed.
+        void Finish(DoneFunc done = nullptr);
+
+        // Waits for the package to be complete, rethrowing any error.
+        void Wait();
+
+    private:
+        // The data of an entry, until it is read by the background thread.
+        struct Entry
+        {
+            std::deque<std::vector<std::uint8_t>> chunks;
+            bool ended = false;
+        };
+
+        class Source;
+
+        // Called by Source, with mutex held, when it takes a chunk.
+        void Consumed(std::size_t size, std::unique_lock<std::mutex> &lock);
+
+        void Run();
+
+        FilePtr zip;
+        APPXOptions options;
+        std::size_t bufferLimit;
+        ReadyFunc ready;
+        std::unique_ptr<Source> source;
+        FileListQueue queue;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<Entry> entries;
+        std::size_t buffered = 0;
+        bool blocked = false;
+        bool isEntryOpen = false;
+        bool finishing = false;
+        // Set when the background thread stops writing, then when it has
+        // called done.
+        bool written = false;
+        bool finished = false;
+        bool cancelled = false;
+        std::exception_ptr error;
+        DoneFunc done;
+
+        std::thread thread;
+    };
+}
+}
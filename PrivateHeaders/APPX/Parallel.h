@@ -0,0 +1,32 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace facebook {
+namespace appx {
+    // Returns the number of threads to use if the user asked for 'jobs'
+    // threads. 0 means one thread per CPU.
+    unsigned EffectiveJobCount(unsigned jobs);
+
+    // Calls func(i) for every i in [0, count), using up to 'jobs' threads.
+    // Indexes are handed out in increasing order.
+    //
+    // If func throws, no further indexes are handed out, and the first
+    // exception is rethrown after all threads finish.
+    //
+    // Calls from within func share the outer call's threads: at most 'jobs'
+    // threads run at once for a top-level call and the calls nested in it,
+    // and a nested call uses threads as the outer call stops needing them.
+    // Unrelated top-level calls do not limit each other.
+    void ParallelFor(std::size_t count, unsigned jobs,
+                     const std::function<void(std::size_t)> &func);
+}
+}
@@ -0,0 +1,46 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+// Statically-defined tracing (USDT) probes, for tracing packaging with
+// bpftrace, perf, or SystemTap without rebuilding. An unattached probe is a
+// single nop. See Tools/slow-files.bt for an example.
+//
+// Probes (provider "appx"):
+//
+//   entry_start(archiveName, compressionLevel)
+//   entry_finish(archiveName, uncompressedSize, compressedSize)
+//   block(uncompressedSize)
+//   deflate_flush(totalIn, totalOut)
+//   file_write(size)
+//   sign_start(certPath)
+//   sign_finish(signatureSize)
+//
+// Strings are const char *; sizes are 64-bit. Durations are measured by
+// pairing *_start and *_finish probes on the same thread.
+//
+// Probes are compiled out unless APPX_ENABLE_PROBES is defined (see the
+// APPX_ENABLE_PROBES CMake option). Arguments are not evaluated when
+// compiled out.
+
+#if defined(APPX_ENABLE_PROBES)
+#include <sys/sdt.h>
+#define APPX_PROBE1(name, a) DTRACE_PROBE1(appx, name, a)
+#define APPX_PROBE2(name, a, b) DTRACE_PROBE2(appx, name, a, b)
+#define APPX_PROBE3(name, a, b, c) DTRACE_PROBE3(appx, name, a, b, c)
+#else
+#define APPX_PROBE1(name, a) \
+    do {                     \
+    } while (false)
+#define APPX_PROBE2(name, a, b) \
+    do {                        \
+    } while (false)
+#define APPX_PROBE3(name, a, b, c) \
+    do {                           \
+    } while (false)
+#endif
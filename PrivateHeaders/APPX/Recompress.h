@@ -0,0 +1,28 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/APPX.h>
+#include <APPX/File.h>
+#include <string>
+
+namespace facebook {
+namespace appx {
+    // Rewrites an existing APPX or APPXBUNDLE with new options (such as a
+    // compression level), reading files directly from the package without
+    // extracting them.
+    //
+    // Files keep their order. AppxBlockMap.xml, [Content_Types].xml, and the
+    // signature are regenerated; the package is signed only if
+    // options.certPath is set. The packages in a bundle are recompressed
+    // and signed the same way, and their sizes in the bundle manifest
+    // updated. options.isBundle and options.inputSource are ignored.
+    void RecompressAppx(const FilePtr &zip, const std::string &packagePath,
+                        APPXOptions options);
+}
+}
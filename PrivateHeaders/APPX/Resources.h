@@ -0,0 +1,50 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/APPX.h>
+#include <APPX/File.h>
+#include <APPX/FileList.h>
+#include <string>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // A resource qualifier, named as in a bundle manifest's Resource
+    // element (Language, Scale, or DXFeatureLevel), with its lower-case
+    // value.
+    struct ResourceQualifier
+    {
+        std::string name;
+        std::string value;
+    };
+
+    // Returns the resource qualifiers in an archive name. Qualifiers are
+    // written as in MRT resource names: a directory or a dot-separated part
+    // of the file name made of underscore-separated qualifiers such as
+    // "lang-fr-FR" (or "language-"), "scale-200", and "dxfl-dx11" (or
+    // "dxfeaturelevel-"). For example, "Assets/scale-200/Logo.png" and
+    // "Strings/Logo.lang-fr_scale-200.png".
+    std::vector<ResourceQualifier> ResourceQualifiers(
+        const std::string &archiveName);
+
+    // Writes an APPXBUNDLE splitting one app's files into packages: the
+    // main package, with the files without qualifiers (and those whose
+    // qualifiers match the Resources in AppxManifest.xml), and a resource
+    // package for each other set of qualifiers. Resource packages' manifests
+    // are generated from AppxManifest.xml, as is the bundle's manifest.
+    //
+    // The packages are written with options (signed if options.certPath
+    // is set) to temporary files, up to options.jobs at once, sharing
+    // options.maxMemory. Time budgets, checkpoints, incremental builds, and
+    // content groups are not supported.
+    void WriteResourceBundle(const FilePtr &zip,
+                             const std::vector<FileListEntry> &fileNames,
+                             const APPXOptions &options);
+}
+}
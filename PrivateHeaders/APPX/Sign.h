@@ -11,6 +11,9 @@
 #include <APPX/OpenSSL.h>
 #include <cstdint>
 #include <openssl/pkcs7.h>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace facebook {
 namespace appx {
@@ -21,6 +24,15 @@ namespace appx {
     OpenSSLPtr<PKCS7, PKCS7_free> Sign(const std::string &certPath,
                                        const APPXDigests &digests);
 
+    // Creates a signed code integrity catalog listing the given binaries,
+    // which are pairs of archive names and Authenticode SHA-256 hashes.
+    OpenSSLPtr<PKCS7, PKCS7_free> SignCatalog(
+        const std::string &certPath,
+        const std::vector<std::pair<std::string, SHA256Hash>> &members);
+
+    // Returns the DER encoding of a signature.
+    std::vector<std::uint8_t> GetSignatureBytes(PKCS7 *signature);
+
     // A set of digests required when signing APPX files.
     struct APPXDigests
     {
@@ -7,15 +7,21 @@
 
 #pragma once
 
+#include <APPX/CachePolicy.h>
 #include <APPX/File.h>
 #include <APPX/Hash.h>
+#include <APPX/Memory.h>
 #include <APPX/OpenSSL.h>
+#include <APPX/Probes.h>
+#include <APPX/Zeros.h>
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <functional>
 #include <limits>
+#include <stdexcept>
 #include <type_traits>
 #include <vector>
 #include <zlib.h>
@@ -32,16 +38,74 @@ namespace appx {
         {
         }
 
+        // Informs writeBehind of written data. offset is the current
+        // position of the file.
+        FileSink(FILE *file, WriteBehind *writeBehind, off_t offset)
+            : file(file), writeBehind(writeBehind), unflushedOffset(offset)
+        {
+        }
+
         void Write(std::size_t size, const std::uint8_t *bytes)
         {
+            APPX_PROBE1(file_write, static_cast<std::uint64_t>(size));
             std::size_t written = std::fwrite(bytes, 1, size, this->file);
             if (written != size) {
                 throw ErrnoException();
             }
+            if (this->writeBehind) {
+                this->unflushedSize += size;
+                if (this->unflushedSize >= kWriteBehindSize) {
+                    this->Flush();
+                }
+            }
+        }
+
+        // Flushes buffered data to the file.
+        void Flush()
+        {
+            if (std::fflush(this->file) != 0) {
+                throw ErrnoException();
+            }
+            if (this->writeBehind) {
+                this->writeBehind->Written(this->unflushedOffset,
+                                           this->unflushedSize);
+                this->unflushedOffset += this->unflushedSize;
+                this->unflushedSize = 0;
+            }
         }
 
     private:
+        // How much data to write before informing writeBehind.
+        enum : off_t
+        {
+            kWriteBehindSize = 1024 * 1024
+        };
+
         FILE *file;
+        WriteBehind *writeBehind = nullptr;
+        off_t unflushedOffset = 0;
+        off_t unflushedSize = 0;
+    };
+
+    // A sink which writes to a file descriptor at increasing offsets using
+    // pwrite, leaving the file position untouched.
+    class PositionalFileSink
+    {
+    public:
+        PositionalFileSink(int fd, off_t offset) : fd(fd), offset(offset)
+        {
+        }
+
+        void Write(std::size_t size, const std::uint8_t *bytes)
+        {
+            APPX_PROBE1(file_write, static_cast<std::uint64_t>(size));
+            PWrite(this->fd, size, bytes, this->offset);
+            this->offset += size;
+        }
+
+    private:
+        int fd;
+        off_t offset;
     };
 
     // A sink which creates a SHA256 digest.
@@ -53,11 +117,31 @@ namespace appx {
             SHA256_Init(&this->context);
         }
 
+        // Continues hashing from a state returned by State. Throws if the
+        // state is malformed.
+        explicit SHA256Sink(const std::vector<std::uint8_t> &state)
+        {
+            if (state.size() != sizeof(this->context)) {
+                throw std::runtime_error("Malformed SHA-256 state");
+            }
+            std::memcpy(&this->context, state.data(), sizeof(this->context));
+        }
+
         void Write(std::size_t size, const std::uint8_t *bytes)
         {
             SHA256_Update(&this->context, bytes, size);
         }
 
+        // Returns the intermediate hash state. It can only be restored by
+        // a build using the same OpenSSL.
+        std::vector<std::uint8_t> State() const
+        {
+            const std::uint8_t *bytes =
+                reinterpret_cast<const std::uint8_t *>(&this->context);
+            return std::vector<std::uint8_t>(bytes,
+                                             bytes + sizeof(this->context));
+        }
+
         SHA256Hash SHA256() const
         {
             SHA256_CTX context = this->context;
@@ -152,6 +236,19 @@ namespace appx {
             }
         }
 
+        void WriteZeros(off_t size)
+        {
+            while (size > 0) {
+                off_t toWrite = std::min(this->chunkSize - this->written, size);
+                WriteZeroBytes(this->sink, toWrite);
+                this->written += toWrite;
+                size -= toWrite;
+                if (this->written == this->chunkSize) {
+                    EndChunk();
+                }
+            }
+        }
+
         void Close()
         {
             EndChunk();
@@ -163,14 +260,26 @@ namespace appx {
             return this->chunks;
         }
 
+        // Passes each completed chunk to callback instead of keeping it in
+        // Chunks(). Useful if a chunk's state is much larger than its result.
+        void SetChunkCallback(std::function<void(Sink &&)> callback)
+        {
+            this->chunkCallback = std::move(callback);
+        }
+
     private:
         void EndChunk()
         {
             if (this->written == 0) {
                 return;
             }
+            APPX_PROBE1(block, static_cast<std::uint64_t>(this->written));
             MaybeClose(this->sink);
-            this->chunks.emplace_back(std::move(this->sink));
+            if (this->chunkCallback) {
+                this->chunkCallback(std::move(this->sink));
+            } else {
+                this->chunks.emplace_back(std::move(this->sink));
+            }
             this->sink = this->factory();
             this->written = 0;
         }
@@ -199,6 +308,7 @@ namespace appx {
         TSinkFactory factory;
         Sink sink;
         std::vector<Sink> chunks;
+        std::function<void(Sink &&)> chunkCallback;
     };
 
     template <typename TSinkFactory>
@@ -224,6 +334,11 @@ namespace appx {
             this->offset += size;
         }
 
+        void WriteZeros(off_t size)
+        {
+            this->offset += size;
+        }
+
         off_t Offset() const
         {
             return this->offset;
@@ -250,6 +365,129 @@ namespace appx {
         std::vector<std::uint8_t> &vector;
     };
 
+    // A sink which buffers bytes in memory while the memory budget allows it,
+    // and in a temporary file after that.
+    class SpillSink
+    {
+    public:
+        // If budget is null, all bytes are buffered in memory.
+        explicit SpillSink(MemoryBudget *budget = nullptr) : budget(budget)
+        {
+        }
+
+        ~SpillSink()
+        {
+            this->ReleaseMemory();
+        }
+
+        SpillSink(const SpillSink &) = delete;
+        SpillSink &operator=(const SpillSink &) = delete;
+
+        SpillSink(SpillSink &&other)
+            : budget(other.budget),
+              memory(std::move(other.memory)),
+              reserved(other.reserved),
+              file(std::move(other.file)),
+              size(other.size)
+        {
+            other.reserved = 0;
+            other.size = 0;
+        }
+
+        SpillSink &operator=(SpillSink &&other)
+        {
+            this->ReleaseMemory();
+            this->budget = other.budget;
+            this->memory = std::move(other.memory);
+            this->reserved = other.reserved;
+            this->file = std::move(other.file);
+            this->size = other.size;
+            other.reserved = 0;
+            other.size = 0;
+            return *this;
+        }
+
+        void Write(std::size_t size, const std::uint8_t *bytes)
+        {
+            if (!this->file) {
+                if (this->Reserve(this->memory.size() + size)) {
+                    this->memory.insert(this->memory.end(), bytes,
+                                        bytes + size);
+                    this->size += size;
+                    return;
+                }
+                this->file = OpenTemporaryFile();
+            }
+            appx::Write(this->file, size, bytes);
+            this->size += size;
+        }
+
+        // The number of bytes written.
+        std::size_t Size() const
+        {
+            return this->size;
+        }
+
+        // Writes all buffered bytes into sink.
+        template <typename TSink>
+        void CopyTo(TSink &sink)
+        {
+            sink.Write(this->memory.size(), this->memory.data());
+            if (this->file) {
+                if (std::fflush(this->file.get()) != 0) {
+                    throw ErrnoException();
+                }
+                Seek(this->file, 0, SEEK_SET);
+                Copy(this->file, sink);
+                Seek(this->file, 0, SEEK_END);
+            }
+        }
+
+    private:
+        // Granularity of reservations from the budget.
+        enum
+        {
+            kReservationSize = 65536
+        };
+
+        bool Reserve(std::size_t size)
+        {
+            if (size <= this->reserved) {
+                return true;
+            }
+            // Grow geometrically to avoid copying the buffer too often, but
+            // settle for less if the budget is nearly exhausted.
+            std::size_t minimum = (size + kReservationSize - 1) /
+                                  kReservationSize * kReservationSize;
+            std::size_t preferred = std::max(minimum, this->reserved * 2);
+            std::size_t newReserved = preferred;
+            if (this->budget &&
+                !this->budget->TryAcquire(preferred - this->reserved)) {
+                newReserved = minimum;
+                if (!this->budget->TryAcquire(minimum - this->reserved)) {
+                    return false;
+                }
+            }
+            this->reserved = newReserved;
+            this->memory.reserve(this->reserved);
+            return true;
+        }
+
+        void ReleaseMemory()
+        {
+            if (this->budget && this->reserved != 0) {
+                this->budget->Release(this->reserved);
+            }
+            this->reserved = 0;
+        }
+
+        MemoryBudget *budget;
+        std::vector<std::uint8_t> memory;
+        std::size_t reserved = 0;
+        FilePtr file;
+        std::size_t size = 0;
+    };
+
     // A sink which compresses into another sink using the ZIP DEFLATE
     // algorithm. Close must be called after writing data.
     template <typename TSink>
@@ -326,6 +564,9 @@ namespace appx {
                 this->stream.next_in = nullptr;
                 this->stream.avail_in = 0;
                 this->Deflate(Z_FULL_FLUSH);
+                APPX_PROBE2(deflate_flush,
+                            static_cast<std::uint64_t>(this->stream.total_in),
+                            static_cast<std::uint64_t>(this->stream.total_out));
             }
         }
 
@@ -371,6 +612,11 @@ namespace appx {
                 crc32(this->crc, bytes, static_cast<unsigned int>(size));
         }
 
+        void WriteZeros(off_t size)
+        {
+            this->crc = crc32_combine(this->crc, ZerosCRC32(size), size);
+        }
+
         std::uint32_t CRC32() const
         {
             return this->crc;
@@ -395,6 +641,11 @@ namespace appx {
         {
             // Do nothing.
         }
+
+        void WriteZeros(off_t size)
+        {
+            // Do nothing.
+        }
     };
 
     // A linked list of sinks.
@@ -415,6 +666,12 @@ namespace appx {
             tail.Write(size, bytes);
         }
 
+        void WriteZeros(off_t size)
+        {
+            WriteZeroBytes(head, size);
+            tail.WriteZeros(size);
+        }
+
     private:
         THeadSink &head;
         MultiSink<TTailSinks...> tail;
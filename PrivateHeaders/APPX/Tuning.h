@@ -0,0 +1,154 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/FileList.h>
+#include <APPX/InputSource.h>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // Returns the CPU time used by the calling thread, in seconds.
+    double ThreadCPUTime();
+
+    // Compression is estimated by sampling blocks of files. Each sampled
+    // file contributes up to kSampleWindows blocks, spread evenly through
+    // the file.
+    enum
+    {
+        kSampleWindows = 4,
+    };
+
+    // Calls write with each sampled block of a file of the given size.
+    void ReadSampleWindows(InputSource &source, const std::string &path,
+                           off_t size, const InputSource::WriteFunc &write);
+
+    // Chooses files to sample, given their sizes. Samples are taken from
+    // the largest files until 1/16 of the input (but at least 4 MiB) is
+    // covered; empty files are always chosen, since they cost nothing.
+    // Files for which canSample returns false are skipped.
+    //
+    // Returns indexes into sizes, largest first. If sampledBytes is not
+    // null, it is set to the number of bytes ReadSampleWindows reads
+    // from the chosen files.
+    std::vector<std::size_t> ChooseSampledFiles(
+        const std::vector<off_t> &sizes,
+        const std::function<bool(std::size_t)> &canSample,
+        off_t *sampledBytes = nullptr);
+
+    // Combines samples by file extension, so files which were not sampled
+    // can use samples of similar files. TSample must have Add(const
+    // TSample &) and Empty().
+    template <typename TSample>
+    class SamplesByExtension
+    {
+    public:
+        void Add(const std::string &archiveName, const TSample &sample)
+        {
+            this->byExtension[ArchiveNameExtension(archiveName)].Add(sample);
+            this->all.Add(sample);
+        }
+
+        // Returns the samples of files with archiveName's extension, or of
+        // all files if there are none.
+        const TSample &Find(const std::string &archiveName) const
+        {
+            auto it =
+                this->byExtension.find(ArchiveNameExtension(archiveName));
+            return it != this->byExtension.end() && !it->second.Empty()
+                       ? it->second
+                       : this->all;
+        }
+
+    private:
+        std::unordered_map<std::string, TSample> byExtension;
+        TSample all;
+    };
+
+    // Chooses a compression level for each file so the package is as small
+    // as possible while writing the files takes at most a given amount of
+    // CPU time.
+    //
+    // Levels are chosen from estimates made by compressing samples of the
+    // files. As files are written, the estimates are corrected using the
+    // time actually taken, and files which have not been started are
+    // re-planned.
+    class CompressionTuner
+    {
+    public:
+        // The levels the tuner chooses between, from cheapest to most
+        // expensive.
+        enum
+        {
+            kLevelCount = 4,
+        };
+        static const int kLevels[kLevelCount];
+
+        // Samples inputs from source using up to 'jobs' threads. Time spent
+        // sampling counts against cpuBudget.
+        CompressionTuner(const std::vector<FileListEntry> &inputs,
+                         InputSource &source, double cpuBudget,
+                         unsigned jobs);
+
+        CompressionTuner(const CompressionTuner &) = delete;
+        CompressionTuner &operator=(const CompressionTuner &) = delete;
+
+        // Returns the compression level for inputs[index], and marks the
+        // file as started. Thread-safe.
+        int Level(std::size_t index);
+
+        // Records that inputs[index] was written using cpuSeconds of CPU
+        // time. Thread-safe.
+        void Finished(std::size_t index, double cpuSeconds);
+
+    private:
+        struct Estimate
+        {
+            double cost[kLevelCount] = {};
+            double size[kLevelCount] = {};
+            // Indexes into kLevels worth considering, from cheapest to most
+            // expensive, each saving fewer bytes per second than the last.
+            std::vector<std::size_t> hull;
+
+            // Bytes saved per second of CPU time by compressing with
+            // kLevels[to] instead of kLevels[from].
+            double Efficiency(std::size_t from, std::size_t to) const;
+        };
+
+        enum class State
+        {
+            Waiting,
+            Started,
+            Finished,
+        };
+
+        // Assigns levels to files which have not been started. The mutex
+        // must be held.
+        void Plan();
+
+        const double cpuBudget;
+        std::vector<Estimate> estimates;
+        double samplingCost = 0;
+
+        std::mutex mutex;
+        std::vector<std::size_t> plan;
+        std::vector<State> states;
+        double spent = 0;
+        double estimatedSpent = 0;
+        // Ratio between actual and estimated CPU time.
+        double correction = 1;
+        double plannedCorrection = 1;
+    };
+}
+}
@@ -12,5 +12,8 @@
 namespace facebook {
 namespace appx {
     std::string XMLEncodeString(const std::string &);
+
+    // Undoes XMLEncodeString. Other entities are left as-is.
+    std::string XMLDecodeString(const std::string &);
 }
 }
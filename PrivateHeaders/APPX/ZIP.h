@@ -7,9 +7,16 @@
 
 #pragma once
 
+#include <APPX/BlockMemo.h>
+#include <APPX/CachePolicy.h>
+#include <APPX/ContentType.h>
+#include <APPX/Deflate.h>
 #include <APPX/Encode.h>
 #include <APPX/File.h>
 #include <APPX/Hash.h>
+#include <APPX/InputSource.h>
+#include <APPX/Memory.h>
+#include <APPX/Probes.h>
 #include <APPX/Sink.h>
 #include <APPX/XML.h>
 #include <algorithm>
@@ -45,6 +52,16 @@ namespace appx {
         kArchiveExtractVersion = 45,
     };
 
+    // Approximate memory used while compressing a file, excluding the
+    // compressed data: zlib's deflate state at MAX_MEM_LEVEL and I/O buffers.
+    enum
+    {
+        kZIPFileEntryWorkingSetSize = 512 * 1024,
+        // Like kZIPFileEntryWorkingSetSize, for kExhaustiveCompression on one
+        // thread.
+        kExhaustiveZIPFileEntryWorkingSetSize = 8 * 1024 * 1024,
+    };
+
     enum class ZIPCompressionType : std::uint16_t
     {
         Store = 0,
@@ -77,6 +94,9 @@ namespace appx {
         };
     };
 
+    static_assert(static_cast<std::size_t>(ZIPBlock::kSize) == kZeroBlockSize,
+                  "Zero blocks must be ZIP blocks");
+
     struct ZIPFileEntry
     {
         std::string fileName;
@@ -118,6 +138,10 @@ namespace appx {
 
         static std::string SanitizedFileName(const std::string &fileName);
 
+        // Undoes SanitizedFileName.
+        static std::string UnsanitizedFileName(
+            const std::string &sanitizedFileName);
+
         off_t FileRecordHeaderSize() const
         {
             return 30 + this->sanitizedFileName.size();
@@ -204,14 +228,9 @@ namespace appx {
     //   with the
     //   number that represents the offset for FileName.appx.
     inline std::string _ManifestContentsAfterPopulatingOffsets(
-        const std::string &manifestInputFileName,
+        std::string manifestText,
         const std::vector<ZIPFileEntry> &otherEntries)
     {
-        std::ifstream manifestInput(manifestInputFileName);
-        std::string manifestText(
-            (std::istreambuf_iterator<char>(manifestInput)),
-            std::istreambuf_iterator<char>());
-
         // here we are creating offsets
         for (const ZIPFileEntry &entry : otherEntries) {
             std::string offsetTemplateName = entry.fileName + "-offset";
@@ -269,31 +288,29 @@ namespace appx {
     }
 
     // this writes [Content_Types].xml
+    //
+    // Each extension gets one Default element, found with a hash set, and
+    // each file without an extension an Override. Like the block map, the
+    // XML is streamed into a buffer which can spill to disk.
     template <typename TSink>
     ZIPFileEntry WriteContentTypesZIPFileEntry(
         TSink &sink, off_t offset, bool isBundle,
-        const std::vector<ZIPFileEntry> &otherEntries)
+        const std::vector<ZIPFileEntry> &otherEntries,
+        const ContentTypeRegistry &contentTypes = ContentTypeRegistry(),
+        MemoryBudget *budget = nullptr)
     {
-        // we only need the filenames from otherEntries
-        // [Content_Types].xml contains the ZIP-escaped
-        // names, hence the use of sanitizedFileName
-        std::unordered_map<std::string, const char *> sKnownContentTypes = {
-            {"appx", "application/vnd.ms-appx"},
-            {"dll", "application/x-msdownload"},
-                {"exe", "application/x-msdownload"},
-                {"png", "image/png"},
-            };
-        if (isBundle) {
-            sKnownContentTypes.emplace(
-                "xml", "application/vnd.ms-appx.bundlemanifest+xml");
-        } else {
-            sKnownContentTypes.emplace("xml",
-                                       "application/vnd.ms-appx.manifest+xml");
-        }
-
-        static const char *kDefaultContentType = "application/octet-stream";
-
+        SpillSink xmlSink(budget);
+        CRC32Sink crc32Sink;
+        SHA256Sink sha256Sink;
+        auto xmlHashSink = MakeMultiSink(xmlSink, crc32Sink, sha256Sink);
         std::ostringstream ss;
+        auto flush = [&]() {
+            std::string xml = ss.str();
+            xmlHashSink.Write(
+                xml.size(), reinterpret_cast<const std::uint8_t *>(xml.data()));
+            ss.str(std::string());
+        };
+
         ss << "<?xml "
            << "version=\"1.0\" "
            << "encoding=\"UTF-8\" "
@@ -302,40 +319,59 @@ namespace appx {
            << "xmlns=\"http://schemas.openxmlformats.org/package/2006/"
               "content-types\">";
 
-        std::vector<std::string> writtenExtensions;
+        // Parts whose content type does not follow from their extension.
+        static const std::unordered_map<std::string, const char *>
+            kPartContentTypes = {
+                {"AppxMetadata/AppxContentGroupMap.xml",
+                 "application/vnd.ms-appx.contentgroupmap+xml"},
+            };
+
+        // [Content_Types].xml contains the ZIP-escaped names, hence the use
+        // of sanitizedFileName. Extensions are deduplicated in lower case,
+        // but written as first seen.
+        std::unordered_set<std::string> writtenExtensions;
+        std::string extension;
         for (const ZIPFileEntry &entry : otherEntries) {
-            std::size_t baseNamePos = entry.sanitizedFileName.rfind('/') + 1;
-            std::size_t extensionPos = entry.sanitizedFileName.rfind('.') + 1;
+            const std::string &name = entry.sanitizedFileName;
+            if (name == "AppxMetadata/CodeIntegrity.cat") {
+                // Declared below.
+                continue;
+            }
+            auto partContentTypeIt = kPartContentTypes.find(name);
+            if (partContentTypeIt != kPartContentTypes.end()) {
+                ss << "<Override "
+                   << "PartName=\"/" << XMLEncodeString(name) << "\" "
+                   << "ContentType=\""
+                   << XMLEncodeString(partContentTypeIt->second) << "\"/>";
+                flush();
+                continue;
+            }
+            std::size_t baseNamePos = name.rfind('/') + 1;
+            std::size_t extensionPos = name.rfind('.') + 1;
             bool hasExtension = extensionPos > baseNamePos;
-            if (hasExtension) {
-                std::string extension(
-                    entry.sanitizedFileName.cbegin() + extensionPos,
-                    entry.sanitizedFileName.cend());
-                bool notWritten =
-                    std::find(writtenExtensions.begin(),
-                              writtenExtensions.end(),
-                              extension) == writtenExtensions.end();
-                if (notWritten) {
-                    auto contentTypeIt = sKnownContentTypes.find(extension);
-                    const char *contentType;
-                    if (contentTypeIt != sKnownContentTypes.end()) {
-                        contentType = contentTypeIt->second;
-                    } else {
-                        contentType = kDefaultContentType;
-                    }
-                    ss << "<Default "
-                       << "Extension=\"" << XMLEncodeString(extension) << "\" "
-                       << "ContentType=\"" << XMLEncodeString(contentType)
-                       << "\"/>";
-                    writtenExtensions.push_back(extension);
-                }
-            } else {
+            if (!hasExtension) {
+                // OPC has no way to give files without an extension a type
+                // other than naming each one.
                 ss << "<Override "
-                   << "PartName=\"/" << XMLEncodeString(entry.sanitizedFileName)
-                   << "\" "
-                   << "ContentType=\"" << XMLEncodeString(kDefaultContentType)
-                   << "\"/>";
+                   << "PartName=\"/" << XMLEncodeString(name) << "\" "
+                   << "ContentType=\""
+                   << ContentTypeRegistry::kDefaultContentType << "\"/>";
+                flush();
+                continue;
             }
+            // extension's buffer is reused, so only new extensions allocate.
+            extension.assign(name, extensionPos, std::string::npos);
+            ContentTypeRegistry::ToLower(extension);
+            if (!writtenExtensions.insert(extension).second) {
+                continue;
+            }
+            ss << "<Default "
+               << "Extension=\""
+               << XMLEncodeString(name.substr(extensionPos)) << "\" "
+               << "ContentType=\""
+               << XMLEncodeString(contentTypes.Find(extension, isBundle))
+               << "\"/>";
+            flush();
         }
 
         ss << "<Override "
@@ -348,29 +384,38 @@ namespace appx {
            << "PartName=\"/AppxMetadata/CodeIntegrity.cat\" "
            << "ContentType=\"application/vnd.ms-pkiseccat\"/>";
         ss << "</Types>";
+        flush();
 
-        const std::string xml(ss.str());
-        const std::uint8_t *xmlBytes =
-            reinterpret_cast<const std::uint8_t *>(xml.c_str());
-        std::size_t xmlSize = xml.size();
-        CRC32Sink crc32Sink;
-        crc32Sink.Write(xmlSize, xmlBytes);
+        std::size_t xmlSize = xmlSink.Size();
         assert(xmlSize < std::numeric_limits<off_t>::max());
         ZIPFileEntry entry("[Content_Types].xml", static_cast<off_t>(xmlSize),
-                           offset, crc32Sink.CRC32(), {},
-                           SHA256Hash::DigestFromBytes(xmlSize, xmlBytes));
+                           offset, crc32Sink.CRC32(), {}, sha256Sink.SHA256());
         entry.WriteFileRecordHeader(sink);
-        sink.Write(xmlSize, xmlBytes);
+        xmlSink.CopyTo(sink);
         return entry;
     }
 
     template <typename TSink>
     ZIPFileEntry WriteAppxBlockMapZIPFileEntry(
         TSink &sink, off_t offset,
-        const std::vector<ZIPFileEntry> &otherEntries, bool isBundle)
+        const std::vector<ZIPFileEntry> &otherEntries, bool isBundle,
+        MemoryBudget *budget = nullptr)
     {
-        // https://msdn.microsoft.com/en-us/library/windows/desktop/jj709951.aspx
+        // The block map can be large for large packages, so the XML is
+        // streamed into a buffer which can spill to disk.
+        SpillSink xmlSink(budget);
+        CRC32Sink crc32Sink;
+        SHA256Sink sha256Sink;
+        auto xmlHashSink = MakeMultiSink(xmlSink, crc32Sink, sha256Sink);
         std::ostringstream ss;
+        auto flush = [&]() {
+            std::string xml = ss.str();
+            xmlHashSink.Write(
+                xml.size(), reinterpret_cast<const std::uint8_t *>(xml.data()));
+            ss.str(std::string());
+        };
+
+        // https://msdn.microsoft.com/en-us/library/windows/desktop/jj709951.aspx
         ss << "<?xml "
            << "version=\"1.0\" "
            << "encoding=\"UTF-8\" "
@@ -403,27 +448,16 @@ namespace appx {
                 ss << "/>";
             }
             ss << "</File>";
+            flush();
         }
         ss << "</BlockMap>";
-        std::string xml = ss.str();
-        std::size_t xmlSize = xml.size();
-        const std::uint8_t *xmlBytes =
-            reinterpret_cast<const std::uint8_t *>(xml.c_str());
-        std::uint32_t crc32;
-        SHA256Hash sha256;
-        {
-            CRC32Sink crc32Sink;
-            SHA256Sink sha256Sink;
-            auto sink = MakeMultiSink(crc32Sink, sha256Sink);
-            sink.Write(xmlSize, xmlBytes);
-            crc32 = crc32Sink.CRC32();
-            sha256 = sha256Sink.SHA256();
-        }
-        assert(xml.size() < std::numeric_limits<off_t>::max());
+        flush();
+        std::size_t xmlSize = xmlSink.Size();
+        assert(xmlSize < std::numeric_limits<off_t>::max());
         ZIPFileEntry entry("AppxBlockMap.xml", static_cast<off_t>(xmlSize),
-                           offset, crc32, {}, sha256);
+                           offset, crc32Sink.CRC32(), {}, sha256Sink.SHA256());
         entry.WriteFileRecordHeader(sink);
-        sink.Write(xmlSize, xmlBytes);
+        xmlSink.CopyTo(sink);
         return entry;
     }
 
@@ -432,17 +466,38 @@ namespace appx {
         template <typename TSink>
         void operator()(TSink &sink) const
         {
-            std::string manifestText = _ManifestContentsAfterPopulatingOffsets(
-                this->inputFileName, this->otherEntries);
+            std::string manifestText;
+            this->source.Read(
+                this->inputFileName, CachePolicy::Default,
+                [&manifestText](std::size_t size, const std::uint8_t *bytes) {
+                    manifestText.append(reinterpret_cast<const char *>(bytes),
+                                        size);
+                });
+            manifestText = _ManifestContentsAfterPopulatingOffsets(
+                std::move(manifestText), this->otherEntries);
             sink.Write(
                 manifestText.size(),
                 reinterpret_cast<const std::uint8_t *>(manifestText.c_str()));
         }
 
+        InputSource &source;
         const std::string &inputFileName;
         const std::vector<ZIPFileEntry> &otherEntries;
     };
 
+    // Helper for WriteZIPFileEntry which writes an in-memory string.
+    struct WriteStringFunc
+    {
+        template <typename TSink>
+        void operator()(TSink &sink) const
+        {
+            sink.Write(this->data.size(),
+                       reinterpret_cast<const std::uint8_t *>(this->data.data()));
+        }
+
+        const std::string &data;
+    };
+
     // Write the ZIP file record header and data to sink, reading the data using
     // dataCallback.
     //
@@ -450,62 +505,152 @@ namespace appx {
     // template <typename TSink> void dataCallback(TSink &);
     //
     // dataCallback is called at most once.
+    //
+    // If budget is not null, compression waits until the budget allows
+    // kZIPFileEntryWorkingSetSize more bytes, and the compressed data is
+    // spilled to disk if the budget does not allow buffering it in memory.
+    //
+    // compressionLevel may be kExhaustiveCompression, in which case blocks
+    // are compressed on up to 'jobs' threads. (Only one thread is used if
+    // the budget is limited.)
+    //
+    // If memo is not null, compressed blocks are looked up in and added to
+    // memo.
     template <typename TSink, typename TSource>
     ZIPFileEntry WriteZIPFileEntry(TSink &sink, off_t offset,
                                    const std::string &archiveFileName,
-                                   int compressionLevel, TSource &&dataCallback)
+                                   int compressionLevel, TSource &&dataCallback,
+                                   MemoryBudget *budget = nullptr,
+                                   unsigned jobs = 1, BlockMemo *memo = nullptr)
     {
+        APPX_PROBE2(entry_start, archiveFileName.c_str(), compressionLevel);
         std::uint32_t crc32;
         off_t uncompressedFileSize;
         off_t compressedFileSize;
-        std::vector<uint8_t> data;
+        SpillSink dataSink(budget);
         std::vector<ZIPBlock> blocks;
         ZIPCompressionType compressionType;
         {
+            WorkingSetReservation workingSet(
+                budget, compressionLevel == kExhaustiveCompression
+                            ? kExhaustiveZIPFileEntryWorkingSetSize
+                            : kZIPFileEntryWorkingSetSize);
             if (_IsAPPXFile(archiveFileName)) {
                 compressionLevel = Z_NO_COMPRESSION;
             }
 
             CRC32Sink crc32Sink;
-            VectorSink dataSink(data);
             // TODO(strager): Instead of writing the data to memory, write the
             // header after the data.
             if (compressionLevel == Z_NO_COMPRESSION) {
                 OffsetSink offsetSink;
                 auto chunkSink = MakeChunkSink(ZIPBlock::kSize,
                                                []() { return SHA256Sink(); });
+                chunkSink.SetChunkCallback([&blocks](SHA256Sink &&chunk) {
+                    blocks.push_back(ZIPBlock(chunk.SHA256()));
+                });
                 auto sink =
                     MakeMultiSink(crc32Sink, offsetSink, dataSink, chunkSink);
                 dataCallback(sink);
                 chunkSink.Close();
-                for (const SHA256Sink &chunk : chunkSink.Chunks()) {
-                    blocks.push_back(ZIPBlock(chunk.SHA256()));
-                }
                 uncompressedFileSize = offsetSink.Offset();
                 compressedFileSize = uncompressedFileSize;
                 compressionType = ZIPCompressionType::Store;
-            } else {
+            } else if (compressionLevel == kExhaustiveCompression) {
                 OffsetSink compressedOffsetSink;
                 auto targetSink = MakeMultiSink(dataSink, compressedOffsetSink);
+                ExhaustiveDeflateSink<decltype(targetSink)> deflateSink(
+                    ZIPBlock::kSize, budget && budget->Limit() ? 1 : jobs,
+                    targetSink,
+                    [&blocks](const SHA256Hash &sha256, off_t compressedSize) {
+                        blocks.push_back(ZIPBlock(sha256, compressedSize));
+                    },
+                    memo);
+                OffsetSink uncompressedOffsetSink;
+                auto sink = MakeMultiSink(deflateSink, uncompressedOffsetSink,
+                                          crc32Sink);
+                dataCallback(sink);
+                deflateSink.Close();
+                uncompressedFileSize = uncompressedOffsetSink.Offset();
+                compressedFileSize = compressedOffsetSink.Offset();
+                compressionType = ZIPCompressionType::Deflate;
+            } else {
+                // Collects a block's compressed bytes to add to memo.
+                struct CaptureSink
+                {
+                    void Write(std::size_t size, const std::uint8_t *bytes)
+                    {
+                        if (this->compressed) {
+                            this->compressed->insert(this->compressed->end(),
+                                                     bytes, bytes + size);
+                        }
+                    }
+
+                    std::vector<std::uint8_t> *compressed = nullptr;
+                };
+                OffsetSink compressedOffsetSink;
+                CaptureSink captureSink;
+                auto targetSink =
+                    MakeMultiSink(dataSink, compressedOffsetSink, captureSink);
                 struct Chunk
                 {
                     Chunk(DeflateSink<decltype(targetSink)> &deflateSink,
-                          OffsetSink &deflateOffsetSink)
+                          OffsetSink &deflateOffsetSink,
+                          decltype(targetSink) &outputSink,
+                          CaptureSink &captureSink, BlockMemo *memo,
+                          int compressionLevel)
                         : deflateSink(&deflateSink),
-                          deflateOffsetSink(&deflateOffsetSink)
+                          deflateOffsetSink(&deflateOffsetSink),
+                          outputSink(&outputSink),
+                          captureSink(&captureSink),
+                          memo(memo),
+                          compressionLevel(compressionLevel)
                     {
                         this->startOffset = this->deflateOffsetSink->Offset();
                     }
 
                     void Write(std::size_t size, const std::uint8_t *bytes)
                     {
+                        this->size += size;
                         this->sha256Sink.Write(size, bytes);
-                        this->deflateSink->Write(size, bytes);
+                        if (this->memo) {
+                            // Compressed in Close unless memoized.
+                            this->data.insert(this->data.end(), bytes,
+                                              bytes + size);
+                        } else {
+                            this->deflateSink->Write(size, bytes);
+                        }
+                    }
+
+                    // A whole block of zeros is not hashed or compressed.
+                    void WriteZeros(off_t size)
+                    {
+                        if (this->size == 0 && size == ZIPBlock::kSize) {
+                            this->isZeroBlock = true;
+                            this->size = size;
+                            const std::vector<std::uint8_t> &compressed =
+                                CompressedZeroBlock(this->compressionLevel);
+                            this->outputSink->Write(compressed.size(),
+                                                    compressed.data());
+                            return;
+                        }
+                        while (size > 0) {
+                            std::size_t count = static_cast<std::size_t>(
+                                std::min<off_t>(size, kZeroBlockSize));
+                            this->Write(count, kZeroBlock);
+                            size -= count;
+                        }
                     }
 
                     void Close()
                     {
-                        this->deflateSink->Flush();
+                        if (this->isZeroBlock) {
+                            // Already written.
+                        } else if (this->memo) {
+                            this->CloseMemoized();
+                        } else {
+                            this->deflateSink->Flush();
+                        }
                         this->endOffset = this->deflateOffsetSink->Offset();
                     }
 
@@ -516,32 +661,65 @@ namespace appx {
 
                     SHA256Hash SHA256() const
                     {
-                        return this->sha256Sink.SHA256();
+                        return this->isZeroBlock ? ZeroBlockSHA256()
+                                                 : this->sha256Sink.SHA256();
                     }
 
                 private:
+                    // After a flush, the deflate stream is as if new, so a
+                    // block's compressed bytes depend only on its data.
+                    void CloseMemoized()
+                    {
+                        if (this->data.empty()) {
+                            // ChunkSink closes an empty chunk at the end.
+                            return;
+                        }
+                        SHA256Hash sha256 = this->sha256Sink.SHA256();
+                        std::vector<std::uint8_t> compressed;
+                        if (this->memo->Find(sha256, this->compressionLevel,
+                                             this->data.size(), compressed)) {
+                            this->outputSink->Write(compressed.size(),
+                                                    compressed.data());
+                            return;
+                        }
+                        this->captureSink->compressed = &compressed;
+                        this->deflateSink->Write(this->data.size(),
+                                                 this->data.data());
+                        this->deflateSink->Flush();
+                        this->captureSink->compressed = nullptr;
+                        this->memo->Add(sha256, this->compressionLevel,
+                                        std::move(compressed));
+                    }
+
                     SHA256Sink sha256Sink;
                     DeflateSink<decltype(targetSink)> *deflateSink;
                     OffsetSink *deflateOffsetSink;
+                    decltype(targetSink) *outputSink;
+                    CaptureSink *captureSink;
+                    BlockMemo *memo;
+                    int compressionLevel;
+                    std::vector<std::uint8_t> data;
+                    off_t size = 0;
+                    bool isZeroBlock = false;
                     off_t startOffset;
                     off_t endOffset;
                 };
                 auto deflateSink =
-                    MakeDeflateSink(Z_BEST_COMPRESSION, targetSink);
-                auto chunkSink = MakeChunkSink(
-                    ZIPBlock::kSize, [&deflateSink, &compressedOffsetSink]() {
-                        return Chunk(deflateSink, compressedOffsetSink);
-                    });
+                    MakeDeflateSink(compressionLevel, targetSink);
+                auto chunkSink = MakeChunkSink(ZIPBlock::kSize, [&]() {
+                    return Chunk(deflateSink, compressedOffsetSink, targetSink,
+                                 captureSink, memo, compressionLevel);
+                });
+                chunkSink.SetChunkCallback([&blocks](Chunk &&chunk) {
+                    blocks.push_back(
+                        ZIPBlock(chunk.SHA256(), chunk.CompressedSize()));
+                });
                 OffsetSink uncompressedOffsetSink;
                 auto sink =
                     MakeMultiSink(chunkSink, uncompressedOffsetSink, crc32Sink);
                 dataCallback(sink);
                 chunkSink.Close();
                 deflateSink.Close();
-                for (const Chunk &chunk : chunkSink.Chunks()) {
-                    blocks.push_back(
-                        ZIPBlock(chunk.SHA256(), chunk.CompressedSize()));
-                }
                 uncompressedFileSize = uncompressedOffsetSink.Offset();
                 compressedFileSize = compressedOffsetSink.Offset();
                 compressionType = ZIPCompressionType::Deflate;
@@ -552,34 +730,27 @@ namespace appx {
                            uncompressedFileSize, compressionType, offset, crc32,
                            blocks, SHA256Hash());
         entry.WriteFileRecordHeader(sink);
-        sink.Write(data.size(), data.data());
+        dataSink.CopyTo(sink);
+        APPX_PROBE3(entry_finish, archiveFileName.c_str(),
+                    static_cast<std::uint64_t>(uncompressedFileSize),
+                    static_cast<std::uint64_t>(compressedFileSize));
         return entry;
     }
 
-    // Helper for WriteZIPFileEntry.
-    struct WriteZIPFileEntryFunc
-    {
-        template <typename TSink>
-        void operator()(TSink &sink) const
-        {
-            FilePtr file = Open(this->inputFileName, "rb");
-            Copy(file, sink);
-        }
-
-        const std::string &inputFileName;
-    };
-
     // Write the ZIP file record header and data to sink, reading the data from
-    // a file.
+    // an input source.
     template <typename TSink>
-    ZIPFileEntry WriteZIPFileEntry(TSink &sink, off_t offset,
-                                   const std::string &inputFileName,
-                                   const std::string &archiveFileName,
-                                   int compressionLevel)
+    ZIPFileEntry WriteZIPFileEntry(
+        TSink &sink, off_t offset, InputSource &source,
+        const std::string &inputFileName, const std::string &archiveFileName,
+        int compressionLevel, MemoryBudget *budget = nullptr,
+        CachePolicy cachePolicy = CachePolicy::Default, unsigned jobs = 1,
+        BlockMemo *memo = nullptr)
     {
-        return WriteZIPFileEntry(sink, offset, archiveFileName,
-                                 compressionLevel,
-                                 WriteZIPFileEntryFunc{inputFileName});
+        return WriteZIPFileEntry(
+            sink, offset, archiveFileName, compressionLevel,
+            WriteInputSourceFunc{source, inputFileName, cachePolicy}, budget,
+            jobs, memo);
     }
 }
 }
@@ -0,0 +1,148 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/File.h>
+#include <APPX/InputSource.h>
+#include <APPX/ZIP.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    // Reads files from an existing ZIP archive (including ZIP64). Thread-safe.
+    class ZIPReader
+    {
+    public:
+        struct Entry
+        {
+            // The archive name, with ZIP escaping undone.
+            std::string fileName;
+            ZIPCompressionType compressionType;
+            std::uint32_t crc32;
+            off_t compressedSize;
+            off_t uncompressedSize;
+            off_t fileRecordHeaderOffset;
+            // Offset of the (compressed) data following the file record
+            // header.
+            off_t dataOffset;
+            // True if the block map is loaded and lists the entry.
+            bool hasBlockMap = false;
+            // The entry's blocks from the block map.
+            std::vector<ZIPBlock> blocks;
+            // True if each block of compressed data can be inflated on its
+            // own, starting at the sum of the previous blocks' sizes. Cleared
+            // by ReadAt (under the reader's lock) if a block cannot be.
+            mutable bool canReadBlocks = false;
+        };
+
+        // Reads the central directory. Throws std::runtime_error if the
+        // file is not a ZIP archive or uses unsupported features, such as
+        // encryption or compression other than DEFLATE.
+        explicit ZIPReader(const std::string &path);
+        // Reads an open file, such as a package extracted to a temporary
+        // file. 'name' is used in errors. The file may be closed afterwards.
+        ZIPReader(const FilePtr &file, const std::string &name);
+        ~ZIPReader();
+
+        ZIPReader(const ZIPReader &) = delete;
+        ZIPReader &operator=(const ZIPReader &) = delete;
+
+        // Entries in central directory order.
+        const std::vector<Entry> &Entries() const
+        {
+            return this->entries;
+        }
+
+        // Returns the entry with the given archive name, or null.
+        const Entry *Find(const std::string &fileName) const;
+
+        // Reads AppxBlockMap.xml, if present, so ReadAt can inflate only the
+        // blocks it needs. Throws std::runtime_error if the block map does
+        // not match the entries. Not thread-safe.
+        void LoadBlockMap();
+
+        // Reads an entry's uncompressed data. Throws std::runtime_error if
+        // the data does not match the entry's size or CRC-32.
+        void Read(const Entry &entry,
+                  const InputSource::WriteFunc &write) const;
+
+        // Reads up to size bytes of an entry's uncompressed data starting at
+        // offset, returning the number of bytes read. Compressed entries are
+        // inflated from the first block needed if the block map is loaded,
+        // using up to 'jobs' threads, and from the start otherwise. If the
+        // block map is loaded, throws std::runtime_error if a compressed
+        // block holding the range does not match its hash.
+        std::size_t ReadAt(const Entry &entry, off_t offset, std::size_t size,
+                           std::uint8_t *bytes, unsigned jobs = 1) const;
+
+    private:
+        // ReadAt for a compressed entry with block sizes. Returns false if
+        // a block does not inflate on its own (as in packages written by
+        // tools which do not flush between blocks) or does not match its
+        // hash.
+        bool ReadBlocksAt(const Entry &entry, off_t offset, std::size_t size,
+                          std::uint8_t *bytes, unsigned jobs) const;
+
+        // Reads the central directory of fd. Closes fd on failure.
+        void ReadCentralDirectory();
+
+        // Reads exactly size bytes at offset.
+        void PRead(off_t offset, std::size_t size, std::uint8_t *bytes) const;
+
+        // Calls write with consecutive pieces of an entry's uncompressed
+        // data until write returns false. Returns the CRC-32 and size of the
+        // data read.
+        std::pair<std::uint32_t, off_t> Stream(
+            const Entry &entry,
+            const std::function<bool(std::size_t, const std::uint8_t *)>
+                &write) const;
+
+        std::string path;
+        int fd;
+        std::vector<Entry> entries;
+        std::unordered_map<std::string, std::size_t> entryIndexes;
+        // Guards the entries' canReadBlocks.
+        mutable std::mutex mutex;
+    };
+
+    // Reads inputs from an existing package. Paths are archive names.
+    class ZIPInputSource : public InputSource
+    {
+    public:
+        explicit ZIPInputSource(const ZIPReader &reader) : reader(reader)
+        {
+        }
+
+        // Serves path from contents instead of the package.
+        void Replace(const std::string &path, std::string contents);
+        // Serves path from a file, such as a temporary file, instead of the
+        // package.
+        void Replace(const std::string &path, FilePtr file);
+
+        off_t Size(const std::string &path) override;
+        void Read(const std::string &path, CachePolicy policy,
+                  const WriteFunc &write) override;
+        std::size_t ReadAt(const std::string &path, off_t offset,
+                           std::size_t size, std::uint8_t *bytes) override;
+
+    private:
+        const ZIPReader::Entry &Entry(const std::string &path) const;
+
+        const ZIPReader &reader;
+        std::unordered_map<std::string, std::string> replacements;
+        std::unordered_map<std::string, FilePtr> fileReplacements;
+    };
+}
+}
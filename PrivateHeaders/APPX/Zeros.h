@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#pragma once
+
+#include <APPX/Hash.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+// Fast paths for runs of zero bytes, such as holes in sparse files and
+// zero padding.
+//
+// A sink may have a WriteZeros(off_t size) method, called (through
+// WriteZeroBytes) instead of Write with size zero bytes. Sinks without one
+// are written zeros as usual.
+
+namespace facebook {
+namespace appx {
+    // Size of a zero block, which is a block of AppxBlockMap.xml (see
+    // ZIPBlock::kSize).
+    enum : std::size_t
+    {
+        kZeroBlockSize = 65536
+    };
+
+    // kZeroBlockSize zero bytes.
+    extern const std::uint8_t kZeroBlock[kZeroBlockSize];
+
+    // Returns true if all of the bytes are zero.
+    bool IsZero(std::size_t size, const std::uint8_t *bytes);
+
+    // Returns the CRC-32 of size zero bytes, in O(log size) time.
+    std::uint32_t ZerosCRC32(off_t size);
+
+    // Returns the SHA-256 of a zero block.
+    const SHA256Hash &ZeroBlockSHA256();
+
+    // Returns a zero block compressed at compressionLevel (which may be
+    // kExhaustiveCompression) as a block of WriteZIPFileEntry: compressed
+    // by DeflateSink and flushed, or by ExhaustiveDeflate. Computed once
+    // per level.
+    const std::vector<std::uint8_t> &CompressedZeroBlock(int compressionLevel);
+
+    template <typename TSink>
+    auto WriteZeroBytesImpl(TSink &sink, off_t size, int)
+        -> decltype(sink.WriteZeros(size), void())
+    {
+        sink.WriteZeros(size);
+    }
+
+    template <typename TSink>
+    void WriteZeroBytesImpl(TSink &sink, off_t size, long)
+    {
+        while (size > 0) {
+            std::size_t count = static_cast<std::size_t>(
+                std::min<off_t>(size, kZeroBlockSize));
+            sink.Write(count, kZeroBlock);
+            size -= count;
+        }
+    }
+
+    // Writes size zero bytes to a sink, with its WriteZeros method if it
+    // has one.
+    template <typename TSink>
+    void WriteZeroBytes(TSink &sink, off_t size)
+    {
+        WriteZeroBytesImpl(sink, size, 0);
+    }
+}
+}
@@ -5,40 +5,46 @@
 // This source code is licensed under the BSD-style license found in the
 // LICENSE file in the root directory of this source tree.
 
+#include <APPX/APPX.h>
+#include <APPX/CachePolicy.h>
+#include <APPX/Checkpoint.h>
+#include <APPX/CodeIntegrity.h>
 #include <APPX/File.h>
+#include <APPX/Incremental.h>
+#include <APPX/Index.h>
+#include <APPX/Memory.h>
+#include <APPX/Parallel.h>
+#include <APPX/Probes.h>
 #include <APPX/Sign.h>
 #include <APPX/Sink.h>
+#include <APPX/Tuning.h>
 #include <APPX/ZIP.h>
+#include <APPX/ZIPReader.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 namespace facebook {
 namespace appx {
     namespace {
-        // TODO(strager): Stream data instead of returning a chunk of memory.
-        std::vector<std::uint8_t> GetSignatureBytes(PKCS7 *signature)
+        // Buffer size for hashing the start of a package.
+        enum
         {
-            BIOPtr out(BIO_new(BIO_s_mem()));
-            if (!out) {
-                throw OpenSSLException();
-            }
-            if (!i2d_PKCS7_bio(out.get(), signature)) {
-                throw OpenSSLException();
-            }
-            if (BIO_flush(out.get()) != 1) {
-                throw OpenSSLException();
-            }
-            BUF_MEM *buffer;
-            if (BIO_get_mem_ptr(out.get(), &buffer) < 0) {
-                throw OpenSSLException();
-            }
-            const std::uint8_t *data =
-                reinterpret_cast<const std::uint8_t *>(buffer->data);
-            return std::vector<std::uint8_t>(data, data + buffer->length);
-        }
+            kHashBufferSize = 1024 * 1024,
+        };
 
         // Creates the AppxSignature.p7x file and inserts it into the ZIP.
         template <typename TSink>
@@ -50,10 +56,13 @@ namespace appx {
             std::uint32_t crc32;
             off_t uncompressedSize;
             {
+                APPX_PROBE1(sign_start, certPath.c_str());
                 OpenSSLPtr<PKCS7, PKCS7_free> signature =
                     Sign(certPath, digests);
                 std::vector<std::uint8_t> signatureData =
                     GetSignatureBytes(signature.get());
+                APPX_PROBE1(sign_finish,
+                            static_cast<std::uint64_t>(signatureData.size()));
 
                 VectorSink vectorSink(compressedSignatureData);
                 auto deflateSink =
@@ -80,91 +89,913 @@ namespace appx {
                        compressedSignatureData.data());
             return entry;
         }
-    }
 
-    void WriteAppx(
-        const FilePtr &zip,
-        const std::unordered_map<std::string, std::string> &fileNames,
-        const std::string *certPath, int compressionLevel, bool isBundle)
-    {
-        FileSink zipRawSink(zip.get());
-        OffsetSink zipOffsetSink;
-        auto zipSink = MakeMultiSink(zipRawSink, zipOffsetSink);
-        std::vector<ZIPFileEntry> zipFileEntries;
-        std::pair<std::string, std::string> appxBundleManifest;
+        // Returns the compression level for inputs[index].
+        int CompressionLevel(CompressionTuner *tuner, std::size_t index,
+                             int compressionLevel)
+        {
+            return tuner ? tuner->Level(index) : compressionLevel;
+        }
+
+        // Helper for WriteZIPFileEntry which also writes the data read by
+        // another helper to hashSink.
+        template <typename TSource, typename THashSink>
+        struct HashingFunc
+        {
+            template <typename TSink>
+            void operator()(TSink &sink)
+            {
+                auto hashingSink = MakeMultiSink(sink, this->hashSink);
+                this->source(hashingSink);
+            }
 
-        APPXDigests digests;
+            TSource source;
+            THashSink &hashSink;
+        };
 
-        // Write and hash the ZIP content.
+        // Writes an input's file record. If catalog is not null, binaries
+        // are hashed into it as they are read.
+        template <typename TSink>
+        ZIPFileEntry WriteInputZIPFileEntry(
+            TSink &sink, off_t offset, InputSource &source,
+            const FileListEntry &input, int compressionLevel,
+            MemoryBudget *budget, CachePolicy cachePolicy, unsigned jobs,
+            BlockMemo *memo, CodeIntegrityCatalog *catalog)
         {
-            SHA256Sink axpcSink;
-            auto sink = MakeMultiSink(zipSink, axpcSink);
-            for (const auto &fileNamePair : fileNames) {
-                const std::string &archiveName = fileNamePair.first;
-                const std::string &fileName = fileNamePair.second;
+            const std::string &archiveName = input.first;
+            WriteInputSourceFunc read{source, input.second, cachePolicy};
+            if (!catalog || !CodeIntegrityCatalog::IsMember(archiveName)) {
+                if (catalog && archiveName == kCodeIntegrityCatalogName) {
+                    throw std::runtime_error(
+                        std::string(kCodeIntegrityCatalogName) +
+                        " is generated when signing and must not be an "
+                        "input");
+                }
+                return WriteZIPFileEntry(sink, offset, archiveName,
+                                         compressionLevel, read, budget,
+                                         jobs, memo);
+            }
+            PEImageHashSink hashSink;
+            ZIPFileEntry entry = WriteZIPFileEntry(
+                sink, offset, archiveName, compressionLevel,
+                HashingFunc<WriteInputSourceFunc, PEImageHashSink>{read,
+                                                                  hashSink},
+                budget, jobs, memo);
+            catalog->Add(archiveName, hashSink);
+            return entry;
+        }
 
-                const std::string suffix = "AppxBundleManifest.xml";
-                if (isBundle &&
-                        suffix.size() < archiveName.size() &&
-                        std::equal(suffix.rbegin(), suffix.rend(), archiveName.rbegin())) {
-                    appxBundleManifest = fileNamePair;
-                    continue;
+        // Adds binaries which are already in the package to catalog,
+        // reading them again. Files are pairs of archive names and paths
+        // in source.
+        void AddToCatalog(CodeIntegrityCatalog &catalog,
+                          const std::vector<FileListEntry> &files,
+                          InputSource &source, CachePolicy cachePolicy,
+                          unsigned jobs)
+        {
+            std::vector<const FileListEntry *> binaries;
+            for (const FileListEntry &file : files) {
+                if (CodeIntegrityCatalog::IsMember(file.first)) {
+                    binaries.push_back(&file);
                 }
+            }
+            ParallelFor(binaries.size(), jobs, [&](std::size_t i) {
+                PEImageHashSink hashSink;
+                source.Read(binaries[i]->second, cachePolicy,
+                            [&hashSink](std::size_t size,
+                                        const std::uint8_t *bytes) {
+                                hashSink.Write(size, bytes);
+                            });
+                catalog.Add(binaries[i]->first, hashSink);
+            });
+        }
 
-                zipFileEntries.emplace_back(
-                    WriteZIPFileEntry(sink, zipOffsetSink.Offset(), fileName,
-                                      archiveName, compressionLevel));
+        // Returns true if the file descriptor supports pwrite.
+        bool IsSeekable(int fd)
+        {
+            return lseek(fd, 0, SEEK_CUR) != -1;
+        }
+
+        // Hashes the next 'size' bytes of a file. Returns false if the file
+        // is shorter.
+        template <typename TSink>
+        bool HashBytes(const FilePtr &file, off_t size, TSink &sink)
+        {
+            std::vector<std::uint8_t> buffer(static_cast<std::size_t>(
+                std::min<off_t>(kHashBufferSize, size)));
+            for (off_t offset = 0; offset < size;) {
+                std::size_t chunkSize = static_cast<std::size_t>(
+                    std::min<off_t>(buffer.size(), size - offset));
+                if (Read(file, chunkSize, buffer.data()) != chunkSize) {
+                    return false;
+                }
+                sink.Write(chunkSize, buffer.data());
+                offset += chunkSize;
             }
+            return true;
+        }
 
-            if (isBundle) {
-                ZIPFileEntry appxBundleManifestEntry = WriteZIPFileEntry(
-                    sink, zipOffsetSink.Offset(), appxBundleManifest.first,
-                    compressionLevel,
-                    WriteAppxBundleManifestFunc{appxBundleManifest.second,
-                                                zipFileEntries});
-                zipFileEntries.emplace_back(std::move(appxBundleManifestEntry));
+        // Hashes the first 'size' bytes of a file. Returns false if the file
+        // is shorter.
+        template <typename TSink>
+        bool HashPrefix(const FilePtr &file, off_t size, TSink &sink)
+        {
+            Seek(file, 0, SEEK_SET);
+            return HashBytes(file, size, sink);
+        }
+
+        // Restores the AXPC hash state and the catalog's image hashes for
+        // the records an append keeps, entries, which are contiguous from
+        // the start of the package. They come from incremental's sidecar if
+        // it describes the package, so the append costs nothing per kept
+        // record; otherwise the records, and the binaries (from source by
+        // archive name), are read again.
+        //
+        // Returns the kept records as inputs for the next sidecar. Their
+        // local paths and stamps are empty unless the sidecar had them for
+        // the same compression level.
+        std::vector<IncrementalBuild::Input> RestoreAppendedRecords(
+            const FilePtr &zip, const std::vector<ZIPFileEntry> &entries,
+            const IncrementalBuild *incremental, int compressionLevel,
+            CodeIntegrityCatalog *catalog, InputSource &source,
+            CachePolicy cachePolicy, unsigned jobs, SHA256Sink &axpcSink)
+        {
+            std::vector<IncrementalBuild::Input> inputs;
+            if (incremental && incremental->Describes(entries, zip.get())) {
+                inputs = incremental->Inputs();
+                if (incremental->CompressionLevel() != compressionLevel) {
+                    for (IncrementalBuild::Input &input : inputs) {
+                        input.localPath.clear();
+                        input.stamp.clear();
+                    }
+                }
+                if (!inputs.empty()) {
+                    axpcSink = inputs.back().record.axpcSink;
+                }
+                if (catalog && incremental->IsSigned()) {
+                    for (const IncrementalBuild::Input &input : inputs) {
+                        if (input.hasImageHash) {
+                            catalog->Add(input.record.entry.fileName,
+                                         input.imageHash);
+                        }
+                    }
+                    return inputs;
+                }
+            } else if (catalog || incremental) {
+                Seek(zip, 0, SEEK_SET);
+                for (const ZIPFileEntry &entry : entries) {
+                    off_t size = entry.FileRecordSize();
+                    if (!HashBytes(zip, size, axpcSink)) {
+                        throw std::runtime_error("Unexpected end of file");
+                    }
+                    inputs.push_back(IncrementalBuild::Input{
+                        {entry, entry.fileRecordHeaderOffset + size,
+                         axpcSink},
+                        "", "", false, SHA256Hash(), 0});
+                }
             }
+            if (catalog) {
+                std::vector<FileListEntry> files;
+                for (const ZIPFileEntry &entry : entries) {
+                    files.emplace_back(entry.fileName, entry.fileName);
+                }
+                AddToCatalog(*catalog, files, source, cachePolicy, jobs);
+            }
+            return inputs;
+        }
 
-            // this creates AppxBlockMap.xml file
-            ZIPFileEntry blockMap = WriteAppxBlockMapZIPFileEntry(
-                sink, zipOffsetSink.Offset(), zipFileEntries, isBundle);
-            digests.axbm = blockMap.sha256;
-            zipFileEntries.emplace_back(std::move(blockMap));
+        // Compresses files on multiple threads, writing each file record
+        // directly to its final position in the ZIP with pwrite.
+        //
+        // A file record's position is reserved once the records before it
+        // have been compressed. Records are hashed into axpcSink in order as
+        // their positions are reserved, so the output (and the digest) is
+        // identical to writing each record serially starting at offset.
+        //
+        // Records waiting for their turn are buffered within budget, and
+        // spilled to disk otherwise.
+        //
+        // Inputs are taken in order with takeInput until it returns false.
+        // If tuner is not null, it chooses each file's compression level.
+        // If checkpoint is not null, records are added to it in order once
+        // they and the records before them have been written. If midstates
+        // is not null, the hash state after each record is appended to it.
+        // If catalog is not null, binaries are hashed into it. If
+        // outputDigests is not null, records are hashed into it in order.
+        //
+        // Returns the offset following the last record.
+        off_t WriteZIPFileEntriesParallel(
+            int fd, off_t offset,
+            const std::function<bool(FileListEntry &)> &takeInput,
+            InputSource &source, int compressionLevel,
+            CompressionTuner *tuner, unsigned jobs, BlockMemo *memo,
+            MemoryBudget &budget, CachePolicy cachePolicy, WriteBehind *writeBehind,
+            Checkpoint *checkpoint, std::vector<SHA256Sink> *midstates,
+            CodeIntegrityCatalog *catalog, SHA256Sink &axpcSink,
+            DigestSink *outputDigests,
+            std::vector<ZIPFileEntry> &zipFileEntries)
+        {
+            struct Record
+            {
+                std::unique_ptr<ZIPFileEntry> entry;
+                SpillSink data;
+            };
+            // Records are added as inputs are taken; they are only accessed
+            // with mutex held.
+            std::deque<Record> records;
+            std::mutex mutex;
+            std::mutex inputMutex;
+            std::atomic<bool> failed(false);
+            std::size_t nextToReserve = 0;
+            off_t nextOffset = offset;
+            // For the checkpoint and midstates: the hash state after each
+            // record, and whether each record has been written.
+            std::deque<SHA256Sink> axpcStates;
+            std::deque<bool> written;
+            std::size_t nextToCheckpoint = 0;
 
-            // this creates [Content_Types].xml
-            ZIPFileEntry contentTypes = WriteContentTypesZIPFileEntry(
-                sink, zipOffsetSink.Offset(), isBundle, zipFileEntries);
-            digests.axct = contentTypes.sha256;
-            zipFileEntries.emplace_back(std::move(contentTypes));
+            // Takes the next input and writes its record. Returns false if
+            // there are no inputs left.
+            auto writeNext = [&]() {
+                std::size_t i;
+                FileListEntry input;
+                {
+                    std::lock_guard<std::mutex> inputLock(inputMutex);
+                    if (failed || !takeInput(input)) {
+                        return false;
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    i = records.size();
+                    records.push_back(Record{nullptr, SpillSink(&budget)});
+                    written.push_back(false);
+                    if (checkpoint || midstates) {
+                        axpcStates.emplace_back();
+                    }
+                }
+                Record record{nullptr, SpillSink(&budget)};
+                double start = ThreadCPUTime();
+                record.entry.reset(new ZIPFileEntry(WriteInputZIPFileEntry(
+                    record.data, 0, source, input,
+                    CompressionLevel(tuner, i, compressionLevel), &budget,
+                    cachePolicy, jobs, memo, catalog)));
+                if (tuner) {
+                    tuner->Finished(i, ThreadCPUTime() - start);
+                }
 
-            digests.axpc = axpcSink.SHA256();
+                // Reserve positions for this record and any records after it
+                // which were waiting for it.
+                std::vector<std::pair<off_t, SpillSink>> toWrite;
+                std::size_t firstToWrite;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    records[i] = std::move(record);
+                    firstToWrite = nextToReserve;
+                    while (nextToReserve < records.size() &&
+                           records[nextToReserve].entry) {
+                        Record &ready = records[nextToReserve];
+                        off_t size = static_cast<off_t>(ready.data.Size());
+                        assert(size == ready.entry->FileRecordSize());
+                        ready.entry->fileRecordHeaderOffset = nextOffset;
+                        ready.data.CopyTo(axpcSink);
+                        if (outputDigests) {
+                            ready.data.CopyTo(*outputDigests);
+                        }
+                        if (checkpoint || midstates) {
+                            axpcStates[nextToReserve] = axpcSink;
+                        }
+                        Preallocate(fd, nextOffset, size);
+                        toWrite.emplace_back(nextOffset,
+                                             std::move(ready.data));
+                        nextOffset += size;
+                        nextToReserve += 1;
+                    }
+                }
+
+                for (auto &write : toWrite) {
+                    PositionalFileSink fileSink(fd, write.first);
+                    write.second.CopyTo(fileSink);
+                    if (writeBehind) {
+                        writeBehind->Written(write.first,
+                                             write.second.Size());
+                    }
+                }
+
+                if (checkpoint && !toWrite.empty()) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (std::size_t j = 0; j < toWrite.size(); ++j) {
+                        written[firstToWrite + j] = true;
+                    }
+                    while (nextToCheckpoint < nextToReserve &&
+                           written[nextToCheckpoint]) {
+                        const ZIPFileEntry &entry =
+                            *records[nextToCheckpoint].entry;
+                        checkpoint->Add(entry,
+                                        entry.fileRecordHeaderOffset +
+                                            entry.FileRecordSize(),
+                                        axpcStates[nextToCheckpoint]);
+                        nextToCheckpoint += 1;
+                    }
+                }
+                return true;
+            };
+
+            // Each thread writes inputs until none are left.
+            ParallelFor(jobs, jobs, [&](std::size_t) {
+                try {
+                    while (writeNext()) {
+                    }
+                } catch (...) {
+                    failed = true;
+                    throw;
+                }
+            });
+
+            assert(nextToReserve == records.size());
+            for (Record &record : records) {
+                zipFileEntries.emplace_back(std::move(*record.entry));
+            }
+            if (midstates) {
+                midstates->insert(midstates->end(), axpcStates.begin(),
+                                  axpcStates.end());
+            }
+            return nextOffset;
         }
 
-        // Hash (but do not write) the directory, pre-signature.
+        // Writes the inputs, generated files, and directory of a package
+        // at startOffset. zipFileEntries are files already in the package,
+        // before startOffset, whose records are contiguous from its start.
+        //
+        // The inputs are fileNames or, if queue is not null, the files
+        // taken from queue as they are added.
+        //
+        // If zipFileEntries is not empty, preservedSource reads its files by
+        // archive name, to list binaries in the code integrity catalog.
+        void WritePackage(const FilePtr &zip,
+                          const std::vector<FileListEntry> &fileNames,
+                          FileListQueue *queue,
+                          const APPXOptions &options, off_t startOffset,
+                          std::vector<ZIPFileEntry> zipFileEntries,
+                          InputSource *preservedSource = nullptr)
         {
-            SHA256Sink axcdSink;
-            OffsetSink tmpOffsetSink = zipOffsetSink;
-            auto sink = MakeMultiSink(axcdSink, tmpOffsetSink);
+            const bool isBundle = options.isBundle;
+            const int compressionLevel = options.compressionLevel;
+            const unsigned jobs = EffectiveJobCount(options.jobs);
+            MemoryBudget budget(options.maxMemory);
+            FileSystemInputSource fileSystem;
+            InputSource &source =
+                options.inputSource ? *options.inputSource : fileSystem;
+            std::pair<std::string, std::string> appxBundleManifest;
+
+            const ContentGroupMap &contentGroups = options.contentGroups;
+            if (isBundle && !contentGroups.Empty()) {
+                throw std::runtime_error(
+                    "Content groups are not supported for bundles");
+            }
+            if (queue && (!contentGroups.Empty() || options.timeBudget > 0 ||
+                          !options.checkpointPath.empty() ||
+                          !options.incrementalPath.empty())) {
+                throw std::runtime_error(
+                    "Content groups, time budgets, checkpoints, and "
+                    "incremental builds need the whole file list in advance");
+            }
+            if (!options.incrementalPath.empty()) {
+                if (!options.checkpointPath.empty() ||
+                    options.timeBudget > 0) {
+                    throw std::runtime_error(
+                        "Incremental builds do not support checkpoints or "
+                        "time budgets");
+                }
+                if (!IsSeekable(fileno(zip.get()))) {
+                    throw std::runtime_error(
+                        "Incremental builds require a seekable output");
+                }
+            }
+
+            std::vector<std::pair<std::string, std::string>> inputs;
+            inputs.reserve(fileNames.size());
+            for (const auto &fileNamePair : fileNames) {
+                if (isBundle && IsAppxBundleManifest(fileNamePair.first)) {
+                    appxBundleManifest = fileNamePair;
+                    continue;
+                }
+                if (fileNamePair.first == ContentGroupMap::kArchiveName &&
+                    !contentGroups.Empty()) {
+                    throw std::runtime_error(
+                        std::string(ContentGroupMap::kArchiveName) +
+                        " is generated and must not be an input");
+                }
+                inputs.push_back(fileNamePair);
+            }
+            if (!contentGroups.Empty()) {
+                contentGroups.Layout(inputs);
+            }
+
+            // Bundles' packages have their own catalogs.
+            std::unique_ptr<CodeIntegrityCatalog> catalog;
+            if (!options.certPath.empty() && !isBundle) {
+                catalog.reset(new CodeIntegrityCatalog());
+            }
+            SHA256Sink axpcSink;
+
+            // Checkpoints and incremental builds keep records only of inputs
+            // whose stamps are unchanged.
+            std::vector<std::string> stamps;
+            if (!options.checkpointPath.empty() ||
+                !options.incrementalPath.empty()) {
+                stamps.reserve(inputs.size());
+                for (const FileListEntry &input : inputs) {
+                    stamps.push_back(source.Stamp(input.second));
+                }
+            }
+
+            std::unique_ptr<Checkpoint> checkpoint;
+            if (!options.checkpointPath.empty()) {
+                if (!IsSeekable(fileno(zip.get()))) {
+                    throw std::runtime_error(
+                        "Checkpoints require a seekable output");
+                }
+                checkpoint.reset(new Checkpoint(
+                    options.checkpointPath,
+                    Checkpoint::Fingerprint(compressionLevel, inputs, source),
+                    stamps, options.resume, zip.get()));
+                const std::vector<Checkpoint::Record> &resumed =
+                    checkpoint->Resumed();
+                if (!resumed.empty()) {
+                    // Continue after the last recorded file if the output
+                    // still has the bytes the checkpoint describes.
+                    const Checkpoint::Record &last = resumed.back();
+                    SHA256Sink outputSink;
+                    if (resumed.size() > inputs.size() ||
+                        !HashPrefix(zip, last.endOffset, outputSink) ||
+                        outputSink.SHA256() != last.axpcSink.SHA256()) {
+                        throw std::runtime_error(
+                            "Output does not match checkpoint: " +
+                            options.checkpointPath);
+                    }
+                    for (const Checkpoint::Record &record : resumed) {
+                        zipFileEntries.push_back(record.entry);
+                    }
+                    // The resumed records' inputs have unchanged stamps, so
+                    // they read as they did when the records were written.
+                    if (catalog) {
+                        AddToCatalog(*catalog,
+                                     std::vector<FileListEntry>(
+                                         inputs.begin(),
+                                         inputs.begin() + resumed.size()),
+                                     source, options.cachePolicy, jobs);
+                    }
+                    axpcSink = last.axpcSink;
+                    startOffset = last.endOffset;
+                    inputs.erase(inputs.begin(),
+                                 inputs.begin() + resumed.size());
+                    Seek(zip, startOffset, SEEK_SET);
+                }
+            }
+
+            // Keep the records of the unchanged leading inputs from the last
+            // incremental build, continuing from the hash state after them.
+            std::unique_ptr<IncrementalBuild> incremental;
+            std::vector<IncrementalBuild::Input> incrementalInputs;
+            std::vector<FileListEntry> allInputs;
+            std::vector<SHA256Sink> midstates;
+            if (!options.incrementalPath.empty()) {
+                incremental.reset(new IncrementalBuild(options.incrementalPath));
+                allInputs = inputs;
+            }
+            // An append keeps the package's records; a build keeps the
+            // records of its unchanged leading inputs.
+            if (preservedSource) {
+                incrementalInputs = RestoreAppendedRecords(
+                    zip, zipFileEntries, incremental.get(), compressionLevel,
+                    catalog.get(), *preservedSource, options.cachePolicy,
+                    jobs, axpcSink);
+                Seek(zip, startOffset, SEEK_SET);
+            } else if (incremental) {
+                std::size_t reused = incremental->ReusablePrefix(
+                    compressionLevel, catalog != nullptr, inputs, stamps,
+                    zip.get());
+                incrementalInputs.assign(
+                    incremental->Inputs().begin(),
+                    incremental->Inputs().begin() + reused);
+                for (const IncrementalBuild::Input &input :
+                     incrementalInputs) {
+                    zipFileEntries.push_back(input.record.entry);
+                    if (catalog && input.hasImageHash) {
+                        catalog->Add(input.record.entry.fileName,
+                                     input.imageHash);
+                    }
+                }
+                if (reused > 0) {
+                    const Checkpoint::Record &last =
+                        incrementalInputs.back().record;
+                    axpcSink = last.axpcSink;
+                    startOffset = last.endOffset;
+                    inputs.erase(inputs.begin(), inputs.begin() + reused);
+                }
+                Seek(zip, startOffset, SEEK_SET);
+            }
+
+            DigestSink noDigests({});
+            DigestSink &outputDigests =
+                options.outputDigests ? *options.outputDigests : noDigests;
+            if (options.outputDigests && startOffset > 0) {
+                if (!HashPrefix(zip, startOffset, outputDigests)) {
+                    throw std::runtime_error("Output is shorter than expected");
+                }
+                Seek(zip, startOffset, SEEK_SET);
+            }
+
+            std::unique_ptr<WriteBehind> writeBehind;
+            if (options.cachePolicy != CachePolicy::Default &&
+                IsSeekable(fileno(zip.get()))) {
+                writeBehind.reset(new WriteBehind(fileno(zip.get())));
+            }
+
+            const bool isParallel = jobs > 1 && IsSeekable(fileno(zip.get()));
+            std::unique_ptr<CompressionTuner> tuner;
+            if (options.timeBudget > 0) {
+                double cpuBudget = options.timeBudget;
+                if (!options.timeBudgetIsCPU && isParallel) {
+                    unsigned cpus = std::thread::hardware_concurrency();
+                    cpuBudget *= cpus ? std::min(jobs, cpus) : jobs;
+                }
+                tuner.reset(new CompressionTuner(inputs, source, cpuBudget,
+                                                 isParallel ? jobs : 1));
+            }
+
+            // Inputs are taken in order from the list, or from the queue as
+            // they are discovered, holding back a bundle's manifest.
+            std::size_t nextInput = 0;
+            std::function<bool(FileListEntry &)> takeInput =
+                [&](FileListEntry &input) {
+                    if (!queue) {
+                        if (nextInput == inputs.size()) {
+                            return false;
+                        }
+                        input = inputs[nextInput++];
+                        return true;
+                    }
+                    while (queue->Next(input)) {
+                        if (isBundle && IsAppxBundleManifest(input.first)) {
+                            appxBundleManifest = input;
+                            continue;
+                        }
+                        return true;
+                    }
+                    return false;
+                };
+
+            // Write the file records of the inputs in parallel if possible.
+            if (isParallel) {
+                if (std::fflush(zip.get()) != 0) {
+                    throw ErrnoException();
+                }
+                off_t offset = ftello(zip.get());
+                if (offset == -1) {
+                    throw ErrnoException();
+                }
+                try {
+                    startOffset = WriteZIPFileEntriesParallel(
+                        fileno(zip.get()), offset, takeInput, source,
+                        compressionLevel, tuner.get(), jobs,
+                        options.blockMemo, budget,
+                        options.cachePolicy, writeBehind.get(),
+                        checkpoint.get(),
+                        incremental ? &midstates : nullptr, catalog.get(),
+                        axpcSink, options.outputDigests, zipFileEntries);
+                } catch (...) {
+                    if (checkpoint) {
+                        checkpoint->Flush();
+                    }
+                    throw;
+                }
+                Seek(zip, startOffset, SEEK_SET);
+            }
+
+            FileSink zipRawSink(zip.get(), writeBehind.get(), startOffset);
+            OffsetSink zipOffsetSink(startOffset);
+            auto zipSink =
+                MakeMultiSink(zipRawSink, zipOffsetSink, outputDigests);
+
+            APPXDigests digests;
+            std::unique_ptr<MemoryCharge> metadataCharge;
+
+            // Write and hash the ZIP content.
+            {
+                auto sink = MakeMultiSink(zipSink, axpcSink);
+                try {
+                    FileListEntry input;
+                    for (std::size_t i = 0; takeInput(input); ++i) {
+                        double start = ThreadCPUTime();
+                        zipFileEntries.emplace_back(WriteInputZIPFileEntry(
+                            sink, zipOffsetSink.Offset(), source, input,
+                            CompressionLevel(tuner.get(), i,
+                                             compressionLevel),
+                            &budget, options.cachePolicy, jobs,
+                            options.blockMemo, catalog.get()));
+                        if (tuner) {
+                            tuner->Finished(i, ThreadCPUTime() - start);
+                        }
+                        if (checkpoint) {
+                            checkpoint->Add(zipFileEntries.back(),
+                                            zipOffsetSink.Offset(), axpcSink);
+                        }
+                        if (incremental) {
+                            midstates.push_back(axpcSink);
+                        }
+                    }
+                } catch (...) {
+                    if (checkpoint) {
+                        checkpoint->Flush();
+                    }
+                    throw;
+                }
+                if (queue) {
+                    if (zipFileEntries.empty() &&
+                        appxBundleManifest.first.empty()) {
+                        throw std::runtime_error("Missing inputs");
+                    }
+                    if (isBundle && appxBundleManifest.first.empty()) {
+                        throw std::runtime_error(
+                            "Missing AppxMetadata/AppxBundleManifest.xml");
+                    }
+                }
+
+                // File metadata (mostly block hashes) is kept in memory until
+                // the directory is written. It cannot be spilled, but counts
+                // against the budget so the remaining buffers spill sooner.
+                std::size_t metadataSize = 0;
+                for (const ZIPFileEntry &entry : zipFileEntries) {
+                    metadataSize += sizeof(entry) + entry.fileName.size() +
+                                    entry.sanitizedFileName.size() +
+                                    entry.blocks.size() * sizeof(ZIPBlock);
+                }
+                metadataCharge.reset(new MemoryCharge(&budget, metadataSize));
+
+                if (!contentGroups.Empty()) {
+                    std::vector<std::string> archiveNames;
+                    archiveNames.reserve(zipFileEntries.size());
+                    for (const ZIPFileEntry &entry : zipFileEntries) {
+                        archiveNames.push_back(entry.fileName);
+                    }
+                    std::string xml = contentGroups.XML(archiveNames);
+                    zipFileEntries.emplace_back(WriteZIPFileEntry(
+                        sink, zipOffsetSink.Offset(), ContentGroupMap::kArchiveName,
+                        compressionLevel, WriteStringFunc{xml}, &budget));
+                }
+
+                if (isBundle) {
+                    ZIPFileEntry appxBundleManifestEntry = WriteZIPFileEntry(
+                        sink, zipOffsetSink.Offset(), appxBundleManifest.first,
+                        compressionLevel,
+                        WriteAppxBundleManifestFunc{source,
+                                                    appxBundleManifest.second,
+                                                    zipFileEntries},
+                        &budget);
+                    zipFileEntries.emplace_back(std::move(appxBundleManifestEntry));
+                }
+
+                if (catalog && !catalog->Empty()) {
+                    OpenSSLPtr<PKCS7, PKCS7_free> signedCatalog =
+                        catalog->Sign(options.certPath);
+                    std::vector<std::uint8_t> catalogData =
+                        GetSignatureBytes(signedCatalog.get());
+                    std::string catalogString(catalogData.begin(),
+                                              catalogData.end());
+                    digests.axci = SHA256Hash::DigestFromBytes(
+                        catalogData.size(), catalogData.data());
+                    zipFileEntries.emplace_back(WriteZIPFileEntry(
+                        sink, zipOffsetSink.Offset(),
+                        kCodeIntegrityCatalogName, compressionLevel,
+                        WriteStringFunc{catalogString}, &budget));
+                }
+
+                // this creates AppxBlockMap.xml file
+                ZIPFileEntry blockMap = WriteAppxBlockMapZIPFileEntry(
+                    sink, zipOffsetSink.Offset(), zipFileEntries, isBundle,
+                    &budget);
+                digests.axbm = blockMap.sha256;
+                zipFileEntries.emplace_back(std::move(blockMap));
+
+                // this creates [Content_Types].xml
+                ZIPFileEntry contentTypes = WriteContentTypesZIPFileEntry(
+                    sink, zipOffsetSink.Offset(), isBundle, zipFileEntries,
+                    options.contentTypes, &budget);
+                digests.axct = contentTypes.sha256;
+                zipFileEntries.emplace_back(std::move(contentTypes));
+
+                digests.axpc = axpcSink.SHA256();
+            }
+
+            // Hash (but do not write) the directory, pre-signature.
+            {
+                SHA256Sink axcdSink;
+                OffsetSink tmpOffsetSink = zipOffsetSink;
+                auto sink = MakeMultiSink(axcdSink, tmpOffsetSink);
+                for (const ZIPFileEntry &entry : zipFileEntries) {
+                    entry.WriteDirectoryEntry(sink);
+                }
+                WriteZIPEndOfCentralDirectoryRecord(sink, tmpOffsetSink.Offset(),
+                                                    zipFileEntries);
+                digests.axcd = axcdSink.SHA256();
+            }
+
+            // Sign and write the signature.
+            if (!options.certPath.empty()) {
+                zipFileEntries.emplace_back(WriteSignature(
+                    zipSink, options.certPath, digests, zipOffsetSink.Offset()));
+            }
+
+            // Write the directory.
             for (const ZIPFileEntry &entry : zipFileEntries) {
-                entry.WriteDirectoryEntry(sink);
+                entry.WriteDirectoryEntry(zipSink);
             }
-            WriteZIPEndOfCentralDirectoryRecord(sink, tmpOffsetSink.Offset(),
+            WriteZIPEndOfCentralDirectoryRecord(zipSink, zipOffsetSink.Offset(),
                                                 zipFileEntries);
-            digests.axcd = axcdSink.SHA256();
+            metadataCharge.reset();
+            if (writeBehind) {
+                zipRawSink.Flush();
+                writeBehind->Finish();
+            }
+
+            if (!options.indexPath.empty()) {
+                std::ofstream index;
+                index.exceptions(std::ofstream::badbit |
+                                 std::ofstream::failbit);
+                index.open(options.indexPath,
+                           std::ios::out | std::ios::binary);
+                WritePackageIndex(index, zipFileEntries,
+                                  IndexFormatForPath(options.indexPath));
+            }
+
+            if (checkpoint || incremental || preservedSource) {
+                // A resumed or incremental build, or an append, may have
+                // left bytes after the package. This precedes saving the
+                // sidecar, which must see the final file.
+                if (std::fflush(zip.get()) != 0) {
+                    throw ErrnoException();
+                }
+                off_t size = ftello(zip.get());
+                if (size == -1 || ftruncate(fileno(zip.get()), size) != 0) {
+                    throw ErrnoException();
+                }
+            }
+            if (checkpoint) {
+                checkpoint->Remove();
+            }
+            if (incremental) {
+                std::map<std::string, SHA256Hash> imageHashes;
+                if (catalog) {
+                    for (const auto &member : catalog->Members()) {
+                        imageHashes.insert(member);
+                    }
+                }
+                // zipFileEntries starts with the kept records, then those of
+                // the rest of allInputs.
+                std::size_t reused = incrementalInputs.size();
+                std::size_t appended = preservedSource ? reused : 0;
+                assert(reused + midstates.size() <= zipFileEntries.size());
+                for (std::size_t i = 0; i < midstates.size(); ++i) {
+                    const ZIPFileEntry &entry = zipFileEntries[reused + i];
+                    incrementalInputs.push_back(IncrementalBuild::Input{
+                        {entry, entry.fileRecordHeaderOffset +
+                                    entry.FileRecordSize(),
+                         midstates[i]},
+                        "", "", false, SHA256Hash(), 0});
+                }
+                for (std::size_t i = 0; i < incrementalInputs.size(); ++i) {
+                    IncrementalBuild::Input &input = incrementalInputs[i];
+                    if (i >= appended) {
+                        input.localPath = allInputs[i - appended].second;
+                        input.stamp = stamps[i - appended];
+                    }
+                    auto it = imageHashes.find(input.record.entry.fileName);
+                    input.hasImageHash = it != imageHashes.end();
+                    if (input.hasImageHash) {
+                        input.imageHash = it->second;
+                    }
+                }
+                incremental->Save(compressionLevel, catalog != nullptr,
+                                  std::move(incrementalInputs), zip.get());
+            }
+        }
+    }
+
+    bool IsGeneratedAppxFile(const std::string &archiveName)
+    {
+        return archiveName == "AppxBlockMap.xml" ||
+               archiveName == "[Content_Types].xml" ||
+               archiveName == "AppxSignature.p7x" ||
+               archiveName == kCodeIntegrityCatalogName;
+    }
+
+    bool IsAppxBundleManifest(const std::string &archiveName)
+    {
+        const std::string suffix = "AppxBundleManifest.xml";
+        return suffix.size() < archiveName.size() &&
+               std::equal(suffix.rbegin(), suffix.rend(),
+                          archiveName.rbegin());
+    }
+
+    void WriteAppx(const FilePtr &zip,
+                   const std::vector<FileListEntry> &fileNames,
+                   const APPXOptions &options)
+    {
+        WritePackage(zip, fileNames, nullptr, options, 0, {});
+    }
+
+    void WriteAppx(const FilePtr &zip, FileListQueue &fileNames,
+                   const APPXOptions &options)
+    {
+        try {
+            WritePackage(zip, {}, &fileNames, options, 0, {});
+        } catch (...) {
+            fileNames.Cancel(std::current_exception());
+            throw;
         }
+    }
 
-        // Sign and write the signature.
-        if (certPath) {
-            zipFileEntries.emplace_back(WriteSignature(
-                zipSink, *certPath, digests, zipOffsetSink.Offset()));
+    void AppendAppx(const std::string &packagePath,
+                    const std::vector<FileListEntry> &fileNames,
+                    const APPXOptions &options)
+    {
+        if (options.isBundle) {
+            throw std::runtime_error("Appending to bundles is not supported");
+        }
+        if (!options.contentGroups.Empty()) {
+            throw std::runtime_error(
+                "Content groups are not supported when appending");
+        }
+        if (!options.checkpointPath.empty()) {
+            throw std::runtime_error(
+                "Checkpoints are not supported when appending");
         }
 
-        // Write the directory.
-        for (const ZIPFileEntry &entry : zipFileEntries) {
-            entry.WriteDirectoryEntry(zipSink);
+        ZIPReader reader(packagePath);
+        reader.LoadBlockMap();
+        if (!reader.Find("AppxBlockMap.xml")) {
+            throw std::runtime_error("Not an APPX package: " + packagePath);
+        }
+        if (reader.Find("AppxMetadata/AppxBundleManifest.xml")) {
+            throw std::runtime_error("Appending to bundles is not supported");
+        }
+        // New files would land outside the groups' layout and map.
+        if (reader.Find(ContentGroupMap::kArchiveName)) {
+            throw std::runtime_error(
+                "Appending to packages with content groups is not supported");
         }
-        WriteZIPEndOfCentralDirectoryRecord(zipSink, zipOffsetSink.Offset(),
-                                            zipFileEntries);
+
+        // Generated files are written after all other files, so the package
+        // is cut at the first generated file and the rest rewritten.
+        off_t truncateOffset = std::numeric_limits<off_t>::max();
+        for (const ZIPReader::Entry &entry : reader.Entries()) {
+            if (IsGeneratedAppxFile(entry.fileName)) {
+                truncateOffset =
+                    std::min(truncateOffset, entry.fileRecordHeaderOffset);
+            }
+        }
+        // The kept records must be contiguous, as the tool writes them.
+        std::vector<ZIPFileEntry> zipFileEntries;
+        off_t nextOffset = 0;
+        for (const ZIPReader::Entry &entry : reader.Entries()) {
+            if (IsGeneratedAppxFile(entry.fileName)) {
+                continue;
+            }
+            if (entry.fileRecordHeaderOffset != nextOffset ||
+                !entry.hasBlockMap) {
+                throw std::runtime_error(
+                    "Cannot append to package not written by appx: " +
+                    packagePath);
+            }
+            zipFileEntries.emplace_back(
+                entry.fileName, entry.compressedSize, entry.uncompressedSize,
+                entry.compressionType, entry.fileRecordHeaderOffset,
+                entry.crc32, entry.blocks, SHA256Hash());
+            if (zipFileEntries.back().FileRecordHeaderSize() !=
+                entry.dataOffset - entry.fileRecordHeaderOffset) {
+                throw std::runtime_error(
+                    "Cannot append to package not written by appx: " +
+                    packagePath);
+            }
+            nextOffset += zipFileEntries.back().FileRecordSize();
+        }
+        if (nextOffset != truncateOffset) {
+            throw std::runtime_error(
+                "Cannot append to package not written by appx: " +
+                packagePath);
+        }
+        for (const FileListEntry &fileName : fileNames) {
+            if (reader.Find(fileName.first)) {
+                throw std::runtime_error("File already in package: " +
+                                         fileName.first);
+            }
+        }
+
+        FilePtr zip = Open(packagePath, "r+b");
+        Seek(zip, truncateOffset, SEEK_SET);
+        ZIPInputSource preservedSource(reader);
+        WritePackage(zip, fileNames, nullptr, options, truncateOffset,
+                     std::move(zipFileEntries), &preservedSource);
     }
 }
 }
@@ -0,0 +1,448 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Analyze.h>
+#include <APPX/JSON.h>
+#include <APPX/Parallel.h>
+#include <APPX/Sink.h>
+#include <APPX/ZIP.h>
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        // Each file contributes up to kSampleBlocks blocks, spread evenly
+        // through the file, to the compression estimates.
+        enum
+        {
+            kSampleBlocks = 8,
+        };
+
+        // Index into CompressionTuner::kLevels used for block ratios.
+        const std::size_t kRatioLevel = 2;
+
+        const std::size_t kSummaryRows = 10;
+
+        // Block hashes from a package's AppxBlockMap.xml, base64-encoded.
+        std::unordered_set<std::string> ReadBlockMapHashes(
+            const std::string &packagePath)
+        {
+            ZIPReader reader(packagePath);
+            const ZIPReader::Entry *entry = reader.Find("AppxBlockMap.xml");
+            if (!entry) {
+                throw std::runtime_error("Package has no block map: " +
+                                         packagePath);
+            }
+            std::string xml;
+            reader.Read(*entry,
+                        [&xml](std::size_t size, const std::uint8_t *bytes) {
+                            xml.append(reinterpret_cast<const char *>(bytes),
+                                       size);
+                        });
+            static const std::string kHashPrefix = "<Block Hash=\"";
+            std::unordered_set<std::string> hashes;
+            std::string::size_type pos = 0;
+            while ((pos = xml.find(kHashPrefix, pos)) != std::string::npos) {
+                pos += kHashPrefix.size();
+                std::string::size_type end = xml.find('"', pos);
+                if (end == std::string::npos) {
+                    break;
+                }
+                hashes.insert(xml.substr(pos, end - pos));
+                pos = end;
+            }
+            return hashes;
+        }
+
+        std::string Base64(const SHA256Hash &hash)
+        {
+            Base64Sink base64Sink;
+            base64Sink.Write(sizeof(hash.bytes), hash.bytes);
+            base64Sink.Close();
+            return base64Sink.Base64();
+        }
+
+        // Hashes a file block by block, compressing the sampled blocks.
+        class FileAnalyzer
+        {
+        public:
+            FileAnalyzer(FileAnalysis &analysis,
+                         const std::unordered_set<std::string> &referenceHashes)
+                : analysis(analysis), referenceHashes(referenceHashes)
+            {
+                this->block.reserve(ZIPBlock::kSize);
+                off_t blocks = (analysis.size + ZIPBlock::kSize - 1) /
+                               ZIPBlock::kSize;
+                off_t samples =
+                    std::min(blocks, static_cast<off_t>(kSampleBlocks));
+                for (off_t i = 0; i < samples; ++i) {
+                    this->sampledBlocks.insert(
+                        samples == 1 ? 0 : (blocks - 1) * i / (samples - 1));
+                }
+            }
+
+            void Write(std::size_t size, const std::uint8_t *bytes)
+            {
+                while (size > 0) {
+                    std::size_t count =
+                        std::min(size, static_cast<std::size_t>(
+                                           ZIPBlock::kSize -
+                                           this->block.size()));
+                    this->block.insert(this->block.end(), bytes,
+                                       bytes + count);
+                    bytes += count;
+                    size -= count;
+                    if (this->block.size() == ZIPBlock::kSize) {
+                        this->EndBlock();
+                    }
+                }
+            }
+
+            // Finishes the analysis, returning the hash of the whole file.
+            SHA256Hash Close()
+            {
+                if (!this->block.empty()) {
+                    this->EndBlock();
+                }
+                FileAnalysis &analysis = this->analysis;
+                if (this->sampledBytes > 0) {
+                    double scale = analysis.size / this->sampledBytes;
+                    for (std::size_t level = 0;
+                         level < CompressionTuner::kLevelCount; ++level) {
+                        analysis.estimatedSize[level] =
+                            this->sampledSize[level] * scale;
+                        analysis.estimatedSeconds[level] =
+                            (this->hashCost + this->sampledCost[level]) *
+                            scale;
+                    }
+                }
+                return this->fileHashSink.SHA256();
+            }
+
+        private:
+            void EndBlock()
+            {
+                FileAnalysis &analysis = this->analysis;
+                const std::size_t size = this->block.size();
+                const off_t index = analysis.blocks;
+                analysis.blocks += 1;
+                this->fileHashSink.Write(size, this->block.data());
+
+                bool isSampled = this->sampledBlocks.count(index) != 0;
+                double start = ThreadCPUTime();
+                SHA256Sink blockHashSink;
+                blockHashSink.Write(size, this->block.data());
+                SHA256Hash blockHash = blockHashSink.SHA256();
+                if (isSampled) {
+                    this->hashCost += ThreadCPUTime() - start;
+                }
+                if (!this->referenceHashes.empty() &&
+                    this->referenceHashes.count(Base64(blockHash)) != 0) {
+                    analysis.referenceBlocks += 1;
+                    analysis.referenceBytes += size;
+                }
+
+                if (isSampled) {
+                    analysis.sampledBlocks += 1;
+                    this->sampledBytes += size;
+                    this->sampledSize[0] += size;
+                    for (std::size_t level = 1;
+                         level < CompressionTuner::kLevelCount; ++level) {
+                        start = ThreadCPUTime();
+                        OffsetSink offsetSink;
+                        auto deflateSink = MakeDeflateSink(
+                            CompressionTuner::kLevels[level], offsetSink);
+                        deflateSink.Write(size, this->block.data());
+                        deflateSink.Close();
+                        this->sampledCost[level] += ThreadCPUTime() - start;
+                        this->sampledSize[level] += offsetSink.Offset();
+                        if (level == kRatioLevel) {
+                            std::size_t bucket = static_cast<std::size_t>(
+                                offsetSink.Offset() *
+                                SizeAnalysis::kRatioBuckets / size);
+                            bucket = std::min(
+                                bucket, static_cast<std::size_t>(
+                                            SizeAnalysis::kRatioBuckets - 1));
+                            analysis.blockRatios[bucket] += 1;
+                        }
+                    }
+                }
+                this->block.clear();
+            }
+
+            FileAnalysis &analysis;
+            const std::unordered_set<std::string> &referenceHashes;
+            std::unordered_set<off_t> sampledBlocks;
+            std::vector<std::uint8_t> block;
+            SHA256Sink fileHashSink;
+            double sampledBytes = 0;
+            double hashCost = 0;
+            double sampledCost[CompressionTuner::kLevelCount] = {};
+            double sampledSize[CompressionTuner::kLevelCount] = {};
+        };
+
+        void WriteJSONStringOrNull(std::ostream &out, const std::string &s)
+        {
+            if (s.empty()) {
+                out << "null";
+            } else {
+                WriteJSONString(out, s);
+            }
+        }
+
+        // Writes the fields of a SizeAnalysis, without braces.
+        void WriteJSONFields(std::ostream &out, const SizeAnalysis &analysis)
+        {
+            out << "\"size\": " << analysis.size << ", \"compressedSize\": ";
+            if (analysis.compressedSize < 0) {
+                out << "null, \"ratio\": null";
+            } else {
+                out << analysis.compressedSize << ", \"ratio\": "
+                    << (analysis.size == 0
+                            ? 1.0
+                            : static_cast<double>(analysis.compressedSize) /
+                                  analysis.size);
+            }
+            out << ", \"blocks\": " << analysis.blocks
+                << ", \"sampledBlocks\": " << analysis.sampledBlocks
+                << ", \"blockRatioHistogram\": [";
+            for (std::size_t i = 0; i < SizeAnalysis::kRatioBuckets; ++i) {
+                out << (i ? ", " : "") << analysis.blockRatios[i];
+            }
+            out << "], \"estimates\": [";
+            for (std::size_t i = 0; i < CompressionTuner::kLevelCount; ++i) {
+                out << (i ? ", " : "")
+                    << "{\"level\": " << CompressionTuner::kLevels[i]
+                    << ", \"size\": "
+                    << static_cast<off_t>(analysis.estimatedSize[i])
+                    << ", \"cpuSeconds\": " << analysis.estimatedSeconds[i]
+                    << "}";
+            }
+            out << "], \"referenceBlocks\": " << analysis.referenceBlocks
+                << ", \"referenceBytes\": " << analysis.referenceBytes;
+        }
+
+        double Percent(double part, double whole)
+        {
+            return whole == 0 ? 100 : 100 * part / whole;
+        }
+
+        // Writes a summary table row for a file or extension.
+        void WriteSummaryRow(std::ostream &out, const std::string &name,
+                             const SizeAnalysis &analysis)
+        {
+            out << "  " << std::setw(14) << analysis.size;
+            if (analysis.compressedSize < 0) {
+                out << std::setw(14) << "-" << std::setw(8) << "-";
+            } else {
+                out << std::setw(14) << analysis.compressedSize << std::setw(7)
+                    << Percent(analysis.compressedSize, analysis.size) << "%";
+            }
+            out << std::setw(7)
+                << Percent(analysis.estimatedSize[kRatioLevel], analysis.size)
+                << "%  " << name << "\n";
+        }
+    }
+
+    void SizeAnalysis::Add(const SizeAnalysis &other)
+    {
+        this->size += other.size;
+        if (other.compressedSize >= 0) {
+            this->compressedSize =
+                std::max(this->compressedSize, static_cast<off_t>(0)) +
+                other.compressedSize;
+        }
+        this->blocks += other.blocks;
+        this->sampledBlocks += other.sampledBlocks;
+        for (std::size_t i = 0; i < kRatioBuckets; ++i) {
+            this->blockRatios[i] += other.blockRatios[i];
+        }
+        for (std::size_t i = 0; i < CompressionTuner::kLevelCount; ++i) {
+            this->estimatedSize[i] += other.estimatedSize[i];
+            this->estimatedSeconds[i] += other.estimatedSeconds[i];
+        }
+        this->referenceBlocks += other.referenceBlocks;
+        this->referenceBytes += other.referenceBytes;
+    }
+
+    Analysis Analyze(const std::vector<FileListEntry> &inputs,
+                     InputSource &source, const ZIPReader *package,
+                     const std::string &referencePath, unsigned jobs)
+    {
+        Analysis analysis;
+        analysis.referencePath = referencePath;
+        std::unordered_set<std::string> referenceHashes;
+        if (!referencePath.empty()) {
+            referenceHashes = ReadBlockMapHashes(referencePath);
+        }
+
+        analysis.files.resize(inputs.size());
+        std::vector<SHA256Hash> fileHashes(inputs.size());
+        ParallelFor(inputs.size(), jobs, [&](std::size_t i) {
+            FileAnalysis &file = analysis.files[i];
+            file.archiveName = inputs[i].first;
+            file.size = source.Size(inputs[i].second);
+            if (package) {
+                file.compressedSize =
+                    package->Find(inputs[i].second)->compressedSize;
+            }
+            FileAnalyzer analyzer(file, referenceHashes);
+            source.Read(inputs[i].second, CachePolicy::Default,
+                        [&analyzer](std::size_t size,
+                                    const std::uint8_t *bytes) {
+                            analyzer.Write(size, bytes);
+                        });
+            fileHashes[i] = analyzer.Close();
+        });
+
+        std::unordered_map<std::string, std::size_t> firstByHash;
+        std::map<std::string, ExtensionAnalysis> extensions;
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            FileAnalysis &file = analysis.files[i];
+            if (file.size > 0) {
+                std::string hash(
+                    reinterpret_cast<const char *>(fileHashes[i].bytes),
+                    sizeof(fileHashes[i].bytes));
+                auto it = firstByHash.emplace(std::move(hash), i).first;
+                if (it->second != i) {
+                    file.duplicateOf = static_cast<std::ptrdiff_t>(it->second);
+                }
+            }
+            std::string extension = ArchiveNameExtension(file.archiveName);
+            ExtensionAnalysis &extensionAnalysis = extensions[extension];
+            extensionAnalysis.extension = extension;
+            extensionAnalysis.files += 1;
+            extensionAnalysis.Add(file);
+            analysis.total.Add(file);
+        }
+        for (auto &extension : extensions) {
+            analysis.extensions.push_back(std::move(extension.second));
+        }
+        std::stable_sort(analysis.extensions.begin(),
+                         analysis.extensions.end(),
+                         [](const ExtensionAnalysis &a,
+                            const ExtensionAnalysis &b) {
+                             return a.size > b.size;
+                         });
+        return analysis;
+    }
+
+    void WriteAnalysisJSON(std::ostream &out, const Analysis &analysis)
+    {
+        out << "{\n  \"package\": ";
+        WriteJSONStringOrNull(out, analysis.packagePath);
+        out << ",\n  \"reference\": ";
+        WriteJSONStringOrNull(out, analysis.referencePath);
+        out << ",\n  \"total\": {";
+        WriteJSONFields(out, analysis.total);
+        out << "},\n  \"extensions\": [";
+        for (std::size_t i = 0; i < analysis.extensions.size(); ++i) {
+            const ExtensionAnalysis &extension = analysis.extensions[i];
+            out << (i ? ",\n" : "\n") << "    {\"extension\": ";
+            WriteJSONString(out, extension.extension);
+            out << ", \"files\": " << extension.files << ", ";
+            WriteJSONFields(out, extension);
+            out << "}";
+        }
+        out << "\n  ],\n  \"files\": [";
+        for (std::size_t i = 0; i < analysis.files.size(); ++i) {
+            const FileAnalysis &file = analysis.files[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": ";
+            WriteJSONString(out, file.archiveName);
+            out << ", ";
+            WriteJSONFields(out, file);
+            out << ", \"duplicateOf\": ";
+            if (file.duplicateOf < 0) {
+                out << "null";
+            } else {
+                WriteJSONString(out,
+                                analysis.files[file.duplicateOf].archiveName);
+            }
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    void WriteAnalysisSummary(std::ostream &out, const Analysis &analysis)
+    {
+        const SizeAnalysis &total = analysis.total;
+        std::ios::fmtflags flags = out.flags();
+        out << std::fixed << std::setprecision(1);
+
+        out << analysis.files.size() << " files, " << total.size
+            << " bytes";
+        if (total.compressedSize >= 0) {
+            out << ", " << total.compressedSize << " bytes compressed ("
+                << Percent(total.compressedSize, total.size) << "%)";
+        }
+        out << "\n\nEstimated size and CPU time by level:\n";
+        for (std::size_t i = 0; i < CompressionTuner::kLevelCount; ++i) {
+            out << "  -" << CompressionTuner::kLevels[i] << std::setw(14)
+                << static_cast<off_t>(total.estimatedSize[i]) << " bytes"
+                << std::setw(10) << std::setprecision(2)
+                << total.estimatedSeconds[i] << " s\n"
+                << std::setprecision(1);
+        }
+
+        out << "\nSampled blocks by compression ratio (-"
+            << CompressionTuner::kLevels[kRatioLevel] << "):\n";
+        for (std::size_t i = 0; i < SizeAnalysis::kRatioBuckets; ++i) {
+            out << "  " << std::setw(3) << i * 100 / SizeAnalysis::kRatioBuckets
+                << "%" << std::setw(10) << total.blockRatios[i] << "\n";
+        }
+
+        const char *header = "            size    compressed   ratio   est.\n";
+        out << "\nLargest extensions:\n" << header;
+        for (std::size_t i = 0;
+             i < std::min(analysis.extensions.size(), kSummaryRows); ++i) {
+            const ExtensionAnalysis &extension = analysis.extensions[i];
+            WriteSummaryRow(out,
+                            (extension.extension.empty()
+                                 ? std::string("(none)")
+                                 : "." + extension.extension) +
+                                " (" + std::to_string(extension.files) +
+                                " files)",
+                            extension);
+        }
+
+        std::vector<const FileAnalysis *> bySize;
+        off_t duplicateFiles = 0;
+        off_t duplicateBytes = 0;
+        for (const FileAnalysis &file : analysis.files) {
+            bySize.push_back(&file);
+            if (file.duplicateOf >= 0) {
+                duplicateFiles += 1;
+                duplicateBytes += file.size;
+            }
+        }
+        std::stable_sort(bySize.begin(), bySize.end(),
+                         [](const FileAnalysis *a, const FileAnalysis *b) {
+                             return a->size > b->size;
+                         });
+        out << "\nLargest files:\n" << header;
+        for (std::size_t i = 0; i < std::min(bySize.size(), kSummaryRows);
+             ++i) {
+            WriteSummaryRow(out, bySize[i]->archiveName, *bySize[i]);
+        }
+
+        out << "\nDuplicate files: " << duplicateFiles << " ("
+            << duplicateBytes << " bytes)\n";
+        if (!analysis.referencePath.empty()) {
+            out << "Blocks shared with reference: " << total.referenceBlocks
+                << " of " << total.blocks << " (" << total.referenceBytes
+                << " bytes)\n";
+        }
+        out.flags(flags);
+    }
+}
+}
@@ -0,0 +1,76 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/BlockMemo.h>
+#include <cstring>
+#include <utility>
+
+namespace facebook {
+namespace appx {
+    std::size_t BlockMemo::KeyHash::operator()(const Key &key) const
+    {
+        // The hash is already uniformly distributed.
+        std::size_t hash;
+        std::memcpy(&hash, key.sha256.bytes, sizeof(hash));
+        return hash ^ static_cast<std::size_t>(key.compressionLevel);
+    }
+
+    std::size_t BlockMemo::EntrySize(const Entry &entry)
+    {
+        // Roughly a list node and a hash table node.
+        return entry.compressed.size() + sizeof(Entry) + 64;
+    }
+
+    bool BlockMemo::Find(const SHA256Hash &sha256, int compressionLevel,
+                         std::size_t uncompressedSize,
+                         std::vector<std::uint8_t> &compressed)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto it = this->index.find(Key{sha256, compressionLevel});
+        if (it == this->index.end()) {
+            this->stats.misses += 1;
+            return false;
+        }
+        this->entries.splice(this->entries.begin(), this->entries, it->second);
+        compressed = it->second->compressed;
+        this->stats.hits += 1;
+        this->stats.hitBytes += uncompressedSize;
+        return true;
+    }
+
+    void BlockMemo::Add(const SHA256Hash &sha256, int compressionLevel,
+                        std::vector<std::uint8_t> compressed)
+    {
+        Entry entry{Key{sha256, compressionLevel}, std::move(compressed)};
+        std::size_t size = EntrySize(entry);
+        if (size > this->limit) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->index.count(entry.key)) {
+            // Another thread compressed the same block.
+            return;
+        }
+        while (this->used + size > this->limit) {
+            const Entry &oldest = this->entries.back();
+            this->used -= EntrySize(oldest);
+            this->index.erase(oldest.key);
+            this->entries.pop_back();
+            this->stats.evictions += 1;
+        }
+        this->entries.push_front(std::move(entry));
+        this->index.emplace(this->entries.front().key, this->entries.begin());
+        this->used += size;
+    }
+
+    BlockMemo::Stats BlockMemo::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->stats;
+    }
+}
+}
@@ -0,0 +1,283 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/CachePolicy.h>
+#include <APPX/File.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <limits>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        enum : std::size_t
+        {
+            // Read size for buffered reads.
+            kBufferSize = 65536,
+            // Read size and buffer alignment for O_DIRECT reads.
+            kDirectBufferSize = 1024 * 1024,
+            kDirectAlignment = 4096,
+        };
+
+        // How far ahead of the read position to ask for read-ahead, and how
+        // much read data to accumulate before dropping it from the cache.
+        enum : off_t
+        {
+            kReadWindowSize = 8 * 1024 * 1024
+        };
+
+#if !defined(__linux__)
+        enum
+        {
+            POSIX_FADV_SEQUENTIAL,
+            POSIX_FADV_WILLNEED,
+            POSIX_FADV_DONTNEED,
+        };
+#endif
+
+        void Advise(int fd, off_t offset, off_t size, int advice)
+        {
+#if defined(__linux__)
+            // Advice is only a hint, so errors are ignored.
+            posix_fadvise(fd, offset, size, advice);
+#else
+            (void)fd;
+            (void)offset;
+            (void)size;
+            (void)advice;
+#endif
+        }
+    }
+
+    bool ParseCachePolicy(const std::string &name, CachePolicy &policy)
+    {
+        if (name == "default") {
+            policy = CachePolicy::Default;
+        } else if (name == "nocache") {
+            policy = CachePolicy::NoCache;
+        } else if (name == "direct") {
+            policy = CachePolicy::Direct;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    void InputFile::BufferDeleter::operator()(std::uint8_t *buffer)
+    {
+        std::free(buffer);
+    }
+
+    InputFile::InputFile(const std::string &path, CachePolicy policy)
+        : path(path), policy(policy), fd(-1)
+    {
+#if defined(__linux__)
+        if (this->policy == CachePolicy::Direct) {
+            this->fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+            if (this->fd == -1 && errno == EINVAL) {
+                // The file system does not support O_DIRECT.
+                this->policy = CachePolicy::NoCache;
+            }
+        }
+#else
+        if (this->policy == CachePolicy::Direct) {
+            this->policy = CachePolicy::NoCache;
+        }
+#endif
+        if (this->fd == -1) {
+            this->fd = open(path.c_str(), O_RDONLY);
+        }
+        if (this->fd == -1) {
+            throw ErrnoException(path);
+        }
+
+        struct stat status;
+        if (fstat(this->fd, &status) != 0) {
+            int error = errno;
+            close(this->fd);
+            throw ErrnoException(path, error);
+        }
+        this->size = status.st_size;
+        // A file with fewer blocks than its size has holes, which are found
+        // with SEEK_HOLE as they are reached. Files without holes need no
+        // extra system calls.
+        bool isSparse = S_ISREG(status.st_mode) &&
+                        static_cast<off_t>(status.st_blocks) * 512 <
+                            status.st_size;
+        this->dataEnd = isSparse ? 0 : std::numeric_limits<off_t>::max();
+
+        void *storage = nullptr;
+        if (this->policy == CachePolicy::Direct) {
+            this->bufferSize = kDirectBufferSize;
+            int rc =
+                posix_memalign(&storage, kDirectAlignment, this->bufferSize);
+            if (rc != 0) {
+                close(this->fd);
+                throw ErrnoException(rc);
+            }
+        } else {
+            this->bufferSize = kBufferSize;
+            storage = std::malloc(this->bufferSize);
+            if (!storage) {
+                close(this->fd);
+                throw std::bad_alloc();
+            }
+        }
+        this->bufferStorage.reset(static_cast<std::uint8_t *>(storage));
+        this->buffer = this->bufferStorage.get();
+
+        if (this->policy == CachePolicy::NoCache) {
+            Advise(this->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            Advise(this->fd, 0, kReadWindowSize, POSIX_FADV_WILLNEED);
+        }
+#if defined(__APPLE__)
+        if (this->policy != CachePolicy::Default) {
+            fcntl(this->fd, F_NOCACHE, 1);
+        }
+#endif
+    }
+
+    InputFile::~InputFile()
+    {
+        if (this->policy == CachePolicy::NoCache) {
+            Advise(this->fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        close(this->fd);
+    }
+
+    off_t InputFile::SkipHole()
+    {
+        if (this->offset < this->dataEnd) {
+            return 0;
+        }
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        off_t data = lseek(this->fd, this->offset, SEEK_DATA);
+        if (data == -1 && errno == ENXIO) {
+            // The rest of the file is a hole.
+            data = std::max(this->size, this->offset);
+        } else if (data == -1) {
+            // The file system does not support finding holes.
+            this->dataEnd = std::numeric_limits<off_t>::max();
+            return 0;
+        }
+        off_t hole = data;
+        if (data < this->size) {
+            hole = lseek(this->fd, data, SEEK_HOLE);
+            if (hole == -1) {
+                throw ErrnoException(this->path);
+            }
+        }
+        if (lseek(this->fd, data, SEEK_SET) == -1) {
+            throw ErrnoException(this->path);
+        }
+        // If the file grew, keep reading past its old size.
+        this->dataEnd =
+            hole > data ? hole : std::numeric_limits<off_t>::max();
+        off_t holeSize = data - this->offset;
+        this->offset = data;
+        return holeSize;
+#else
+        this->dataEnd = std::numeric_limits<off_t>::max();
+        return 0;
+#endif
+    }
+
+    std::size_t InputFile::Read()
+    {
+        // Stop at the next hole. O_DIRECT reads must be whole pages.
+        std::size_t readSize = static_cast<std::size_t>(std::min<off_t>(
+            this->bufferSize, this->dataEnd - this->offset));
+        if (this->policy == CachePolicy::Direct) {
+            readSize = (readSize + kDirectAlignment - 1) / kDirectAlignment *
+                       kDirectAlignment;
+        }
+        ssize_t rc;
+        do {
+            rc = read(this->fd, this->buffer, readSize);
+        } while (rc == -1 && errno == EINTR);
+        if (rc == -1) {
+            throw ErrnoException(this->path);
+        }
+        off_t previousOffset = this->offset;
+        this->offset += rc;
+
+        if (this->policy == CachePolicy::NoCache) {
+            // Ask for the next window when crossing into a new one.
+            if (previousOffset / kReadWindowSize !=
+                this->offset / kReadWindowSize) {
+                Advise(this->fd,
+                       this->offset / kReadWindowSize * kReadWindowSize +
+                           kReadWindowSize,
+                       kReadWindowSize, POSIX_FADV_WILLNEED);
+            }
+            if (this->offset - this->dropped >= kReadWindowSize) {
+                Advise(this->fd, this->dropped, this->offset - this->dropped,
+                       POSIX_FADV_DONTNEED);
+                this->dropped = this->offset;
+            }
+        }
+        return static_cast<std::size_t>(rc);
+    }
+
+    void WriteBehind::Written(off_t offset, off_t size)
+    {
+        if (size <= 0) {
+            return;
+        }
+#if defined(__linux__)
+        // Start writeback without waiting for it. Like fadvise, this is only
+        // a hint, so errors are ignored.
+        sync_file_range(this->fd, offset, size, SYNC_FILE_RANGE_WRITE);
+#endif
+        // Drop ranges outside the lock, so other writers do not wait for
+        // writeback.
+        std::vector<std::pair<off_t, off_t>> toDrop;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->ranges.emplace_back(offset, size);
+            this->pending += size;
+            while (this->pending > kWindowSize && this->ranges.size() > 1) {
+                toDrop.push_back(this->ranges.front());
+                this->ranges.pop_front();
+                this->pending -= toDrop.back().second;
+            }
+        }
+        for (const std::pair<off_t, off_t> &range : toDrop) {
+            this->Drop(range.first, range.second);
+        }
+    }
+
+    void WriteBehind::Finish()
+    {
+        std::deque<std::pair<off_t, off_t>> toDrop;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            toDrop.swap(this->ranges);
+            this->pending = 0;
+        }
+        for (const std::pair<off_t, off_t> &range : toDrop) {
+            this->Drop(range.first, range.second);
+        }
+    }
+
+    void WriteBehind::Drop(off_t offset, off_t size)
+    {
+#if defined(__linux__)
+        // Dirty pages cannot be dropped, so wait for writeback first.
+        sync_file_range(this->fd, offset, size,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+        Advise(this->fd, offset, size, POSIX_FADV_DONTNEED);
+    }
+}
+}
@@ -0,0 +1,296 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Checkpoint.h>
+#include <APPX/Encode.h>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        const char kMagic[] = "appx-checkpoint";
+        const unsigned kVersion = 2;
+
+        bool ParseSHA256Hash(const std::string &hex, SHA256Hash &hash)
+        {
+            std::vector<std::uint8_t> bytes;
+            if (!ParseHexString(hex, bytes) ||
+                bytes.size() != sizeof(hash.bytes)) {
+                return false;
+            }
+            hash = SHA256Hash(bytes.data());
+            return true;
+        }
+
+        // Encodes a stamp as a whitespace-free field: hex, or "-" if it is
+        // empty.
+        std::string StampField(const std::string &stamp)
+        {
+            if (stamp.empty()) {
+                return "-";
+            }
+            return HexString(
+                reinterpret_cast<const std::uint8_t *>(stamp.data()),
+                stamp.size());
+        }
+
+        bool ParseStampField(const std::string &field, std::string &stamp)
+        {
+            std::vector<std::uint8_t> bytes;
+            if (field == "-") {
+                stamp.clear();
+                return true;
+            }
+            if (!ParseHexString(field, bytes)) {
+                return false;
+            }
+            stamp.assign(bytes.begin(), bytes.end());
+            return true;
+        }
+
+        // Reads a line, returning false at the end of the file or if the
+        // line was cut short (by a crash while it was being written).
+        bool ReadLine(std::istream &in, std::string &line)
+        {
+            return std::getline(in, line) && !in.eof();
+        }
+    }
+
+    const std::chrono::seconds Checkpoint::kInterval(30);
+
+    Checkpoint::Checkpoint(std::string path, const SHA256Hash &fingerprint,
+                           std::vector<std::string> stamps, bool resume,
+                           FILE *output)
+        : path(std::move(path)),
+          stamps(std::move(stamps)),
+          output(output),
+          lastFlush(std::chrono::steady_clock::now())
+    {
+        if (resume) {
+            this->Load(fingerprint);
+        }
+
+        // Rewrite the loaded records, dropping any partially written record
+        // after them. Replace the old checkpoint atomically so a crash now
+        // does not lose it.
+        std::string temporaryPath = this->path + ".tmp";
+        this->file = Open(temporaryPath, "wb");
+        this->WriteHeader(fingerprint);
+        for (const Record &record : this->resumed) {
+            this->WriteRecord(record);
+        }
+        if (std::fflush(this->file.get()) != 0) {
+            throw ErrnoException(temporaryPath);
+        }
+        if (std::rename(temporaryPath.c_str(), this->path.c_str()) != 0) {
+            throw ErrnoException(this->path);
+        }
+    }
+
+    void Checkpoint::Add(const ZIPFileEntry &entry, off_t endOffset,
+                         const SHA256Sink &axpcSink)
+    {
+        this->queued.push_back(Record{entry, endOffset, axpcSink});
+        if (std::chrono::steady_clock::now() - this->lastFlush >= kInterval) {
+            this->Flush();
+        }
+    }
+
+    void Checkpoint::Flush()
+    {
+        this->lastFlush = std::chrono::steady_clock::now();
+        if (this->queued.empty()) {
+            return;
+        }
+        if (std::fflush(this->output) != 0) {
+            throw ErrnoException();
+        }
+        for (const Record &record : this->queued) {
+            this->WriteRecord(record);
+        }
+        if (std::fflush(this->file.get()) != 0) {
+            throw ErrnoException(this->path);
+        }
+        this->queued.clear();
+    }
+
+    void Checkpoint::Remove()
+    {
+        this->file.reset();
+        if (unlink(this->path.c_str()) != 0) {
+            throw ErrnoException(this->path);
+        }
+    }
+
+    SHA256Hash Checkpoint::Fingerprint(
+        int compressionLevel,
+        const std::vector<std::pair<std::string, std::string>> &inputs,
+        InputSource &source)
+    {
+        std::ostringstream text;
+        text << kMagic << " " << kVersion << "\n" << compressionLevel << "\n";
+        for (const auto &input : inputs) {
+            text << input.first << '\0' << input.second << '\0'
+                 << source.Size(input.second) << "\n";
+        }
+        std::string bytes = text.str();
+        return SHA256Hash::DigestFromBytes(
+            bytes.size(), reinterpret_cast<const std::uint8_t *>(bytes.data()));
+    }
+
+    void Checkpoint::Load(const SHA256Hash &fingerprint)
+    {
+        std::ifstream file(this->path);
+        if (!file) {
+            if (errno == ENOENT) {
+                return;
+            }
+            throw ErrnoException(this->path);
+        }
+        std::runtime_error malformed("Malformed checkpoint: " + this->path);
+
+        std::string line;
+        if (!ReadLine(file, line)) {
+            // Interrupted before the header was written.
+            return;
+        }
+        {
+            std::istringstream in(line);
+            std::string magic;
+            unsigned version;
+            std::string hex;
+            SHA256Hash hash;
+            if (!(in >> magic >> version >> hex) || magic != kMagic ||
+                version != kVersion || !ParseSHA256Hash(hex, hash)) {
+                throw malformed;
+            }
+            if (hash != fingerprint) {
+                throw std::runtime_error(
+                    "Checkpoint is for different inputs or options: " +
+                    this->path);
+            }
+        }
+
+        while (ReadLine(file, line)) {
+            std::istringstream in(line);
+            std::vector<Record> records;
+            std::string stampField;
+            std::string stamp;
+            if (!ReadRecord(in, records) || !(in >> stampField) ||
+                !ParseStampField(stampField, stamp)) {
+                throw malformed;
+            }
+            // Inputs after a changed one are written again too, since
+            // their records' offsets and hash states depend on it.
+            std::size_t index = this->resumed.size();
+            if (index < this->stamps.size() && stamp != this->stamps[index]) {
+                break;
+            }
+            this->resumed.push_back(std::move(records.front()));
+        }
+    }
+
+    bool Checkpoint::ReadRecord(std::istream &in, std::vector<Record> &records)
+    {
+        std::string nameHex;
+        off_t compressedSize;
+        off_t uncompressedSize;
+        unsigned compressionType;
+        off_t fileRecordHeaderOffset;
+        std::uint32_t crc32;
+        std::string sha256Hex;
+        off_t endOffset;
+        std::string stateHex;
+        std::size_t blockCount;
+        if (!(in >> nameHex >> compressedSize >> uncompressedSize >>
+              compressionType >> fileRecordHeaderOffset >> crc32 >>
+              sha256Hex >> endOffset >> stateHex >> blockCount)) {
+            return false;
+        }
+        std::vector<std::uint8_t> name;
+        SHA256Hash sha256;
+        std::vector<std::uint8_t> state;
+        if (!ParseHexString(nameHex, name) ||
+            !ParseSHA256Hash(sha256Hex, sha256) ||
+            !ParseHexString(stateHex, state) ||
+            (compressionType !=
+                 static_cast<unsigned>(ZIPCompressionType::Store) &&
+             compressionType !=
+                 static_cast<unsigned>(ZIPCompressionType::Deflate))) {
+            return false;
+        }
+        std::vector<ZIPBlock> blocks;
+        for (std::size_t i = 0; i < blockCount; ++i) {
+            off_t blockCompressedSize;
+            std::string hashHex;
+            SHA256Hash hash;
+            if (!(in >> blockCompressedSize >> hashHex) ||
+                !ParseSHA256Hash(hashHex, hash)) {
+                return false;
+            }
+            blocks.emplace_back(hash, blockCompressedSize);
+        }
+        records.push_back(Record{
+            ZIPFileEntry(std::string(name.begin(), name.end()), compressedSize,
+                         uncompressedSize,
+                         static_cast<ZIPCompressionType>(compressionType),
+                         fileRecordHeaderOffset, crc32, std::move(blocks),
+                         sha256),
+            endOffset, SHA256Sink(state)});
+        return true;
+    }
+
+    void Checkpoint::WriteHeader(const SHA256Hash &fingerprint)
+    {
+        std::ostringstream out;
+        out << kMagic << " " << kVersion << " "
+            << HexString(fingerprint.bytes, sizeof(fingerprint.bytes))
+            << "\n";
+        std::string line = out.str();
+        Write(this->file, line.size(), line.data());
+    }
+
+    void Checkpoint::WriteRecord(const Record &record)
+    {
+        std::ostringstream out;
+        FormatRecord(out, record);
+        out << " "
+            << StampField(this->written < this->stamps.size()
+                              ? this->stamps[this->written]
+                              : std::string())
+            << "\n";
+        ++this->written;
+        std::string line = out.str();
+        Write(this->file, line.size(), line.data());
+    }
+
+    void Checkpoint::FormatRecord(std::ostream &out, const Record &record)
+    {
+        const ZIPFileEntry &entry = record.entry;
+        std::vector<std::uint8_t> state = record.axpcSink.State();
+        out << HexString(reinterpret_cast<const std::uint8_t *>(
+                             entry.fileName.data()),
+                         entry.fileName.size())
+            << " " << entry.compressedSize << " " << entry.uncompressedSize
+            << " " << static_cast<unsigned>(entry.compressionType) << " "
+            << entry.fileRecordHeaderOffset << " " << entry.crc32 << " "
+            << HexString(entry.sha256.bytes, sizeof(entry.sha256.bytes))
+            << " " << record.endOffset << " "
+            << HexString(state.data(), state.size()) << " "
+            << entry.blocks.size();
+        for (const ZIPBlock &block : entry.blocks) {
+            out << " " << block.compressedSize << " "
+                << HexString(block.sha256.bytes, sizeof(block.sha256.bytes));
+        }
+    }
+}
+}
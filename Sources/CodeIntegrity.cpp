@@ -0,0 +1,247 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/CodeIntegrity.h>
+#include <APPX/Sign.h>
+#include <algorithm>
+#include <cctype>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        enum
+        {
+            // PE headers further into the file than this are not parsed.
+            kMaxPEHeaderOffset = 64 * 1024,
+        };
+
+        enum : std::uint16_t
+        {
+            kPE32Magic = 0x10b,
+            kPE32PlusMagic = 0x20b,
+        };
+
+        std::uint16_t ReadU16(const std::vector<std::uint8_t> &bytes,
+                              std::size_t offset)
+        {
+            return static_cast<std::uint16_t>(bytes[offset] |
+                                              bytes[offset + 1] << 8);
+        }
+
+        std::uint32_t ReadU32(const std::vector<std::uint8_t> &bytes,
+                              std::size_t offset)
+        {
+            return static_cast<std::uint32_t>(ReadU16(bytes, offset)) |
+                   static_cast<std::uint32_t>(ReadU16(bytes, offset + 2))
+                       << 16;
+        }
+
+        bool EndsWith(const std::string &string, const std::string &suffix)
+        {
+            return suffix.size() <= string.size() &&
+                   std::equal(suffix.rbegin(), suffix.rend(), string.rbegin(),
+                              [](char a, char b) {
+                                  return std::tolower(
+                                             static_cast<unsigned char>(a)) ==
+                                         std::tolower(
+                                             static_cast<unsigned char>(b));
+                              });
+        }
+    }
+
+    const char kCodeIntegrityCatalogName[] = "AppxMetadata/CodeIntegrity.cat";
+
+    void PEImageHashSink::Write(std::size_t size, const std::uint8_t *bytes)
+    {
+        switch (this->state) {
+        case State::Header:
+            this->header.insert(this->header.end(), bytes, bytes + size);
+            this->offset += size;
+            this->ParseHeader(false);
+            break;
+        case State::Image:
+            this->Hash(this->offset, size, bytes);
+            this->offset += size;
+            break;
+        case State::NotImage:
+            break;
+        }
+    }
+
+    bool PEImageHashSink::IsPEImage()
+    {
+        if (this->state == State::Header) {
+            this->ParseHeader(true);
+        }
+        return this->state == State::Image;
+    }
+
+    SHA256Hash PEImageHashSink::SHA256() const
+    {
+        return this->sha256Sink.SHA256();
+    }
+
+    void PEImageHashSink::ParseHeader(bool isEnd)
+    {
+        const std::vector<std::uint8_t> &header = this->header;
+        // Returns true if the header is long enough to read size bytes at
+        // offset. If it is not, waits for more data, or gives up at the end.
+        auto has = [this, &header, isEnd](std::size_t offset,
+                                          std::size_t size) {
+            if (header.size() >= offset + size) {
+                return true;
+            }
+            if (isEnd) {
+                this->state = State::NotImage;
+            }
+            return false;
+        };
+
+        // DOS header.
+        if (!has(0, 0x40)) {
+            return;
+        }
+        if (header[0] != 'M' || header[1] != 'Z') {
+            this->state = State::NotImage;
+            return;
+        }
+        std::uint32_t peOffset = ReadU32(header, 0x3c);
+        if (peOffset > kMaxPEHeaderOffset) {
+            this->state = State::NotImage;
+            return;
+        }
+
+        // PE signature, COFF header, and optional header magic.
+        std::size_t optionalHeaderOffset = peOffset + 24;
+        if (!has(peOffset, 24 + 2)) {
+            return;
+        }
+        if (header[peOffset] != 'P' || header[peOffset + 1] != 'E' ||
+            header[peOffset + 2] != 0 || header[peOffset + 3] != 0) {
+            this->state = State::NotImage;
+            return;
+        }
+        std::uint16_t optionalHeaderSize = ReadU16(header, peOffset + 20);
+        std::uint16_t magic = ReadU16(header, optionalHeaderOffset);
+        if (magic != kPE32Magic && magic != kPE32PlusMagic) {
+            this->state = State::NotImage;
+            return;
+        }
+        bool isPE32Plus = magic == kPE32PlusMagic;
+        std::size_t checksumOffset = optionalHeaderOffset + 64;
+        std::size_t directoryCountOffset =
+            optionalHeaderOffset + (isPE32Plus ? 108 : 92);
+        // The certificate table is the fifth data directory.
+        std::size_t certificateDirectoryOffset =
+            optionalHeaderOffset + (isPE32Plus ? 144 : 128);
+        if (certificateDirectoryOffset + 8 >
+            optionalHeaderOffset + optionalHeaderSize) {
+            this->state = State::NotImage;
+            return;
+        }
+        if (!has(certificateDirectoryOffset, 8)) {
+            return;
+        }
+        if (ReadU32(header, directoryCountOffset) < 5) {
+            this->state = State::NotImage;
+            return;
+        }
+        off_t certificateTableOffset =
+            ReadU32(header, certificateDirectoryOffset);
+        off_t certificateTableSize =
+            ReadU32(header, certificateDirectoryOffset + 4);
+
+        this->excluded.emplace_back(checksumOffset, checksumOffset + 4);
+        this->excluded.emplace_back(certificateDirectoryOffset,
+                                    certificateDirectoryOffset + 8);
+        if (certificateTableSize > 0) {
+            if (certificateTableOffset <
+                static_cast<off_t>(certificateDirectoryOffset + 8)) {
+                this->state = State::NotImage;
+                return;
+            }
+            this->excluded.emplace_back(
+                certificateTableOffset,
+                certificateTableOffset + certificateTableSize);
+        }
+
+        this->state = State::Image;
+        this->Hash(0, header.size(), header.data());
+        this->header = std::vector<std::uint8_t>();
+    }
+
+    void PEImageHashSink::Hash(off_t offset, std::size_t size,
+                               const std::uint8_t *bytes)
+    {
+        off_t end = offset + static_cast<off_t>(size);
+        for (const std::pair<off_t, off_t> &range : this->excluded) {
+            if (range.second <= offset) {
+                continue;
+            }
+            if (range.first >= end) {
+                break;
+            }
+            if (range.first > offset) {
+                std::size_t hashSize =
+                    static_cast<std::size_t>(range.first - offset);
+                this->sha256Sink.Write(hashSize, bytes);
+                bytes += hashSize;
+                offset += hashSize;
+            }
+            off_t skipTo = std::min(range.second, end);
+            bytes += skipTo - offset;
+            offset = skipTo;
+        }
+        if (offset < end) {
+            this->sha256Sink.Write(static_cast<std::size_t>(end - offset),
+                                   bytes);
+        }
+    }
+
+    bool CodeIntegrityCatalog::IsMember(const std::string &archiveName)
+    {
+        return EndsWith(archiveName, ".exe") || EndsWith(archiveName, ".dll");
+    }
+
+    void CodeIntegrityCatalog::Add(const std::string &archiveName,
+                                   PEImageHashSink &hashSink)
+    {
+        if (!hashSink.IsPEImage()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->members.emplace_back(archiveName, hashSink.SHA256());
+    }
+
+    void CodeIntegrityCatalog::Add(const std::string &archiveName,
+                                   const SHA256Hash &imageHash)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->members.emplace_back(archiveName, imageHash);
+    }
+
+    std::vector<std::pair<std::string, SHA256Hash>>
+    CodeIntegrityCatalog::Members() const
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->members;
+    }
+
+    bool CodeIntegrityCatalog::Empty() const
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->members.empty();
+    }
+
+    OpenSSLPtr<PKCS7, PKCS7_free> CodeIntegrityCatalog::Sign(
+        const std::string &certPath) const
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return SignCatalog(certPath, this->members);
+    }
+}
+}
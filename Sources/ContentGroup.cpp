@@ -0,0 +1,133 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/ContentGroup.h>
+#include <APPX/XML.h>
+#include <algorithm>
+#include <sstream>
+
+namespace facebook {
+namespace appx {
+    const char ContentGroupMap::kRequiredGroupName[] = "Required";
+    const char ContentGroupMap::kArchiveName[] =
+        "AppxMetadata/AppxContentGroupMap.xml";
+
+    ContentGroupMap::ContentGroupMap()
+        : groupNames{std::string(kRequiredGroupName)}
+    {
+    }
+
+    void ContentGroupMap::Add(const std::string &groupName,
+                              std::string pattern)
+    {
+        std::size_t group = this->GroupIndex(groupName);
+        if (!pattern.empty() && pattern.back() == '*') {
+            pattern.pop_back();
+            this->prefixGroups.emplace_back(std::move(pattern), group);
+        } else {
+            this->archiveNameGroups.emplace(std::move(pattern), group);
+        }
+        this->patternCount += 1;
+    }
+
+    std::size_t ContentGroupMap::GroupOf(const std::string &archiveName) const
+    {
+        auto it = this->archiveNameGroups.find(archiveName);
+        if (it != this->archiveNameGroups.end()) {
+            return it->second;
+        }
+        std::size_t group = 0;
+        std::size_t longestPrefix = 0;
+        bool matched = false;
+        for (const auto &prefixGroup : this->prefixGroups) {
+            const std::string &prefix = prefixGroup.first;
+            if (archiveName.compare(0, prefix.size(), prefix) == 0 &&
+                (!matched || prefix.size() > longestPrefix)) {
+                group = prefixGroup.second;
+                longestPrefix = prefix.size();
+                matched = true;
+            }
+        }
+        return group;
+    }
+
+    void ContentGroupMap::Layout(std::vector<FileListEntry> &files) const
+    {
+        std::vector<std::pair<std::size_t, FileListEntry>> grouped;
+        grouped.reserve(files.size());
+        for (FileListEntry &file : files) {
+            std::size_t group = this->GroupOf(file.first);
+            grouped.emplace_back(group, std::move(file));
+        }
+        std::stable_sort(grouped.begin(), grouped.end(),
+                         [](const std::pair<std::size_t, FileListEntry> &a,
+                            const std::pair<std::size_t, FileListEntry> &b) {
+                             return a.first < b.first;
+                         });
+        files.clear();
+        for (auto &file : grouped) {
+            files.push_back(std::move(file.second));
+        }
+    }
+
+    std::string ContentGroupMap::XML(
+        const std::vector<std::string> &archiveNames) const
+    {
+        std::vector<std::vector<const std::string *>> groupFiles(
+            this->groupNames.size());
+        for (const std::string &archiveName : archiveNames) {
+            groupFiles[this->GroupOf(archiveName)].push_back(&archiveName);
+        }
+
+        auto writeGroup = [&](std::ostringstream &ss, std::size_t group) {
+            ss << "<ContentGroup Name=\""
+               << XMLEncodeString(this->groupNames[group]) << "\">";
+            for (const std::string *archiveName : groupFiles[group]) {
+                std::string fixedFileName = *archiveName;
+                std::replace(fixedFileName.begin(), fixedFileName.end(), '/',
+                             '\\');
+                ss << "<File Name=\"" << XMLEncodeString(fixedFileName)
+                   << "\"/>";
+            }
+            ss << "</ContentGroup>";
+        };
+
+        std::ostringstream ss;
+        ss << "<?xml "
+           << "version=\"1.0\" "
+           << "encoding=\"UTF-8\" "
+           << "standalone=\"yes\"?>\r\n";
+        ss << "<ContentGroupMap "
+           << "xmlns=\"http://schemas.microsoft.com/appx/2016/"
+              "contentgroupmap\">";
+        ss << "<Required>";
+        writeGroup(ss, 0);
+        ss << "</Required>";
+        if (this->groupNames.size() > 1) {
+            ss << "<Automatic>";
+            for (std::size_t group = 1; group < this->groupNames.size();
+                 ++group) {
+                writeGroup(ss, group);
+            }
+            ss << "</Automatic>";
+        }
+        ss << "</ContentGroupMap>";
+        return ss.str();
+    }
+
+    std::size_t ContentGroupMap::GroupIndex(const std::string &groupName)
+    {
+        auto it = std::find(this->groupNames.begin(), this->groupNames.end(),
+                            groupName);
+        if (it != this->groupNames.end()) {
+            return static_cast<std::size_t>(it - this->groupNames.begin());
+        }
+        this->groupNames.push_back(groupName);
+        return this->groupNames.size() - 1;
+    }
+}
+}
@@ -0,0 +1,163 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/ContentStore.h>
+#include <APPX/Encode.h>
+#include <cerrno>
+#include <limits>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        // Blobs are named by SHA-256 hashes.
+        const std::size_t kHashSize = 32;
+
+        // Checks that a blob of the expected size was read.
+        void CheckSize(const std::string &path, off_t expected, off_t read)
+        {
+            if (read != expected) {
+                throw std::runtime_error(
+                    "Blob size does not match its digest: " + path);
+            }
+        }
+    }
+
+    ContentStoreInputSource::ContentStoreInputSource(std::string directory,
+                                                     InputSource &base)
+        : directory(std::move(directory)), base(base)
+    {
+    }
+
+    std::string ContentStoreInputSource::AddBlob(const std::string &digest)
+    {
+        std::runtime_error malformed("Malformed content digest: " + digest);
+        auto slash = digest.find('/');
+        if (slash == std::string::npos || slash == 0 ||
+            slash + 1 == digest.size()) {
+            throw malformed;
+        }
+        // Blobs are named by lower-case hashes.
+        std::string hash = digest.substr(0, slash);
+        for (char &c : hash) {
+            if (c >= 'A' && c <= 'F') {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        std::vector<std::uint8_t> hashBytes;
+        if (!ParseHexString(hash, hashBytes) ||
+            hashBytes.size() != kHashSize) {
+            throw malformed;
+        }
+        off_t size = 0;
+        for (std::size_t i = slash + 1; i < digest.size(); ++i) {
+            if (digest[i] < '0' || digest[i] > '9' ||
+                size > (std::numeric_limits<off_t>::max() - 9) / 10) {
+                throw malformed;
+            }
+            size = size * 10 + (digest[i] - '0');
+        }
+
+        std::string path = this->directory + "/" + hash;
+        if (access(path.c_str(), F_OK) != 0) {
+            std::string shardedPath =
+                this->directory + "/" + hash.substr(0, 2) + "/" + hash;
+            if (access(shardedPath.c_str(), F_OK) != 0) {
+                throw std::runtime_error("Blob not in content store: " +
+                                         digest);
+            }
+            path = std::move(shardedPath);
+        }
+
+        // Manifests may name a blob more than once. Its entry is left as
+        // it is, since inputs may already be reading it.
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto added = this->blobs.emplace(
+            path, Blob{hash + "/" + std::to_string(size), size});
+        if (!added.second && added.first->second.size != size) {
+            throw malformed;
+        }
+        return path;
+    }
+
+    const ContentStoreInputSource::Blob *ContentStoreInputSource::Find(
+        const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto it = this->blobs.find(path);
+        // Blobs are never removed, so the pointer stays valid.
+        return it == this->blobs.end() ? nullptr : &it->second;
+    }
+
+    off_t ContentStoreInputSource::Size(const std::string &path)
+    {
+        if (const Blob *blob = this->Find(path)) {
+            return blob->size;
+        }
+        return this->base.Size(path);
+    }
+
+    std::string ContentStoreInputSource::Stamp(const std::string &path)
+    {
+        if (const Blob *blob = this->Find(path)) {
+            return "content " + blob->digest;
+        }
+        return this->base.Stamp(path);
+    }
+
+    void ContentStoreInputSource::Read(const std::string &path,
+                                       CachePolicy policy,
+                                       const WriteFunc &write)
+    {
+        const Blob *blob = this->Find(path);
+        if (!blob) {
+            this->base.Read(path, policy, write);
+            return;
+        }
+        off_t read = 0;
+        this->base.Read(path, policy,
+                        [&](std::size_t size, const std::uint8_t *bytes) {
+                            read += static_cast<off_t>(size);
+                            write(size, bytes);
+                        });
+        CheckSize(path, blob->size, read);
+    }
+
+    void ContentStoreInputSource::ReadSparse(const std::string &path,
+                                             CachePolicy policy,
+                                             const WriteFunc &write,
+                                             const WriteZerosFunc &writeZeros)
+    {
+        const Blob *blob = this->Find(path);
+        if (!blob) {
+            this->base.ReadSparse(path, policy, write, writeZeros);
+            return;
+        }
+        off_t read = 0;
+        this->base.ReadSparse(
+            path, policy,
+            [&](std::size_t size, const std::uint8_t *bytes) {
+                read += static_cast<off_t>(size);
+                write(size, bytes);
+            },
+            [&](off_t size) {
+                read += size;
+                writeZeros(size);
+            });
+        CheckSize(path, blob->size, read);
+    }
+
+    std::size_t ContentStoreInputSource::ReadAt(const std::string &path,
+                                                off_t offset, std::size_t size,
+                                                std::uint8_t *bytes)
+    {
+        return this->base.ReadAt(path, offset, size, bytes);
+    }
+}
+}
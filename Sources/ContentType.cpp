@@ -0,0 +1,79 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/ContentType.h>
+#include <stdexcept>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        const std::unordered_map<std::string, std::string> &BuiltInTypes()
+        {
+            static const std::unordered_map<std::string, std::string> kTypes =
+                {
+                    {"appx", "application/vnd.ms-appx"},
+                    {"dll", "application/x-msdownload"},
+                    {"exe", "application/x-msdownload"},
+                    {"png", "image/png"},
+                    {"xml", "application/vnd.ms-appx.manifest+xml"},
+                };
+            return kTypes;
+        }
+    }
+
+    const char ContentTypeRegistry::kDefaultContentType[] =
+        "application/octet-stream";
+
+    void ContentTypeRegistry::Add(const std::string &extension,
+                                  std::string contentType)
+    {
+        if (extension.empty() ||
+            extension.find_first_of("./") != std::string::npos) {
+            throw std::runtime_error("Invalid file extension: " + extension);
+        }
+        if (contentType.empty()) {
+            throw std::runtime_error("Missing content type for extension: " +
+                                     extension);
+        }
+        std::string key = extension;
+        ToLower(key);
+        this->types[std::move(key)] = std::move(contentType);
+    }
+
+    const std::string &ContentTypeRegistry::Find(
+        const std::string &lowerExtension, bool isBundle) const
+    {
+        static const std::string kDefault = kDefaultContentType;
+        static const std::string kBundleManifest =
+            "application/vnd.ms-appx.bundlemanifest+xml";
+
+        auto it = this->types.find(lowerExtension);
+        if (it != this->types.end()) {
+            return it->second;
+        }
+        if (isBundle && lowerExtension == "xml") {
+            return kBundleManifest;
+        }
+        const std::unordered_map<std::string, std::string> &builtIn =
+            BuiltInTypes();
+        it = builtIn.find(lowerExtension);
+        if (it != builtIn.end()) {
+            return it->second;
+        }
+        return kDefault;
+    }
+
+    void ContentTypeRegistry::ToLower(std::string &extension)
+    {
+        for (char &c : extension) {
+            if (c >= 'A' && c <= 'Z') {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+    }
+}
+}
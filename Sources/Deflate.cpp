@@ -0,0 +1,958 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Deflate.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <zlib.h>
+
+// DEFLATE is specified by RFC 1951.
+
+namespace facebook {
+namespace appx {
+    namespace {
+        enum
+        {
+            kMinMatch = 3,
+            kMaxMatch = 258,
+            kWindowSize = 32768,
+            kMaxStoredBlockSize = 65535,
+
+            kLiteralLengthCodes = 286,
+            kFixedLiteralLengthCodes = 288,
+            kDistanceCodes = 30,
+            kCodeLengthCodes = 19,
+            kEndOfBlock = 256,
+            kMaxCodeBits = 15,
+            kMaxCodeLengthCodeBits = 7,
+        };
+
+        // Search effort. Longer hash chains find more (and closer) matches;
+        // more iterations let the cost model settle.
+        enum
+        {
+            kHashBits = 15,
+            kMaxChainLength = 2048,
+            kIterations = 10,
+            kMaxIterationsWithoutGain = 3,
+            kSplitCandidates = 16,
+            kMaxSplitDepth = 4,
+            kMinSplitSymbols = 1024,
+        };
+
+        const std::uint16_t kLengthBase[] = {
+            3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+            31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+        };
+        const std::uint8_t kLengthExtraBits[] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+            2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+        };
+        const std::uint16_t kDistanceBase[] = {
+            1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+            33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+            1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385,
+            24577,
+        };
+        const std::uint8_t kDistanceExtraBits[] = {
+            0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+            6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+        };
+        const std::uint8_t kCodeLengthOrder[kCodeLengthCodes] = {
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+        };
+
+        // Returns the literal/length code (257 to 285) for a match length.
+        unsigned LengthCode(unsigned length)
+        {
+            struct Table
+            {
+                Table()
+                {
+                    for (unsigned code = 0; code < 29; ++code) {
+                        unsigned end = code + 1 < 29 ? kLengthBase[code + 1]
+                                                     : kMaxMatch + 1;
+                        for (unsigned l = kLengthBase[code]; l < end; ++l) {
+                            this->codes[l] = static_cast<std::uint16_t>(
+                                kEndOfBlock + 1 + code);
+                        }
+                    }
+                }
+
+                std::uint16_t codes[kMaxMatch + 1];
+            };
+            static const Table table;
+            return table.codes[length];
+        }
+
+        // Returns the distance code (0 to 29) for a match distance.
+        unsigned DistanceCode(unsigned distance)
+        {
+            return static_cast<unsigned>(
+                std::upper_bound(std::begin(kDistanceBase),
+                                 std::end(kDistanceBase), distance) -
+                std::begin(kDistanceBase) - 1);
+        }
+
+        // A literal byte (if distance is 0) or a match.
+        struct Symbol
+        {
+            // The literal byte, or the match length.
+            std::uint16_t litLen;
+            std::uint16_t distance;
+        };
+
+        // How often each code is used.
+        struct Histogram
+        {
+            Histogram()
+            {
+                std::fill(std::begin(this->litLen), std::end(this->litLen),
+                          0);
+                std::fill(std::begin(this->distance),
+                          std::end(this->distance), 0);
+                this->litLen[kEndOfBlock] = 1;
+            }
+
+            explicit Histogram(const std::vector<Symbol> &symbols)
+                : Histogram()
+            {
+                for (const Symbol &symbol : symbols) {
+                    if (symbol.distance == 0) {
+                        this->litLen[symbol.litLen] += 1;
+                    } else {
+                        this->litLen[LengthCode(symbol.litLen)] += 1;
+                        this->distance[DistanceCode(symbol.distance)] += 1;
+                    }
+                }
+            }
+
+            std::size_t litLen[kLiteralLengthCodes];
+            std::size_t distance[kDistanceCodes];
+        };
+
+        // Returns code lengths of a Huffman code for the given symbol
+        // frequencies, limited to maxBits. At least two symbols are given
+        // codes, so the code is complete.
+        std::vector<std::uint8_t> HuffmanLengths(
+            std::vector<std::size_t> frequencies, unsigned maxBits)
+        {
+            std::size_t used = 0;
+            for (std::size_t i = 0; i < frequencies.size() && used < 2; ++i) {
+                used += frequencies[i] != 0;
+            }
+            for (std::size_t i = 0; i < frequencies.size() && used < 2; ++i) {
+                if (frequencies[i] == 0) {
+                    frequencies[i] = 1;
+                    used += 1;
+                }
+            }
+
+            std::vector<std::uint8_t> lengths(frequencies.size(), 0);
+            for (;;) {
+                // Nodes [0, frequencies.size()) are leaves.
+                std::vector<std::size_t> parents(frequencies.size(), 0);
+                typedef std::pair<std::size_t, std::size_t> Node;
+                std::priority_queue<Node, std::vector<Node>,
+                                    std::greater<Node>>
+                    queue;
+                for (std::size_t i = 0; i < frequencies.size(); ++i) {
+                    if (frequencies[i] != 0) {
+                        queue.push(Node(frequencies[i], i));
+                    }
+                }
+                while (queue.size() > 1) {
+                    Node a = queue.top();
+                    queue.pop();
+                    Node b = queue.top();
+                    queue.pop();
+                    std::size_t parent = parents.size();
+                    parents.push_back(0);
+                    parents[a.second] = parent;
+                    parents[b.second] = parent;
+                    queue.push(Node(a.first + b.first, parent));
+                }
+                std::size_t root = queue.top().second;
+
+                // Parents are created after their children, so depths can
+                // be computed from the root down.
+                std::vector<unsigned> depths(parents.size(), 0);
+                unsigned maxDepth = 0;
+                for (std::size_t i = root; i-- > 0;) {
+                    if (parents[i] != 0) {
+                        depths[i] = depths[parents[i]] + 1;
+                    }
+                }
+                for (std::size_t i = 0; i < frequencies.size(); ++i) {
+                    if (frequencies[i] != 0) {
+                        lengths[i] = static_cast<std::uint8_t>(depths[i]);
+                        maxDepth = std::max(maxDepth, depths[i]);
+                    }
+                }
+                if (maxDepth <= maxBits) {
+                    return lengths;
+                }
+                // Flatten the distribution and try again.
+                for (std::size_t &frequency : frequencies) {
+                    if (frequency != 0) {
+                        frequency = frequency / 2 + 1;
+                    }
+                }
+            }
+        }
+
+        // Returns the canonical Huffman codes for code lengths, bit-reversed
+        // so they can be written least significant bit first.
+        std::vector<std::uint16_t> HuffmanCodes(
+            const std::vector<std::uint8_t> &lengths)
+        {
+            unsigned counts[kMaxCodeBits + 1] = {};
+            for (std::uint8_t length : lengths) {
+                counts[length] += 1;
+            }
+            counts[0] = 0;
+            unsigned nextCodes[kMaxCodeBits + 1] = {};
+            unsigned code = 0;
+            for (unsigned bits = 1; bits <= kMaxCodeBits; ++bits) {
+                code = (code + counts[bits - 1]) << 1;
+                nextCodes[bits] = code;
+            }
+            std::vector<std::uint16_t> codes(lengths.size(), 0);
+            for (std::size_t i = 0; i < lengths.size(); ++i) {
+                unsigned length = lengths[i];
+                if (length == 0) {
+                    continue;
+                }
+                unsigned value = nextCodes[length]++;
+                unsigned reversed = 0;
+                for (unsigned bit = 0; bit < length; ++bit) {
+                    reversed = (reversed << 1) | ((value >> bit) & 1);
+                }
+                codes[i] = static_cast<std::uint16_t>(reversed);
+            }
+            return codes;
+        }
+
+        class BitWriter
+        {
+        public:
+            explicit BitWriter(std::vector<std::uint8_t> &bytes)
+                : bytes(bytes)
+            {
+            }
+
+            // Writes the low 'count' bits of value, least significant
+            // first. count must be at most 16.
+            void Write(std::uint32_t value, unsigned count)
+            {
+                this->buffer |= value << this->count;
+                this->count += count;
+                while (this->count >= 8) {
+                    this->bytes.push_back(
+                        static_cast<std::uint8_t>(this->buffer));
+                    this->buffer >>= 8;
+                    this->count -= 8;
+                }
+            }
+
+            void AlignToByte()
+            {
+                if (this->count > 0) {
+                    this->Write(0, 8 - this->count);
+                }
+            }
+
+        private:
+            std::vector<std::uint8_t> &bytes;
+            std::uint32_t buffer = 0;
+            unsigned count = 0;
+        };
+
+        // A Huffman code for literals/lengths and one for distances.
+        struct BlockCode
+        {
+            std::vector<std::uint8_t> litLenLengths;
+            std::vector<std::uint16_t> litLenCodes;
+            std::vector<std::uint8_t> distanceLengths;
+            std::vector<std::uint16_t> distanceCodes;
+
+            static BlockCode Fixed()
+            {
+                BlockCode code;
+                code.litLenLengths.resize(kFixedLiteralLengthCodes);
+                for (std::size_t i = 0; i < kFixedLiteralLengthCodes; ++i) {
+                    code.litLenLengths[i] =
+                        i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+                }
+                code.distanceLengths.assign(kDistanceCodes, 5);
+                code.litLenCodes = HuffmanCodes(code.litLenLengths);
+                code.distanceCodes = HuffmanCodes(code.distanceLengths);
+                return code;
+            }
+
+            static BlockCode Dynamic(const Histogram &histogram)
+            {
+                BlockCode code;
+                code.litLenLengths = HuffmanLengths(
+                    std::vector<std::size_t>(std::begin(histogram.litLen),
+                                             std::end(histogram.litLen)),
+                    kMaxCodeBits);
+                code.distanceLengths = HuffmanLengths(
+                    std::vector<std::size_t>(std::begin(histogram.distance),
+                                             std::end(histogram.distance)),
+                    kMaxCodeBits);
+                code.litLenCodes = HuffmanCodes(code.litLenLengths);
+                code.distanceCodes = HuffmanCodes(code.distanceLengths);
+                return code;
+            }
+
+            // Bits needed to encode the symbols (and end of block) with this
+            // code.
+            std::size_t DataBits(const Histogram &histogram) const
+            {
+                std::size_t bits = 0;
+                for (std::size_t i = 0; i < kLiteralLengthCodes; ++i) {
+                    bits += histogram.litLen[i] * this->litLenLengths[i];
+                    if (i > kEndOfBlock) {
+                        bits += histogram.litLen[i] *
+                                kLengthExtraBits[i - kEndOfBlock - 1];
+                    }
+                }
+                for (std::size_t i = 0; i < kDistanceCodes; ++i) {
+                    bits += histogram.distance[i] *
+                            (this->distanceLengths[i] + kDistanceExtraBits[i]);
+                }
+                return bits;
+            }
+
+            void WriteSymbols(BitWriter &writer,
+                              const std::vector<Symbol> &symbols) const
+            {
+                for (const Symbol &symbol : symbols) {
+                    if (symbol.distance == 0) {
+                        writer.Write(this->litLenCodes[symbol.litLen],
+                                     this->litLenLengths[symbol.litLen]);
+                        continue;
+                    }
+                    unsigned lengthCode = LengthCode(symbol.litLen);
+                    unsigned lengthIndex = lengthCode - kEndOfBlock - 1;
+                    writer.Write(this->litLenCodes[lengthCode],
+                                 this->litLenLengths[lengthCode]);
+                    writer.Write(symbol.litLen - kLengthBase[lengthIndex],
+                                 kLengthExtraBits[lengthIndex]);
+                    unsigned distanceCode = DistanceCode(symbol.distance);
+                    writer.Write(this->distanceCodes[distanceCode],
+                                 this->distanceLengths[distanceCode]);
+                    writer.Write(symbol.distance - kDistanceBase[distanceCode],
+                                 kDistanceExtraBits[distanceCode]);
+                }
+                writer.Write(this->litLenCodes[kEndOfBlock],
+                             this->litLenLengths[kEndOfBlock]);
+            }
+        };
+
+        // The header of a dynamic block: its code lengths, run-length
+        // encoded and Huffman coded.
+        struct DynamicHeader
+        {
+            struct CodeLength
+            {
+                std::uint8_t symbol;
+                std::uint8_t extra;
+            };
+
+            DynamicHeader(const BlockCode &code)
+            {
+                this->litLenCount = kLiteralLengthCodes;
+                while (this->litLenCount > kEndOfBlock + 1 &&
+                       code.litLenLengths[this->litLenCount - 1] == 0) {
+                    this->litLenCount -= 1;
+                }
+                this->distanceCount = kDistanceCodes;
+                while (this->distanceCount > 1 &&
+                       code.distanceLengths[this->distanceCount - 1] == 0) {
+                    this->distanceCount -= 1;
+                }
+                std::vector<std::uint8_t> lengths(
+                    code.litLenLengths.begin(),
+                    code.litLenLengths.begin() + this->litLenCount);
+                lengths.insert(
+                    lengths.end(), code.distanceLengths.begin(),
+                    code.distanceLengths.begin() + this->distanceCount);
+
+                // Try each combination of run-length codes, keeping the
+                // smallest.
+                this->bits = std::numeric_limits<std::size_t>::max();
+                for (unsigned flags = 0; flags < 8; ++flags) {
+                    std::vector<CodeLength> encoded = RunLengthEncode(
+                        lengths, flags & 1, flags & 2, flags & 4);
+                    std::vector<std::size_t> frequencies(kCodeLengthCodes, 0);
+                    for (const CodeLength &codeLength : encoded) {
+                        frequencies[codeLength.symbol] += 1;
+                    }
+                    std::vector<std::uint8_t> codeLengthLengths =
+                        HuffmanLengths(frequencies, kMaxCodeLengthCodeBits);
+                    std::size_t codeLengthCount = kCodeLengthCodes;
+                    while (codeLengthCount > 4 &&
+                           codeLengthLengths
+                                   [kCodeLengthOrder[codeLengthCount - 1]] ==
+                               0) {
+                        codeLengthCount -= 1;
+                    }
+                    std::size_t bits = 5 + 5 + 4 + 3 * codeLengthCount;
+                    for (const CodeLength &codeLength : encoded) {
+                        bits += codeLengthLengths[codeLength.symbol] +
+                                ExtraBits(codeLength.symbol);
+                    }
+                    if (bits < this->bits) {
+                        this->bits = bits;
+                        this->encoded = std::move(encoded);
+                        this->codeLengthLengths = std::move(codeLengthLengths);
+                        this->codeLengthCount = codeLengthCount;
+                    }
+                }
+            }
+
+            void Write(BitWriter &writer) const
+            {
+                writer.Write(static_cast<std::uint32_t>(this->litLenCount -
+                                                        (kEndOfBlock + 1)),
+                             5);
+                writer.Write(static_cast<std::uint32_t>(this->distanceCount - 1),
+                             5);
+                writer.Write(static_cast<std::uint32_t>(this->codeLengthCount - 4),
+                             4);
+                for (std::size_t i = 0; i < this->codeLengthCount; ++i) {
+                    writer.Write(this->codeLengthLengths[kCodeLengthOrder[i]],
+                                 3);
+                }
+                std::vector<std::uint16_t> codes =
+                    HuffmanCodes(this->codeLengthLengths);
+                for (const CodeLength &codeLength : this->encoded) {
+                    writer.Write(codes[codeLength.symbol],
+                                 this->codeLengthLengths[codeLength.symbol]);
+                    writer.Write(codeLength.extra,
+                                 ExtraBits(codeLength.symbol));
+                }
+            }
+
+            std::size_t bits;
+
+        private:
+            static unsigned ExtraBits(unsigned symbol)
+            {
+                switch (symbol) {
+                    case 16:
+                        return 2;
+                    case 17:
+                        return 3;
+                    case 18:
+                        return 7;
+                    default:
+                        return 0;
+                }
+            }
+
+            static std::vector<CodeLength> RunLengthEncode(
+                const std::vector<std::uint8_t> &lengths, bool use16,
+                bool use17, bool use18)
+            {
+                std::vector<CodeLength> encoded;
+                std::size_t i = 0;
+                while (i < lengths.size()) {
+                    std::uint8_t value = lengths[i];
+                    std::size_t end = i + 1;
+                    while (end < lengths.size() && lengths[end] == value) {
+                        end += 1;
+                    }
+                    if (value == 0) {
+                        while (end - i >= 3) {
+                            std::size_t count = end - i;
+                            if (use18 && count >= 11) {
+                                count = std::min<std::size_t>(count, 138);
+                                encoded.push_back(CodeLength{
+                                    18, static_cast<std::uint8_t>(count - 11)});
+                            } else if (use17) {
+                                count = std::min<std::size_t>(count, 10);
+                                encoded.push_back(CodeLength{
+                                    17, static_cast<std::uint8_t>(count - 3)});
+                            } else {
+                                break;
+                            }
+                            i += count;
+                        }
+                    } else {
+                        encoded.push_back(CodeLength{value, 0});
+                        i += 1;
+                        while (use16 && end - i >= 3) {
+                            std::size_t count =
+                                std::min<std::size_t>(end - i, 6);
+                            encoded.push_back(CodeLength{
+                                16, static_cast<std::uint8_t>(count - 3)});
+                            i += count;
+                        }
+                    }
+                    for (; i < end; ++i) {
+                        encoded.push_back(CodeLength{value, 0});
+                    }
+                }
+                return encoded;
+            }
+
+            std::size_t litLenCount;
+            std::size_t distanceCount;
+            std::size_t codeLengthCount;
+            std::vector<CodeLength> encoded;
+            std::vector<std::uint8_t> codeLengthLengths;
+        };
+
+        // Returns the size of a dynamic block, in bits, excluding the block
+        // type.
+        std::size_t DynamicBlockBits(const Histogram &histogram)
+        {
+            BlockCode code = BlockCode::Dynamic(histogram);
+            return DynamicHeader(code).bits + code.DataBits(histogram);
+        }
+
+        // Finds, for every position, the shortest distance for every match
+        // length.
+        class MatchFinder
+        {
+        public:
+            struct Match
+            {
+                std::uint16_t length;
+                std::uint16_t distance;
+            };
+
+            MatchFinder(std::size_t size, const std::uint8_t *bytes)
+                : offsets(size + 1, 0)
+            {
+                std::vector<std::int32_t> heads(1 << kHashBits, -1);
+                std::vector<std::int32_t> previous(size, -1);
+                for (std::size_t i = 0; i < size; ++i) {
+                    this->offsets[i] =
+                        static_cast<std::uint32_t>(this->matches.size());
+                    if (i + kMinMatch > size) {
+                        continue;
+                    }
+                    std::size_t maxLength =
+                        std::min<std::size_t>(kMaxMatch, size - i);
+                    std::uint32_t hash =
+                        ((bytes[i] << 10) ^ (bytes[i + 1] << 5) ^
+                         bytes[i + 2]) &
+                        ((1 << kHashBits) - 1);
+                    // Candidates are visited closest first. Record a match
+                    // whenever one is longer than all closer ones.
+                    std::size_t bestLength = kMinMatch - 1;
+                    std::size_t chainLength = 0;
+                    for (std::int32_t candidate = heads[hash];
+                         candidate >= 0 && chainLength < kMaxChainLength;
+                         candidate = previous[candidate], ++chainLength) {
+                        std::size_t distance = i - candidate;
+                        if (distance > kWindowSize) {
+                            break;
+                        }
+                        const std::uint8_t *a = bytes + i;
+                        const std::uint8_t *b = bytes + candidate;
+                        if (b[bestLength] != a[bestLength]) {
+                            continue;
+                        }
+                        std::size_t length = 0;
+                        while (length < maxLength && a[length] == b[length]) {
+                            length += 1;
+                        }
+                        if (length > bestLength) {
+                            bestLength = length;
+                            this->matches.push_back(
+                                Match{static_cast<std::uint16_t>(length),
+                                      static_cast<std::uint16_t>(distance)});
+                            if (length == maxLength) {
+                                break;
+                            }
+                        }
+                    }
+                    previous[i] = heads[hash];
+                    heads[hash] = static_cast<std::int32_t>(i);
+                }
+                this->offsets[size] =
+                    static_cast<std::uint32_t>(this->matches.size());
+            }
+
+            // Matches at a position, by increasing length and distance. For
+            // lengths after the previous match's length up to a match's
+            // length, the match's distance is the shortest.
+            const Match *Begin(std::size_t position) const
+            {
+                return this->matches.data() + this->offsets[position];
+            }
+
+            const Match *End(std::size_t position) const
+            {
+                return this->matches.data() + this->offsets[position + 1];
+            }
+
+        private:
+            std::vector<std::uint32_t> offsets;
+            std::vector<Match> matches;
+        };
+
+        // Estimated bits for each code, used to choose matches.
+        struct CostModel
+        {
+            explicit CostModel(const Histogram &histogram)
+            {
+                float litLenCosts[kLiteralLengthCodes];
+                Entropy(histogram.litLen, kLiteralLengthCodes, litLenCosts);
+                Entropy(histogram.distance, kDistanceCodes,
+                        this->distanceCodes);
+                for (unsigned i = 0; i < 256; ++i) {
+                    this->literals[i] = litLenCosts[i];
+                }
+                for (unsigned i = kMinMatch; i <= kMaxMatch; ++i) {
+                    unsigned code = LengthCode(i);
+                    this->lengths[i] = litLenCosts[code] +
+                                       kLengthExtraBits[code - kEndOfBlock - 1];
+                }
+                for (unsigned i = 0; i < kDistanceCodes; ++i) {
+                    this->distanceCodes[i] += kDistanceExtraBits[i];
+                }
+            }
+
+            float Distance(unsigned distance) const
+            {
+                return this->distanceCodes[DistanceCode(distance)];
+            }
+
+            float literals[256];
+            float lengths[kMaxMatch + 1];
+            float distanceCodes[kDistanceCodes];
+
+        private:
+            static void Entropy(const std::size_t *counts, std::size_t size,
+                                float *costs)
+            {
+                std::size_t total = 0;
+                for (std::size_t i = 0; i < size; ++i) {
+                    total += counts[i];
+                }
+                double log2Total = total ? std::log2(double(total)) : 0;
+                for (std::size_t i = 0; i < size; ++i) {
+                    // Unused codes are assumed to be rare.
+                    costs[i] = static_cast<float>(
+                        counts[i] ? log2Total - std::log2(double(counts[i]))
+                                  : log2Total + 1);
+                }
+            }
+        };
+
+        class Compressor
+        {
+        public:
+            Compressor(std::size_t size, const std::uint8_t *bytes)
+                : size(size), bytes(bytes), matchFinder(size, bytes),
+                  runs(size + 1, 0)
+            {
+                for (std::size_t i = size; i-- > 0;) {
+                    this->runs[i] =
+                        i + 1 < size && bytes[i + 1] == bytes[i]
+                            ? this->runs[i + 1] + 1
+                            : 1;
+                }
+            }
+
+            std::vector<std::uint8_t> Compress()
+            {
+                std::vector<Symbol> greedy = this->GreedyParse(0, this->size);
+                std::vector<std::size_t> splits;
+                this->FindSplits(greedy, 0, greedy.size(), 0, splits);
+
+                std::vector<std::uint8_t> output;
+                BitWriter writer(output);
+                std::size_t begin = 0;
+                std::size_t symbolIndex = 0;
+                splits.push_back(greedy.size());
+                for (std::size_t split : splits) {
+                    std::size_t end = begin;
+                    for (; symbolIndex < split; ++symbolIndex) {
+                        end += SymbolSize(greedy[symbolIndex]);
+                    }
+                    this->WriteBlock(writer, begin, end);
+                    begin = end;
+                }
+                assert(begin == this->size);
+
+                // An empty stored block, as written by deflate with
+                // Z_FULL_FLUSH.
+                writer.Write(0, 3);
+                writer.AlignToByte();
+                writer.Write(0x0000, 16);
+                writer.Write(0xffff, 16);
+                return output;
+            }
+
+        private:
+            static std::size_t SymbolSize(const Symbol &symbol)
+            {
+                return symbol.distance == 0 ? 1 : symbol.litLen;
+            }
+
+            // Parses [begin, end) taking the longest match at each position.
+            std::vector<Symbol> GreedyParse(std::size_t begin,
+                                            std::size_t end) const
+            {
+                std::vector<Symbol> symbols;
+                std::size_t i = begin;
+                while (i < end) {
+                    const MatchFinder::Match *first =
+                        this->matchFinder.Begin(i);
+                    const MatchFinder::Match *last = this->matchFinder.End(i);
+                    if (first != last) {
+                        const MatchFinder::Match &match = last[-1];
+                        std::size_t length =
+                            std::min<std::size_t>(match.length, end - i);
+                        if (length >= kMinMatch) {
+                            symbols.push_back(
+                                Symbol{static_cast<std::uint16_t>(length),
+                                       match.distance});
+                            i += length;
+                            continue;
+                        }
+                    }
+                    symbols.push_back(Symbol{this->bytes[i], 0});
+                    i += 1;
+                }
+                return symbols;
+            }
+
+            // Chooses where to split symbols [begin, end) into separate
+            // DEFLATE blocks, appending the indexes of the first symbol of
+            // each new block to splits.
+            void FindSplits(const std::vector<Symbol> &symbols,
+                            std::size_t begin, std::size_t end,
+                            unsigned depth, std::vector<std::size_t> &splits)
+            {
+                if (depth >= kMaxSplitDepth ||
+                    end - begin < 2 * kMinSplitSymbols) {
+                    return;
+                }
+                auto cost = [&symbols](std::size_t from, std::size_t to) {
+                    return DynamicBlockBits(Histogram(std::vector<Symbol>(
+                        symbols.begin() + from, symbols.begin() + to)));
+                };
+                std::size_t bestCost = cost(begin, end);
+                std::size_t bestSplit = 0;
+                for (std::size_t i = 1; i < kSplitCandidates; ++i) {
+                    std::size_t split =
+                        begin + (end - begin) * i / kSplitCandidates;
+                    std::size_t splitCost =
+                        cost(begin, split) + cost(split, end);
+                    if (splitCost < bestCost) {
+                        bestCost = splitCost;
+                        bestSplit = split;
+                    }
+                }
+                if (bestSplit == 0) {
+                    return;
+                }
+                this->FindSplits(symbols, begin, bestSplit, depth + 1, splits);
+                splits.push_back(bestSplit);
+                this->FindSplits(symbols, bestSplit, end, depth + 1, splits);
+            }
+
+            // Parses [begin, end) into the symbols with the lowest total
+            // cost.
+            std::vector<Symbol> OptimalParse(std::size_t begin,
+                                             std::size_t end,
+                                             const CostModel &model) const
+            {
+                const std::size_t size = end - begin;
+                std::vector<float> costs(size + 1,
+                                         std::numeric_limits<float>::infinity());
+                std::vector<Symbol> choices(size + 1, Symbol{0, 0});
+                costs[0] = 0;
+                auto relax = [&costs, &choices](std::size_t to, float cost,
+                                                Symbol symbol) {
+                    if (cost < costs[to]) {
+                        costs[to] = cost;
+                        choices[to] = symbol;
+                    }
+                };
+                for (std::size_t i = 0; i < size; ++i) {
+                    const float cost = costs[i];
+                    if (std::isinf(cost)) {
+                        continue;
+                    }
+                    const std::size_t position = begin + i;
+                    const std::uint8_t byte = this->bytes[position];
+
+                    // In long runs of one byte, take maximum-length matches
+                    // without considering alternatives.
+                    if (position > 0 && this->bytes[position - 1] == byte &&
+                        this->runs[position] > 2 * kMaxMatch &&
+                        i + kMaxMatch <= size) {
+                        relax(i + kMaxMatch,
+                              cost + model.lengths[kMaxMatch] +
+                                  model.Distance(1),
+                              Symbol{kMaxMatch, 1});
+                        i += kMaxMatch - 1;
+                        continue;
+                    }
+
+                    relax(i + 1, cost + model.literals[byte], Symbol{byte, 0});
+                    std::size_t length = kMinMatch;
+                    for (const MatchFinder::Match *match =
+                             this->matchFinder.Begin(position);
+                         match != this->matchFinder.End(position); ++match) {
+                        float matchCost = cost + model.Distance(match->distance);
+                        std::size_t maxLength =
+                            std::min<std::size_t>(match->length, size - i);
+                        for (; length <= maxLength; ++length) {
+                            relax(i + length,
+                                  matchCost + model.lengths[length],
+                                  Symbol{static_cast<std::uint16_t>(length),
+                                         match->distance});
+                        }
+                        if (maxLength < match->length) {
+                            break;
+                        }
+                    }
+                }
+
+                std::vector<Symbol> symbols;
+                for (std::size_t i = size; i > 0;) {
+                    const Symbol &symbol = choices[i];
+                    symbols.push_back(symbol);
+                    i -= SymbolSize(symbol);
+                }
+                std::reverse(symbols.begin(), symbols.end());
+                return symbols;
+            }
+
+            // Writes [begin, end) as a non-final DEFLATE block (or several
+            // stored blocks), whichever kind is smallest.
+            void WriteBlock(BitWriter &writer, std::size_t begin,
+                            std::size_t end) const
+            {
+                // Refine the cost model using the previous parse until it
+                // stops improving.
+                std::vector<Symbol> best = this->GreedyParse(begin, end);
+                Histogram bestHistogram(best);
+                std::size_t bestBits = DynamicBlockBits(bestHistogram);
+                Histogram histogram = bestHistogram;
+                unsigned iterationsWithoutGain = 0;
+                for (unsigned i = 0; i < kIterations &&
+                                     iterationsWithoutGain <
+                                         kMaxIterationsWithoutGain;
+                     ++i) {
+                    std::vector<Symbol> symbols =
+                        this->OptimalParse(begin, end, CostModel(histogram));
+                    histogram = Histogram(symbols);
+                    std::size_t bits = DynamicBlockBits(histogram);
+                    if (bits < bestBits) {
+                        best = std::move(symbols);
+                        bestHistogram = histogram;
+                        bestBits = bits;
+                        iterationsWithoutGain = 0;
+                    } else {
+                        iterationsWithoutGain += 1;
+                    }
+                }
+
+                BlockCode fixed = BlockCode::Fixed();
+                std::size_t fixedBits = fixed.DataBits(bestHistogram);
+                std::size_t storedCount =
+                    std::max<std::size_t>(
+                        1, (end - begin + kMaxStoredBlockSize - 1) /
+                               kMaxStoredBlockSize);
+                std::size_t storedBits =
+                    storedCount * (3 + 7 + 32) + 8 * (end - begin);
+
+                if (storedBits < bestBits && storedBits < fixedBits) {
+                    std::size_t i = begin;
+                    do {
+                        std::size_t count = std::min<std::size_t>(
+                            end - i, kMaxStoredBlockSize);
+                        writer.Write(0, 3);
+                        writer.AlignToByte();
+                        writer.Write(static_cast<std::uint32_t>(count), 16);
+                        writer.Write(
+                            static_cast<std::uint32_t>(~count & 0xffff), 16);
+                        for (std::size_t j = 0; j < count; ++j) {
+                            writer.Write(this->bytes[i + j], 8);
+                        }
+                        i += count;
+                    } while (i < end);
+                } else if (fixedBits <= bestBits) {
+                    writer.Write(1 << 1, 3);
+                    fixed.WriteSymbols(writer, best);
+                } else {
+                    BlockCode code = BlockCode::Dynamic(bestHistogram);
+                    writer.Write(2 << 1, 3);
+                    DynamicHeader(code).Write(writer);
+                    code.WriteSymbols(writer, best);
+                }
+            }
+
+            const std::size_t size;
+            const std::uint8_t *bytes;
+            MatchFinder matchFinder;
+            // The number of bytes equal to bytes[i] starting at i.
+            std::vector<std::size_t> runs;
+        };
+
+        // Compresses with zlib at Z_BEST_COMPRESSION, like DeflateSink.
+        std::vector<std::uint8_t> ZlibDeflate(std::size_t size,
+                                              const std::uint8_t *bytes)
+        {
+            z_stream stream;
+            stream.zalloc = nullptr;
+            stream.zfree = nullptr;
+            stream.opaque = nullptr;
+            if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED,
+                             -MAX_WBITS, MAX_MEM_LEVEL,
+                             Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("deflateInit failed");
+            }
+            // deflateBound does not account for the flush marker.
+            std::vector<std::uint8_t> output(deflateBound(&stream, size) + 16);
+            stream.next_in = const_cast<std::uint8_t *>(bytes);
+            stream.avail_in = static_cast<uInt>(size);
+            stream.next_out = output.data();
+            stream.avail_out = static_cast<uInt>(output.size());
+            int rc = deflate(&stream, Z_FULL_FLUSH);
+            std::size_t outputSize = output.size() - stream.avail_out;
+            // The stream is unfinished, so deflateEnd reports an error.
+            deflateEnd(&stream);
+            if (rc != Z_OK || stream.avail_in != 0 || stream.avail_out == 0) {
+                throw std::runtime_error("deflate failed");
+            }
+            output.resize(outputSize);
+            return output;
+        }
+    }
+
+    std::vector<std::uint8_t> ExhaustiveDeflate(std::size_t size,
+                                                const std::uint8_t *bytes)
+    {
+        std::vector<std::uint8_t> zlibOutput = ZlibDeflate(size, bytes);
+        if (size == 0) {
+            return zlibOutput;
+        }
+        std::vector<std::uint8_t> output = Compressor(size, bytes).Compress();
+        return output.size() < zlibOutput.size() ? output : zlibOutput;
+    }
+}
+}
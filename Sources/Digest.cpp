@@ -0,0 +1,86 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Digest.h>
+#include <APPX/Encode.h>
+#include <APPX/OpenSSL.h>
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+namespace facebook {
+namespace appx {
+    DigestSink::DigestSink(const std::vector<std::string> &algorithms)
+    {
+        for (std::string algorithm : algorithms) {
+            std::transform(algorithm.begin(), algorithm.end(),
+                           algorithm.begin(), [](char c) {
+                               return static_cast<char>(std::tolower(
+                                   static_cast<unsigned char>(c)));
+                           });
+            const EVP_MD *md = EVP_get_digestbyname(algorithm.c_str());
+            if (!md) {
+                throw std::runtime_error("Unsupported digest algorithm: " +
+                                         algorithm);
+            }
+            std::unique_ptr<EVP_MD_CTX, ContextDeleter> context(
+                EVP_MD_CTX_new());
+            if (!context || !EVP_DigestInit_ex(context.get(), md, nullptr)) {
+                throw OpenSSLException();
+            }
+            this->algorithms.push_back(std::move(algorithm));
+            this->contexts.push_back(std::move(context));
+        }
+    }
+
+    void DigestSink::Write(std::size_t size, const std::uint8_t *bytes)
+    {
+        for (auto &context : this->contexts) {
+            if (!EVP_DigestUpdate(context.get(), bytes, size)) {
+                throw OpenSSLException();
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> DigestSink::HexDigests()
+        const
+    {
+        std::vector<std::pair<std::string, std::string>> digests;
+        for (std::size_t i = 0; i < this->contexts.size(); ++i) {
+            // Finish a copy, so more bytes can be written.
+            std::unique_ptr<EVP_MD_CTX, ContextDeleter> context(
+                EVP_MD_CTX_new());
+            std::uint8_t digest[EVP_MAX_MD_SIZE];
+            unsigned int size;
+            if (!context ||
+                !EVP_MD_CTX_copy_ex(context.get(), this->contexts[i].get()) ||
+                !EVP_DigestFinal_ex(context.get(), digest, &size)) {
+                throw OpenSSLException();
+            }
+            digests.emplace_back(this->algorithms[i], HexString(digest, size));
+        }
+        return digests;
+    }
+
+    std::vector<std::string> ParseDigestAlgorithms(const std::string &list)
+    {
+        std::vector<std::string> algorithms;
+        std::istringstream in(list);
+        std::string algorithm;
+        while (std::getline(in, algorithm, ',')) {
+            if (!algorithm.empty()) {
+                algorithms.push_back(algorithm);
+            }
+        }
+        if (algorithms.empty()) {
+            throw std::runtime_error("No digest algorithms: " + list);
+        }
+        return algorithms;
+    }
+}
+}
@@ -0,0 +1,482 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/CodeIntegrity.h>
+#include <APPX/Estimate.h>
+#include <APPX/Parallel.h>
+#include <APPX/Sign.h>
+#include <APPX/Sink.h>
+#include <APPX/Tuning.h>
+#include <APPX/ZIP.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        // Closing a DEFLATE stream after a full flush writes an empty final
+        // block.
+        const off_t kDeflateFinishSize = 2;
+
+        // Enough of a file to hold any header PEImageHashSink accepts.
+        const std::size_t kPEHeaderPrefixSize = 68 * 1024;
+
+        // How much deflated signed data (the signature, and a compressed
+        // code integrity catalog) can vary in size with the hashes in it.
+        const off_t kSignedDataSlack = 32;
+
+        enum Scenario
+        {
+            kEstimate,
+            kLow,
+            kHigh,
+            kScenarioCount,
+        };
+
+        // Compression ratios of deflated blocks.
+        struct Ratios
+        {
+            double uncompressedSize = 0;
+            double compressedSize = 0;
+            double low = std::numeric_limits<double>::max();
+            double high = 0;
+
+            void AddBlock(off_t uncompressed, off_t compressed)
+            {
+                double ratio = static_cast<double>(compressed) / uncompressed;
+                this->uncompressedSize += uncompressed;
+                this->compressedSize += compressed;
+                this->low = std::min(this->low, ratio);
+                this->high = std::max(this->high, ratio);
+            }
+
+            void Add(const Ratios &other)
+            {
+                this->uncompressedSize += other.uncompressedSize;
+                this->compressedSize += other.compressedSize;
+                this->low = std::min(this->low, other.low);
+                this->high = std::max(this->high, other.high);
+            }
+
+            bool Empty() const
+            {
+                return this->uncompressedSize == 0;
+            }
+
+            double Ratio(Scenario scenario) const
+            {
+                switch (scenario) {
+                case kLow:
+                    return this->low;
+                case kHigh:
+                    return this->high;
+                default:
+                    return this->compressedSize / this->uncompressedSize;
+                }
+            }
+        };
+
+        struct InputEstimate
+        {
+            off_t size = 0;
+            // The input's entry (at offset 0), if it is known exactly.
+            std::unique_ptr<ZIPFileEntry> entry;
+            // Otherwise, the ratios its blocks are estimated with.
+            Ratios ratios;
+        };
+
+        // Compresses a file's sample windows, each as WriteZIPFileEntry
+        // compresses a block.
+        Ratios SampleFile(InputSource &source, const std::string &path,
+                          off_t size, int compressionLevel)
+        {
+            Ratios ratios;
+            ReadSampleWindows(
+                source, path, size,
+                [&](std::size_t windowSize, const std::uint8_t *window) {
+                    OffsetSink offsetSink;
+                    auto deflateSink =
+                        MakeDeflateSink(compressionLevel, offsetSink);
+                    deflateSink.Write(windowSize, window);
+                    deflateSink.Flush();
+                    ratios.AddBlock(static_cast<off_t>(windowSize),
+                                    offsetSink.Offset());
+                    deflateSink.Close();
+                });
+            return ratios;
+        }
+
+        // Returns true if the start of a binary is a PE image's header.
+        bool IsPEImageFile(InputSource &source, const std::string &path)
+        {
+            std::vector<std::uint8_t> prefix(kPEHeaderPrefixSize);
+            PEImageHashSink hashSink;
+            std::size_t size =
+                source.ReadAt(path, 0, prefix.size(), prefix.data());
+            hashSink.Write(size, prefix.data());
+            return hashSink.IsPEImage();
+        }
+
+        // Returns an input's entry at offset for a scenario.
+        ZIPFileEntry InputEntry(const FileListEntry &input,
+                                const InputEstimate &estimate,
+                                Scenario scenario, off_t offset)
+        {
+            if (estimate.entry) {
+                ZIPFileEntry entry = *estimate.entry;
+                entry.fileRecordHeaderOffset = offset;
+                return entry;
+            }
+            double ratio = estimate.ratios.Ratio(scenario);
+            std::vector<ZIPBlock> blocks;
+            off_t compressedSize = kDeflateFinishSize;
+            for (off_t blockOffset = 0; blockOffset < estimate.size;
+                 blockOffset += ZIPBlock::kSize) {
+                off_t blockSize = std::min(
+                    static_cast<off_t>(ZIPBlock::kSize),
+                    estimate.size - blockOffset);
+                off_t blockCompressedSize = std::max<off_t>(
+                    1, static_cast<off_t>(std::llround(ratio * blockSize)));
+                blocks.push_back(ZIPBlock(SHA256Hash(), blockCompressedSize));
+                compressedSize += blockCompressedSize;
+            }
+            return ZIPFileEntry(input.first, compressedSize, estimate.size,
+                                ZIPCompressionType::Deflate, offset, 0,
+                                std::move(blocks), SHA256Hash());
+        }
+
+        // The inputs and generated files of a package, for one scenario,
+        // as WritePackage lays them out.
+        struct Layout
+        {
+            std::vector<ZIPFileEntry> entries;
+            off_t size;
+        };
+
+        Layout LayOut(Scenario scenario,
+                      const std::vector<FileListEntry> &inputs,
+                      const std::vector<InputEstimate> &estimates,
+                      const FileListEntry &appxBundleManifest,
+                      const ZIPFileEntry *catalog,
+                      const ZIPFileEntry *signature,
+                      const APPXOptions &options, InputSource &source)
+        {
+            const int compressionLevel = options.compressionLevel;
+            Layout layout;
+            std::vector<ZIPFileEntry> &entries = layout.entries;
+            off_t offset = 0;
+            for (std::size_t i = 0; i < inputs.size(); ++i) {
+                entries.push_back(
+                    InputEntry(inputs[i], estimates[i], scenario, offset));
+                offset += entries.back().FileRecordSize();
+            }
+
+            OffsetSink sink(offset);
+            if (!options.contentGroups.Empty()) {
+                std::vector<std::string> archiveNames;
+                for (const ZIPFileEntry &entry : entries) {
+                    archiveNames.push_back(entry.fileName);
+                }
+                std::string xml = options.contentGroups.XML(archiveNames);
+                entries.push_back(WriteZIPFileEntry(
+                    sink, sink.Offset(), ContentGroupMap::kArchiveName,
+                    compressionLevel, WriteStringFunc{xml}));
+            }
+            if (options.isBundle) {
+                entries.push_back(WriteZIPFileEntry(
+                    sink, sink.Offset(), appxBundleManifest.first,
+                    compressionLevel,
+                    WriteAppxBundleManifestFunc{
+                        source, appxBundleManifest.second, entries}));
+            }
+
+            // Signed data is written as estimated, and varies by up to
+            // kSignedDataSlack when deflated.
+            auto addSigned = [&](ZIPFileEntry entry) {
+                if (entry.compressionType == ZIPCompressionType::Deflate) {
+                    if (scenario == kLow) {
+                        entry.compressedSize -= kSignedDataSlack;
+                    } else if (scenario == kHigh) {
+                        entry.compressedSize += kSignedDataSlack;
+                    }
+                }
+                entry.fileRecordHeaderOffset = sink.Offset();
+                sink = OffsetSink(sink.Offset() + entry.FileRecordSize());
+                entries.push_back(std::move(entry));
+            };
+            if (catalog) {
+                addSigned(*catalog);
+            }
+            entries.push_back(WriteAppxBlockMapZIPFileEntry(
+                sink, sink.Offset(), entries, options.isBundle));
+            entries.push_back(WriteContentTypesZIPFileEntry(
+                sink, sink.Offset(), options.isBundle, entries,
+                options.contentTypes));
+            if (signature) {
+                addSigned(*signature);
+            }
+
+            for (const ZIPFileEntry &entry : entries) {
+                entry.WriteDirectoryEntry(sink);
+            }
+            WriteZIPEndOfCentralDirectoryRecord(sink, sink.Offset(), entries);
+            layout.size = sink.Offset();
+            return layout;
+        }
+
+        // Returns a placeholder for a hash which is not computed.
+        SHA256Hash PlaceholderHash(const std::string &name)
+        {
+            return SHA256Hash::DigestFromBytes(
+                name.size(), reinterpret_cast<const std::uint8_t *>(name.data()));
+        }
+
+        SizeEstimate MakeSizeEstimate(off_t estimate, off_t low, off_t high)
+        {
+            SizeEstimate size;
+            size.estimate = estimate;
+            size.low = std::min(low, estimate);
+            size.high = std::max(high, estimate);
+            return size;
+        }
+    }
+
+    PackageEstimate EstimateAppx(const std::vector<FileListEntry> &fileNames,
+                                 const APPXOptions &options)
+    {
+        if (options.timeBudget > 0 || !options.checkpointPath.empty()) {
+            throw std::runtime_error(
+                "Time budgets and checkpoints cannot be estimated");
+        }
+        if (options.isBundle && !options.contentGroups.Empty()) {
+            throw std::runtime_error(
+                "Content groups are not supported for bundles");
+        }
+        const int compressionLevel = options.compressionLevel;
+        const unsigned jobs = EffectiveJobCount(options.jobs);
+        const bool isSigned = !options.certPath.empty();
+        FileSystemInputSource fileSystem;
+        InputSource &source =
+            options.inputSource ? *options.inputSource : fileSystem;
+
+        FileListEntry appxBundleManifest;
+        std::vector<FileListEntry> inputs;
+        for (const FileListEntry &fileName : fileNames) {
+            if (options.isBundle && IsAppxBundleManifest(fileName.first)) {
+                appxBundleManifest = fileName;
+                continue;
+            }
+            if (fileName.first == ContentGroupMap::kArchiveName &&
+                !options.contentGroups.Empty()) {
+                throw std::runtime_error(
+                    std::string(ContentGroupMap::kArchiveName) +
+                    " is generated and must not be an input");
+            }
+            if (fileName.first == kCodeIntegrityCatalogName && isSigned &&
+                !options.isBundle) {
+                throw std::runtime_error(
+                    std::string(kCodeIntegrityCatalogName) +
+                    " is generated when signing and must not be an input");
+            }
+            inputs.push_back(fileName);
+        }
+        if (!options.contentGroups.Empty()) {
+            options.contentGroups.Layout(inputs);
+        }
+
+        PackageEstimate result;
+        std::vector<InputEstimate> estimates(inputs.size());
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            InputEstimate &estimate = estimates[i];
+            estimate.size = source.Size(inputs[i].second);
+            result.inputBytes += estimate.size;
+            if (compressionLevel == Z_NO_COMPRESSION ||
+                _IsAPPXFile(inputs[i].first)) {
+                // Stored files are exact without reading them.
+                std::vector<ZIPBlock> blocks(
+                    (estimate.size + ZIPBlock::kSize - 1) / ZIPBlock::kSize,
+                    ZIPBlock(SHA256Hash()));
+                estimate.entry.reset(new ZIPFileEntry(
+                    inputs[i].first, estimate.size, 0, 0, std::move(blocks),
+                    SHA256Hash()));
+            }
+        }
+
+        // Files larger than kSampleWindows blocks are sampled; smaller
+        // files are compressed whole.
+        std::vector<off_t> sizes;
+        for (const InputEstimate &estimate : estimates) {
+            sizes.push_back(estimate.size);
+        }
+        std::vector<std::size_t> sampled = ChooseSampledFiles(
+            sizes, [&estimates](std::size_t i) { return !estimates[i].entry; },
+            &result.sampledBytes);
+        const off_t wholeFileLimit =
+            static_cast<off_t>(kSampleWindows) * ZIPBlock::kSize;
+
+        // Small files are compressed exactly as WriteAppx would. Windows of
+        // large files are compressed at the best zlib level when
+        // estimating exhaustive compression.
+        const int windowLevel = compressionLevel == kExhaustiveCompression
+                                    ? Z_BEST_COMPRESSION
+                                    : compressionLevel;
+        ParallelFor(sampled.size(), jobs, [&](std::size_t i) {
+            const FileListEntry &input = inputs[sampled[i]];
+            InputEstimate &estimate = estimates[sampled[i]];
+            if (estimate.size > wholeFileLimit) {
+                estimate.ratios = SampleFile(source, input.second,
+                                             estimate.size, windowLevel);
+                return;
+            }
+            OffsetSink sink;
+            estimate.entry.reset(new ZIPFileEntry(WriteZIPFileEntry(
+                sink, 0, source, input.second, input.first, compressionLevel,
+                nullptr, options.cachePolicy)));
+            off_t remaining = estimate.size;
+            for (const ZIPBlock &block : estimate.entry->blocks) {
+                off_t blockSize =
+                    std::min(static_cast<off_t>(ZIPBlock::kSize), remaining);
+                estimate.ratios.AddBlock(blockSize, block.compressedSize);
+                remaining -= blockSize;
+            }
+        });
+
+        // Files which were not sampled use the ratios of sampled files with
+        // the same extension, or of all sampled files.
+        SamplesByExtension<Ratios> ratiosByExtension;
+        for (std::size_t i : sampled) {
+            ratiosByExtension.Add(inputs[i].first, estimates[i].ratios);
+        }
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            InputEstimate &estimate = estimates[i];
+            if (estimate.entry || !estimate.ratios.Empty()) {
+                continue;
+            }
+            estimate.ratios = ratiosByExtension.Find(inputs[i].first);
+            // The largest deflated file is always sampled.
+            assert(!estimate.ratios.Empty());
+        }
+
+        // The catalog and signature are signed with placeholder hashes;
+        // their sizes do not depend on the hashes, except when deflated.
+        std::unique_ptr<ZIPFileEntry> catalog;
+        std::unique_ptr<ZIPFileEntry> signature;
+        if (isSigned) {
+            APPXDigests digests;
+            if (!options.isBundle) {
+                std::vector<std::size_t> binaries;
+                for (std::size_t i = 0; i < inputs.size(); ++i) {
+                    if (CodeIntegrityCatalog::IsMember(inputs[i].first)) {
+                        binaries.push_back(i);
+                    }
+                }
+                std::vector<char> isImage(binaries.size());
+                ParallelFor(binaries.size(), jobs, [&](std::size_t i) {
+                    isImage[i] =
+                        IsPEImageFile(source, inputs[binaries[i]].second);
+                });
+                std::vector<std::pair<std::string, SHA256Hash>> members;
+                for (std::size_t i = 0; i < binaries.size(); ++i) {
+                    if (isImage[i]) {
+                        const std::string &name = inputs[binaries[i]].first;
+                        members.emplace_back(name, PlaceholderHash(name));
+                    }
+                }
+                if (!members.empty()) {
+                    OpenSSLPtr<PKCS7, PKCS7_free> signedCatalog =
+                        SignCatalog(options.certPath, members);
+                    std::vector<std::uint8_t> catalogData =
+                        GetSignatureBytes(signedCatalog.get());
+                    std::string catalogString(catalogData.begin(),
+                                              catalogData.end());
+                    digests.axci = PlaceholderHash("axci");
+                    OffsetSink sink;
+                    catalog.reset(new ZIPFileEntry(WriteZIPFileEntry(
+                        sink, 0, kCodeIntegrityCatalogName,
+                        compressionLevel, WriteStringFunc{catalogString})));
+                }
+            }
+
+            // As WriteSignature writes AppxSignature.p7x.
+            digests.axpc = PlaceholderHash("axpc");
+            digests.axcd = PlaceholderHash("axcd");
+            digests.axct = PlaceholderHash("axct");
+            digests.axbm = PlaceholderHash("axbm");
+            OpenSSLPtr<PKCS7, PKCS7_free> signedDigests =
+                Sign(options.certPath, digests);
+            std::vector<std::uint8_t> signatureData =
+                GetSignatureBytes(signedDigests.get());
+            OffsetSink compressedSink;
+            auto deflateSink =
+                MakeDeflateSink(Z_BEST_COMPRESSION, compressedSink);
+            static const std::uint8_t p7xSignature[] = {0x50, 0x4b, 0x43,
+                                                        0x58};
+            deflateSink.Write(sizeof(p7xSignature), p7xSignature);
+            deflateSink.Write(signatureData.size(), signatureData.data());
+            deflateSink.Close();
+            signature.reset(new ZIPFileEntry(
+                "AppxSignature.p7x", compressedSink.Offset(),
+                static_cast<off_t>(sizeof(p7xSignature) +
+                                   signatureData.size()),
+                ZIPCompressionType::Deflate, 0, 0, {}, SHA256Hash()));
+        }
+
+        Layout layouts[kScenarioCount];
+        for (int scenario = 0; scenario < kScenarioCount; ++scenario) {
+            layouts[scenario] =
+                LayOut(static_cast<Scenario>(scenario), inputs, estimates,
+                       appxBundleManifest, catalog.get(), signature.get(),
+                       options, source);
+        }
+
+        const std::vector<ZIPFileEntry> &entries = layouts[kEstimate].entries;
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            const ZIPFileEntry &low = layouts[kLow].entries[i];
+            const ZIPFileEntry &high = layouts[kHigh].entries[i];
+            EntryEstimate entry;
+            entry.archiveName = entries[i].fileName;
+            entry.headerOffset = MakeSizeEstimate(
+                entries[i].fileRecordHeaderOffset,
+                low.fileRecordHeaderOffset, high.fileRecordHeaderOffset);
+            entry.uncompressedSize = entries[i].uncompressedSize;
+            entry.compressedSize =
+                MakeSizeEstimate(entries[i].compressedSize,
+                                 low.compressedSize, high.compressedSize);
+            result.entries.push_back(std::move(entry));
+        }
+        result.size =
+            MakeSizeEstimate(layouts[kEstimate].size, layouts[kLow].size,
+                             layouts[kHigh].size);
+        return result;
+    }
+
+    void WriteEstimate(std::ostream &out, const PackageEstimate &estimate)
+    {
+        out << std::setw(14) << "offset" << std::setw(14) << "size"
+            << std::setw(14) << "compressed" << std::setw(14) << "low"
+            << std::setw(14) << "high"
+            << "  name\n";
+        for (const EntryEstimate &entry : estimate.entries) {
+            out << std::setw(14) << entry.headerOffset.estimate
+                << std::setw(14) << entry.uncompressedSize << std::setw(14)
+                << entry.compressedSize.estimate << std::setw(14)
+                << entry.compressedSize.low << std::setw(14)
+                << entry.compressedSize.high << "  " << entry.archiveName
+                << "\n";
+        }
+        out << "\nPackage size: " << estimate.size.estimate << " bytes ("
+            << estimate.size.low << " to " << estimate.size.high << ")\n"
+            << "Sampled " << estimate.sampledBytes << " of "
+            << estimate.inputBytes << " input bytes\n";
+    }
+}
+}
@@ -6,6 +6,9 @@
 // LICENSE file in the root directory of this source tree.
 
 #include <APPX/File.h>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace facebook {
 namespace appx {
@@ -32,5 +35,62 @@ namespace appx {
           error(error)
     {
     }
+
+    FilePtr OpenTemporaryFile()
+    {
+        const char *directory = std::getenv("TMPDIR");
+        if (!directory || !*directory) {
+            directory = "/tmp";
+        }
+        std::string path = std::string(directory) + "/appx.XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd == -1) {
+            throw ErrnoException(path);
+        }
+        // The file is deleted when closed.
+        unlink(path.c_str());
+        FilePtr file(fdopen(fd, "w+b"));
+        if (!file) {
+            int error = errno;
+            close(fd);
+            throw ErrnoException(path, error);
+        }
+        return file;
+    }
+
+    void PWrite(int fd, std::size_t size, const void *bytes, off_t offset)
+    {
+        const char *data = static_cast<const char *>(bytes);
+        while (size > 0) {
+            ssize_t written = pwrite(fd, data, size, offset);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw ErrnoException();
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+            offset += written;
+        }
+    }
+
+    void Preallocate(int fd, off_t offset, off_t size)
+    {
+        if (size <= 0) {
+            return;
+        }
+#if defined(__linux__)
+        // Unlike posix_fallocate, fallocate fails instead of writing zeros if
+        // the file system cannot preallocate.
+        if (fallocate(fd, 0, offset, size) != 0) {
+            if (errno != EOPNOTSUPP && errno != ENOSYS) {
+                throw ErrnoException();
+            }
+        }
+#else
+        // Preallocation is only an optimization.
+#endif
+    }
 }
 }
@@ -0,0 +1,132 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/FileList.h>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace facebook {
+namespace appx {
+    std::string ArchiveNameExtension(const std::string &archiveName)
+    {
+        std::size_t slash = archiveName.rfind('/');
+        std::size_t dot = archiveName.rfind('.');
+        if (dot == std::string::npos ||
+            (slash != std::string::npos && dot < slash)) {
+            return std::string();
+        }
+        std::string extension = archiveName.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](char c) {
+                           return static_cast<char>(
+                               std::tolower(static_cast<unsigned char>(c)));
+                       });
+        return extension;
+    }
+
+    bool FileList::Add(std::string archiveName, std::string localPath)
+    {
+        if (!this->archiveNames.insert(archiveName).second) {
+            return false;
+        }
+        this->files.emplace_back(std::move(archiveName), std::move(localPath));
+        return true;
+    }
+
+    bool FileListQueue::Add(std::string archiveName, std::string localPath)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->changed.wait(lock, [this]() {
+            return this->cancelled || this->files.size() < this->capacity;
+        });
+        if (this->cancelled) {
+            if (this->cancelError) {
+                std::rethrow_exception(this->cancelError);
+            }
+            throw std::runtime_error("File list cancelled");
+        }
+        if (!this->archiveNames.insert(archiveName).second) {
+            return false;
+        }
+        this->files.emplace_back(std::move(archiveName), std::move(localPath));
+        this->changed.notify_all();
+        return true;
+    }
+
+    void FileListQueue::Close(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->closed = true;
+        this->error = error;
+        this->changed.notify_all();
+    }
+
+    bool FileListQueue::Next(FileListEntry &file)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->changed.wait(lock, [this]() {
+            return this->closed || !this->files.empty();
+        });
+        if (this->files.empty()) {
+            if (this->error) {
+                std::rethrow_exception(this->error);
+            }
+            return false;
+        }
+        file = std::move(this->files.front());
+        this->files.pop_front();
+        this->changed.notify_all();
+        return true;
+    }
+
+    void FileListQueue::Cancel(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->cancelled = true;
+        this->cancelError = error;
+        this->changed.notify_all();
+    }
+
+    void FileList::Sort()
+    {
+        // std::string's operator< compares chars as if unsigned (via
+        // std::char_traits), independent of locale and library.
+        std::sort(this->files.begin(), this->files.end(),
+                  [](const FileListEntry &a, const FileListEntry &b) {
+                      return a.first < b.first;
+                  });
+    }
+
+    void FileList::Reorder(const std::vector<std::string> &archiveNames)
+    {
+        std::unordered_map<std::string, std::size_t> ranks;
+        for (const std::string &archiveName : archiveNames) {
+            if (!this->Contains(archiveName)) {
+                throw std::runtime_error("Ordered file is not an input: " +
+                                         archiveName);
+            }
+            ranks.emplace(archiveName, ranks.size());
+        }
+        std::size_t unranked = ranks.size();
+        auto rank = [&](const FileListEntry &entry) {
+            auto it = ranks.find(entry.first);
+            return it == ranks.end() ? unranked : it->second;
+        };
+        std::sort(this->files.begin(), this->files.end(),
+                  [&](const FileListEntry &a, const FileListEntry &b) {
+                      std::size_t aRank = rank(a);
+                      std::size_t bRank = rank(b);
+                      if (aRank != bRank) {
+                          return aRank < bRank;
+                      }
+                      return a.first < b.first;
+                  });
+    }
+}
+}
@@ -0,0 +1,249 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Encode.h>
+#include <APPX/File.h>
+#include <APPX/Incremental.h>
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unordered_map>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        const char kMagic[] = "appx-incremental";
+        const unsigned kVersion = 1;
+
+        // Identifies the contents of an open file: its size, modification
+        // time, and inode.
+        std::string FileStamp(FILE *file)
+        {
+            struct stat status;
+            if (fstat(fileno(file), &status) != 0) {
+                throw ErrnoException();
+            }
+#if defined(__APPLE__)
+            const struct timespec &modified = status.st_mtimespec;
+#else
+            const struct timespec &modified = status.st_mtim;
+#endif
+            std::ostringstream stamp;
+            stamp << status.st_size << '.' << modified.tv_sec << '.'
+                  << modified.tv_nsec << '.' << status.st_dev << '.'
+                  << status.st_ino;
+            return stamp.str();
+        }
+
+        // Encodes a string as a whitespace-free field: hex, or "-" if it is
+        // empty.
+        std::string HexString(const std::string &string)
+        {
+            if (string.empty()) {
+                return "-";
+            }
+            return appx::HexString(
+                reinterpret_cast<const std::uint8_t *>(string.data()),
+                string.size());
+        }
+
+        bool ParseHexString(const std::string &hex, std::string &string)
+        {
+            std::vector<std::uint8_t> bytes;
+            if (hex == "-") {
+                string.clear();
+                return true;
+            }
+            if (!appx::ParseHexString(hex, bytes)) {
+                return false;
+            }
+            string.assign(bytes.begin(), bytes.end());
+            return true;
+        }
+    }
+
+    IncrementalBuild::IncrementalBuild(std::string path)
+        : path(std::move(path))
+    {
+        std::ifstream file(this->path);
+        if (!file) {
+            if (errno == ENOENT) {
+                return;
+            }
+            throw ErrnoException(this->path);
+        }
+        std::runtime_error malformed("Malformed incremental build sidecar: " +
+                                     this->path);
+
+        std::string line;
+        if (!std::getline(file, line)) {
+            throw malformed;
+        }
+        {
+            std::istringstream in(line);
+            std::string magic;
+            unsigned version;
+            if (!(in >> magic >> version >> this->compressionLevel >>
+                  this->isSigned >> this->packageStamp) ||
+                magic != kMagic || version != kVersion) {
+                throw malformed;
+            }
+        }
+
+        while (std::getline(file, line)) {
+            std::istringstream in(line);
+            std::vector<Checkpoint::Record> records;
+            std::string localPathHex;
+            std::string stampHex;
+            std::string imageHashHex;
+            unsigned changes;
+            std::string localPath;
+            std::string stamp;
+            if (!Checkpoint::ReadRecord(in, records) ||
+                !(in >> localPathHex >> stampHex >> imageHashHex >>
+                  changes) ||
+                !ParseHexString(localPathHex, localPath) ||
+                !ParseHexString(stampHex, stamp)) {
+                throw malformed;
+            }
+            bool hasImageHash = imageHashHex != "-";
+            std::vector<std::uint8_t> imageHash(sizeof(SHA256Hash::bytes));
+            if (hasImageHash &&
+                (!appx::ParseHexString(imageHashHex, imageHash) ||
+                 imageHash.size() != sizeof(SHA256Hash::bytes))) {
+                throw malformed;
+            }
+            this->inputs.push_back(Input{std::move(records.front()),
+                                         std::move(localPath),
+                                         std::move(stamp), hasImageHash,
+                                         SHA256Hash(imageHash.data()),
+                                         changes});
+        }
+    }
+
+    std::size_t IncrementalBuild::ReusablePrefix(
+        int compressionLevel, bool isSigned,
+        const std::vector<FileListEntry> &inputs,
+        const std::vector<std::string> &stamps, FILE *output) const
+    {
+        if (this->inputs.empty() ||
+            compressionLevel != this->compressionLevel ||
+            isSigned != this->isSigned ||
+            FileStamp(output) != this->packageStamp) {
+            return 0;
+        }
+        std::size_t count = 0;
+        while (count < inputs.size() && count < this->inputs.size()) {
+            const Input &input = this->inputs[count];
+            // An empty stamp means the source cannot tell if the input
+            // changed.
+            if (input.record.entry.fileName != inputs[count].first ||
+                input.localPath != inputs[count].second ||
+                stamps[count].empty() || input.stamp != stamps[count]) {
+                break;
+            }
+            ++count;
+        }
+        return count;
+    }
+
+    bool IncrementalBuild::Describes(const std::vector<ZIPFileEntry> &entries,
+                                     FILE *output) const
+    {
+        if (entries.size() != this->inputs.size() ||
+            FileStamp(output) != this->packageStamp) {
+            return false;
+        }
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            const Checkpoint::Record &record = this->inputs[i].record;
+            if (record.entry.fileName != entries[i].fileName ||
+                record.entry.fileRecordHeaderOffset !=
+                    entries[i].fileRecordHeaderOffset ||
+                record.endOffset != entries[i].fileRecordHeaderOffset +
+                                        entries[i].FileRecordSize()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::string> IncrementalBuild::StableOrder() const
+    {
+        std::vector<const Input *> sorted;
+        sorted.reserve(this->inputs.size());
+        for (const Input &input : this->inputs) {
+            sorted.push_back(&input);
+        }
+        std::sort(sorted.begin(), sorted.end(),
+                  [](const Input *a, const Input *b) {
+                      if (a->changes != b->changes) {
+                          return a->changes < b->changes;
+                      }
+                      return a->record.entry.fileName <
+                             b->record.entry.fileName;
+                  });
+        std::vector<std::string> archiveNames;
+        archiveNames.reserve(sorted.size());
+        for (const Input *input : sorted) {
+            archiveNames.push_back(input->record.entry.fileName);
+        }
+        return archiveNames;
+    }
+
+    void IncrementalBuild::Save(int compressionLevel, bool isSigned,
+                                std::vector<Input> inputs, FILE *output)
+    {
+        std::unordered_map<std::string, const Input *> previous;
+        for (const Input &input : this->inputs) {
+            previous.emplace(input.record.entry.fileName, &input);
+        }
+        for (Input &input : inputs) {
+            auto it = previous.find(input.record.entry.fileName);
+            if (it == previous.end()) {
+                input.changes = 1;
+            } else if (it->second->localPath != input.localPath ||
+                       it->second->stamp != input.stamp ||
+                       input.stamp.empty()) {
+                input.changes = it->second->changes + 1;
+            } else {
+                input.changes = it->second->changes;
+            }
+        }
+
+        // Replace the sidecar atomically, so it never describes a package
+        // partially.
+        std::string temporaryPath = this->path + ".tmp";
+        {
+            std::ofstream file;
+            file.exceptions(std::ofstream::badbit | std::ofstream::failbit);
+            file.open(temporaryPath, std::ios::out | std::ios::binary);
+            file << kMagic << " " << kVersion << " " << compressionLevel
+                 << " " << isSigned << " " << FileStamp(output) << "\n";
+            for (const Input &input : inputs) {
+                Checkpoint::FormatRecord(file, input.record);
+                file << " " << HexString(input.localPath) << " "
+                     << HexString(input.stamp) << " "
+                     << (input.hasImageHash
+                             ? appx::HexString(input.imageHash.bytes,
+                                               sizeof(input.imageHash.bytes))
+                             : "-")
+                     << " " << input.changes << "\n";
+            }
+        }
+        if (std::rename(temporaryPath.c_str(), this->path.c_str()) != 0) {
+            throw ErrnoException(this->path);
+        }
+        this->inputs = std::move(inputs);
+        this->compressionLevel = compressionLevel;
+        this->isSigned = isSigned;
+        this->packageStamp = FileStamp(output);
+    }
+}
+}
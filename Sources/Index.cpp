@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Encode.h>
+#include <APPX/Index.h>
+#include <APPX/JSON.h>
+#include <APPX/Sink.h>
+#include <algorithm>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        // Where a block's data is in the package.
+        struct BlockRange
+        {
+            off_t offset;
+            off_t size;
+        };
+
+        std::vector<BlockRange> BlockRanges(const ZIPFileEntry &entry)
+        {
+            std::vector<BlockRange> ranges;
+            ranges.reserve(entry.blocks.size());
+            off_t offset =
+                entry.fileRecordHeaderOffset + entry.FileRecordHeaderSize();
+            off_t remaining = entry.uncompressedSize;
+            for (const ZIPBlock &block : entry.blocks) {
+                off_t uncompressedSize =
+                    std::min(remaining, static_cast<off_t>(ZIPBlock::kSize));
+                off_t size = block.compressedSize == ZIPBlock::kNotCompressed
+                                 ? uncompressedSize
+                                 : block.compressedSize;
+                ranges.push_back(BlockRange{offset, size});
+                offset += size;
+                remaining -= uncompressedSize;
+            }
+            return ranges;
+        }
+
+        void Write(std::ostream &out, std::size_t size,
+                   const std::uint8_t *bytes)
+        {
+            out.write(reinterpret_cast<const char *>(bytes), size);
+        }
+
+        void WriteBinaryIndex(std::ostream &out,
+                              const std::vector<ZIPFileEntry> &entries)
+        {
+            static const std::uint8_t kMagic[] = {'A', 'P', 'P', 'X',
+                                                  'I', 'D', 'X', '1'};
+            Write(out, sizeof(kMagic), kMagic);
+            std::uint8_t count[] = {FB_BYTES_4_LE(entries.size())};
+            Write(out, sizeof(count), count);
+            for (const ZIPFileEntry &entry : entries) {
+                std::uint8_t nameSize[] = {
+                    FB_BYTES_2_LE(entry.fileName.size())};
+                Write(out, sizeof(nameSize), nameSize);
+                Write(out, entry.fileName.size(),
+                      reinterpret_cast<const std::uint8_t *>(
+                          entry.fileName.data()));
+                std::uint8_t fields[] = {
+                    FB_BYTES_8_LE(entry.fileRecordHeaderOffset),
+                    FB_BYTES_4_LE(entry.FileRecordHeaderSize()),
+                    FB_BYTES_8_LE(entry.compressedSize),
+                    FB_BYTES_8_LE(entry.uncompressedSize),
+                    FB_BYTES_4_LE(entry.crc32),
+                    FB_BYTES_2_LE(
+                        static_cast<std::uint16_t>(entry.compressionType)),
+                    FB_BYTES_4_LE(entry.blocks.size()),
+                };
+                Write(out, sizeof(fields), fields);
+                std::vector<BlockRange> ranges = BlockRanges(entry);
+                for (std::size_t i = 0; i < entry.blocks.size(); ++i) {
+                    const SHA256Hash &hash = entry.blocks[i].sha256;
+                    Write(out, sizeof(hash.bytes), hash.bytes);
+                    std::uint8_t range[] = {
+                        FB_BYTES_8_LE(ranges[i].offset),
+                        FB_BYTES_4_LE(ranges[i].size),
+                    };
+                    Write(out, sizeof(range), range);
+                }
+            }
+        }
+
+        void WriteJSONIndex(std::ostream &out,
+                            const std::vector<ZIPFileEntry> &entries)
+        {
+            out << "{\n  \"entries\": [";
+            for (std::size_t i = 0; i < entries.size(); ++i) {
+                const ZIPFileEntry &entry = entries[i];
+                out << (i ? ",\n" : "\n") << "    {\"name\": ";
+                WriteJSONString(out, entry.fileName);
+                out << ", \"headerOffset\": " << entry.fileRecordHeaderOffset
+                    << ", \"headerSize\": " << entry.FileRecordHeaderSize()
+                    << ", \"compressedSize\": " << entry.compressedSize
+                    << ", \"uncompressedSize\": " << entry.uncompressedSize
+                    << ", \"crc32\": " << entry.crc32
+                    << ", \"compression\": "
+                    << static_cast<unsigned>(entry.compressionType)
+                    << ", \"blocks\": [";
+                std::vector<BlockRange> ranges = BlockRanges(entry);
+                for (std::size_t j = 0; j < entry.blocks.size(); ++j) {
+                    const SHA256Hash &hash = entry.blocks[j].sha256;
+                    Base64Sink base64Sink;
+                    base64Sink.Write(sizeof(hash.bytes), hash.bytes);
+                    base64Sink.Close();
+                    out << (j ? ",\n" : "\n") << "      {\"hash\": ";
+                    WriteJSONString(out, base64Sink.Base64());
+                    out << ", \"offset\": " << ranges[j].offset
+                        << ", \"size\": " << ranges[j].size << "}";
+                }
+                out << (entry.blocks.empty() ? "]}" : "\n    ]}");
+            }
+            out << "\n  ]\n}\n";
+        }
+    }
+
+    IndexFormat IndexFormatForPath(const std::string &path)
+    {
+        const std::string suffix = ".json";
+        if (path.size() >= suffix.size() &&
+            std::equal(suffix.rbegin(), suffix.rend(), path.rbegin())) {
+            return IndexFormat::JSON;
+        }
+        return IndexFormat::Binary;
+    }
+
+    void WritePackageIndex(std::ostream &out,
+                           const std::vector<ZIPFileEntry> &entries,
+                           IndexFormat format)
+    {
+        switch (format) {
+            case IndexFormat::Binary:
+                WriteBinaryIndex(out, entries);
+                break;
+            case IndexFormat::JSON:
+                WriteJSONIndex(out, entries);
+                break;
+        }
+    }
+}
+}
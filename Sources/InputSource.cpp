@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/File.h>
+#include <APPX/InputSource.h>
+#include <sstream>
+#include <sys/stat.h>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        // Adapts a WriteFunc to the sink interface.
+        struct WriteFuncSink
+        {
+            void Write(std::size_t size, const std::uint8_t *bytes)
+            {
+                this->write(size, bytes);
+            }
+
+            const InputSource::WriteFunc &write;
+        };
+
+        // Like WriteFuncSink, passing runs of zeros to a WriteZerosFunc.
+        struct SparseWriteFuncSink
+        {
+            void Write(std::size_t size, const std::uint8_t *bytes)
+            {
+                this->write(size, bytes);
+            }
+
+            void WriteZeros(off_t size)
+            {
+                this->writeZeros(size);
+            }
+
+            const InputSource::WriteFunc &write;
+            const InputSource::WriteZerosFunc &writeZeros;
+        };
+    }
+
+    off_t FileSystemInputSource::Size(const std::string &path)
+    {
+        struct stat status;
+        if (stat(path.c_str(), &status) != 0) {
+            throw ErrnoException(path);
+        }
+        return status.st_size;
+    }
+
+    std::string FileSystemInputSource::Stamp(const std::string &path)
+    {
+        struct stat status;
+        if (stat(path.c_str(), &status) != 0) {
+            throw ErrnoException(path);
+        }
+#if defined(__APPLE__)
+        const struct timespec &modified = status.st_mtimespec;
+        const struct timespec &changed = status.st_ctimespec;
+#else
+        const struct timespec &modified = status.st_mtim;
+        const struct timespec &changed = status.st_ctim;
+#endif
+        std::ostringstream stamp;
+        stamp << status.st_size << ' ' << modified.tv_sec << '.'
+              << modified.tv_nsec << ' ' << changed.tv_sec << '.'
+              << changed.tv_nsec << ' ' << status.st_dev << ' '
+              << status.st_ino;
+        return stamp.str();
+    }
+
+    void FileSystemInputSource::Read(const std::string &path,
+                                     CachePolicy policy,
+                                     const WriteFunc &write)
+    {
+        InputFile file(path, policy);
+        WriteFuncSink sink{write};
+        file.CopyTo(sink);
+    }
+
+    void FileSystemInputSource::ReadSparse(const std::string &path,
+                                           CachePolicy policy,
+                                           const WriteFunc &write,
+                                           const WriteZerosFunc &writeZeros)
+    {
+        InputFile file(path, policy);
+        SparseWriteFuncSink sink{write, writeZeros};
+        file.CopyTo(sink);
+    }
+
+    std::size_t FileSystemInputSource::ReadAt(const std::string &path,
+                                              off_t offset, std::size_t size,
+                                              std::uint8_t *bytes)
+    {
+        FilePtr file = Open(path, "rb");
+        Seek(file, offset, SEEK_SET);
+        return appx::Read(file, size, bytes);
+    }
+}
+}
@@ -0,0 +1,39 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/JSON.h>
+#include <cstdio>
+
+namespace facebook {
+namespace appx {
+    void WriteJSONString(std::ostream &out, const std::string &s)
+    {
+        out << '"';
+        for (char c : s) {
+            switch (c) {
+                case '"':
+                    out << "\\\"";
+                    break;
+                case '\\':
+                    out << "\\\\";
+                    break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char buffer[7];
+                        std::snprintf(buffer, sizeof(buffer), "\\u%04X",
+                                      static_cast<unsigned char>(c));
+                        out << buffer;
+                    } else {
+                        out << c;
+                    }
+                    break;
+            }
+        }
+        out << '"';
+    }
+}
+}
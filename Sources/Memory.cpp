@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Memory.h>
+#include <algorithm>
+#include <cassert>
+
+namespace facebook {
+namespace appx {
+    void MemoryBudget::AcquireWorkingSet(std::size_t size)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        if (this->limit != 0) {
+            this->released.wait(lock, [&]() {
+                return this->workingSets == 0 ||
+                       this->used + size <= this->limit;
+            });
+        }
+        this->workingSets += 1;
+        this->Add(size);
+    }
+
+    void MemoryBudget::ReleaseWorkingSet(std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            assert(this->workingSets > 0);
+            this->workingSets -= 1;
+            assert(this->used >= size);
+            this->used -= size;
+        }
+        this->released.notify_all();
+    }
+
+    bool MemoryBudget::TryAcquire(std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->limit != 0 && this->used + size > this->limit) {
+            return false;
+        }
+        this->Add(size);
+        return true;
+    }
+
+    void MemoryBudget::Charge(std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->Add(size);
+    }
+
+    void MemoryBudget::Release(std::size_t size)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            assert(this->used >= size);
+            this->used -= size;
+        }
+        this->released.notify_all();
+    }
+
+    std::size_t MemoryBudget::Peak() const
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->peak;
+    }
+
+    void MemoryBudget::Add(std::size_t size)
+    {
+        this->used += size;
+        this->peak = std::max(this->peak, this->used);
+    }
+}
+}
@@ -0,0 +1,261 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/InputSource.h>
+#include <APPX/PackageWriter.h>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace facebook {
+namespace appx {
+    // Serves entries' data to WriteAppx as it is pushed. An entry's local
+    // path is its index in PackageWriter::entries.
+    class PackageWriter::Source : public InputSource
+    {
+    public:
+        explicit Source(PackageWriter &writer) : writer(writer)
+        {
+        }
+
+        off_t Size(const std::string &) override
+        {
+            throw std::runtime_error(
+                "Entry sizes are not known until entries end");
+        }
+
+        void Read(const std::string &path, CachePolicy,
+                  const WriteFunc &write) override
+        {
+            std::size_t index = std::stoul(path);
+            PackageWriter &writer = this->writer;
+            std::unique_lock<std::mutex> lock(writer.mutex);
+            for (;;) {
+                writer.changed.wait(lock, [&writer, index]() {
+                    const Entry &entry = writer.entries[index];
+                    return writer.cancelled || entry.ended ||
+                           !entry.chunks.empty();
+                });
+                if (writer.cancelled) {
+                    throw std::runtime_error("Package abandoned");
+                }
+                Entry &entry = writer.entries[index];
+                if (entry.chunks.empty()) {
+                    return;
+                }
+                std::vector<std::uint8_t> chunk =
+                    std::move(entry.chunks.front());
+                entry.chunks.pop_front();
+                writer.Consumed(chunk.size(), lock);
+                lock.unlock();
+                write(chunk.size(), chunk.data());
+                lock.lock();
+            }
+        }
+
+        std::size_t ReadAt(const std::string &, off_t, std::size_t,
+                           std::uint8_t *) override
+        {
+            throw std::runtime_error(
+                "Entries can only be read once, in order");
+        }
+
+    private:
+        PackageWriter &writer;
+    };
+
+    PackageWriter::PackageWriter(FilePtr zip, APPXOptions options,
+                                 std::size_t bufferLimit, ReadyFunc ready)
+        : zip(std::move(zip)),
+          options(std::move(options)),
+          bufferLimit(bufferLimit),
+          ready(std::move(ready)),
+          source(new Source(*this)),
+          queue(std::numeric_limits<std::size_t>::max())
+    {
+        if (!this->options.contentGroups.Empty() ||
+            this->options.timeBudget > 0 ||
+            !this->options.checkpointPath.empty() ||
+            this->options.inputSource) {
+            throw std::runtime_error(
+                "Content groups, time budgets, checkpoints, and input "
+                "sources are not supported by PackageWriter");
+        }
+        this->options.inputSource = this->source.get();
+        this->thread = std::thread([this]() { this->Run(); });
+    }
+
+    PackageWriter::~PackageWriter()
+    {
+        bool abandon;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            abandon = !this->finishing;
+            if (abandon) {
+                this->cancelled = true;
+                this->changed.notify_all();
+            }
+        }
+        if (abandon) {
+            this->queue.Close(std::make_exception_ptr(
+                std::runtime_error("Package abandoned")));
+        }
+        this->thread.join();
+    }
+
+    void PackageWriter::BeginEntry(std::string archiveName)
+    {
+        std::size_t index;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->isEntryOpen) {
+                throw std::runtime_error("An entry is already open");
+            }
+            if (this->finishing) {
+                throw std::runtime_error("Package is finished");
+            }
+            if (this->error) {
+                std::rethrow_exception(this->error);
+            }
+            index = this->entries.size();
+            this->entries.emplace_back();
+            this->isEntryOpen = true;
+        }
+
+        // The queue is only cancelled when writing the package failed,
+        // with that error, which Add rethrows without waiting for the
+        // background thread.
+        bool added = false;
+        std::exception_ptr error;
+        try {
+            added = this->queue.Add(archiveName, std::to_string(index));
+        } catch (...) {
+            error = std::current_exception();
+        }
+        if (!added) {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->entries.pop_back();
+            this->isEntryOpen = false;
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        if (!added) {
+            throw std::runtime_error("Entry already in package: " +
+                                     archiveName);
+        }
+    }
+
+    bool PackageWriter::Write(std::size_t size, const std::uint8_t *bytes)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->isEntryOpen) {
+            throw std::runtime_error("No entry is open");
+        }
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
+        if (size > 0) {
+            this->entries.back().chunks.emplace_back(bytes, bytes + size);
+            this->buffered += size;
+            this->changed.notify_all();
+        }
+        if (this->buffered > this->bufferLimit) {
+            this->blocked = true;
+            return false;
+        }
+        return true;
+    }
+
+    void PackageWriter::EndEntry()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->isEntryOpen) {
+            throw std::runtime_error("No entry is open");
+        }
+        this->entries.back().ended = true;
+        this->isEntryOpen = false;
+        this->changed.notify_all();
+    }
+
+    void PackageWriter::Finish(DoneFunc done)
+    {
+        bool isDone;
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (this->isEntryOpen) {
+                throw std::runtime_error("An entry is still open");
+            }
+            if (this->finishing) {
+                throw std::runtime_error("Package is finished");
+            }
+            this->finishing = true;
+            this->done = done;
+            isDone = this->written;
+            error = this->error;
+        }
+        this->queue.Close();
+        if (isDone && done) {
+            done(error);
+        }
+    }
+
+    void PackageWriter::Wait()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->changed.wait(lock, [this]() { return this->finished; });
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
+    }
+
+    void PackageWriter::Consumed(std::size_t size,
+                                 std::unique_lock<std::mutex> &lock)
+    {
+        this->buffered -= size;
+        if (this->blocked && this->buffered <= this->bufferLimit / 2) {
+            this->blocked = false;
+            if (this->ready) {
+                lock.unlock();
+                this->ready();
+                lock.lock();
+            }
+        }
+    }
+
+    void PackageWriter::Run()
+    {
+        std::exception_ptr error;
+        try {
+            WriteAppx(this->zip, this->queue, this->options);
+            if (std::fflush(this->zip.get()) != 0) {
+                throw ErrnoException();
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        DoneFunc done;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->error = error;
+            this->written = true;
+            if (this->finishing) {
+                done = this->done;
+            }
+        }
+        // Wait returns once done has returned.
+        if (done) {
+            done(error);
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->finished = true;
+        this->changed.notify_all();
+    }
+}
+}
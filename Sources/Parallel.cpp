@@ -0,0 +1,117 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Parallel.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    unsigned EffectiveJobCount(unsigned jobs)
+    {
+        if (jobs == 0) {
+            jobs = std::thread::hardware_concurrency();
+        }
+        return std::max(jobs, 1U);
+    }
+
+    namespace {
+        // If the current thread is running ParallelFor work, the count of
+        // threads running work for the same top-level call.
+        thread_local std::atomic<unsigned> *runningThreads = nullptr;
+    }
+
+    void ParallelFor(std::size_t count, unsigned jobs,
+                     const std::function<void(std::size_t)> &func)
+    {
+        const unsigned threadLimit = EffectiveJobCount(jobs);
+        std::size_t threadCount =
+            std::min(static_cast<std::size_t>(threadLimit), count);
+        if (threadCount <= 1) {
+            for (std::size_t i = 0; i < count; ++i) {
+                func(i);
+            }
+            return;
+        }
+
+        std::atomic<std::size_t> nextIndex(0);
+        std::atomic<bool> failed(false);
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        // Runs func for the next index. Returns false if there is no more
+        // work.
+        auto runOne = [&]() {
+            if (failed) {
+                return false;
+            }
+            std::size_t i = nextIndex++;
+            if (i >= count) {
+                return false;
+            }
+            try {
+                func(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+            return true;
+        };
+        // A top-level call counts its own threads; nested calls share the
+        // count of the call they run in.
+        std::atomic<unsigned> ownRunningThreads(1);
+        const bool isNested = runningThreads != nullptr;
+        if (!isNested) {
+            runningThreads = &ownRunningThreads;
+        }
+        std::atomic<unsigned> *const running = runningThreads;
+        auto worker = [&]() {
+            runningThreads = running;
+            while (runOne()) {
+            }
+            *running -= 1;
+        };
+
+        // Start threads while fewer than threadLimit are running for the
+        // top-level call. A nested call therefore starts with no threads of
+        // its own, and picks up threads as the outer call's threads finish.
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        auto startThreads = [&]() {
+            while (threads.size() + 1 < threadCount && nextIndex < count) {
+                unsigned runningCount = *running;
+                if (runningCount >= threadLimit) {
+                    break;
+                }
+                if (running->compare_exchange_weak(runningCount,
+                                                   runningCount + 1)) {
+                    threads.emplace_back(worker);
+                }
+            }
+        };
+        do {
+            startThreads();
+        } while (runOne());
+
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+        if (!isNested) {
+            runningThreads = nullptr;
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+}
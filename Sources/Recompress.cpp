@@ -0,0 +1,165 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Recompress.h>
+#include <APPX/ZIPReader.h>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        const char kBundleManifestFileName[] =
+            "AppxMetadata/AppxBundleManifest.xml";
+
+        bool EndsWith(const std::string &s, const std::string &suffix)
+        {
+            return s.size() >= suffix.size() &&
+                   s.compare(s.size() - suffix.size(), suffix.size(),
+                             suffix) == 0;
+        }
+
+        // Undoes _ManifestContentsAfterPopulatingOffsets: the offset of each
+        // package in the bundle manifest is replaced with its template so
+        // WriteAppx fills in the package's new offset.
+        std::string BundleManifestTemplate(std::string manifestText,
+                                           const ZIPReader &reader)
+        {
+            for (const ZIPReader::Entry &entry : reader.Entries()) {
+                if (!EndsWith(entry.fileName, ".appx")) {
+                    continue;
+                }
+                std::string offset =
+                    "Offset=\"" + std::to_string(entry.dataOffset) + "\"";
+                std::string offsetTemplate =
+                    "Offset=\"" + entry.fileName + "-offset\"";
+                std::string::size_type pos = 0;
+                while ((pos = manifestText.find(offset, pos)) !=
+                       std::string::npos) {
+                    manifestText.replace(pos, offset.size(), offsetTemplate);
+                    pos += offsetTemplate.size();
+                }
+            }
+            return manifestText;
+        }
+
+        // Sets the Size attribute of the bundle manifest's Package elements
+        // for fileName, if they have one.
+        void SetPackageSize(std::string &manifestText,
+                            const std::string &fileName, off_t size)
+        {
+            const std::string fileNameAttribute =
+                "FileName=\"" + fileName + "\"";
+            const std::string sizeAttribute = "Size=\"";
+            std::string::size_type pos = 0;
+            while ((pos = manifestText.find(fileNameAttribute, pos)) !=
+                   std::string::npos) {
+                std::string::size_type start = manifestText.rfind('<', pos);
+                std::string::size_type end = manifestText.find('>', pos);
+                pos += fileNameAttribute.size();
+                if (start == std::string::npos || end == std::string::npos) {
+                    continue;
+                }
+                std::string::size_type sizePos =
+                    manifestText.find(" " + sizeAttribute, start);
+                if (sizePos == std::string::npos || sizePos > end) {
+                    continue;
+                }
+                sizePos += 1 + sizeAttribute.size();
+                std::string::size_type sizeEnd =
+                    manifestText.find('"', sizePos);
+                if (sizeEnd == std::string::npos || sizeEnd > end) {
+                    continue;
+                }
+                std::string newSize = std::to_string(size);
+                manifestText.replace(sizePos, sizeEnd - sizePos, newSize);
+                pos = sizePos + newSize.size();
+            }
+        }
+
+        void RecompressPackage(const FilePtr &zip, const ZIPReader &reader,
+                               APPXOptions options)
+        {
+            ZIPInputSource source(reader);
+
+            std::vector<FileListEntry> fileNames;
+            options.isBundle = false;
+            for (const ZIPReader::Entry &entry : reader.Entries()) {
+                if (IsGeneratedAppxFile(entry.fileName)) {
+                    continue;
+                }
+                if (entry.fileName == kBundleManifestFileName) {
+                    options.isBundle = true;
+                }
+                fileNames.emplace_back(entry.fileName, entry.fileName);
+            }
+
+            if (options.isBundle) {
+                std::string manifestText;
+                reader.Read(*reader.Find(kBundleManifestFileName),
+                            [&manifestText](std::size_t size,
+                                            const std::uint8_t *bytes) {
+                                manifestText.append(
+                                    reinterpret_cast<const char *>(bytes),
+                                    size);
+                            });
+                manifestText =
+                    BundleManifestTemplate(std::move(manifestText), reader);
+
+                // The bundle's packages are recompressed (and signed) the
+                // same way, one at a time through temporary files.
+                APPXOptions packageOptions = options;
+                packageOptions.indexPath.clear();
+                packageOptions.outputDigests = nullptr;
+                for (const ZIPReader::Entry &entry : reader.Entries()) {
+                    if (!EndsWith(entry.fileName, ".appx")) {
+                        continue;
+                    }
+                    FilePtr original = OpenTemporaryFile();
+                    reader.Read(entry, [&original](std::size_t size,
+                                                   const std::uint8_t *bytes) {
+                        Write(original, size, bytes);
+                    });
+                    if (std::fflush(original.get()) != 0) {
+                        throw ErrnoException();
+                    }
+                    ZIPReader packageReader(original, entry.fileName);
+                    packageReader.LoadBlockMap();
+
+                    FilePtr package = OpenTemporaryFile();
+                    RecompressPackage(package, packageReader, packageOptions);
+                    if (std::fflush(package.get()) != 0) {
+                        throw ErrnoException();
+                    }
+                    off_t size = ftello(package.get());
+                    if (size == -1) {
+                        throw ErrnoException();
+                    }
+                    SetPackageSize(manifestText, entry.fileName, size);
+                    source.Replace(entry.fileName, std::move(package));
+                }
+                source.Replace(kBundleManifestFileName,
+                               std::move(manifestText));
+            }
+
+            options.inputSource = &source;
+            WriteAppx(zip, fileNames, options);
+        }
+    }
+
+    void RecompressAppx(const FilePtr &zip, const std::string &packagePath,
+                        APPXOptions options)
+    {
+        ZIPReader reader(packagePath);
+        // Lets the time budget's sampling inflate only the blocks it reads.
+        reader.LoadBlockMap();
+        RecompressPackage(zip, reader, std::move(options));
+    }
+}
+}
@@ -0,0 +1,598 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Parallel.h>
+#include <APPX/Resources.h>
+#include <APPX/XML.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        // Buffer size for reading packages written to temporary files.
+        enum
+        {
+            kReadBufferSize = 1024 * 1024,
+        };
+
+        // Qualifier names in resource names, and the Resource attributes
+        // they correspond to.
+        const std::pair<const char *, const char *> kQualifierNames[] = {
+            {"lang", "Language"},
+            {"language", "Language"},
+            {"scale", "Scale"},
+            {"dxfl", "DXFeatureLevel"},
+            {"dxfeaturelevel", "DXFeatureLevel"},
+        };
+
+        std::string ToLower(std::string s)
+        {
+            std::transform(s.begin(), s.end(), s.begin(), [](char c) {
+                return static_cast<char>(
+                    std::tolower(static_cast<unsigned char>(c)));
+            });
+            return s;
+        }
+
+        // Adds the qualifiers in part (a directory or a part of a file
+        // name) if it is made only of qualifiers. Returns false otherwise.
+        bool ParseQualifiers(const std::string &part,
+                             std::vector<ResourceQualifier> &qualifiers)
+        {
+            std::vector<ResourceQualifier> parsed;
+            std::istringstream tokens(part);
+            std::string token;
+            while (std::getline(tokens, token, '_')) {
+                token = ToLower(token);
+                std::size_t dash = token.find('-');
+                if (dash == std::string::npos || dash + 1 == token.size()) {
+                    return false;
+                }
+                std::string value = token.substr(dash + 1);
+                if (!std::all_of(value.begin(), value.end(), [](char c) {
+                        return c == '-' ||
+                               std::isalnum(static_cast<unsigned char>(c));
+                    })) {
+                    return false;
+                }
+                const char *name = nullptr;
+                for (const auto &qualifierName : kQualifierNames) {
+                    if (token.compare(0, dash, qualifierName.first) == 0) {
+                        name = qualifierName.second;
+                    }
+                }
+                if (!name) {
+                    return false;
+                }
+                parsed.push_back(ResourceQualifier{name, value});
+            }
+            if (parsed.empty()) {
+                return false;
+            }
+            qualifiers.insert(qualifiers.end(), parsed.begin(), parsed.end());
+            return true;
+        }
+
+        // Returns the tag (from '<' to before '>') of the first element
+        // named name, ignoring namespace prefixes, at or after pos, and
+        // moves pos past it. Returns an empty string if there is none.
+        std::string FindTag(const std::string &xml, const std::string &name,
+                            std::string::size_type &pos)
+        {
+            while ((pos = xml.find('<', pos)) != std::string::npos) {
+                std::string::size_type end = xml.find('>', pos);
+                if (end == std::string::npos) {
+                    break;
+                }
+                std::string tag = xml.substr(pos, end - pos);
+                pos = end;
+                std::string::size_type nameEnd =
+                    tag.find_first_of(" \t\r\n/", 1);
+                std::string tagName = tag.substr(1, nameEnd - 1);
+                std::string::size_type colon = tagName.find(':');
+                if (colon != std::string::npos) {
+                    tagName.erase(0, colon + 1);
+                }
+                if (tagName == name) {
+                    return tag;
+                }
+            }
+            pos = std::string::npos;
+            return std::string();
+        }
+
+        // Returns the first element named name, from its start tag to its
+        // end tag, or an empty string.
+        std::string FindElement(const std::string &xml,
+                                const std::string &name)
+        {
+            std::string::size_type pos = 0;
+            std::string tag = FindTag(xml, name, pos);
+            if (tag.empty()) {
+                return std::string();
+            }
+            std::string::size_type start = pos - tag.size();
+            if (tag.back() == '/') {
+                return xml.substr(start, pos + 1 - start);
+            }
+            std::string::size_type nameEnd = tag.find_first_of(" \t\r\n", 1);
+            std::string endTag = "</" + tag.substr(1, nameEnd - 1) + ">";
+            std::string::size_type end = xml.find(endTag, pos);
+            if (end == std::string::npos) {
+                return std::string();
+            }
+            return xml.substr(start, end + endTag.size() - start);
+        }
+
+        // Returns the (XML-encoded) value of a tag's attribute, ignoring
+        // namespace prefixes, or an empty string.
+        std::string Attribute(const std::string &tag, const std::string &name)
+        {
+            for (const char *separator : {" ", ":"}) {
+                std::string prefix = separator + name + "=\"";
+                std::string::size_type start = tag.find(prefix);
+                if (start == std::string::npos) {
+                    continue;
+                }
+                start += prefix.size();
+                std::string::size_type end = tag.find('"', start);
+                if (end != std::string::npos) {
+                    return tag.substr(start, end - start);
+                }
+            }
+            return std::string();
+        }
+
+        // What resource package manifests and the bundle manifest need to
+        // know about the app's AppxManifest.xml. Strings are XML-encoded.
+        struct AppManifest
+        {
+            std::string name;
+            std::string publisher;
+            std::string version;
+            std::string architecture;
+            std::string properties;
+            std::string dependencies;
+            // The app's default resources, kept in the main package.
+            std::vector<ResourceQualifier> resources;
+        };
+
+        AppManifest ParseAppManifest(const std::string &xml)
+        {
+            AppManifest manifest;
+            std::string::size_type pos = 0;
+            std::string identity = FindTag(xml, "Identity", pos);
+            manifest.name = Attribute(identity, "Name");
+            manifest.publisher = Attribute(identity, "Publisher");
+            manifest.version = Attribute(identity, "Version");
+            manifest.architecture =
+                Attribute(identity, "ProcessorArchitecture");
+            if (manifest.architecture.empty()) {
+                manifest.architecture = "neutral";
+            }
+            if (manifest.name.empty() || manifest.publisher.empty() ||
+                manifest.version.empty()) {
+                throw std::runtime_error(
+                    "AppxManifest.xml has no package identity");
+            }
+            manifest.properties = FindElement(xml, "Properties");
+            manifest.dependencies = FindElement(xml, "Dependencies");
+
+            std::string resources = FindElement(xml, "Resources");
+            pos = 0;
+            for (;;) {
+                std::string tag = FindTag(resources, "Resource", pos);
+                if (tag.empty()) {
+                    break;
+                }
+                for (const char *name :
+                     {"Language", "Scale", "DXFeatureLevel"}) {
+                    std::string value = ToLower(Attribute(tag, name));
+                    if (!value.empty() && value != "x-generate") {
+                        manifest.resources.push_back(
+                            ResourceQualifier{name, value});
+                    }
+                }
+            }
+            return manifest;
+        }
+
+        // Writes Resource elements for qualifiers. If prefixed, the
+        // attributes not in the foundation namespace have the uap prefix.
+        void WriteResources(std::ostream &out,
+                            const std::vector<ResourceQualifier> &qualifiers,
+                            bool prefixed)
+        {
+            out << "<Resources>";
+            for (const ResourceQualifier &qualifier : qualifiers) {
+                out << "<Resource "
+                    << (prefixed && qualifier.name != "Language" ? "uap:"
+                                                                 : "")
+                    << qualifier.name << "=\""
+                    << XMLEncodeString(qualifier.value) << "\"/>";
+            }
+            out << "</Resources>";
+        }
+
+        // A package in the bundle.
+        struct Package
+        {
+            // Empty for the main package.
+            std::vector<ResourceQualifier> qualifiers;
+            std::string resourceId;
+            std::string fileName;
+            std::vector<FileListEntry> files;
+            FilePtr file;
+            off_t size = 0;
+        };
+
+        std::string ResourcePackageManifest(const AppManifest &app,
+                                            const Package &package)
+        {
+            std::ostringstream ss;
+            ss << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+               << "<Package "
+               << "xmlns=\"http://schemas.microsoft.com/appx/manifest/"
+                  "foundation/windows10\" "
+               << "xmlns:uap=\"http://schemas.microsoft.com/appx/manifest/"
+                  "uap/windows10\" "
+               << "IgnorableNamespaces=\"uap\">"
+               << "<Identity Name=\"" << app.name << "\" "
+               << "Publisher=\"" << app.publisher << "\" "
+               << "Version=\"" << app.version << "\" "
+               << "ResourceId=\"" << package.resourceId << "\"/>"
+               << app.properties << app.dependencies;
+            WriteResources(ss, package.qualifiers, true);
+            ss << "</Package>";
+            return ss.str();
+        }
+
+        std::string BundleManifest(const AppManifest &app,
+                                   const std::deque<Package> &packages)
+        {
+            std::ostringstream ss;
+            ss << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+               << "<Bundle "
+               << "xmlns=\"http://schemas.microsoft.com/appx/2013/bundle\" "
+               << "SchemaVersion=\"1.0\">"
+               << "<Identity Name=\"" << app.name << "\" "
+               << "Publisher=\"" << app.publisher << "\" "
+               << "Version=\"" << app.version << "\"/>"
+               << "<Packages>";
+            for (const Package &package : packages) {
+                bool isMain = package.resourceId.empty();
+                ss << "<Package "
+                   << "Type=\"" << (isMain ? "application" : "resource")
+                   << "\" "
+                   << "Version=\"" << app.version << "\" ";
+                if (isMain) {
+                    ss << "Architecture=\"" << app.architecture << "\" ";
+                } else {
+                    ss << "ResourceId=\"" << package.resourceId << "\" ";
+                }
+                // The offset is filled in when the bundle is written.
+                ss << "FileName=\"" << XMLEncodeString(package.fileName)
+                   << "\" "
+                   << "Offset=\"" << XMLEncodeString(package.fileName)
+                   << "-offset\" "
+                   << "Size=\"" << package.size << "\">";
+                WriteResources(ss,
+                               isMain ? app.resources : package.qualifiers,
+                               false);
+                ss << "</Package>";
+            }
+            ss << "</Packages></Bundle>";
+            return ss.str();
+        }
+
+        // Serves the packages' inputs, their generated manifests, and the
+        // packages themselves. Paths are indexes into 'inputs'.
+        class BundleInputSource : public InputSource
+        {
+        public:
+            explicit BundleInputSource(InputSource &base) : base(base)
+            {
+            }
+
+            std::string AddPath(const std::string &path)
+            {
+                this->inputs.push_back(Input{path, std::string(), nullptr});
+                return std::to_string(this->inputs.size() - 1);
+            }
+
+            std::string AddData(std::string data)
+            {
+                this->inputs.push_back(
+                    Input{std::string(), std::move(data), nullptr});
+                return std::to_string(this->inputs.size() - 1);
+            }
+
+            std::string AddFile(const FilePtr &file)
+            {
+                this->inputs.push_back(
+                    Input{std::string(), std::string(), file.get()});
+                return std::to_string(this->inputs.size() - 1);
+            }
+
+            off_t Size(const std::string &path) override
+            {
+                const Input &input = this->Find(path);
+                if (input.file) {
+                    struct stat status;
+                    if (fstat(fileno(input.file), &status) != 0) {
+                        throw ErrnoException();
+                    }
+                    return status.st_size;
+                }
+                if (input.path.empty()) {
+                    return static_cast<off_t>(input.data.size());
+                }
+                return this->base.Size(input.path);
+            }
+
+            void Read(const std::string &path, CachePolicy policy,
+                      const WriteFunc &write) override
+            {
+                const Input &input = this->Find(path);
+                if (input.file) {
+                    std::vector<std::uint8_t> buffer(kReadBufferSize);
+                    off_t offset = 0;
+                    while (std::size_t read = this->ReadAt(
+                               path, offset, buffer.size(), buffer.data())) {
+                        write(read, buffer.data());
+                        offset += read;
+                    }
+                } else if (input.path.empty()) {
+                    write(input.data.size(),
+                          reinterpret_cast<const std::uint8_t *>(
+                              input.data.data()));
+                } else {
+                    this->base.Read(input.path, policy, write);
+                }
+            }
+
+            std::size_t ReadAt(const std::string &path, off_t offset,
+                               std::size_t size,
+                               std::uint8_t *bytes) override
+            {
+                const Input &input = this->Find(path);
+                if (input.file) {
+                    std::size_t total = 0;
+                    while (total < size) {
+                        ssize_t read = pread(fileno(input.file), bytes + total,
+                                             size - total, offset + total);
+                        if (read < 0) {
+                            throw ErrnoException();
+                        }
+                        if (read == 0) {
+                            break;
+                        }
+                        total += static_cast<std::size_t>(read);
+                    }
+                    return total;
+                }
+                if (input.path.empty()) {
+                    if (offset >= static_cast<off_t>(input.data.size())) {
+                        return 0;
+                    }
+                    std::size_t read = std::min(
+                        size, input.data.size() -
+                                  static_cast<std::size_t>(offset));
+                    std::copy_n(input.data.data() + offset, read, bytes);
+                    return read;
+                }
+                return this->base.ReadAt(input.path, offset, size, bytes);
+            }
+
+        private:
+            struct Input
+            {
+                std::string path;
+                std::string data;
+                FILE *file;
+            };
+
+            const Input &Find(const std::string &path) const
+            {
+                return this->inputs.at(std::stoul(path));
+            }
+
+            InputSource &base;
+            std::deque<Input> inputs;
+        };
+    }
+
+    std::vector<ResourceQualifier> ResourceQualifiers(
+        const std::string &archiveName)
+    {
+        std::vector<ResourceQualifier> qualifiers;
+        std::string::size_type start = 0;
+        std::string::size_type slash;
+        while ((slash = archiveName.find('/', start)) != std::string::npos) {
+            ParseQualifiers(archiveName.substr(start, slash - start),
+                            qualifiers);
+            start = slash + 1;
+        }
+        // Qualifiers in a file name are between its base name and its
+        // extension.
+        std::vector<std::string> parts;
+        std::istringstream fileName(archiveName.substr(start));
+        std::string part;
+        while (std::getline(fileName, part, '.')) {
+            parts.push_back(part);
+        }
+        for (std::size_t i = 1; i + 1 < parts.size(); ++i) {
+            ParseQualifiers(parts[i], qualifiers);
+        }
+
+        // Keep the first of each name, in a canonical order.
+        std::stable_sort(qualifiers.begin(), qualifiers.end(),
+                         [](const ResourceQualifier &a,
+                            const ResourceQualifier &b) {
+                             return a.name < b.name;
+                         });
+        qualifiers.erase(std::unique(qualifiers.begin(), qualifiers.end(),
+                                     [](const ResourceQualifier &a,
+                                        const ResourceQualifier &b) {
+                                         return a.name == b.name;
+                                     }),
+                         qualifiers.end());
+        return qualifiers;
+    }
+
+    void WriteResourceBundle(const FilePtr &zip,
+                             const std::vector<FileListEntry> &fileNames,
+                             const APPXOptions &options)
+    {
+        if (options.isBundle) {
+            throw std::runtime_error(
+                "Resource bundles are made from an app's files, not "
+                "packages");
+        }
+        if (options.timeBudget > 0 || !options.checkpointPath.empty() ||
+            !options.incrementalPath.empty() ||
+            !options.contentGroups.Empty()) {
+            throw std::runtime_error(
+                "Time budgets, checkpoints, incremental builds, and content "
+                "groups are not supported for resource bundles");
+        }
+        // A PRI file indexes every resource of the app, so it would be wrong
+        // for each split package; makepri generates one per package.
+        for (const FileListEntry &file : fileNames) {
+            const std::string name = ToLower(file.first);
+            if (name.size() >= 4 &&
+                name.compare(name.size() - 4, 4, ".pri") == 0) {
+                throw std::runtime_error(
+                    "Cannot split resources indexed by a PRI file: " +
+                    file.first);
+            }
+        }
+        FileSystemInputSource fileSystem;
+        BundleInputSource source(options.inputSource ? *options.inputSource
+                                                     : fileSystem);
+
+        auto manifestIt = std::find_if(
+            fileNames.begin(), fileNames.end(),
+            [](const FileListEntry &file) {
+                return file.first == "AppxManifest.xml";
+            });
+        if (manifestIt == fileNames.end()) {
+            throw std::runtime_error("Missing AppxManifest.xml");
+        }
+        std::string manifestPath = source.AddPath(manifestIt->second);
+        std::string manifestXML;
+        source.Read(manifestPath, CachePolicy::Default,
+                    [&manifestXML](std::size_t size,
+                                   const std::uint8_t *bytes) {
+                        manifestXML.append(
+                            reinterpret_cast<const char *>(bytes), size);
+                    });
+        AppManifest app = ParseAppManifest(manifestXML);
+
+        // The main package comes first, then resource packages by
+        // resource ID.
+        std::deque<Package> packages(1);
+        packages[0].fileName =
+            app.name + "_" + app.version + "_" + app.architecture + ".appx";
+        std::map<std::string, std::size_t> packagesByResourceId;
+        for (const FileListEntry &file : fileNames) {
+            std::vector<ResourceQualifier> qualifiers;
+            for (const ResourceQualifier &qualifier :
+                 ResourceQualifiers(file.first)) {
+                bool isDefault = std::any_of(
+                    app.resources.begin(), app.resources.end(),
+                    [&qualifier](const ResourceQualifier &resource) {
+                        return resource.name == qualifier.name &&
+                               resource.value == qualifier.value;
+                    });
+                if (!isDefault) {
+                    qualifiers.push_back(qualifier);
+                }
+            }
+            std::string resourceId;
+            for (const ResourceQualifier &qualifier : qualifiers) {
+                resourceId += (resourceId.empty() ? "split." : ".") +
+                              ToLower(qualifier.name) + "-" + qualifier.value;
+            }
+            std::size_t index = 0;
+            if (!resourceId.empty()) {
+                auto inserted = packagesByResourceId.insert(
+                    std::make_pair(resourceId, packagesByResourceId.size()));
+                index = inserted.first->second + 1;
+                if (inserted.second) {
+                    packages.emplace_back();
+                    Package &package = packages.back();
+                    package.qualifiers = qualifiers;
+                    package.resourceId = resourceId;
+                    package.fileName = app.name + "_" + app.version + "_" +
+                                       resourceId + ".appx";
+                }
+            }
+            packages[index].files.emplace_back(file.first,
+                                               source.AddPath(file.second));
+        }
+        std::sort(packages.begin() + 1, packages.end(),
+                  [](const Package &a, const Package &b) {
+                      return a.resourceId < b.resourceId;
+                  });
+        for (std::size_t i = 1; i < packages.size(); ++i) {
+            Package &package = packages[i];
+            package.files.insert(
+                package.files.begin(),
+                FileListEntry("AppxManifest.xml",
+                              source.AddData(
+                                  ResourcePackageManifest(app, package))));
+        }
+
+        // Packages are written at once, sharing the threads and memory.
+        const unsigned jobs = EffectiveJobCount(options.jobs);
+        APPXOptions packageOptions = options;
+        packageOptions.inputSource = &source;
+        packageOptions.indexPath.clear();
+        packageOptions.outputDigests = nullptr;
+        if (options.maxMemory > 0) {
+            packageOptions.maxMemory = std::max<std::size_t>(
+                1, options.maxMemory /
+                       std::min<std::size_t>(packages.size(), jobs));
+        }
+        ParallelFor(packages.size(), jobs, [&](std::size_t i) {
+            Package &package = packages[i];
+            package.file = OpenTemporaryFile();
+            WriteAppx(package.file, package.files, packageOptions);
+            if (std::fflush(package.file.get()) != 0) {
+                throw ErrnoException();
+            }
+            package.size = ftello(package.file.get());
+            if (package.size == -1) {
+                throw ErrnoException();
+            }
+        });
+
+        std::vector<FileListEntry> bundleFiles;
+        for (const Package &package : packages) {
+            bundleFiles.emplace_back(package.fileName,
+                                     source.AddFile(package.file));
+        }
+        bundleFiles.emplace_back(
+            "AppxMetadata/AppxBundleManifest.xml",
+            source.AddData(BundleManifest(app, packages)));
+        APPXOptions bundleOptions = options;
+        bundleOptions.isBundle = true;
+        bundleOptions.inputSource = &source;
+        WriteAppx(zip, bundleFiles, bundleOptions);
+    }
+}
+}
@@ -7,9 +7,12 @@
 
 #include <APPX/Sign.h>
 #include <APPX/Sink.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <ctime>
 #include <openssl/asn1t.h>
+#include <openssl/x509.h>
 #include <vector>
 
 namespace facebook {
@@ -21,13 +24,22 @@ namespace appx {
             const char kSPCSipinfo[] = "1.3.6.1.4.1.311.2.1.30";
             const char kSPCSpOpusInfo[] = "1.3.6.1.4.1.311.2.1.12";
             const char kSPCStatementType[] = "1.3.6.1.4.1.311.2.1.11";
+            const char kSPCPEImageData[] = "1.3.6.1.4.1.311.2.1.15";
+            const char kCTL[] = "1.3.6.1.4.1.311.10.1";
+            const char kCatalogList[] = "1.3.6.1.4.1.311.12.1.1";
+            const char kCatalogListMember2[] = "1.3.6.1.4.1.311.12.1.3";
+            const char kCatalogNameValue[] = "1.3.6.1.4.1.311.12.2.1";
 
             void Register()
             {
-                OBJ_create_and_add_object(kSPCIndirectData, nullptr, nullptr);
-                OBJ_create_and_add_object(kSPCSipinfo, nullptr, nullptr);
-                OBJ_create_and_add_object(kSPCSpOpusInfo, nullptr, nullptr);
-                OBJ_create_and_add_object(kSPCStatementType, nullptr, nullptr);
+                for (const char *oid :
+                     {kSPCIndirectData, kSPCSipinfo, kSPCSpOpusInfo,
+                      kSPCStatementType, kSPCPEImageData, kCTL, kCatalogList,
+                      kCatalogListMember2, kCatalogNameValue}) {
+                    if (OBJ_txt2nid(oid) == NID_undef) {
+                        OBJ_create_and_add_object(oid, nullptr, nullptr);
+                    }
+                }
             }
         };
 
@@ -131,12 +143,80 @@ namespace appx {
             } ASN1_SEQUENCE_END(SPCStatementType)
             IMPLEMENT_ASN1_FUNCTIONS(SPCStatementType)
             // clang-format on
+
+            // Catalog files, as described by mscat.h.
+            struct CatalogNameValue
+            {
+                ASN1_BMPSTRING *tag;
+                ASN1_INTEGER *flags;
+                ASN1_OCTET_STRING *value;
+            };
+            DECLARE_ASN1_FUNCTIONS(CatalogNameValue)
+            using CatalogNameValuePtr =
+                OpenSSLPtr<CatalogNameValue, CatalogNameValue_free>;
+
+            struct CatalogMember
+            {
+                ASN1_OCTET_STRING *tag;
+                STACK_OF(X509_ATTRIBUTE) * attributes;
+            };
+            DECLARE_ASN1_FUNCTIONS(CatalogMember)
+            using CatalogMemberPtr =
+                OpenSSLPtr<CatalogMember, CatalogMember_free>;
+
+            struct CertificateTrustList
+            {
+                STACK_OF(ASN1_OBJECT) * subjectUsage;
+                ASN1_OCTET_STRING *listIdentifier;
+                ASN1_TIME *thisUpdate;
+                X509_ALGOR *subjectAlgorithm;
+                STACK_OF(ASN1_TYPE) * members;  // CatalogMember-s.
+            };
+            DECLARE_ASN1_FUNCTIONS(CertificateTrustList)
+            using CertificateTrustListPtr =
+                OpenSSLPtr<CertificateTrustList, CertificateTrustList_free>;
+
+            // clang-format off
+            ASN1_SEQUENCE(CatalogNameValue) = {
+                ASN1_SIMPLE(CatalogNameValue, tag, ASN1_BMPSTRING),
+                ASN1_SIMPLE(CatalogNameValue, flags, ASN1_INTEGER),
+                ASN1_SIMPLE(CatalogNameValue, value, ASN1_OCTET_STRING),
+            } ASN1_SEQUENCE_END(CatalogNameValue)
+            IMPLEMENT_ASN1_FUNCTIONS(CatalogNameValue)
+
+            ASN1_SEQUENCE(CatalogMember) = {
+                ASN1_SIMPLE(CatalogMember, tag, ASN1_OCTET_STRING),
+                ASN1_SET_OF(CatalogMember, attributes, X509_ATTRIBUTE),
+            } ASN1_SEQUENCE_END(CatalogMember)
+            IMPLEMENT_ASN1_FUNCTIONS(CatalogMember)
+
+            ASN1_SEQUENCE(CertificateTrustList) = {
+                ASN1_SEQUENCE_OF(CertificateTrustList, subjectUsage,
+                                 ASN1_OBJECT),
+                ASN1_SIMPLE(CertificateTrustList, listIdentifier,
+                            ASN1_OCTET_STRING),
+                ASN1_SIMPLE(CertificateTrustList, thisUpdate, ASN1_TIME),
+                ASN1_SIMPLE(CertificateTrustList, subjectAlgorithm,
+                            X509_ALGOR),
+                ASN1_SEQUENCE_OF(CertificateTrustList, members, ASN1_ANY),
+            } ASN1_SEQUENCE_END(CertificateTrustList)
+            IMPLEMENT_ASN1_FUNCTIONS(CertificateTrustList)
+            // clang-format on
         }
 
         class EncodedASN1
         {
         public:
-            template <typename T, int (*TEncode)(T *, std::uint8_t **)>
+            // OpenSSL 1.1 made the i2d_* functions take a const item.
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+            template <typename T>
+            using EncodeFunction = int (*)(const T *, std::uint8_t **);
+#else
+            template <typename T>
+            using EncodeFunction = int (*)(T *, std::uint8_t **);
+#endif
+
+            template <typename T, EncodeFunction<T> TEncode>
             static EncodedASN1 FromItem(T *item)
             {
                 std::uint8_t *dataRaw = nullptr;
@@ -162,7 +242,7 @@ namespace appx {
             // an ASN1_STRING.
             //
             // The returned object holds a copy of this object's data.
-            ASN1_STRINGPtr ToSequenceString()
+            ASN1_STRINGPtr ToSequenceString() const
             {
                 ASN1_STRINGPtr string(ASN1_STRING_new());
                 if (!string) {
@@ -179,7 +259,7 @@ namespace appx {
             // an ASN1_TYPE.
             //
             // The returned object holds a copy of this object's data.
-            ASN1_TYPEPtr ToSequenceType()
+            ASN1_TYPEPtr ToSequenceType() const
             {
                 ASN1_STRINGPtr string = this->ToSequenceString();
                 ASN1_TYPEPtr type(ASN1_TYPE_new());
@@ -352,90 +432,360 @@ namespace appx {
             return CertificateFile{std::move(privateKey),
                                    std::move(certificate)};
         }
-    }
 
-    OpenSSLPtr<PKCS7, PKCS7_free> Sign(const std::string &certPath,
-                                       const APPXDigests &digests)
-    {
-        OpenSSL_add_all_algorithms();
-        oid::Register();
+        // Returns the offset of the contents octets of a DER encoding.
+        std::size_t ContentsOffset(const EncodedASN1 &encoded)
+        {
+            if (encoded.Size() < 2) {
+                throw std::runtime_error("Malformed ASN.1");
+            }
+            std::uint8_t length = encoded.Data()[1];
+            return (length & 0x80) ? 2 + (length & 0x7f) : 2;
+        }
 
-        CertificateFile certFile = ReadCertificateFile(certPath);
+        // Creates PKCS7 signed data holding content of the given type.
+        // addAttributes adds signed attributes to the signer info.
+        template <typename TAddAttributes>
+        OpenSSLPtr<PKCS7, PKCS7_free> SignContent(const std::string &certPath,
+                                                  const char *contentType,
+                                                  EncodedASN1 &content,
+                                                  TAddAttributes addAttributes)
+        {
+            CertificateFile certFile = ReadCertificateFile(certPath);
 
-        // Create the signature.
-        OpenSSLPtr<PKCS7, PKCS7_free> signature(PKCS7_new());
-        if (!signature) {
-            throw OpenSSLException();
+            // Create the signature.
+            OpenSSLPtr<PKCS7, PKCS7_free> signature(PKCS7_new());
+            if (!signature) {
+                throw OpenSSLException();
+            }
+            if (!PKCS7_set_type(signature.get(), NID_pkcs7_signed)) {
+                throw OpenSSLException();
+            }
+            PKCS7_SIGNER_INFO *signerInfo = PKCS7_add_signature(
+                signature.get(), certFile.certificate.get(),
+                certFile.privateKey.get(), EVP_sha256());
+            if (!signerInfo) {
+                throw OpenSSLException();
+            }
+            addAttributes(signerInfo);
+
+            if (!PKCS7_content_new(signature.get(), NID_pkcs7_data)) {
+                throw OpenSSLException();
+            }
+            if (!PKCS7_add_certificate(signature.get(),
+                                       certFile.certificate.get())) {
+                throw OpenSSLException();
+            }
+
+            // TODO(strager): Use lower-level APIs to avoid OpenSSL injecting
+            // the signingTime attribute.
+            BIOPtr signedData(PKCS7_dataInit(signature.get(), NULL));
+            if (!signedData) {
+                throw OpenSSLException();
+            }
+            // Per RFC 2315 section 9.3:
+            // "Only the contents octets of the DER encoding of that field are
+            // digested, not the identifier octets or the length octets."
+            // Strip off the length.
+            std::size_t skip = ContentsOffset(content);
+            if (skip > content.Size()) {
+                throw std::runtime_error("Malformed ASN.1");
+            }
+            if (BIO_write(signedData.get(), content.Data() + skip,
+                          content.Size() - skip) != content.Size() - skip) {
+                throw OpenSSLException();
+            }
+            if (BIO_flush(signedData.get()) != 1) {
+                throw OpenSSLException();
+            }
+            if (!PKCS7_dataFinal(signature.get(), signedData.get())) {
+                throw OpenSSLException();
+            }
+
+            // Set the content. Must be done after digesting the signed data.
+            OpenSSLPtr<PKCS7, PKCS7_free> contentInfo(PKCS7_new());
+            if (!contentInfo) {
+                throw OpenSSLException();
+            }
+            contentInfo->type = OBJ_txt2obj(contentType, 1);
+            ASN1_TYPEPtr contentSequence = content.ToSequenceType();
+            contentInfo->d.other = contentSequence.get();
+            if (!PKCS7_set_content(signature.get(), contentInfo.get())) {
+                throw OpenSSLException();
+            }
+            contentInfo.release();
+            contentSequence.release();
+
+            return signature;
+        }
+
+        // Returns the UCS-2 (big-endian) encoding of a UTF-8 string.
+        ASN1_STRINGPtr BMPString(const std::string &utf8)
+        {
+            ASN1_STRING *stringRaw = nullptr;
+            if (ASN1_mbstring_copy(
+                    &stringRaw,
+                    reinterpret_cast<const unsigned char *>(utf8.data()),
+                    utf8.size(), MBSTRING_UTF8, B_ASN1_BMPSTRING) < 0) {
+                throw OpenSSLException();
+            }
+            return ASN1_STRINGPtr(stringRaw);
+        }
+
+        // Returns the NUL-terminated UTF-16 (little-endian) encoding of a
+        // UTF-8 string.
+        std::vector<std::uint8_t> UTF16LEString(const std::string &utf8)
+        {
+            ASN1_STRINGPtr bmp = BMPString(utf8);
+            const std::uint8_t *bytes = ASN1_STRING_get0_data(bmp.get());
+            std::vector<std::uint8_t> result;
+            for (int i = 0; i + 1 < ASN1_STRING_length(bmp.get()); i += 2) {
+                result.push_back(bytes[i + 1]);
+                result.push_back(bytes[i]);
+            }
+            result.push_back(0);
+            result.push_back(0);
+            return result;
+        }
+
+        // Adds an attribute whose value is the given DER-encoded SEQUENCE.
+        void AddAttribute(STACK_OF(X509_ATTRIBUTE) * attributes,
+                          const char *type, const EncodedASN1 &value)
+        {
+            ASN1_STRINGPtr string = value.ToSequenceString();
+            X509_ATTRIBUTE *attribute = X509_ATTRIBUTE_create(
+                OBJ_txt2nid(type), V_ASN1_SEQUENCE, string.get());
+            if (!attribute) {
+                throw OpenSSLException();
+            }
+            string.release();
+            if (!sk_X509_ATTRIBUTE_push(attributes, attribute)) {
+                X509_ATTRIBUTE_free(attribute);
+                throw OpenSSLException();
+            }
+        }
+
+        // Makes the catalog's entry for a PE image: its hash (as the
+        // tag and as Authenticode indirect data) and its name.
+        asn1::CatalogMemberPtr MakeCatalogMember(const std::string &tag,
+                                                 const std::string &name,
+                                                 const SHA256Hash &hash)
+        {
+            using namespace asn1;
+
+            // SpcPeImageData with no flags and an empty file link, as
+            // signtool writes.
+            static const std::uint8_t kPEImageData[] = {
+                0x30, 0x09, 0x03, 0x01, 0x00, 0xA0,
+                0x04, 0xA2, 0x02, 0x80, 0x00,
+            };
+            ASN1_TYPEPtr peImageData(ASN1_TYPE_new());
+            ASN1_STRINGPtr peImageDataString(ASN1_STRING_new());
+            if (!peImageData || !peImageDataString ||
+                !ASN1_STRING_set(peImageDataString.get(), kPEImageData,
+                                 sizeof(kPEImageData))) {
+                throw OpenSSLException();
+            }
+            peImageData->type = V_ASN1_SEQUENCE;
+            peImageData->value.sequence = peImageDataString.release();
+
+            ASN1_TYPEPtr algorithmParameter(ASN1_TYPE_new());
+            if (!algorithmParameter) {
+                throw OpenSSLException();
+            }
+            algorithmParameter->type = V_ASN1_NULL;
+
+            SPCIndirectDataContentPtr idc(SPCIndirectDataContent_new());
+            if (!idc) {
+                throw OpenSSLException();
+            }
+            idc->data->type = OBJ_txt2obj(oid::kSPCPEImageData, 1);
+            idc->data->value = peImageData.release();
+            idc->messageDigest->digestAlgorithm->algorithm =
+                OBJ_nid2obj(NID_sha256);
+            idc->messageDigest->digestAlgorithm->parameter =
+                algorithmParameter.release();
+            if (!ASN1_OCTET_STRING_set(idc->messageDigest->digest, hash.bytes,
+                                       sizeof(hash.bytes))) {
+                throw OpenSSLException();
+            }
+
+            CatalogNameValuePtr nameValue(CatalogNameValue_new());
+            if (!nameValue) {
+                throw OpenSSLException();
+            }
+            ASN1_STRINGPtr nameTag = BMPString("File");
+            if (!ASN1_STRING_copy(nameValue->tag, nameTag.get())) {
+                throw OpenSSLException();
+            }
+            // CRYPTCAT_ATTR_AUTHENTICATED | CRYPTCAT_ATTR_NAMEASCII |
+            // CRYPTCAT_ATTR_DATAASCII.
+            ASN1_INTEGER_set(nameValue->flags, 0x10010001);
+            std::vector<std::uint8_t> nameBytes = UTF16LEString(name);
+            if (!ASN1_OCTET_STRING_set(nameValue->value, nameBytes.data(),
+                                       nameBytes.size())) {
+                throw OpenSSLException();
+            }
+
+            CatalogMemberPtr member(CatalogMember_new());
+            if (!member) {
+                throw OpenSSLException();
+            }
+            std::vector<std::uint8_t> tagBytes = UTF16LEString(tag);
+            if (!ASN1_OCTET_STRING_set(member->tag, tagBytes.data(),
+                                       tagBytes.size())) {
+                throw OpenSSLException();
+            }
+            AddAttribute(member->attributes, oid::kCatalogNameValue,
+                         EncodedASN1::FromItem<CatalogNameValue,
+                                               i2d_CatalogNameValue>(
+                             nameValue.get()));
+            AddAttribute(member->attributes, oid::kSPCIndirectData,
+                         EncodedASN1::FromItem<SPCIndirectDataContent,
+                                               i2d_SPCIndirectDataContent>(
+                             idc.get()));
+            return member;
         }
-        if (!PKCS7_set_type(signature.get(), NID_pkcs7_signed)) {
+
+        // Returns the hash as upper-case hexadecimal, as catalogs tag
+        // members.
+        std::string CatalogTag(const SHA256Hash &hash)
+        {
+            static const char kDigits[] = "0123456789ABCDEF";
+            std::string tag;
+            for (std::uint8_t byte : hash.bytes) {
+                tag += kDigits[byte >> 4];
+                tag += kDigits[byte & 0xf];
+            }
+            return tag;
+        }
+    }
+
+    // TODO(strager): Stream data instead of returning a chunk of memory.
+    std::vector<std::uint8_t> GetSignatureBytes(PKCS7 *signature)
+    {
+        BIOPtr out(BIO_new(BIO_s_mem()));
+        if (!out) {
             throw OpenSSLException();
         }
-        PKCS7_SIGNER_INFO *signerInfo =
-            PKCS7_add_signature(signature.get(), certFile.certificate.get(),
-                                certFile.privateKey.get(), EVP_sha256());
-        if (!signerInfo) {
+        if (!i2d_PKCS7_bio(out.get(), signature)) {
             throw OpenSSLException();
         }
-        AddAttributes(signerInfo);
-
-        if (!PKCS7_content_new(signature.get(), NID_pkcs7_data)) {
+        if (BIO_flush(out.get()) != 1) {
             throw OpenSSLException();
         }
-        if (!PKCS7_add_certificate(signature.get(),
-                                   certFile.certificate.get())) {
+        BUF_MEM *buffer;
+        if (BIO_get_mem_ptr(out.get(), &buffer) < 0) {
             throw OpenSSLException();
         }
+        const std::uint8_t *data =
+            reinterpret_cast<const std::uint8_t *>(buffer->data);
+        return std::vector<std::uint8_t>(data, data + buffer->length);
+    }
+
+    OpenSSLPtr<PKCS7, PKCS7_free> Sign(const std::string &certPath,
+                                       const APPXDigests &digests)
+    {
+        OpenSSL_add_all_algorithms();
+        oid::Register();
 
         asn1::SPCIndirectDataContentPtr idc(asn1::SPCIndirectDataContent_new());
         MakeIndirectDataContent(*idc, digests);
         EncodedASN1 idcEncoded =
             EncodedASN1::FromItem<asn1::SPCIndirectDataContent,
                                   asn1::i2d_SPCIndirectDataContent>(idc.get());
+        return SignContent(certPath, oid::kSPCIndirectData, idcEncoded,
+                           AddAttributes);
+    }
 
-        // TODO(strager): Use lower-level APIs to avoid OpenSSL injecting the
-        // signingTime attribute.
-        BIOPtr signedData(PKCS7_dataInit(signature.get(), NULL));
-        if (!signedData) {
-            throw OpenSSLException();
-        }
-        // Per RFC 2315 section 9.3:
-        // "Only the contents octets of the DER encoding of that field are
-        // digested, not the identifier octets or the length octets."
-        // Strip off the length.
-        if (idcEncoded.Size() < 2) {
-            throw std::runtime_error("NYI");
-        }
-        if ((idcEncoded.Data()[1] & 0x80) == 0x00) {
-            throw std::runtime_error("NYI");
+    OpenSSLPtr<PKCS7, PKCS7_free> SignCatalog(
+        const std::string &certPath,
+        const std::vector<std::pair<std::string, SHA256Hash>> &members)
+    {
+        using namespace asn1;
+
+        OpenSSL_add_all_algorithms();
+        oid::Register();
+
+        // Members are sorted by tag so the catalog does not depend on the
+        // order binaries were hashed in.
+        std::vector<std::pair<std::string, std::size_t>> tags;
+        for (std::size_t i = 0; i < members.size(); ++i) {
+            tags.emplace_back(CatalogTag(members[i].second), i);
         }
-        std::size_t skip = 4;
-        if (BIO_write(signedData.get(), idcEncoded.Data() + skip,
-                      idcEncoded.Size() - skip) != idcEncoded.Size() - skip) {
+        std::sort(tags.begin(), tags.end(),
+                  [&members](const std::pair<std::string, std::size_t> &a,
+                             const std::pair<std::string, std::size_t> &b) {
+                      if (a.first != b.first) {
+                          return a.first < b.first;
+                      }
+                      return members[a.second].first <
+                             members[b.second].first;
+                  });
+
+        CertificateTrustListPtr ctl(CertificateTrustList_new());
+        if (!ctl) {
             throw OpenSSLException();
         }
-        if (BIO_flush(signedData.get()) != 1) {
+        if (!sk_ASN1_OBJECT_push(ctl->subjectUsage,
+                                 OBJ_txt2obj(oid::kCatalogList, 1))) {
             throw OpenSSLException();
         }
-        if (!PKCS7_dataFinal(signature.get(), signedData.get())) {
+        // The list identifier is derived from the members (instead of being
+        // random) so it only changes when they do.
+        SHA256Sink identifierSink;
+        for (const auto &tag : tags) {
+            identifierSink.Write(
+                tag.first.size(),
+                reinterpret_cast<const std::uint8_t *>(tag.first.data()));
+        }
+        SHA256Hash identifier = identifierSink.SHA256();
+        if (!ASN1_OCTET_STRING_set(ctl->listIdentifier, identifier.bytes,
+                                   16)) {
             throw OpenSSLException();
         }
-
-        // Set the content to an SpcIndirectDataContent. Must be done after
-        // digesting the signed data.
-        OpenSSLPtr<PKCS7, PKCS7_free> content(PKCS7_new());
-        if (!content) {
+        if (!ASN1_TIME_set(ctl->thisUpdate, std::time(nullptr))) {
             throw OpenSSLException();
         }
-        content->type = OBJ_txt2obj(oid::kSPCIndirectData, 1);
-        ASN1_TYPEPtr idcSequence = idcEncoded.ToSequenceType();
-        content->d.other = idcSequence.get();
-        if (!PKCS7_set_content(signature.get(), content.get())) {
+        ASN1_TYPEPtr algorithmParameter(ASN1_TYPE_new());
+        if (!algorithmParameter) {
             throw OpenSSLException();
         }
-        content.release();
-        idcSequence.release();
+        algorithmParameter->type = V_ASN1_NULL;
+        ctl->subjectAlgorithm->algorithm =
+            OBJ_txt2obj(oid::kCatalogListMember2, 1);
+        ctl->subjectAlgorithm->parameter = algorithmParameter.release();
+
+        for (std::size_t i = 0; i < tags.size(); ++i) {
+            // Identical binaries share a member, named after the first.
+            if (i > 0 && tags[i].first == tags[i - 1].first) {
+                continue;
+            }
+            const auto &member = members[tags[i].second];
+            CatalogMemberPtr catalogMember =
+                MakeCatalogMember(tags[i].first, member.first, member.second);
+            ASN1_TYPEPtr memberSequence =
+                EncodedASN1::FromItem<CatalogMember, i2d_CatalogMember>(
+                    catalogMember.get())
+                    .ToSequenceType();
+            if (!sk_ASN1_TYPE_push(ctl->members, memberSequence.get())) {
+                throw OpenSSLException();
+            }
+            memberSequence.release();
+        }
 
-        return signature;
+        EncodedASN1 ctlEncoded =
+            EncodedASN1::FromItem<CertificateTrustList,
+                                  i2d_CertificateTrustList>(ctl.get());
+        return SignContent(
+            certPath, oid::kCTL, ctlEncoded,
+            [](PKCS7_SIGNER_INFO *signerInfo) {
+                if (!PKCS7_add_signed_attribute(
+                        signerInfo, NID_pkcs9_contentType, V_ASN1_OBJECT,
+                        OBJ_txt2obj(oid::kCTL, 1))) {
+                    throw OpenSSLException();
+                }
+            });
     }
 }
 }
@@ -0,0 +1,334 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/File.h>
+#include <APPX/Parallel.h>
+#include <APPX/Sink.h>
+#include <APPX/Tuning.h>
+#include <APPX/ZIP.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <queue>
+#include <string>
+#include <time.h>
+#include <unordered_map>
+#include <zlib.h>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        // Samples are taken until 1/kSampledFraction of the input (but at
+        // least kMinSampledBytes) is covered.
+        const off_t kSampledFraction = 16;
+        const off_t kMinSampledBytes = 4 * 1024 * 1024;
+
+        // Replan when the ratio between actual and estimated CPU time
+        // changes by more than this much.
+        const double kReplanThreshold = 0.1;
+
+        const double kMinCost = 1e-12;
+
+        struct Sample
+        {
+            double bytes = 0;
+            // CPU time hashing the sample, which every level pays.
+            double hashCost = 0;
+            // CPU time compressing the sample, and the compressed size.
+            double cost[CompressionTuner::kLevelCount] = {};
+            double size[CompressionTuner::kLevelCount] = {};
+
+            void Add(const Sample &other)
+            {
+                this->bytes += other.bytes;
+                this->hashCost += other.hashCost;
+                for (std::size_t i = 0; i < CompressionTuner::kLevelCount;
+                     ++i) {
+                    this->cost[i] += other.cost[i];
+                    this->size[i] += other.size[i];
+                }
+            }
+
+            bool Empty() const
+            {
+                return this->bytes == 0;
+            }
+        };
+
+        Sample SampleFile(InputSource &source, const std::string &path,
+                          off_t fileSize)
+        {
+            Sample sample;
+            ReadSampleWindows(
+                source, path, fileSize,
+                [&sample](std::size_t size, const std::uint8_t *bytes) {
+                    double start = ThreadCPUTime();
+                    SHA256Sink sha256Sink;
+                    CRC32Sink crc32Sink;
+                    sha256Sink.Write(size, bytes);
+                    crc32Sink.Write(size, bytes);
+                    sample.hashCost += ThreadCPUTime() - start;
+                    sample.size[0] += size;
+                    sample.bytes += size;
+
+                    for (std::size_t level = 1;
+                         level < CompressionTuner::kLevelCount; ++level) {
+                        start = ThreadCPUTime();
+                        OffsetSink offsetSink;
+                        auto deflateSink = MakeDeflateSink(
+                            CompressionTuner::kLevels[level], offsetSink);
+                        deflateSink.Write(size, bytes);
+                        deflateSink.Close();
+                        sample.cost[level] += ThreadCPUTime() - start;
+                        sample.size[level] += offsetSink.Offset();
+                    }
+                });
+            return sample;
+        }
+    }
+
+    double ThreadCPUTime()
+    {
+        timespec time;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+            throw ErrnoException();
+        }
+        return time.tv_sec + time.tv_nsec / 1e9;
+    }
+
+    void ReadSampleWindows(InputSource &source, const std::string &path,
+                           off_t size, const InputSource::WriteFunc &write)
+    {
+        std::vector<std::uint8_t> window(ZIPBlock::kSize);
+        off_t windowCount = (size + ZIPBlock::kSize - 1) / ZIPBlock::kSize;
+        off_t sampleCount =
+            std::min(windowCount, static_cast<off_t>(kSampleWindows));
+        for (off_t i = 0; i < sampleCount; ++i) {
+            off_t windowIndex =
+                sampleCount == 1 ? 0
+                                 : (windowCount - 1) * i / (sampleCount - 1);
+            std::size_t read =
+                source.ReadAt(path, windowIndex * ZIPBlock::kSize,
+                              window.size(), window.data());
+            if (read == 0) {
+                break;
+            }
+            write(read, window.data());
+        }
+    }
+
+    std::vector<std::size_t> ChooseSampledFiles(
+        const std::vector<off_t> &sizes,
+        const std::function<bool(std::size_t)> &canSample,
+        off_t *sampledBytes)
+    {
+        const off_t totalSize =
+            std::accumulate(sizes.begin(), sizes.end(), off_t(0));
+        std::vector<std::size_t> bySize(sizes.size());
+        std::iota(bySize.begin(), bySize.end(), 0);
+        std::stable_sort(bySize.begin(), bySize.end(),
+                         [&sizes](std::size_t a, std::size_t b) {
+                             return sizes[a] > sizes[b];
+                         });
+        const off_t sampleLimit =
+            std::max(totalSize / kSampledFraction, kMinSampledBytes);
+        std::vector<std::size_t> sampled;
+        off_t sampledSize = 0;
+        for (std::size_t i : bySize) {
+            if (!canSample(i) ||
+                (sizes[i] > 0 && sampledSize >= sampleLimit)) {
+                continue;
+            }
+            sampled.push_back(i);
+            sampledSize +=
+                std::min(sizes[i],
+                         static_cast<off_t>(kSampleWindows) * ZIPBlock::kSize);
+        }
+        if (sampledBytes) {
+            *sampledBytes = sampledSize;
+        }
+        return sampled;
+    }
+
+    double CompressionTuner::Estimate::Efficiency(std::size_t from,
+                                                  std::size_t to) const
+    {
+        return (this->size[from] - this->size[to]) /
+               std::max(this->cost[to] - this->cost[from], kMinCost);
+    }
+
+    const int CompressionTuner::kLevels[kLevelCount] = {
+        Z_NO_COMPRESSION, Z_BEST_SPEED, 6, Z_BEST_COMPRESSION,
+    };
+
+    CompressionTuner::CompressionTuner(const std::vector<FileListEntry> &inputs,
+                                       InputSource &source, double cpuBudget,
+                                       unsigned jobs)
+        : cpuBudget(cpuBudget),
+          estimates(inputs.size()),
+          plan(inputs.size(), 0),
+          states(inputs.size(), State::Waiting)
+    {
+        std::vector<off_t> sizes(inputs.size());
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            sizes[i] = source.Size(inputs[i].second);
+        }
+        std::vector<std::size_t> sampled = ChooseSampledFiles(
+            sizes, [&inputs](std::size_t i) {
+                return !_IsAPPXFile(inputs[i].first);
+            });
+
+        std::vector<Sample> samples(inputs.size());
+        std::vector<double> samplingCosts(sampled.size());
+        ParallelFor(sampled.size(), jobs, [&](std::size_t i) {
+            double start = ThreadCPUTime();
+            std::size_t index = sampled[i];
+            samples[index] =
+                SampleFile(source, inputs[index].second, sizes[index]);
+            samplingCosts[i] = ThreadCPUTime() - start;
+        });
+        this->samplingCost = std::accumulate(samplingCosts.begin(),
+                                             samplingCosts.end(), 0.0);
+
+        SamplesByExtension<Sample> samplesByExtension;
+        for (std::size_t i : sampled) {
+            samplesByExtension.Add(inputs[i].first, samples[i]);
+        }
+
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            Estimate &estimate = this->estimates[i];
+            estimate.hull.push_back(0);
+            if (sizes[i] == 0 || _IsAPPXFile(inputs[i].first)) {
+                continue;
+            }
+            const Sample *sample = &samples[i];
+            if (sample->Empty()) {
+                sample = &samplesByExtension.Find(inputs[i].first);
+            }
+            if (sample->Empty()) {
+                continue;
+            }
+            double scale = sizes[i] / sample->bytes;
+            for (std::size_t level = 0; level < kLevelCount; ++level) {
+                estimate.cost[level] =
+                    (sample->hashCost + sample->cost[level]) * scale;
+                estimate.size[level] = sample->size[level] * scale;
+            }
+
+            // Keep the levels on the lower convex hull of (cost, size),
+            // so each step up saves fewer bytes per second than the last.
+            std::vector<std::size_t> byCost;
+            for (std::size_t level = 1; level < kLevelCount; ++level) {
+                byCost.push_back(level);
+            }
+            std::stable_sort(byCost.begin(), byCost.end(),
+                             [&estimate](std::size_t a, std::size_t b) {
+                                 return estimate.cost[a] < estimate.cost[b];
+                             });
+            std::vector<std::size_t> &hull = estimate.hull;
+            for (std::size_t level : byCost) {
+                if (estimate.size[level] >= estimate.size[hull.back()]) {
+                    continue;
+                }
+                while (hull.size() >= 2 &&
+                       estimate.Efficiency(hull[hull.size() - 2],
+                                           hull.back()) <=
+                           estimate.Efficiency(hull.back(), level)) {
+                    hull.pop_back();
+                }
+                hull.push_back(level);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->Plan();
+    }
+
+    int CompressionTuner::Level(std::size_t index)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->states[index] = State::Started;
+        return kLevels[this->plan[index]];
+    }
+
+    void CompressionTuner::Finished(std::size_t index, double cpuSeconds)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->states[index] = State::Finished;
+        this->spent += cpuSeconds;
+        this->estimatedSpent +=
+            this->estimates[index].cost[this->plan[index]];
+        if (this->estimatedSpent <= 0) {
+            return;
+        }
+        this->correction = this->spent / this->estimatedSpent;
+        if (std::abs(this->correction - this->plannedCorrection) >
+            this->plannedCorrection * kReplanThreshold) {
+            this->Plan();
+        }
+    }
+
+    void CompressionTuner::Plan()
+    {
+        // Start by storing every waiting file, then greedily apply the
+        // upgrades which save the most bytes per second while they fit.
+        double available = this->cpuBudget - this->samplingCost - this->spent;
+        for (std::size_t i = 0; i < this->estimates.size(); ++i) {
+            const Estimate &estimate = this->estimates[i];
+            if (this->states[i] == State::Waiting) {
+                this->plan[i] = estimate.hull.front();
+            }
+            if (this->states[i] != State::Finished) {
+                available -= estimate.cost[this->plan[i]] * this->correction;
+            }
+        }
+
+        struct Upgrade
+        {
+            double efficiency;
+            std::size_t index;
+            std::size_t step;
+
+            bool operator<(const Upgrade &other) const
+            {
+                return this->efficiency < other.efficiency;
+            }
+        };
+        auto makeUpgrade = [this](std::size_t index, std::size_t step) {
+            const Estimate &estimate = this->estimates[index];
+            return Upgrade{estimate.Efficiency(estimate.hull[step - 1],
+                                               estimate.hull[step]),
+                           index, step};
+        };
+        std::priority_queue<Upgrade> upgrades;
+        for (std::size_t i = 0; i < this->estimates.size(); ++i) {
+            if (this->states[i] == State::Waiting &&
+                this->estimates[i].hull.size() > 1) {
+                upgrades.push(makeUpgrade(i, 1));
+            }
+        }
+        while (!upgrades.empty()) {
+            Upgrade upgrade = upgrades.top();
+            upgrades.pop();
+            const Estimate &estimate = this->estimates[upgrade.index];
+            std::size_t from = estimate.hull[upgrade.step - 1];
+            std::size_t to = estimate.hull[upgrade.step];
+            double cost =
+                (estimate.cost[to] - estimate.cost[from]) * this->correction;
+            if (cost > available) {
+                continue;
+            }
+            available -= cost;
+            this->plan[upgrade.index] = to;
+            if (upgrade.step + 1 < estimate.hull.size()) {
+                upgrades.push(makeUpgrade(upgrade.index, upgrade.step + 1));
+            }
+        }
+        this->plannedCorrection = this->correction;
+    }
+}
+}
@@ -29,5 +29,32 @@ namespace appx {
         }
         return encoded;
     }
+
+    std::string XMLDecodeString(const std::string &s)
+    {
+        static const std::unordered_map<std::string, char> sDecodeMap = {
+            {"quot", '"'}, {"amp", '&'}, {"apos", '\''},
+            {"lt", '<'},   {"gt", '>'},
+        };
+
+        std::string decoded;
+        decoded.reserve(s.size());
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            std::size_t end;
+            if (s[i] != '&' || (end = s.find(';', i)) == std::string::npos) {
+                decoded += s[i];
+                continue;
+            }
+            std::string name = s.substr(i + 1, end - i - 1);
+            auto it = sDecodeMap.find(name);
+            if (it != sDecodeMap.end()) {
+                decoded += it->second;
+            } else {
+                decoded += s.substr(i, end - i + 1);
+            }
+            i = end;
+        }
+        return decoded;
+    }
 }
 }
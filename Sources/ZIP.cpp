@@ -6,6 +6,7 @@
 // LICENSE file in the root directory of this source tree.
 
 #include <APPX/ZIP.h>
+#include <cctype>
 #include <cstdio>
 #include <cstring>
 #include <string>
@@ -42,5 +43,27 @@ namespace appx {
         }
         return s;
     }
+
+    std::string ZIPFileEntry::UnsanitizedFileName(
+        const std::string &sanitizedFileName)
+    {
+        std::string s;
+        s.reserve(sanitizedFileName.size());
+        for (std::size_t i = 0; i < sanitizedFileName.size(); ++i) {
+            char c = sanitizedFileName[i];
+            if (c == '%' && i + 2 < sanitizedFileName.size() &&
+                std::isxdigit(static_cast<unsigned char>(
+                    sanitizedFileName[i + 1])) &&
+                std::isxdigit(static_cast<unsigned char>(
+                    sanitizedFileName[i + 2]))) {
+                s += static_cast<char>(std::stoi(
+                    sanitizedFileName.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else {
+                s += c;
+            }
+        }
+        return s;
+    }
 }
 }
@@ -0,0 +1,786 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/File.h>
+#include <APPX/Parallel.h>
+#include <APPX/XML.h>
+#include <APPX/ZIPReader.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace facebook {
+namespace appx {
+    namespace {
+        enum : std::uint32_t
+        {
+            kFileRecordSignature = 0x04034B50,
+            kDirectoryEntrySignature = 0x02014B50,
+            kEndOfCentralDirectorySignature = 0x06054B50,
+            kZIP64EndOfCentralDirectorySignature = 0x06064B50,
+            kZIP64EndOfCentralDirectoryLocatorSignature = 0x07064B50,
+        };
+
+        enum
+        {
+            kFileRecordHeaderSize = 30,
+            kDirectoryEntrySize = 46,
+            kEndOfCentralDirectorySize = 22,
+            kZIP64EndOfCentralDirectorySize = 56,
+            kZIP64EndOfCentralDirectoryLocatorSize = 20,
+            kMaxCommentSize = 0xFFFF,
+            kZIP64ExtraFieldID = 0x0001,
+            kEncryptedFlag = 0x0001,
+            kBufferSize = 64 * 1024,
+        };
+
+        std::uint16_t ReadLE16(const std::uint8_t *bytes)
+        {
+            return static_cast<std::uint16_t>(bytes[0] | (bytes[1] << 8));
+        }
+
+        std::uint32_t ReadLE32(const std::uint8_t *bytes)
+        {
+            return static_cast<std::uint32_t>(ReadLE16(bytes)) |
+                   (static_cast<std::uint32_t>(ReadLE16(bytes + 2)) << 16);
+        }
+
+        std::uint64_t ReadLE64(const std::uint8_t *bytes)
+        {
+            return static_cast<std::uint64_t>(ReadLE32(bytes)) |
+                   (static_cast<std::uint64_t>(ReadLE32(bytes + 4)) << 32);
+        }
+
+        // Returns the value of a block map element's attribute, or an empty
+        // string.
+        std::string BlockMapAttribute(const std::string &tag,
+                                      const std::string &name)
+        {
+            std::string prefix = " " + name + "=\"";
+            std::string::size_type start = tag.find(prefix);
+            if (start == std::string::npos) {
+                return std::string();
+            }
+            start += prefix.size();
+            std::string::size_type end = tag.find('"', start);
+            if (end == std::string::npos) {
+                return std::string();
+            }
+            return tag.substr(start, end - start);
+        }
+
+        bool DecodeBase64SHA256(const std::string &base64, SHA256Hash &out)
+        {
+            // A 32-byte hash is 44 base64 characters, including one '='.
+            std::uint8_t bytes[33];
+            if (base64.size() != 44 ||
+                EVP_DecodeBlock(bytes, reinterpret_cast<const unsigned char *>(
+                                           base64.data()),
+                                static_cast<int>(base64.size())) !=
+                    sizeof(bytes)) {
+                return false;
+            }
+            out = SHA256Hash(bytes);
+            return true;
+        }
+
+        // Inflates a raw DEFLATE stream which may end without a final block.
+        class Inflater
+        {
+        public:
+            Inflater()
+            {
+                this->stream.zalloc = nullptr;
+                this->stream.zfree = nullptr;
+                this->stream.opaque = nullptr;
+                this->stream.next_in = nullptr;
+                this->stream.avail_in = 0;
+                if (inflateInit2(&this->stream, -MAX_WBITS) != Z_OK) {
+                    throw std::runtime_error("inflateInit failed");
+                }
+            }
+
+            ~Inflater()
+            {
+                inflateEnd(&this->stream);
+            }
+
+            Inflater(const Inflater &) = delete;
+            Inflater &operator=(const Inflater &) = delete;
+
+            // Inflates all of input into output, returning the number of
+            // bytes written, or output.size() if output is too small.
+            std::size_t Inflate(std::vector<std::uint8_t> &input,
+                                std::vector<std::uint8_t> &output)
+            {
+                this->stream.next_in = input.data();
+                this->stream.avail_in = static_cast<uInt>(input.size());
+                this->stream.next_out = output.data();
+                this->stream.avail_out = static_cast<uInt>(output.size());
+                int rc;
+                do {
+                    rc = inflate(&this->stream, Z_SYNC_FLUSH);
+                } while (rc == Z_OK && this->stream.avail_in > 0 &&
+                         this->stream.avail_out > 0);
+                if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+                    return output.size();
+                }
+                return output.size() - this->stream.avail_out;
+            }
+
+        private:
+            z_stream stream;
+        };
+
+        std::runtime_error MalformedZIPError(const std::string &path,
+                                             const std::string &message)
+        {
+            return std::runtime_error("Malformed ZIP file: " + path + ": " +
+                                      message);
+        }
+    }
+
+    ZIPReader::ZIPReader(const std::string &path) : path(path)
+    {
+        this->fd = open(path.c_str(), O_RDONLY);
+        if (this->fd == -1) {
+            throw ErrnoException(path);
+        }
+        this->ReadCentralDirectory();
+    }
+
+    ZIPReader::ZIPReader(const FilePtr &file, const std::string &name)
+        : path(name)
+    {
+        this->fd = dup(fileno(file.get()));
+        if (this->fd == -1) {
+            throw ErrnoException(name);
+        }
+        this->ReadCentralDirectory();
+    }
+
+    void ZIPReader::ReadCentralDirectory()
+    {
+        try {
+            struct stat status;
+            if (fstat(this->fd, &status) != 0) {
+                throw ErrnoException(path);
+            }
+            const off_t fileSize = status.st_size;
+
+            // Find the end of central directory record, which is followed
+            // only by a comment.
+            std::size_t tailSize = static_cast<std::size_t>(std::min<off_t>(
+                fileSize, kEndOfCentralDirectorySize + kMaxCommentSize));
+            std::vector<std::uint8_t> tail(tailSize);
+            this->PRead(fileSize - tailSize, tailSize, tail.data());
+            if (tailSize < kEndOfCentralDirectorySize) {
+                throw MalformedZIPError(path,
+                                        "end of central directory not found");
+            }
+            std::size_t end = tailSize - kEndOfCentralDirectorySize;
+            while (ReadLE32(&tail[end]) != kEndOfCentralDirectorySignature) {
+                if (end == 0) {
+                    throw MalformedZIPError(
+                        path, "end of central directory not found");
+                }
+                --end;
+            }
+            const std::uint8_t *record = &tail[end];
+            const off_t recordOffset = fileSize - tailSize + end;
+            std::uint64_t entryCount = ReadLE16(record + 10);
+            std::uint64_t directorySize = ReadLE32(record + 12);
+            std::uint64_t directoryOffset = ReadLE32(record + 16);
+
+            // A ZIP64 locator immediately precedes the record if present.
+            if (recordOffset >= kZIP64EndOfCentralDirectoryLocatorSize) {
+                std::uint8_t locator[kZIP64EndOfCentralDirectoryLocatorSize];
+                this->PRead(
+                    recordOffset - kZIP64EndOfCentralDirectoryLocatorSize,
+                    sizeof(locator), locator);
+                if (ReadLE32(locator) ==
+                    kZIP64EndOfCentralDirectoryLocatorSignature) {
+                    std::uint8_t zip64Record[kZIP64EndOfCentralDirectorySize];
+                    this->PRead(static_cast<off_t>(ReadLE64(locator + 8)),
+                                sizeof(zip64Record), zip64Record);
+                    if (ReadLE32(zip64Record) !=
+                        kZIP64EndOfCentralDirectorySignature) {
+                        throw MalformedZIPError(
+                            path, "bad ZIP64 end of central directory");
+                    }
+                    entryCount = ReadLE64(zip64Record + 32);
+                    directorySize = ReadLE64(zip64Record + 40);
+                    directoryOffset = ReadLE64(zip64Record + 48);
+                }
+            }
+            if (directoryOffset + directorySize >
+                static_cast<std::uint64_t>(fileSize)) {
+                throw MalformedZIPError(path,
+                                        "central directory out of bounds");
+            }
+
+            std::vector<std::uint8_t> directory(
+                static_cast<std::size_t>(directorySize));
+            this->PRead(static_cast<off_t>(directoryOffset), directory.size(),
+                        directory.data());
+            std::size_t position = 0;
+            for (std::uint64_t i = 0; i < entryCount; ++i) {
+                if (position + kDirectoryEntrySize > directory.size() ||
+                    ReadLE32(&directory[position]) !=
+                        kDirectoryEntrySignature) {
+                    throw MalformedZIPError(path, "bad central directory");
+                }
+                const std::uint8_t *header = &directory[position];
+                std::uint16_t flags = ReadLE16(header + 8);
+                std::uint16_t method = ReadLE16(header + 10);
+                std::uint16_t nameSize = ReadLE16(header + 28);
+                std::uint16_t extraSize = ReadLE16(header + 30);
+                std::uint16_t commentSize = ReadLE16(header + 32);
+                std::size_t entrySize =
+                    kDirectoryEntrySize + nameSize + extraSize + commentSize;
+                if (position + entrySize > directory.size()) {
+                    throw MalformedZIPError(path, "bad central directory");
+                }
+                std::string sanitizedFileName(
+                    reinterpret_cast<const char *>(header) +
+                        kDirectoryEntrySize,
+                    nameSize);
+
+                Entry entry;
+                entry.fileName =
+                    ZIPFileEntry::UnsanitizedFileName(sanitizedFileName);
+                entry.crc32 = ReadLE32(header + 16);
+                std::uint64_t compressedSize = ReadLE32(header + 20);
+                std::uint64_t uncompressedSize = ReadLE32(header + 24);
+                std::uint64_t headerOffset = ReadLE32(header + 42);
+
+                // ZIP64 fields are present only for the values which do not
+                // fit in 32 bits, in this order.
+                const std::uint8_t *extra =
+                    header + kDirectoryEntrySize + nameSize;
+                const std::uint8_t *extraEnd = extra + extraSize;
+                while (extra + 4 <= extraEnd) {
+                    std::uint16_t id = ReadLE16(extra);
+                    std::uint16_t size = ReadLE16(extra + 2);
+                    const std::uint8_t *data = extra + 4;
+                    const std::uint8_t *dataEnd =
+                        std::min(data + size, extraEnd);
+                    if (id == kZIP64ExtraFieldID) {
+                        for (std::uint64_t *field :
+                             {&uncompressedSize, &compressedSize,
+                              &headerOffset}) {
+                            if (*field == 0xFFFFFFFF && data + 8 <= dataEnd) {
+                                *field = ReadLE64(data);
+                                data += 8;
+                            }
+                        }
+                    }
+                    extra += 4 + size;
+                }
+
+                if (flags & kEncryptedFlag) {
+                    throw std::runtime_error("Encrypted ZIP entries are not "
+                                             "supported: " +
+                                             entry.fileName);
+                }
+                switch (method) {
+                    case static_cast<std::uint16_t>(ZIPCompressionType::Store):
+                        entry.compressionType = ZIPCompressionType::Store;
+                        break;
+                    case static_cast<std::uint16_t>(
+                        ZIPCompressionType::Deflate):
+                        entry.compressionType = ZIPCompressionType::Deflate;
+                        break;
+                    default:
+                        throw std::runtime_error(
+                            "Unsupported ZIP compression method " +
+                            std::to_string(method) + ": " + entry.fileName);
+                }
+                entry.compressedSize = static_cast<off_t>(compressedSize);
+                entry.uncompressedSize = static_cast<off_t>(uncompressedSize);
+                entry.fileRecordHeaderOffset = static_cast<off_t>(headerOffset);
+
+                std::uint8_t fileRecordHeader[kFileRecordHeaderSize];
+                this->PRead(entry.fileRecordHeaderOffset,
+                            sizeof(fileRecordHeader), fileRecordHeader);
+                if (ReadLE32(fileRecordHeader) != kFileRecordSignature) {
+                    throw MalformedZIPError(
+                        path, "bad file record for " + entry.fileName);
+                }
+                entry.dataOffset = entry.fileRecordHeaderOffset +
+                                   kFileRecordHeaderSize +
+                                   ReadLE16(fileRecordHeader + 26) +
+                                   ReadLE16(fileRecordHeader + 28);
+                if (entry.dataOffset + entry.compressedSize > fileSize) {
+                    throw MalformedZIPError(
+                        path, "data out of bounds for " + entry.fileName);
+                }
+
+                position += entrySize;
+                if (!entry.fileName.empty() &&
+                    entry.fileName.back() == '/') {
+                    // Directories are implied by file names.
+                    continue;
+                }
+                this->entryIndexes.emplace(entry.fileName,
+                                           this->entries.size());
+                this->entries.push_back(std::move(entry));
+            }
+        } catch (...) {
+            close(this->fd);
+            throw;
+        }
+    }
+
+    ZIPReader::~ZIPReader()
+    {
+        close(this->fd);
+    }
+
+    const ZIPReader::Entry *ZIPReader::Find(const std::string &fileName) const
+    {
+        auto it = this->entryIndexes.find(fileName);
+        if (it == this->entryIndexes.end()) {
+            return nullptr;
+        }
+        return &this->entries[it->second];
+    }
+
+    void ZIPReader::Read(const Entry &entry,
+                         const InputSource::WriteFunc &write) const
+    {
+        std::pair<std::uint32_t, off_t> result = this->Stream(
+            entry, [&write](std::size_t size, const std::uint8_t *bytes) {
+                write(size, bytes);
+                return true;
+            });
+        if (result.second != entry.uncompressedSize) {
+            throw MalformedZIPError(this->path,
+                                    "wrong size for " + entry.fileName);
+        }
+        if (result.first != entry.crc32) {
+            throw MalformedZIPError(this->path,
+                                    "wrong CRC-32 for " + entry.fileName);
+        }
+    }
+
+    void ZIPReader::LoadBlockMap()
+    {
+        const Entry *blockMapEntry = this->Find("AppxBlockMap.xml");
+        if (!blockMapEntry) {
+            return;
+        }
+        std::string xml;
+        this->Read(*blockMapEntry,
+                   [&xml](std::size_t size, const std::uint8_t *bytes) {
+                       xml.append(reinterpret_cast<const char *>(bytes), size);
+                   });
+
+        Entry *entry = nullptr;
+        std::vector<ZIPBlock> blocks;
+        auto finishFile = [&]() {
+            if (!entry) {
+                return;
+            }
+            off_t expectedBlocks =
+                (entry->uncompressedSize + ZIPBlock::kSize - 1) /
+                ZIPBlock::kSize;
+            if (static_cast<off_t>(blocks.size()) != expectedBlocks) {
+                throw MalformedZIPError(
+                    this->path, "bad block map for " + entry->fileName);
+            }
+            bool canReadBlocks =
+                entry->compressionType == ZIPCompressionType::Deflate;
+            off_t totalSize = 0;
+            for (const ZIPBlock &block : blocks) {
+                if (block.compressedSize == ZIPBlock::kNotCompressed) {
+                    canReadBlocks = false;
+                }
+                totalSize += block.compressedSize;
+            }
+            entry->canReadBlocks =
+                canReadBlocks && totalSize <= entry->compressedSize;
+            entry->blocks = std::move(blocks);
+            entry->hasBlockMap = true;
+            entry = nullptr;
+            blocks.clear();
+        };
+        std::string::size_type pos = 0;
+        while ((pos = xml.find('<', pos)) != std::string::npos) {
+            std::string::size_type end = xml.find('>', pos);
+            if (end == std::string::npos) {
+                break;
+            }
+            std::string tag = xml.substr(pos, end - pos);
+            pos = end;
+            if (tag.compare(0, 6, "<File ") == 0) {
+                finishFile();
+                std::string name =
+                    XMLDecodeString(BlockMapAttribute(tag, "Name"));
+                std::replace(name.begin(), name.end(), '\\', '/');
+                auto it = this->entryIndexes.find(name);
+                if (it != this->entryIndexes.end()) {
+                    entry = &this->entries[it->second];
+                }
+            } else if (tag.compare(0, 7, "<Block ") == 0 && entry) {
+                SHA256Hash sha256;
+                if (!DecodeBase64SHA256(BlockMapAttribute(tag, "Hash"),
+                                        sha256)) {
+                    throw MalformedZIPError(
+                        this->path, "bad block hash for " + entry->fileName);
+                }
+                std::string size = BlockMapAttribute(tag, "Size");
+                off_t compressedSize = ZIPBlock::kNotCompressed;
+                if (!size.empty()) {
+                    char *sizeEnd = nullptr;
+                    errno = 0;
+                    long long parsed = std::strtoll(size.c_str(), &sizeEnd, 10);
+                    if (errno != 0 || *sizeEnd != '\0' ||
+                        size[0] < '0' || size[0] > '9' || parsed <= 0 ||
+                        parsed > entry->compressedSize) {
+                        throw MalformedZIPError(
+                            this->path,
+                            "bad block size for " + entry->fileName);
+                    }
+                    compressedSize = static_cast<off_t>(parsed);
+                }
+                blocks.push_back(ZIPBlock(sha256, compressedSize));
+            } else if (tag == "</File") {
+                finishFile();
+            }
+        }
+        finishFile();
+    }
+
+    std::size_t ZIPReader::ReadAt(const Entry &entry, off_t offset,
+                                  std::size_t size, std::uint8_t *bytes,
+                                  unsigned jobs) const
+    {
+        if (offset >= entry.uncompressedSize) {
+            return 0;
+        }
+        size = static_cast<std::size_t>(
+            std::min<off_t>(size, entry.uncompressedSize - offset));
+        if (entry.compressionType == ZIPCompressionType::Store) {
+            this->PRead(entry.dataOffset + offset, size, bytes);
+            return size;
+        }
+        bool canReadBlocks;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            canReadBlocks = entry.canReadBlocks;
+        }
+        if (canReadBlocks) {
+            if (this->ReadBlocksAt(entry, offset, size, bytes, jobs)) {
+                return size;
+            }
+            std::lock_guard<std::mutex> lock(this->mutex);
+            entry.canReadBlocks = false;
+        }
+
+        // With a block map, the blocks holding the range are checked
+        // against their hashes as they are streamed.
+        const off_t end = offset + static_cast<off_t>(size);
+        const off_t checkStart =
+            entry.hasBlockMap ? offset / ZIPBlock::kSize * ZIPBlock::kSize
+                              : end;
+        const off_t checkEnd =
+            entry.hasBlockMap
+                ? std::min<off_t>(entry.uncompressedSize,
+                                  (end + ZIPBlock::kSize - 1) /
+                                      ZIPBlock::kSize * ZIPBlock::kSize)
+                : end;
+        SHA256Sink blockSink;
+        off_t position = 0;
+        std::size_t read = 0;
+        this->Stream(entry, [&](std::size_t chunkSize,
+                                const std::uint8_t *chunk) {
+            off_t chunkEnd = position + static_cast<off_t>(chunkSize);
+            if (chunkEnd > offset && read < size) {
+                std::size_t skip = static_cast<std::size_t>(
+                    std::max<off_t>(offset - position, 0));
+                std::size_t count = std::min(chunkSize - skip, size - read);
+                std::copy(chunk + skip, chunk + skip + count, bytes + read);
+                read += count;
+            }
+            // Hash the chunk a block at a time.
+            for (off_t at = std::max(position, checkStart);
+                 at < std::min(chunkEnd, checkEnd);) {
+                off_t blockEnd = std::min<off_t>(
+                    (at / ZIPBlock::kSize + 1) * ZIPBlock::kSize,
+                    entry.uncompressedSize);
+                off_t count = std::min(blockEnd, chunkEnd) - at;
+                blockSink.Write(static_cast<std::size_t>(count),
+                                chunk + (at - position));
+                at += count;
+                if (at == blockEnd) {
+                    const ZIPBlock &block = entry.blocks[static_cast<
+                        std::size_t>((at - 1) / ZIPBlock::kSize)];
+                    if (blockSink.SHA256() != block.sha256) {
+                        throw MalformedZIPError(
+                            this->path, "bad block in " + entry.fileName);
+                    }
+                    blockSink = SHA256Sink();
+                }
+            }
+            position = chunkEnd;
+            return position < checkEnd || read < size;
+        });
+        return read;
+    }
+
+    bool ZIPReader::ReadBlocksAt(const Entry &entry, off_t offset,
+                                 std::size_t size, std::uint8_t *bytes,
+                                 unsigned jobs) const
+    {
+        const off_t end = offset + static_cast<off_t>(size);
+        const std::size_t firstBlock =
+            static_cast<std::size_t>(offset / ZIPBlock::kSize);
+        const std::size_t lastBlock =
+            static_cast<std::size_t>((end - 1) / ZIPBlock::kSize);
+        std::vector<off_t> blockOffsets(lastBlock - firstBlock + 1);
+        off_t blockOffset = entry.dataOffset;
+        for (std::size_t i = 0; i <= lastBlock; ++i) {
+            if (i >= firstBlock) {
+                blockOffsets[i - firstBlock] = blockOffset;
+            }
+            blockOffset += entry.blocks[i].compressedSize;
+        }
+
+        std::atomic<bool> failed(false);
+        ParallelFor(blockOffsets.size(), jobs, [&](std::size_t i) {
+            if (failed) {
+                return;
+            }
+            const std::size_t block = firstBlock + i;
+            const off_t blockStart =
+                static_cast<off_t>(block) * ZIPBlock::kSize;
+            const std::size_t blockSize = static_cast<std::size_t>(
+                std::min<off_t>(ZIPBlock::kSize,
+                                entry.uncompressedSize - blockStart));
+            std::vector<std::uint8_t> compressed(
+                static_cast<std::size_t>(entry.blocks[block].compressedSize));
+            this->PRead(blockOffsets[i], compressed.size(), compressed.data());
+
+            // Leave room past the block so trailing empty blocks are
+            // consumed and an oversized block is detected.
+            std::vector<std::uint8_t> uncompressed(blockSize + 1);
+            Inflater inflater;
+            if (inflater.Inflate(compressed, uncompressed) != blockSize ||
+                SHA256Hash::DigestFromBytes(blockSize, uncompressed.data()) !=
+                    entry.blocks[block].sha256) {
+                failed = true;
+                return;
+            }
+
+            off_t copyStart = std::max(offset, blockStart);
+            off_t copyEnd =
+                std::min(end, blockStart + static_cast<off_t>(blockSize));
+            std::copy(uncompressed.begin() + (copyStart - blockStart),
+                      uncompressed.begin() + (copyEnd - blockStart),
+                      bytes + (copyStart - offset));
+        });
+        return !failed;
+    }
+
+    void ZIPReader::PRead(off_t offset, std::size_t size,
+                          std::uint8_t *bytes) const
+    {
+        while (size > 0) {
+            ssize_t rc = pread(this->fd, bytes, size, offset);
+            if (rc == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw ErrnoException(this->path);
+            }
+            if (rc == 0) {
+                throw MalformedZIPError(this->path, "unexpected end of file");
+            }
+            bytes += rc;
+            size -= static_cast<std::size_t>(rc);
+            offset += rc;
+        }
+    }
+
+    std::pair<std::uint32_t, off_t> ZIPReader::Stream(
+        const Entry &entry,
+        const std::function<bool(std::size_t, const std::uint8_t *)> &write)
+        const
+    {
+        std::vector<std::uint8_t> input(kBufferSize);
+        uLong crc32 = ::crc32(0, nullptr, 0);
+        off_t uncompressedSize = 0;
+        off_t offset = entry.dataOffset;
+        const off_t end = entry.dataOffset + entry.compressedSize;
+
+        if (entry.compressionType == ZIPCompressionType::Store) {
+            while (offset < end) {
+                std::size_t size = static_cast<std::size_t>(
+                    std::min<off_t>(input.size(), end - offset));
+                this->PRead(offset, size, input.data());
+                offset += size;
+                crc32 = ::crc32(crc32, input.data(), static_cast<uInt>(size));
+                uncompressedSize += size;
+                if (!write(size, input.data())) {
+                    break;
+                }
+            }
+            return std::make_pair(static_cast<std::uint32_t>(crc32),
+                                  uncompressedSize);
+        }
+
+        z_stream stream;
+        stream.zalloc = nullptr;
+        stream.zfree = nullptr;
+        stream.opaque = nullptr;
+        stream.next_in = nullptr;
+        stream.avail_in = 0;
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+            throw std::runtime_error("inflateInit failed");
+        }
+        std::vector<std::uint8_t> output(kBufferSize);
+        try {
+            int rc = Z_OK;
+            while (rc != Z_STREAM_END) {
+                if (stream.avail_in == 0) {
+                    if (offset == end) {
+                        throw MalformedZIPError(
+                            this->path, "truncated data for " + entry.fileName);
+                    }
+                    std::size_t size = static_cast<std::size_t>(
+                        std::min<off_t>(input.size(), end - offset));
+                    this->PRead(offset, size, input.data());
+                    offset += size;
+                    stream.next_in = input.data();
+                    stream.avail_in = static_cast<uInt>(size);
+                }
+                stream.next_out = output.data();
+                stream.avail_out = static_cast<uInt>(output.size());
+                rc = inflate(&stream, Z_NO_FLUSH);
+                if (rc != Z_OK && rc != Z_STREAM_END) {
+                    throw MalformedZIPError(
+                        this->path, "bad compressed data for " +
+                                        entry.fileName);
+                }
+                std::size_t size = output.size() - stream.avail_out;
+                crc32 = ::crc32(crc32, output.data(), static_cast<uInt>(size));
+                uncompressedSize += size;
+                if (size > 0 && !write(size, output.data())) {
+                    break;
+                }
+            }
+        } catch (...) {
+            inflateEnd(&stream);
+            throw;
+        }
+        inflateEnd(&stream);
+        return std::make_pair(static_cast<std::uint32_t>(crc32),
+                              uncompressedSize);
+    }
+
+    void ZIPInputSource::Replace(const std::string &path, std::string contents)
+    {
+        this->replacements[path] = std::move(contents);
+    }
+
+    void ZIPInputSource::Replace(const std::string &path, FilePtr file)
+    {
+        this->fileReplacements[path] = std::move(file);
+    }
+
+    off_t ZIPInputSource::Size(const std::string &path)
+    {
+        auto it = this->replacements.find(path);
+        if (it != this->replacements.end()) {
+            return static_cast<off_t>(it->second.size());
+        }
+        auto fileIt = this->fileReplacements.find(path);
+        if (fileIt != this->fileReplacements.end()) {
+            struct stat status;
+            if (fstat(fileno(fileIt->second.get()), &status) != 0) {
+                throw ErrnoException();
+            }
+            return status.st_size;
+        }
+        return this->Entry(path).uncompressedSize;
+    }
+
+    void ZIPInputSource::Read(const std::string &path, CachePolicy,
+                              const WriteFunc &write)
+    {
+        auto it = this->replacements.find(path);
+        if (it != this->replacements.end()) {
+            write(it->second.size(),
+                  reinterpret_cast<const std::uint8_t *>(it->second.data()));
+            return;
+        }
+        if (this->fileReplacements.count(path)) {
+            std::vector<std::uint8_t> buffer(kBufferSize);
+            off_t offset = 0;
+            while (std::size_t read = this->ReadAt(path, offset, buffer.size(),
+                                                   buffer.data())) {
+                write(read, buffer.data());
+                offset += read;
+            }
+            return;
+        }
+        this->reader.Read(this->Entry(path), write);
+    }
+
+    std::size_t ZIPInputSource::ReadAt(const std::string &path, off_t offset,
+                                       std::size_t size, std::uint8_t *bytes)
+    {
+        auto it = this->replacements.find(path);
+        if (it != this->replacements.end()) {
+            const std::string &contents = it->second;
+            if (offset >= static_cast<off_t>(contents.size())) {
+                return 0;
+            }
+            size = std::min(size,
+                            contents.size() - static_cast<std::size_t>(offset));
+            std::copy(contents.begin() + offset,
+                      contents.begin() + offset + size, bytes);
+            return size;
+        }
+        auto fileIt = this->fileReplacements.find(path);
+        if (fileIt != this->fileReplacements.end()) {
+            int fd = fileno(fileIt->second.get());
+            std::size_t total = 0;
+            while (total < size) {
+                ssize_t read =
+                    pread(fd, bytes + total, size - total, offset + total);
+                if (read < 0) {
+                    throw ErrnoException();
+                }
+                if (read == 0) {
+                    break;
+                }
+                total += static_cast<std::size_t>(read);
+            }
+            return total;
+        }
+        return this->reader.ReadAt(this->Entry(path), offset, size, bytes);
+    }
+
+    const ZIPReader::Entry &ZIPInputSource::Entry(const std::string &path) const
+    {
+        const ZIPReader::Entry *entry = this->reader.Find(path);
+        if (!entry) {
+            throw std::runtime_error("File not in package: " + path);
+        }
+        return *entry;
+    }
+}
+}
@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+#include <APPX/Deflate.h>
+#include <APPX/Sink.h>
+#include <APPX/Zeros.h>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <zlib.h>
+
+namespace facebook {
+namespace appx {
+    const std::uint8_t kZeroBlock[kZeroBlockSize] = {};
+
+    bool IsZero(std::size_t size, const std::uint8_t *bytes)
+    {
+        // Each byte equals the byte before it, and the first is zero.
+        return size == 0 ||
+               (bytes[0] == 0 && std::memcmp(bytes, bytes + 1, size - 1) == 0);
+    }
+
+    std::uint32_t ZerosCRC32(off_t size)
+    {
+        // Combine the CRCs of runs of 1, 2, 4, ... zeros by the bits of
+        // size.
+        uLong crc = crc32(0, nullptr, 0);
+        uLong runCRC = crc32(0, kZeroBlock, 1);
+        off_t runSize = 1;
+        while (size > 0) {
+            if (size & 1) {
+                crc = crc32_combine(crc, runCRC, runSize);
+            }
+            size >>= 1;
+            if (size > 0) {
+                runCRC = crc32_combine(runCRC, runCRC, runSize);
+                runSize *= 2;
+            }
+        }
+        return static_cast<std::uint32_t>(crc);
+    }
+
+    const SHA256Hash &ZeroBlockSHA256()
+    {
+        static const SHA256Hash hash =
+            SHA256Hash::DigestFromBytes(kZeroBlockSize, kZeroBlock);
+        return hash;
+    }
+
+    const std::vector<std::uint8_t> &CompressedZeroBlock(int compressionLevel)
+    {
+        static std::mutex mutex;
+        // Elements are never removed, so references stay valid.
+        static std::map<int, std::vector<std::uint8_t>> blocks;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = blocks.find(compressionLevel);
+        if (it != blocks.end()) {
+            return it->second;
+        }
+        std::vector<std::uint8_t> compressed;
+        if (compressionLevel == kExhaustiveCompression) {
+            compressed = ExhaustiveDeflate(kZeroBlockSize, kZeroBlock);
+        } else {
+            std::vector<std::uint8_t> output;
+            VectorSink outputSink(output);
+            auto deflateSink = MakeDeflateSink(compressionLevel, outputSink);
+            deflateSink.Write(kZeroBlockSize, kZeroBlock);
+            deflateSink.Flush();
+            compressed = output;
+            deflateSink.Close();
+        }
+        return blocks.emplace(compressionLevel, std::move(compressed))
+            .first->second;
+    }
+}
+}
@@ -6,21 +6,47 @@
 // LICENSE file in the root directory of this source tree.
 
 #include <APPX/APPX.h>
+#include <APPX/Analyze.h>
+#include <APPX/ContentGroup.h>
+#include <APPX/ContentStore.h>
+#include <APPX/Deflate.h>
+#include <APPX/Digest.h>
+#include <APPX/Estimate.h>
 #include <APPX/File.h>
+#include <APPX/FileList.h>
+#include <APPX/Incremental.h>
+#include <APPX/Parallel.h>
+#include <APPX/Recompress.h>
+#include <APPX/Resources.h>
+#include <APPX/Sink.h>
+#include <APPX/ZIPReader.h>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
 #include <fstream>
 #include <fts.h>
+#include <functional>
+#include <getopt.h>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <sstream>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
-#include <unordered_map>
 #include <vector>
 
 using namespace facebook::appx;
 
 namespace {
+// Blocks each thread decompresses per write in 'appx cat'.
+const std::size_t kCatBlocksPerThread = 16;
+
+// Discovered files waiting to be packaged, with -O input.
+const std::size_t kFileListQueueCapacity = 4096;
+
 struct FTSDeleter
 {
     void operator()(FTS *fs)
@@ -63,14 +89,24 @@ std::string GetArchiveName(FTSENT *ent)
     return archiveName;
 }
 
+// Orders fts traversal by name so the file list does not depend on the order
+// of directory entries on disk.
+int CompareFTSEntries(const FTSENT **a, const FTSENT **b)
+{
+    return std::strcmp((*a)->fts_name, (*b)->fts_name);
+}
+
 // Given the path to a file or directory, add files to a mapping from archive
-// names to local filesystem paths.
-void GetArchiveFileList(const char *path,
-                        std::unordered_map<std::string, std::string> &fileNames)
+// names to local filesystem paths (a FileList or FileListQueue).
+template <typename TFileList>
+void GetArchiveFileList(const char *path, TFileList &fileNames)
 {
     char *const paths[] = {const_cast<char *>(path), nullptr};
+    // With -O input, files are packaged during the walk, so fts must not
+    // change the working directory relative paths are opened from.
     std::unique_ptr<FTS, FTSDeleter> fs(
-        fts_open(paths, FTS_NOSTAT | FTS_PHYSICAL, nullptr));
+        fts_open(paths, FTS_NOCHDIR | FTS_NOSTAT | FTS_PHYSICAL,
+                 CompareFTSEntries));
     if (!fs) {
         throw ErrnoException();
     }
@@ -92,8 +128,7 @@ void GetArchiveFileList(const char *path,
             case FTS_NSOK:
             case FTS_SL:
             case FTS_SLNONE:
-                fileNames.insert(std::make_pair(GetArchiveName(ent),
-                                                std::string(ent->fts_path)));
+                fileNames.Add(GetArchiveName(ent), std::string(ent->fts_path));
                 break;
 
             default:
@@ -105,8 +140,9 @@ void GetArchiveFileList(const char *path,
 class MalformedMappingFileError : public std::exception
 {
 public:
-    explicit MalformedMappingFileError(off_t lineNumber)
-        : lineNumber(lineNumber)
+    explicit MalformedMappingFileError(off_t lineNumber,
+                                       const char *kind = "mapping file")
+        : lineNumber(lineNumber), kind(kind)
     {
         this->SetFileName(nullptr);
     }
@@ -122,13 +158,15 @@ public:
             fileName = "(unknown)";
         }
         std::ostringstream ss;
-        ss << "Malformed mapping file: " << fileName << ":" << this->lineNumber;
+        ss << "Malformed " << this->kind << ": " << fileName << ":"
+           << this->lineNumber;
         this->message = ss.str();
     }
 
 private:
     std::string message;
     off_t lineNumber;
+    const char *kind;
 };
 
 bool GetLine(std::istream &file, std::string &out, char delimiter)
@@ -158,9 +196,16 @@ bool GetLine(std::istream &file, std::string &out, char delimiter)
     return true;
 }
 
-void GetArchiveFileListFromMappingFile(
-    std::istream &mappingFile,
-    std::unordered_map<std::string, std::string> &fileNames)
+// Parses a file of the following form:
+//
+//     [header]
+//     "first" "second"
+//     ...
+//
+// calling callback(first, second) for each line after the header.
+void ParseQuotedPairFile(
+    std::istream &mappingFile, const char *header, const char *kind,
+    const std::function<void(std::string, std::string)> &callback)
 {
     static const char kWhitespace[] = " \t";
     // TODO(strager): Make this parser more accepting. This parser is way too
@@ -174,7 +219,7 @@ void GetArchiveFileListFromMappingFile(
         }
         if (mappingFile.fail()) {
             // The line is too long.
-            throw MalformedMappingFileError(lineNumber);
+            throw MalformedMappingFileError(lineNumber, kind);
         }
 
         // Trim leading and trailing whitespace and ignore blank lines.
@@ -192,53 +237,50 @@ void GetArchiveFileListFromMappingFile(
         if (didReadHeader) {
             // Parse the following:
             //
-            //     "localPath" "archiveName"
+            //     "first" "second"
             //
             // TODO(strager): Parse escaped quotes and other characters.
             std::string::size_type quote1 = 0;
             if (line[quote1] != '"') {
                 // Garbage before the first quote.
-                throw MalformedMappingFileError(lineNumber);
+                throw MalformedMappingFileError(lineNumber, kind);
             }
             auto quote2 = line.find('"', quote1 + 1);
             if (quote2 == std::string::npos) {
                 // Missing the second quote.
-                throw MalformedMappingFileError(lineNumber);
+                throw MalformedMappingFileError(lineNumber, kind);
             }
             if (quote2 == quote1 + 1) {
-                // Empty local path.
-                throw MalformedMappingFileError(lineNumber);
+                // Empty first string.
+                throw MalformedMappingFileError(lineNumber, kind);
             }
             auto quote3 = line.find_first_not_of(kWhitespace, quote2 + 1);
             if (quote3 == std::string::npos) {
-                // Missing the archive name.
-                throw MalformedMappingFileError(lineNumber);
+                // Missing the second string.
+                throw MalformedMappingFileError(lineNumber, kind);
             }
             if (line[quote3] != '"') {
                 // Garbage between the second and third quotes.
-                throw MalformedMappingFileError(lineNumber);
+                throw MalformedMappingFileError(lineNumber, kind);
             }
             auto quote4 = line.find('"', quote3 + 1);
             if (quote4 == std::string::npos) {
                 // Missing the fourth quote.
-                throw MalformedMappingFileError(lineNumber);
+                throw MalformedMappingFileError(lineNumber, kind);
             }
             if (quote4 == quote3 + 1) {
-                // Empty archive path.
-                throw MalformedMappingFileError(lineNumber);
+                // Empty second string.
+                throw MalformedMappingFileError(lineNumber, kind);
             }
             if (quote4 != line.size() - 1) {
                 // Garbage after the fourth quote.
-                throw MalformedMappingFileError(lineNumber);
+                throw MalformedMappingFileError(lineNumber, kind);
             }
-            std::string localPath =
-                line.substr(quote1 + 1, quote2 - quote1 - 1);
-            std::string archiveName =
-                line.substr(quote3 + 1, quote4 - quote3 - 1);
-            fileNames.emplace(std::move(archiveName), std::move(localPath));
+            callback(line.substr(quote1 + 1, quote2 - quote1 - 1),
+                     line.substr(quote3 + 1, quote4 - quote3 - 1));
         } else {
-            if (line != "[Files]") {
-                throw MalformedMappingFileError(lineNumber);
+            if (line != header) {
+                throw MalformedMappingFileError(lineNumber, kind);
             }
             didReadHeader = true;
         }
@@ -246,95 +288,1027 @@ void GetArchiveFileListFromMappingFile(
     }
 }
 
+template <typename TFileList>
+void GetArchiveFileListFromMappingFile(std::istream &mappingFile,
+                                       TFileList &fileNames)
+{
+    ParseQuotedPairFile(
+        mappingFile, "[Files]", "mapping file",
+        [&fileNames](std::string localPath, std::string archiveName) {
+            fileNames.Add(std::move(archiveName), std::move(localPath));
+        });
+}
+
+// Parses a content manifest of the following form:
+//
+//     [ContentStore]
+//     "hash/size" "archiveName"
+//
+// adding the blobs to contentStore and the files to a FileList or
+// FileListQueue.
+template <typename TFileList>
+void GetArchiveFileListFromContentManifest(
+    std::istream &manifest, ContentStoreInputSource &contentStore,
+    TFileList &fileNames)
+{
+    ParseQuotedPairFile(
+        manifest, "[ContentStore]", "content manifest",
+        [&](std::string digest, std::string archiveName) {
+            fileNames.Add(std::move(archiveName),
+                          contentStore.AddBlob(digest));
+        });
+}
+
+// Calls parse with the contents of a file (or standard input, for "-").
+void ParseInputFile(const char *path,
+                    const std::function<void(std::istream &)> &parse)
+{
+    if (strcmp(path, "-") == 0) {
+        std::cin.exceptions(std::istream::badbit | std::istream::failbit);
+        parse(std::cin);
+        return;
+    }
+    std::ifstream file;
+    file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
+    file.open(path);
+    try {
+        parse(file);
+    } catch (MalformedMappingFileError &e) {
+        e.SetFileName(path);
+        throw;
+    }
+}
+
+// Adds the files of mapping files, then of content manifests (if
+// contentStore is not null), then of command-line inputs, to a FileList or
+// FileListQueue.
+template <typename TFileList>
+void GetInputs(const std::vector<const char *> &mappingFiles,
+               const std::vector<const char *> &contentManifests,
+               ContentStoreInputSource *contentStore, int argc,
+               char *const *argv, TFileList &fileNames)
+{
+    for (const char *mappingFile : mappingFiles) {
+        ParseInputFile(mappingFile, [&fileNames](std::istream &file) {
+            GetArchiveFileListFromMappingFile(file, fileNames);
+        });
+    }
+    for (const char *manifest : contentManifests) {
+        assert(contentStore);
+        ParseInputFile(manifest, [&](std::istream &file) {
+            GetArchiveFileListFromContentManifest(file, *contentStore,
+                                                  fileNames);
+        });
+    }
+    for (char *const *i = argv; i != argv + argc; ++i) {
+        const char *arg = *i;
+        const char *equalSeparator = strchr(arg, '=');
+        if (equalSeparator) {
+            // ArchivePath=LocalPath specified.
+            fileNames.Add(std::string(arg, equalSeparator),
+                          std::string(equalSeparator + 1));
+        } else {
+            // Local path specified. Infer archive path.
+            GetArchiveFileList(arg, fileNames);
+        }
+    }
+}
+
+// Parses a content group file of the following form:
+//
+//     [ContentGroups]
+//     "groupName" "archiveName"
+//     "groupName" "archiveDirectory/*"
+//
+void GetContentGroupsFromFile(std::istream &contentGroupFile,
+                              ContentGroupMap &contentGroups)
+{
+    ParseQuotedPairFile(
+        contentGroupFile, "[ContentGroups]", "content group file",
+        [&contentGroups](std::string groupName, std::string pattern) {
+            contentGroups.Add(groupName, std::move(pattern));
+        });
+}
+
+// Parses a content type file of the following form:
+//
+//     [ContentTypes]
+//     "extension" "contentType"
+//
+void GetContentTypesFromFile(const char *path,
+                             ContentTypeRegistry &contentTypes)
+{
+    std::ifstream file;
+    file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
+    file.open(path);
+    try {
+        ParseQuotedPairFile(
+            file, "[ContentTypes]", "content type file",
+            [&contentTypes](std::string extension, std::string contentType) {
+                contentTypes.Add(extension, std::move(contentType));
+            });
+    } catch (MalformedMappingFileError &e) {
+        e.SetFileName(path);
+        throw;
+    }
+}
+
+// Reads archive names, one per line, from an order file.
+std::vector<std::string> GetArchiveNamesFromOrderFile(std::istream &orderFile)
+{
+    static const char kWhitespace[] = " \t\r";
+    std::vector<std::string> archiveNames;
+    std::string line;
+    while (GetLine(orderFile, line, '\n')) {
+        auto first = line.find_first_not_of(kWhitespace);
+        if (first == std::string::npos) {
+            // Blank line.
+            continue;
+        }
+        auto last = line.find_last_not_of(kWhitespace);
+        archiveNames.push_back(line.substr(first, last - first + 1));
+    }
+    return archiveNames;
+}
+
+// Parses a byte count with an optional K, M, or G suffix (powers of 1024).
+bool ParseSize(const char *s, std::size_t &out)
+{
+    char *end;
+    errno = 0;
+    unsigned long long size = strtoull(s, &end, 10);
+    if (errno != 0 || end == s) {
+        return false;
+    }
+    unsigned shift = 0;
+    switch (*end) {
+        case '\0':
+            break;
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+        default:
+            return false;
+    }
+    if (*end != '\0' && end[1] != '\0') {
+        return false;
+    }
+    if (size > (std::numeric_limits<std::size_t>::max() >> shift)) {
+        return false;
+    }
+    out = static_cast<std::size_t>(size << shift);
+    return true;
+}
+
+// Parses a positive number of seconds.
+bool ParseSeconds(const char *s, double &out)
+{
+    char *end;
+    errno = 0;
+    double seconds = strtod(s, &end);
+    if (errno != 0 || end == s || *end != '\0' || !std::isfinite(seconds) ||
+        seconds <= 0) {
+        return false;
+    }
+    out = seconds;
+    return true;
+}
+
+// Parses a thread count, throwing std::runtime_error if it is invalid.
+unsigned ParseJobs(const char *s)
+{
+    char *end;
+    errno = 0;
+    unsigned long jobs = strtoul(s, &end, 10);
+    if (errno != 0 || end == s || *end != '\0' || jobs > 1024) {
+        throw std::runtime_error(std::string("Invalid job count: ") + s);
+    }
+    return static_cast<unsigned>(jobs);
+}
+
+// Handles an option shared by all commands which write a package, throwing
+// std::runtime_error if its argument is invalid. Returns false if c is not
+// such an option.
+bool ParsePackageOption(int c, const char *arg, APPXOptions &options)
+{
+    switch (c) {
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+            options.compressionLevel = c - '0';
+            return true;
+        case 'c':
+            options.certPath = arg;
+            return true;
+        case 'C':
+            GetContentTypesFromFile(arg, options.contentTypes);
+            return true;
+        case 'j':
+            options.jobs = ParseJobs(arg);
+            return true;
+        case 'm':
+            if (!ParseSize(arg, options.maxMemory)) {
+                throw std::runtime_error(
+                    std::string("Invalid memory limit: ") + arg);
+            }
+            return true;
+        case 'p':
+            if (!ParseCachePolicy(arg, options.cachePolicy)) {
+                throw std::runtime_error(
+                    std::string("Invalid cache policy: ") + arg);
+            }
+            return true;
+        case 't':
+        case 'T':
+            if (!ParseSeconds(arg, options.timeBudget)) {
+                throw std::runtime_error(
+                    std::string("Invalid time budget: ") + arg);
+            }
+            options.timeBudgetIsCPU = c == 'T';
+            return true;
+        case 'X':
+            options.compressionLevel = kExhaustiveCompression;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Prints how often blocks were found in a --block-memo.
+void PrintBlockMemoStats(const BlockMemo *memo)
+{
+    if (!memo) {
+        return;
+    }
+    BlockMemo::Stats stats = memo->GetStats();
+    std::uint64_t lookups = stats.hits + stats.misses;
+    fprintf(stderr,
+            "Block memo: %llu of %llu blocks found (%.1f%%), %llu bytes not "
+            "compressed, %llu evicted\n",
+            static_cast<unsigned long long>(stats.hits),
+            static_cast<unsigned long long>(lookups),
+            lookups ? 100.0 * stats.hits / lookups : 0.0,
+            static_cast<unsigned long long>(stats.hitBytes),
+            static_cast<unsigned long long>(stats.evictions));
+}
+
+// Writes a --digest's results, one "algorithm digest" line each, to path
+// or, if it is null, to standard output.
+void WriteOutputDigests(const DigestSink *digests, const char *path)
+{
+    if (!digests) {
+        return;
+    }
+    std::ostringstream out;
+    for (const auto &digest : digests->HexDigests()) {
+        out << digest.first << " " << digest.second << "\n";
+    }
+    if (!path) {
+        std::cout << out.str() << std::flush;
+        return;
+    }
+    std::ofstream file;
+    file.exceptions(std::ofstream::badbit | std::ofstream::failbit);
+    file.open(path, std::ios::out | std::ios::binary);
+    file << out.str();
+}
+
 void PrintUsage(const char *programName)
 {
     fprintf(stderr,
             "Usage: %s -o APPX [OPTION]... INPUT...\n"
+            "  or:  %s recompress -o APPX [OPTION]... PACKAGE\n"
+            "  or:  %s analyze [OPTION]... (PACKAGE | INPUT...)\n"
+            "  or:  %s cat [OPTION]... PACKAGE ARCHIVE-NAME\n"
+            "  or:  %s append [OPTION]... APPX INPUT...\n"
             "Creates an optionally-signed Microsoft APPX or APPXBUNDLE package.\n"
             "\n"
                 "Options:\n"
             "  -c pfx-file     sign the APPX with the private key file\n"
+            "  -C type-file    declare the content types of file extensions\n"
+            "                  given by type-file\n"
             "  -f map-file     specify inputs from a mapping file\n"
             "  -f -            specify a mapping file through standard input\n"
+            "  --content-store=store-dir\n"
+            "                  read blobs from the content-addressed store\n"
+            "                  store-dir (see below)\n"
+            "  --content-manifest=manifest-file\n"
+            "                  specify inputs stored in the content store\n"
+            "                  from a content manifest\n"
+            "  -g group-file   lay out files in the content groups given by\n"
+            "                  group-file for streaming install\n"
             "  -h              show this usage text and exit\n"
+            "  -j jobs         compress files using this many threads\n"
+            "                  (default 1; 0 means one thread per CPU)\n"
+            "  --index=index-file\n"
+            "                  write the offsets, sizes, and block hashes of\n"
+            "                  the package's files to index-file (JSON if it\n"
+            "                  ends in .json, otherwise a compact binary form)\n"
+            "  --dry-run       estimate the package's size and the offsets\n"
+            "                  and sizes of its files without writing it,\n"
+            "                  compressing a sample of the inputs (-o is\n"
+            "                  not required)\n"
+            "  -k, --checkpoint=checkpoint-file\n"
+            "                  record progress in checkpoint-file every 30\n"
+            "                  seconds and on failure; deleted on success\n"
+            "  -r, --resume    if checkpoint-file exists, continue the\n"
+            "                  interrupted build it records (requires -k)\n"
+            "  --incremental=sidecar-file\n"
+            "                  describe the package's file records in\n"
+            "                  sidecar-file, and keep those of the leading\n"
+            "                  unchanged files when rebuilding it (the\n"
+            "                  package is the same as a full build)\n"
             "  -b              produce APPXBUNDLE instead of APPX\n"
+            "  --block-memo=size\n"
+            "                  remember up to size bytes of compressed 64 KiB\n"
+            "                  blocks and reuse them for repeated blocks\n"
+            "                  instead of compressing them again, printing\n"
+            "                  the hit rate (the package is the same)\n"
+            "  --digest=algorithms\n"
+            "                  hash the package as it is written with each\n"
+            "                  of the comma-separated algorithms (such as\n"
+            "                  sha256,md5,blake2b512), printing a line of\n"
+            "                  the algorithm and the digest in hex for each\n"
+            "  --digest-file=digest-file\n"
+            "                  write the --digest lines to digest-file\n"
+            "                  instead of standard output\n"
+            "  --split-resources\n"
+            "                  produce an APPXBUNDLE of a main package and\n"
+            "                  resource packages, split by the resource\n"
+            "                  qualifiers in file paths (see below)\n"
+            "  -m size         limit memory used for buffering and compressing\n"
+            "                  files to size bytes (K, M, and G suffixes are\n"
+            "                  accepted), spilling to temporary files\n"
+            "  -p policy       page cache policy for reading inputs and writing\n"
+            "                  the package: 'default', 'nocache' (drop data\n"
+            "                  from the cache after use), or 'direct' (like\n"
+            "                  nocache, but read inputs with O_DIRECT)\n"
+            "  -t seconds      choose each file's compression level to make the\n"
+            "                  smallest package that takes about this much\n"
+            "                  wall-clock time to compress (overrides -0 to\n"
+            "                  -9 except for package metadata)\n"
+            "  -T seconds      like -t, but a budget of CPU time summed across\n"
+            "                  threads\n"
             "  -o output-file  write the APPX (or APPXBUNDLE if -b is specified)\n"
-            "                  to the output-file (required)\n"
+            "                  to the output-file (required unless --dry-run)\n"
+            "  -O sorted       order files by archive name (default)\n"
+            "  -O input        order files as they are given on the command\n"
+            "                  line and in mapping files, packaging them as\n"
+            "                  they are found (unless -g, -k, -t, -T, or\n"
+            "                  --incremental)\n"
+            "  -O stable       order files which changed in fewer builds\n"
+            "                  first, then by archive name, so incremental\n"
+            "                  builds keep more files (requires --incremental)\n"
+            "  -O order-file   order the files listed in order-file (one\n"
+            "                  archive name per line) first, then the rest\n"
+            "                  by archive name\n"
             "  -0, -1, -2, -3, -4, -5, -6, -7, -8, -9\n"
             "                  ZIP compression level\n"
             "  -0              no ZIP compression (store files)\n"
             "  -9              best ZIP compression\n"
+            "  -X              smallest ZIP compression, using an exhaustive\n"
+            "                  DEFLATE encoder (much slower than -9)\n"
             "\n"
             "An input is either:\n"
             "  A directory, indicating that all files and subdirectories \n"
             "    of that directory are included in the package, or\n"
             "  A file name, indicating that the file is included in the \n"
             "    root of the package, or\n"
-            "  A mapping file specified with the -f option.\n"
+            "  A mapping file specified with the -f option, or\n"
+            "  A content manifest specified with --content-manifest.\n"
             "\n"
             "A mapping file has the following form:\n"
             "\n"
             "  [Files]\n"
             "  \"/path/to/local/file.exe\" \"appx_file.exe\"\n"
             "\n"
+            "A content manifest has the following form:\n"
+            "\n"
+            "  [ContentStore]\n"
+            "  \"hash/size\" \"appx_file.exe\"\n"
+            "\n"
+            "  Blobs are named by their hashes in hex and sizes. In the\n"
+            "  store directory, they are named by their hashes, either\n"
+            "  directly or in subdirectories named by the first two digits.\n"
+            "\n"
+            "A content group file has the following form:\n"
+            "\n"
+            "  [ContentGroups]\n"
+            "  \"Required\" \"appx_file.exe\"\n"
+            "  \"Level1\" \"Assets/Level1/*\"\n"
+            "\n"
+            "  Files are installed in group order. Files not in any group\n"
+            "  are in the Required group.\n"
+            "\n"
+            "A content type file has the following form:\n"
+            "\n"
+            "  [ContentTypes]\n"
+            "  \"svg\" \"image/svg+xml\"\n"
+            "\n"
+            "  Extensions are matched ignoring case. Built-in types (such as\n"
+            "  for dll, exe, and png) can be overridden.\n"
+            "\n"
+            "With --split-resources, files are split by qualifiers in their\n"
+            "directory names or before their extensions, such as\n"
+            "Assets/scale-200/Logo.png or Strings/Logo.lang-fr_scale-200.png.\n"
+            "Language (lang-), scale (scale-), and DirectX feature level\n"
+            "(dxfl-) qualifiers are recognized. Files without qualifiers, or\n"
+            "whose qualifiers are the Resources of AppxManifest.xml, are in\n"
+            "the main package. Apps with PRI files (such as resources.pri)\n"
+            "cannot be split, since each package needs its own PRI file.\n"
+            "\n"
             "Supported target systems:\n"
             "  Windows 10 (UAP)\n"
             "  Windows 10 Mobile\n",
+            programName, programName, programName, programName,
+            programName);
+}
+
+void PrintRecompressUsage(const char *programName)
+{
+    fprintf(stderr,
+            "Usage: %s recompress -o APPX [OPTION]... PACKAGE\n"
+            "Rewrites an existing APPX or APPXBUNDLE package, recompressing its\n"
+            "files without extracting them. The block map, content types, and\n"
+            "signature are regenerated. Files keep their order. The packages in\n"
+            "a bundle are recompressed and signed the same way.\n"
+            "\n"
+            "Options:\n"
+            "  -c pfx-file     sign the package with the private key file (the\n"
+            "                  package is unsigned otherwise)\n"
+            "  -C type-file    declare content types, as for creating a package\n"
+            "  -h              show this usage text and exit\n"
+            "  -j jobs         compress files using this many threads\n"
+            "                  (default 1; 0 means one thread per CPU)\n"
+            "  -m size         limit memory used for buffering and compressing\n"
+            "                  files to size bytes\n"
+            "  -o output-file  write the package to output-file (required; must\n"
+            "                  not be PACKAGE)\n"
+            "  -p policy       page cache policy for writing the package\n"
+            "  -t seconds      compress within a wall-clock time budget\n"
+            "  -T seconds      compress within a CPU time budget\n"
+            "  -0 to -9, -X    compression level, as for creating a package\n",
             programName);
 }
+
+void PrintAnalyzeUsage(const char *programName)
+{
+    fprintf(stderr,
+            "Usage: %s analyze [OPTION]... (PACKAGE | INPUT...)\n"
+            "Reports which files of an existing APPX or APPXBUNDLE package, or\n"
+            "of a set of inputs, dominate the package's size and compression\n"
+            "time. A summary is written to standard output.\n"
+            "\n"
+            "Options:\n"
+            "  -f map-file     specify inputs from a mapping file\n"
+            "  --content-store=store-dir, --content-manifest=manifest-file\n"
+            "                  specify inputs from a content store, as for\n"
+            "                  creating a package\n"
+            "  -h              show this usage text and exit\n"
+            "  -j jobs         analyze files using this many threads\n"
+            "                  (default 1; 0 means one thread per CPU)\n"
+            "  -o report-file  also write a detailed JSON report to report-file\n"
+            "  -r package      count blocks shared with this package's block map\n"
+            "\n"
+            "A single input named *.appx or *.appxbundle is read as a package;\n"
+            "files generated when packaging (such as the block map) are not\n"
+            "reported. Other inputs are given as when creating a package.\n",
+            programName);
+}
+
+int AnalyzeMain(int argc, char **argv, const char *programName)
+{
+    const char *reportPath = NULL;
+    std::string referencePath;
+    unsigned jobs = 1;
+    FileList fileNames;
+    std::vector<const char *> mappingFiles;
+    std::vector<const char *> contentManifests;
+    FileSystemInputSource fileSystem;
+    std::unique_ptr<ContentStoreInputSource> contentStore;
+    enum
+    {
+        kContentStoreOption = 256,
+        kContentManifestOption,
+    };
+    static const struct option kLongOptions[] = {
+        {"content-manifest", required_argument, nullptr,
+         kContentManifestOption},
+        {"content-store", required_argument, nullptr, kContentStoreOption},
+        {nullptr, 0, nullptr, 0},
+    };
+    while (int c =
+               getopt_long(argc, argv, "f:hj:o:r:", kLongOptions, nullptr)) {
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+            case 'f':
+                mappingFiles.push_back(optarg);
+                break;
+            case kContentStoreOption:
+                contentStore.reset(
+                    new ContentStoreInputSource(optarg, fileSystem));
+                break;
+            case kContentManifestOption:
+                contentManifests.push_back(optarg);
+                break;
+            case 'j':
+                jobs = ParseJobs(optarg);
+                break;
+            case 'o':
+                reportPath = optarg;
+                break;
+            case 'r':
+                referencePath = optarg;
+                break;
+            case '?':
+                fprintf(stderr, "Unknown option: %c\n", optopt);
+                PrintAnalyzeUsage(programName);
+                return 1;
+            case 'h':
+                PrintAnalyzeUsage(programName);
+                return 0;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (!contentManifests.empty() && !contentStore) {
+        fprintf(stderr, "--content-manifest requires --content-store\n");
+        PrintAnalyzeUsage(programName);
+        return 1;
+    }
+
+    std::unique_ptr<ZIPReader> package;
+    std::unique_ptr<InputSource> packageSource;
+    InputSource *source = contentStore
+                              ? static_cast<InputSource *>(contentStore.get())
+                              : &fileSystem;
+    std::string packagePath;
+    if (argc == 1 && mappingFiles.empty() && contentManifests.empty()) {
+        std::string extension = ArchiveNameExtension(argv[0]);
+        struct stat status;
+        if ((extension == "appx" || extension == "appxbundle") &&
+            stat(argv[0], &status) == 0 && S_ISREG(status.st_mode)) {
+            packagePath = argv[0];
+        }
+    }
+    if (!packagePath.empty()) {
+        package.reset(new ZIPReader(packagePath));
+        packageSource.reset(new ZIPInputSource(*package));
+        source = packageSource.get();
+        // Report the package's inputs, as for its input tree.
+        for (const ZIPReader::Entry &entry : package->Entries()) {
+            if (!IsGeneratedAppxFile(entry.fileName)) {
+                fileNames.Add(entry.fileName, entry.fileName);
+            }
+        }
+    } else {
+        GetInputs(mappingFiles, contentManifests, contentStore.get(), argc,
+                  argv, fileNames);
+        fileNames.Sort();
+    }
+    if (fileNames.Empty()) {
+        fprintf(stderr, "Missing inputs\n");
+        PrintAnalyzeUsage(programName);
+        return 1;
+    }
+
+    Analysis analysis = Analyze(fileNames.Files(), *source, package.get(),
+                                referencePath, EffectiveJobCount(jobs));
+    analysis.packagePath = packagePath;
+    if (reportPath) {
+        std::ofstream report;
+        report.exceptions(std::ofstream::badbit | std::ofstream::failbit);
+        report.open(reportPath);
+        WriteAnalysisJSON(report, analysis);
+    }
+    WriteAnalysisSummary(std::cout, analysis);
+    return 0;
+}
+
+void PrintCatUsage(const char *programName)
+{
+    fprintf(stderr,
+            "Usage: %s cat [OPTION]... PACKAGE ARCHIVE-NAME\n"
+            "Writes a file in an APPX or APPXBUNDLE package to standard output.\n"
+            "Only the blocks of the file which are needed are decompressed.\n"
+            "\n"
+            "Options:\n"
+            "  -h, --help           show this usage text and exit\n"
+            "  -j, --jobs=jobs      decompress blocks using this many threads\n"
+            "                       (default 1; 0 means one thread per CPU)\n"
+            "  --offset=offset      start at this byte of the file (default 0)\n"
+            "  --length=length      write at most this many bytes (default all)\n"
+            "\n"
+            "offset and length accept K, M, and G suffixes.\n",
+            programName);
+}
+
+int CatMain(int argc, char **argv, const char *programName)
+{
+    enum
+    {
+        kOffsetOption = 256,
+        kLengthOption,
+    };
+    static const struct option kLongOptions[] = {
+        {"help", no_argument, nullptr, 'h'},
+        {"jobs", required_argument, nullptr, 'j'},
+        {"length", required_argument, nullptr, kLengthOption},
+        {"offset", required_argument, nullptr, kOffsetOption},
+        {nullptr, 0, nullptr, 0},
+    };
+    std::size_t offset = 0;
+    std::size_t length = std::numeric_limits<std::size_t>::max();
+    unsigned jobs = 1;
+    while (int c = getopt_long(argc, argv, "hj:", kLongOptions, nullptr)) {
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+            case 'j':
+                jobs = ParseJobs(optarg);
+                break;
+            case kOffsetOption:
+                if (!ParseSize(optarg, offset)) {
+                    fprintf(stderr, "Invalid offset: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case kLengthOption:
+                if (!ParseSize(optarg, length)) {
+                    fprintf(stderr, "Invalid length: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case '?':
+                PrintCatUsage(programName);
+                return 1;
+            case 'h':
+                PrintCatUsage(programName);
+                return 0;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc != 2) {
+        fprintf(stderr, "Expected a package and an archive name\n");
+        PrintCatUsage(programName);
+        return 1;
+    }
+
+    ZIPReader reader(argv[0]);
+    const ZIPReader::Entry *entry = reader.Find(argv[1]);
+    if (!entry) {
+        fprintf(stderr, "File not in package: %s\n", argv[1]);
+        return 1;
+    }
+    FileSink stdoutSink(stdout);
+    if (offset == 0 &&
+        length >= static_cast<std::size_t>(entry->uncompressedSize)) {
+        // Check the whole file's CRC-32.
+        reader.Read(*entry, [&stdoutSink](std::size_t size,
+                                          const std::uint8_t *bytes) {
+            stdoutSink.Write(size, bytes);
+        });
+    } else {
+        reader.LoadBlockMap();
+        jobs = EffectiveJobCount(jobs);
+        std::vector<std::uint8_t> buffer(kCatBlocksPerThread *
+                                         ZIPBlock::kSize * jobs);
+        off_t position = static_cast<off_t>(offset);
+        std::size_t remaining = length;
+        while (remaining > 0) {
+            std::size_t read = reader.ReadAt(
+                *entry, position, std::min(remaining, buffer.size()),
+                buffer.data(), jobs);
+            if (read == 0) {
+                break;
+            }
+            stdoutSink.Write(read, buffer.data());
+            position += read;
+            remaining -= read;
+        }
+    }
+    stdoutSink.Flush();
+    return 0;
+}
+
+void PrintAppendUsage(const char *programName)
+{
+    fprintf(stderr,
+            "Usage: %s append [OPTION]... APPX INPUT...\n"
+            "Adds files to an APPX package in place. Only the new files and the\n"
+            "package metadata are written. New files are added in archive name\n"
+            "order after the existing files.\n"
+            "\n"
+            "Options:\n"
+            "  -c pfx-file     sign the APPX with the private key file (the\n"
+            "                  APPX is unsigned otherwise)\n"
+            "  -C type-file    declare content types, as for creating a package\n"
+            "  -f map-file     specify inputs from a mapping file\n"
+            "  --content-store=store-dir, --content-manifest=manifest-file\n"
+            "                  specify inputs from a content store, as for\n"
+            "                  creating a package\n"
+            "  -h              show this usage text and exit\n"
+            "  --incremental=sidecar-file\n"
+            "                  if sidecar-file describes the package (as\n"
+            "                  written by an incremental build or append),\n"
+            "                  sign without reading the existing files again;\n"
+            "                  then describe the new package in it\n"
+            "  -j, -m, -p, -t, -T, -0 to -9, -X\n"
+            "                  as for creating a package\n"
+            "\n"
+            "Inputs are given as when creating a package.\n",
+            programName);
+}
+
+int AppendMain(int argc, char **argv, const char *programName)
+{
+    APPXOptions options;
+    FileList fileNames;
+    std::vector<const char *> mappingFiles;
+    std::vector<const char *> contentManifests;
+    FileSystemInputSource fileSystem;
+    std::unique_ptr<ContentStoreInputSource> contentStore;
+    enum
+    {
+        kContentStoreOption = 256,
+        kContentManifestOption,
+        kIncrementalOption,
+    };
+    static const struct option kLongOptions[] = {
+        {"content-manifest", required_argument, nullptr,
+         kContentManifestOption},
+        {"content-store", required_argument, nullptr, kContentStoreOption},
+        {"incremental", required_argument, nullptr, kIncrementalOption},
+        {nullptr, 0, nullptr, 0},
+    };
+    while (int c = getopt_long(argc, argv, "0123456789c:C:f:hj:m:p:t:T:X",
+                               kLongOptions, nullptr)) {
+        if (c == -1) {
+            break;
+        }
+        if (ParsePackageOption(c, optarg, options)) {
+            continue;
+        }
+        switch (c) {
+            case 'f':
+                mappingFiles.push_back(optarg);
+                break;
+            case kContentStoreOption:
+                contentStore.reset(
+                    new ContentStoreInputSource(optarg, fileSystem));
+                options.inputSource = contentStore.get();
+                break;
+            case kContentManifestOption:
+                contentManifests.push_back(optarg);
+                break;
+            case kIncrementalOption:
+                options.incrementalPath = optarg;
+                break;
+            case '?':
+                fprintf(stderr, "Unknown option: %c\n", optopt);
+                PrintAppendUsage(programName);
+                return 1;
+            case 'h':
+                PrintAppendUsage(programName);
+                return 0;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 1) {
+        fprintf(stderr, "Missing APPX\n");
+        PrintAppendUsage(programName);
+        return 1;
+    }
+    if (!contentManifests.empty() && !contentStore) {
+        fprintf(stderr, "--content-manifest requires --content-store\n");
+        PrintAppendUsage(programName);
+        return 1;
+    }
+    const char *appxPath = argv[0];
+    GetInputs(mappingFiles, contentManifests, contentStore.get(), argc - 1,
+              argv + 1, fileNames);
+    if (fileNames.Empty()) {
+        fprintf(stderr, "Missing inputs\n");
+        PrintAppendUsage(programName);
+        return 1;
+    }
+    fileNames.Sort();
+    AppendAppx(appxPath, fileNames.Files(), options);
+    return 0;
+}
+
+// Returns true if both paths name the same existing file.
+bool IsSameFile(const char *a, const char *b)
+{
+    struct stat statusA;
+    struct stat statusB;
+    return stat(a, &statusA) == 0 && stat(b, &statusB) == 0 &&
+           statusA.st_dev == statusB.st_dev && statusA.st_ino == statusB.st_ino;
+}
+
+int RecompressMain(int argc, char **argv, const char *programName)
+{
+    const char *appxPath = NULL;
+    APPXOptions options;
+    while (int c = getopt(argc, argv, "0123456789c:C:hj:m:o:p:t:T:X")) {
+        if (c == -1) {
+            break;
+        }
+        if (ParsePackageOption(c, optarg, options)) {
+            continue;
+        }
+        switch (c) {
+            case 'o':
+                appxPath = optarg;
+                break;
+            case '?':
+                fprintf(stderr, "Unknown option: %c\n", optopt);
+                PrintRecompressUsage(programName);
+                return 1;
+            case 'h':
+                PrintRecompressUsage(programName);
+                return 0;
+        }
+    }
+    if (!appxPath) {
+        fprintf(stderr, "Missing -o\n");
+        PrintRecompressUsage(programName);
+        return 1;
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc != 1) {
+        fprintf(stderr, "Expected one package to recompress\n");
+        PrintRecompressUsage(programName);
+        return 1;
+    }
+    const char *packagePath = argv[0];
+    if (IsSameFile(packagePath, appxPath)) {
+        fprintf(stderr, "Cannot recompress a package in place: %s\n",
+                packagePath);
+        return 1;
+    }
+    FilePtr appx = Open(appxPath, "wb");
+    RecompressAppx(appx, packagePath, options);
+    return 0;
+}
 }
 
 int main(int argc, char **argv) try {
     const char *programName = argv[0];
-    const char *certPath = NULL;
+    if (argc > 1 && strcmp(argv[1], "recompress") == 0) {
+        return RecompressMain(argc - 1, argv + 1, programName);
+    }
+    if (argc > 1 && strcmp(argv[1], "analyze") == 0) {
+        return AnalyzeMain(argc - 1, argv + 1, programName);
+    }
+    if (argc > 1 && strcmp(argv[1], "cat") == 0) {
+        return CatMain(argc - 1, argv + 1, programName);
+    }
+    if (argc > 1 && strcmp(argv[1], "append") == 0) {
+        return AppendMain(argc - 1, argv + 1, programName);
+    }
     const char *appxPath = NULL;
-    int compressionLevel = Z_NO_COMPRESSION;
-    bool isBundle = false;
-    std::unordered_map<std::string, std::string> fileNames;
-    while (int c = getopt(argc, argv, "0123456789bc:f:ho:")) {
+    const char *order = "sorted";
+    APPXOptions options;
+    FileList fileNames;
+    std::vector<const char *> mappingFiles;
+    std::vector<const char *> contentManifests;
+    FileSystemInputSource fileSystem;
+    std::unique_ptr<ContentStoreInputSource> contentStore;
+    bool dryRun = false;
+    bool splitResources = false;
+    std::unique_ptr<BlockMemo> blockMemo;
+    std::unique_ptr<DigestSink> outputDigests;
+    const char *digestPath = nullptr;
+    enum
+    {
+        kIndexOption = 256,
+        kDryRunOption,
+        kSplitResourcesOption,
+        kBlockMemoOption,
+        kIncrementalOption,
+        kDigestOption,
+        kDigestFileOption,
+        kContentStoreOption,
+        kContentManifestOption,
+    };
+    static const struct option kLongOptions[] = {
+        {"block-memo", required_argument, nullptr, kBlockMemoOption},
+        {"checkpoint", required_argument, nullptr, 'k'},
+        {"content-manifest", required_argument, nullptr,
+         kContentManifestOption},
+        {"content-store", required_argument, nullptr, kContentStoreOption},
+        {"digest", required_argument, nullptr, kDigestOption},
+        {"digest-file", required_argument, nullptr, kDigestFileOption},
+        {"dry-run", no_argument, nullptr, kDryRunOption},
+        {"help", no_argument, nullptr, 'h'},
+        {"incremental", required_argument, nullptr, kIncrementalOption},
+        {"index", required_argument, nullptr, kIndexOption},
+        {"resume", no_argument, nullptr, 'r'},
+        {"split-resources", no_argument, nullptr, kSplitResourcesOption},
+        {nullptr, 0, nullptr, 0},
+    };
+    while (int c = getopt_long(argc, argv,
+                               "0123456789bc:C:f:g:hj:k:m:o:O:p:rt:T:X",
+                               kLongOptions, nullptr)) {
         if (c == -1) {
             break;
         }
+        if (ParsePackageOption(c, optarg, options)) {
+            continue;
+        }
         switch (c) {
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-                compressionLevel = c - '0';
-                break;
             case 'b':
-                isBundle = true;
+                options.isBundle = true;
+                break;
+            case 'k':
+                options.checkpointPath = optarg;
+                break;
+            case 'r':
+                options.resume = true;
+                break;
+            case kIndexOption:
+                options.indexPath = optarg;
+                break;
+            case kIncrementalOption:
+                options.incrementalPath = optarg;
                 break;
-            case 'c':
-                certPath = optarg;
+            case kDigestOption:
+                outputDigests.reset(
+                    new DigestSink(ParseDigestAlgorithms(optarg)));
+                options.outputDigests = outputDigests.get();
                 break;
+            case kDigestFileOption:
+                digestPath = optarg;
+                break;
+            case kContentStoreOption:
+                contentStore.reset(
+                    new ContentStoreInputSource(optarg, fileSystem));
+                options.inputSource = contentStore.get();
+                break;
+            case kContentManifestOption:
+                contentManifests.push_back(optarg);
+                break;
+            case kDryRunOption:
+                dryRun = true;
+                break;
+            case kSplitResourcesOption:
+                splitResources = true;
+                break;
+            case kBlockMemoOption: {
+                std::size_t limit;
+                if (!ParseSize(optarg, limit) || limit == 0) {
+                    throw std::runtime_error(
+                        std::string("Invalid block memo size: ") + optarg);
+                }
+                blockMemo.reset(new BlockMemo(limit));
+                options.blockMemo = blockMemo.get();
+                break;
+            }
             case 'f':
-                if (strcmp(optarg, "-") == 0) {
-                    std::cin.exceptions(std::istream::badbit |
-                                        std::istream::failbit);
-                    GetArchiveFileListFromMappingFile(std::cin, fileNames);
-                } else {
-                    std::ifstream file;
-                    file.exceptions(std::ifstream::badbit |
-                                    std::ifstream::failbit);
-                    file.open(optarg);
-                    try {
-                        GetArchiveFileListFromMappingFile(file, fileNames);
-                    } catch (MalformedMappingFileError &e) {
-                        e.SetFileName(optarg);
-                        throw;
-                    }
+                mappingFiles.push_back(optarg);
+                break;
+            case 'g': {
+                std::ifstream file;
+                file.exceptions(std::ifstream::badbit |
+                                std::ifstream::failbit);
+                file.open(optarg);
+                try {
+                    GetContentGroupsFromFile(file, options.contentGroups);
+                } catch (MalformedMappingFileError &e) {
+                    e.SetFileName(optarg);
+                    throw;
                 }
                 break;
+            }
             case 'o':
                 appxPath = optarg;
                 break;
+            case 'O':
+                order = optarg;
+                break;
             case '?':
                 fprintf(stderr, "Unknown option: %c\n", optopt);
                 PrintUsage(programName);
@@ -344,38 +1318,137 @@ int main(int argc, char **argv) try {
                 return 0;
         }
     }
-    if (!appxPath) {
+    if (!appxPath && !dryRun) {
         fprintf(stderr, "Missing -o\n");
         PrintUsage(programName);
         return 1;
     }
+    if (options.resume && options.checkpointPath.empty()) {
+        fprintf(stderr, "--resume requires --checkpoint\n");
+        PrintUsage(programName);
+        return 1;
+    }
+    if (dryRun && (options.timeBudget > 0 ||
+                   !options.checkpointPath.empty() ||
+                   !options.indexPath.empty() ||
+                   !options.incrementalPath.empty() || outputDigests)) {
+        fprintf(stderr, "--dry-run cannot be used with -t, -T, -k, --index, "
+                        "--incremental, or --digest\n");
+        PrintUsage(programName);
+        return 1;
+    }
+    if (!contentManifests.empty() && !contentStore) {
+        fprintf(stderr, "--content-manifest requires --content-store\n");
+        PrintUsage(programName);
+        return 1;
+    }
+    if (digestPath && !outputDigests) {
+        fprintf(stderr, "--digest-file requires --digest\n");
+        PrintUsage(programName);
+        return 1;
+    }
+    if (strcmp(order, "stable") == 0 && options.incrementalPath.empty()) {
+        fprintf(stderr, "-O stable requires --incremental\n");
+        PrintUsage(programName);
+        return 1;
+    }
+    if (splitResources && (dryRun || options.isBundle)) {
+        fprintf(stderr, "--split-resources cannot be used with -b or "
+                        "--dry-run\n");
+        PrintUsage(programName);
+        return 1;
+    }
     argc -= optind;
     argv += optind;
-    for (char *const *i = argv; i != argv + argc; ++i) {
-        const char *arg = *i;
-        const char *equalSeparator = strchr(arg, '=');
-        if (equalSeparator) {
-            // ArchivePath=LocalPath specified.
-            fileNames.insert(std::make_pair(std::string(arg, equalSeparator),
-                                            std::string(equalSeparator + 1)));
-        } else {
-            // Local path specified. Infer archive path.
-            GetArchiveFileList(arg, fileNames);
+    if (mappingFiles.empty() && contentManifests.empty() && argc == 0) {
+        fprintf(stderr, "Missing inputs\n");
+        PrintUsage(programName);
+        return 1;
+    }
+
+    // In input order, files can be packaged while later inputs are still
+    // being discovered, unless packaging needs the whole list up front.
+    if (strcmp(order, "input") == 0 && !dryRun && !splitResources &&
+        options.contentGroups.Empty() &&
+        options.timeBudget == 0 && options.checkpointPath.empty() &&
+        options.incrementalPath.empty()) {
+        FilePtr appx = Open(appxPath, "wb");
+        FileListQueue queue(kFileListQueueCapacity);
+        std::thread discovery([&]() {
+            try {
+                GetInputs(mappingFiles, contentManifests, contentStore.get(),
+                          argc, argv, queue);
+                queue.Close();
+            } catch (...) {
+                queue.Close(std::current_exception());
+            }
+        });
+        try {
+            WriteAppx(appx, queue, options);
+        } catch (...) {
+            discovery.join();
+            throw;
         }
+        discovery.join();
+        PrintBlockMemoStats(blockMemo.get());
+        WriteOutputDigests(outputDigests.get(), digestPath);
+        return 0;
     }
-    if (fileNames.empty()) {
+
+    GetInputs(mappingFiles, contentManifests, contentStore.get(), argc, argv,
+              fileNames);
+    if (fileNames.Empty()) {
         fprintf(stderr, "Missing inputs\n");
         PrintUsage(programName);
         return 1;
     }
-    if (isBundle && fileNames.count("AppxMetadata/AppxBundleManifest.xml") == 0) {
+    if (options.isBundle && !fileNames.Contains("AppxMetadata/AppxBundleManifest.xml")) {
         fprintf(stderr, "You need to provide AppxBundleManifest.xml!\n");
         return 1;
     }
-    std::string certPathString = certPath ?: "";
-    FilePtr appx = Open(appxPath, "wb");
-    WriteAppx(appx, fileNames, certPath ? &certPathString : nullptr,
-              compressionLevel, isBundle);
+    if (strcmp(order, "sorted") == 0) {
+        fileNames.Sort();
+    } else if (strcmp(order, "input") == 0) {
+        // Keep the order of the command line and mapping files.
+    } else if (strcmp(order, "stable") == 0) {
+        // Files new to this build follow, by archive name.
+        std::vector<std::string> archiveNames;
+        for (std::string &archiveName :
+             IncrementalBuild(options.incrementalPath).StableOrder()) {
+            if (fileNames.Contains(archiveName)) {
+                archiveNames.push_back(std::move(archiveName));
+            }
+        }
+        fileNames.Reorder(archiveNames);
+    } else {
+        std::ifstream file;
+        file.exceptions(std::ifstream::badbit);
+        file.open(order);
+        if (!file) {
+            throw ErrnoException(order);
+        }
+        fileNames.Reorder(GetArchiveNamesFromOrderFile(file));
+    }
+    if (dryRun) {
+        WriteEstimate(std::cout, EstimateAppx(fileNames.Files(), options));
+        return 0;
+    }
+    // Keep the partial output when resuming from a checkpoint, or the
+    // last build's output for an incremental build.
+    bool resuming = (options.resume &&
+                     access(options.checkpointPath.c_str(), F_OK) == 0) ||
+                    (!options.incrementalPath.empty() &&
+                     access(appxPath, F_OK) == 0);
+    FilePtr appx = Open(appxPath, resuming ? "r+b" : "wb");
+    if (splitResources) {
+        WriteResourceBundle(appx, fileNames.Files(), options);
+        PrintBlockMemoStats(blockMemo.get());
+        WriteOutputDigests(outputDigests.get(), digestPath);
+        return 0;
+    }
+    WriteAppx(appx, fileNames.Files(), options);
+    PrintBlockMemoStats(blockMemo.get());
+    WriteOutputDigests(outputDigests.get(), digestPath);
     return 0;
 } catch (std::exception &e) {
     fprintf(stderr, "%s\n", e.what());
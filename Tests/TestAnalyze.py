@@ -0,0 +1,114 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import json
+import os
+import subprocess
+import unittest
+import zipfile
+
+class TestAnalyze(unittest.TestCase):
+    '''
+    Ensures the analysis report describes packages and input sets.
+    '''
+
+    def _make_inputs(self, d):
+        text = ''.join('line {}\n'.format(i) for i in range(50000))
+        return appx.util.make_input_tree(d, {
+            'random.bin': os.urandom(200000),
+            'a.txt': text,
+            'b.txt': text,
+            'empty': '',
+        })
+
+    def _analyze(self, d, args):
+        report = os.path.join(d, 'report.json')
+        summary = subprocess.check_output(
+            [appx_exe(), 'analyze', '-o', report] + args)
+        with open(report) as f:
+            return (json.load(f), summary)
+
+    def _files(self, report):
+        return dict((f['name'], f) for f in report['files'])
+
+    def test_package(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            package = os.path.join(d, 'test.appx')
+            appx.util.build_appx(package, ['-9', input_dir])
+            (report, summary) = self._analyze(d, ['-j', '2', package])
+            self.assertEqual(package, report['package'])
+            files = self._files(report)
+            self.assertEqual(['a.txt', 'b.txt', 'empty', 'random.bin'],
+                             sorted(files))
+            with zipfile.ZipFile(package) as zip:
+                for name in files:
+                    info = zip.getinfo(name)
+                    self.assertEqual(info.file_size,
+                                     files[info.filename]['size'])
+                    self.assertEqual(info.compress_size,
+                                     files[info.filename]['compressedSize'])
+            self.assertEqual('a.txt', files['b.txt']['duplicateOf'])
+            self.assertIsNone(files['a.txt']['duplicateOf'])
+            self.assertIsNone(files['empty']['duplicateOf'])
+            for f in report['files']:
+                self.assertEqual(f['sampledBlocks'],
+                                 sum(f['blockRatioHistogram']))
+                self.assertEqual([0, 1, 6, 9],
+                                 [e['level'] for e in f['estimates']])
+            # Random data does not compress; text does.
+            self.assertEqual(files['random.bin']['sampledBlocks'],
+                             files['random.bin']['blockRatioHistogram'][-1])
+            self.assertLess(files['a.txt']['estimates'][3]['size'],
+                            files['a.txt']['size'] / 2)
+            txt = [e for e in report['extensions']
+                   if e['extension'] == 'txt'][0]
+            self.assertEqual(2, txt['files'])
+            self.assertIn('Largest files', summary)
+            self.assertIn('Duplicate files: 1', summary)
+
+    def test_inputs_with_reference(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            package = os.path.join(d, 'test.appx')
+            appx.util.build_appx(package, [input_dir])
+            with open(os.path.join(input_dir, 'random.bin'), 'wb') as f:
+                f.write(os.urandom(200000))
+            (report, _) = self._analyze(d, ['-r', package, input_dir])
+            self.assertIsNone(report['package'])
+            files = self._files(report)
+            self.assertEqual(['a.txt', 'b.txt', 'empty', 'random.bin'],
+                             sorted(files))
+            self.assertIsNone(files['a.txt']['compressedSize'])
+            self.assertEqual(files['a.txt']['blocks'],
+                             files['a.txt']['referenceBlocks'])
+            self.assertEqual(files['a.txt']['size'],
+                             files['a.txt']['referenceBytes'])
+            self.assertEqual(0, files['random.bin']['referenceBlocks'])
+
+    def test_mapping_file_on_standard_input(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            report = os.path.join(d, 'report.json')
+            process = subprocess.Popen(
+                [appx_exe(), 'analyze', '-o', report, '-f', '-'],
+                stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+            process.communicate('[Files]\n"{}" "x/a.txt"\n"{}" "y.bin"\n'
+                                .format(os.path.join(input_dir, 'a.txt'),
+                                        os.path.join(input_dir,
+                                                     'random.bin')))
+            self.assertEqual(0, process.returncode)
+            with open(report) as f:
+                files = self._files(json.load(f))
+            self.assertEqual(['x/a.txt', 'y.bin'], sorted(files))
+            self.assertEqual(200000, files['y.bin']['size'])
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe, test_key_path
+import appx.util
+import hashlib
+import os
+import subprocess
+import unittest
+import zipfile
+
+class TestAppend(unittest.TestCase):
+    '''
+    Ensures appending to a package gives the same package as creating it
+    with all of the files.
+    '''
+
+    def _make_inputs(self, d):
+        old_dir = appx.util.make_input_tree(
+            d, dict(('a{}.dat'.format(i), appx.util.partly_random(size, i))
+                    for i, size in enumerate([0, 1000, 200000])), 'old')
+        new_dir = appx.util.make_input_tree(
+            d, dict(('b{}.dat'.format(i), appx.util.partly_random(size, i))
+                    for i, size in enumerate([70000, 5])), 'new')
+        return (old_dir, new_dir)
+
+    def _read(self, path):
+        with open(path, 'rb') as f:
+            return f.read()
+
+    def _build(self, path, args):
+        appx.util.build_appx(path, args)
+
+    def test_same_as_creating(self):
+        with appx.util.temp_dir() as d:
+            (old_dir, new_dir) = self._make_inputs(d)
+            expected = os.path.join(d, 'expected.appx')
+            self._build(expected, ['-6', old_dir, new_dir])
+            for jobs in ['1', '2']:
+                output = os.path.join(d, 'output.appx')
+                self._build(output, ['-6', old_dir])
+                subprocess.check_call([appx_exe(), 'append', '-6', '-j', jobs,
+                                       output, new_dir])
+                self.assertEqual(self._read(expected), self._read(output))
+
+    def test_signed(self):
+        with appx.util.temp_dir() as d:
+            (old_dir, new_dir) = self._make_inputs(d)
+            output = os.path.join(d, 'output.appx')
+            self._build(output, ['-c', test_key_path(), old_dir])
+            subprocess.check_call([appx_exe(), 'append',
+                                   '-c', test_key_path(), output, new_dir])
+            with zipfile.ZipFile(output) as zip:
+                self.assertIsNone(zip.testzip())
+                names = zip.namelist()
+                self.assertIn('b0.dat', names)
+                self.assertEqual(1, names.count('AppxSignature.p7x'))
+                self.assertEqual('AppxSignature.p7x', names[-1])
+
+            # Appending without a key removes the signature.
+            expected = os.path.join(d, 'expected.appx')
+            self._build(expected, [old_dir, new_dir,
+                                   'c.dat=' + os.path.join(new_dir, 'b1.dat')])
+            subprocess.check_call([appx_exe(), 'append', output,
+                                   'c.dat=' + os.path.join(new_dir, 'b1.dat')])
+            self.assertEqual(self._read(expected), self._read(output))
+
+    def test_mapping_file_and_content_store(self):
+        with appx.util.temp_dir() as d:
+            (old_dir, new_dir) = self._make_inputs(d)
+            expected = os.path.join(d, 'expected.appx')
+            self._build(expected, ['-6', old_dir, new_dir])
+
+            store_dir = os.path.join(d, 'store')
+            os.mkdir(store_dir)
+            data = self._read(os.path.join(new_dir, 'b1.dat'))
+            digest = hashlib.sha256(data).hexdigest()
+            with open(os.path.join(store_dir, digest), 'wb') as f:
+                f.write(data)
+            manifest = os.path.join(d, 'manifest')
+            with open(manifest, 'wb') as f:
+                f.write('[ContentStore]\n"{}/{}" "b1.dat"\n'.format(
+                    digest, len(data)))
+
+            output = os.path.join(d, 'output.appx')
+            self._build(output, ['-6', old_dir])
+            process = subprocess.Popen(
+                [appx_exe(), 'append', '-6', '-f', '-', '--content-store',
+                 store_dir, '--content-manifest', manifest, output],
+                stdin=subprocess.PIPE)
+            process.communicate('[Files]\n"{}" "b0.dat"\n'.format(
+                os.path.join(new_dir, 'b0.dat')))
+            self.assertEqual(0, process.returncode)
+            self.assertEqual(self._read(expected), self._read(output))
+
+    def _check_append_fails(self, package, args, message):
+        before = self._read(package)
+        process = subprocess.Popen([appx_exe(), 'append', package] + args,
+                                   stderr=subprocess.PIPE)
+        (_, stderr) = process.communicate()
+        self.assertEqual(1, process.returncode)
+        self.assertIn(message, stderr)
+        self.assertEqual(before, self._read(package))
+
+    def test_existing_file(self):
+        with appx.util.temp_dir() as d:
+            (old_dir, new_dir) = self._make_inputs(d)
+            output = os.path.join(d, 'output.appx')
+            self._build(output, [old_dir])
+            self._check_append_fails(
+                output, ['a1.dat=' + os.path.join(new_dir, 'b0.dat')],
+                'File already in package: a1.dat')
+
+    def test_not_appx(self):
+        with appx.util.temp_dir() as d:
+            (old_dir, new_dir) = self._make_inputs(d)
+            package = os.path.join(d, 'test.zip')
+            with zipfile.ZipFile(package, 'w') as zip:
+                zip.writestr('a.txt', 'hello')
+            self._check_append_fails(package, [new_dir], 'Not an APPX')
+
+    def test_content_groups(self):
+        with appx.util.temp_dir() as d:
+            (old_dir, new_dir) = self._make_inputs(d)
+            groups = os.path.join(d, 'groups.txt')
+            with open(groups, 'w') as f:
+                f.write('[ContentGroups]\n"Required" "a0.dat"\n')
+            output = os.path.join(d, 'output.appx')
+            self._build(output, ['-g', groups, old_dir])
+            self._check_append_fails(output, [new_dir],
+                                     'packages with content groups')
+
+if __name__ == '__main__':
+    unittest.main()
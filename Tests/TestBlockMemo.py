@@ -0,0 +1,105 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import os
+import random
+import re
+import subprocess
+import unittest
+import zipfile
+
+BLOCK_SIZE = 65536
+
+class TestBlockMemo(unittest.TestCase):
+    '''
+    Ensures --block-memo reuses the compressed bytes of repeated blocks
+    without changing the package.
+    '''
+
+    def _make_inputs(self, d, blocks):
+        rng = random.Random(7)
+        words = ['alpha', 'beta', 'gamma', 'delta', 'epsilon', '\n']
+        def block():
+            return ' '.join(rng.choice(words)
+                            for _ in range(BLOCK_SIZE))[:BLOCK_SIZE]
+        a, b, c = block(), block(), block()
+        return appx.util.make_input_tree(d, {
+            'first.txt': a * blocks + 'tail',
+            'second.txt': b + a * blocks + 'tail',
+            'copy.txt': b + a * blocks + 'tail',
+            'short.txt': 'tail',
+            'unique.txt': c,
+        })
+
+    def _build(self, d, input_dir, args):
+        output = os.path.join(d, 'test.appx')
+        process = subprocess.Popen([appx_exe(), '-o', output] + args +
+                                   [input_dir], stderr=subprocess.PIPE)
+        (_, stderr) = process.communicate()
+        self.assertEqual(0, process.returncode, stderr)
+        with zipfile.ZipFile(output) as package:
+            self.assertIsNone(package.testzip())
+        with open(output, 'rb') as f:
+            return (f.read(), stderr)
+
+    def _hits(self, stderr):
+        match = re.search(r'Block memo: (\d+) of (\d+) blocks found', stderr)
+        self.assertIsNotNone(match, stderr)
+        return (int(match.group(1)), int(match.group(2)))
+
+    def test_identical_output(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d, blocks=4)
+            for level in ['-1', '-6', '-9']:
+                for jobs in ['1', '3']:
+                    args = [level, '-j', jobs]
+                    (expected, _) = self._build(d, input_dir, args)
+                    (actual, stderr) = self._build(
+                        d, input_dir, args + ['--block-memo', '16M'])
+                    self.assertEqual(expected, actual)
+                    (hits, lookups) = self._hits(stderr)
+                    # Every block but the first of a, b, c, and the tail
+                    # is found.
+                    self.assertEqual(19, lookups)
+                    if jobs == '1':
+                        self.assertEqual(15, hits)
+                    else:
+                        self.assertGreater(hits, 0)
+
+    def test_exhaustive(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d, blocks=1)
+            (expected, _) = self._build(d, input_dir, ['-X'])
+            (actual, stderr) = self._build(d, input_dir,
+                                           ['-X', '--block-memo', '1M'])
+            self.assertEqual(expected, actual)
+            self.assertGreater(self._hits(stderr)[0], 0)
+
+    def test_small_memo(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d, blocks=4)
+            (expected, _) = self._build(d, input_dir, ['-6'])
+            # Too small for any block, and for only some blocks.
+            for size in ['1K', '12K']:
+                (actual, stderr) = self._build(
+                    d, input_dir, ['-6', '--block-memo', size])
+                self.assertEqual(expected, actual)
+            self.assertRegexpMatches(stderr, r'[1-9]\d* evicted')
+
+    def test_invalid_size(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d, blocks=1)
+            with open(os.devnull, 'wb') as devnull:
+                self.assertNotEqual(0, subprocess.call(
+                    [appx_exe(), '-o', os.path.join(d, 'test.appx'),
+                     '--block-memo', '0', input_dir], stderr=devnull))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,51 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import os
+import subprocess
+import unittest
+
+class TestCachePolicy(unittest.TestCase):
+    '''
+    Ensures the page cache policy does not affect the created package.
+    '''
+
+    def _make_inputs(self, d):
+        return appx.util.make_random_input_tree(
+            d, [0, 1, 4095, 4096, 65537, 3000000])
+
+    def _build(self, d, input_dir, args):
+        return appx.util.build_appx(os.path.join(d, 'test.appx'),
+                                    args + [input_dir])
+
+    def test_identical_output(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            for level in ['-0', '-9']:
+                expected = self._build(d, input_dir, [level])
+                for policy in ['default', 'nocache', 'direct']:
+                    for jobs in ['1', '2']:
+                        self.assertEqual(expected, self._build(
+                            d, input_dir,
+                            [level, '-p', policy, '-j', jobs]))
+
+    def test_invalid_policy(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            process = subprocess.Popen([
+                appx_exe(), '-o', os.path.join(d, 'test.appx'),
+                '-p', 'sometimes', input_dir,
+            ], stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('Invalid cache policy', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
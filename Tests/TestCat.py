@@ -0,0 +1,191 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import base64
+import hashlib
+import os
+import struct
+import subprocess
+import unittest
+import zipfile
+
+BLOCK_SIZE = 65536
+
+class TestCat(unittest.TestCase):
+    '''
+    Ensures appx cat reads ranges of files in packages.
+    '''
+
+    def _make_package(self, d, args):
+        input_dir = os.path.join(d, 'input')
+        if not os.path.exists(input_dir):
+            text = ''.join('line {}\n'.format(i) for i in range(200000))
+            appx.util.make_input_tree(
+                d, {'sub dir/big.txt': os.urandom(100000) + text})
+        with open(os.path.join(input_dir, 'sub dir', 'big.txt'), 'rb') as f:
+            data = f.read()
+        package = os.path.join(d, 'test.appx')
+        appx.util.build_appx(package, args + [input_dir])
+        return (package, data)
+
+    def _cat(self, package, name, args=[]):
+        return subprocess.check_output(
+            [appx_exe(), 'cat'] + args + [package, name])
+
+    def _check_ranges(self, package, data):
+        ranges = [
+            (0, 1), (0, BLOCK_SIZE), (1, BLOCK_SIZE), (BLOCK_SIZE - 1, 2),
+            (BLOCK_SIZE * 3, BLOCK_SIZE * 5 + 17), (len(data) - 10, 100),
+            (len(data), 10), (len(data) + 1000, 10),
+        ]
+        for (offset, length) in ranges:
+            for jobs in ['1', '3']:
+                self.assertEqual(
+                    data[offset:offset + length],
+                    self._cat(package, 'sub dir/big.txt', [
+                        '--offset={}'.format(offset),
+                        '--length={}'.format(length), '-j', jobs,
+                    ]))
+        self.assertEqual(data[BLOCK_SIZE * 2:],
+                         self._cat(package, 'sub dir/big.txt',
+                                   ['--offset', '128K']))
+        self.assertEqual(data, self._cat(package, 'sub dir/big.txt'))
+
+    def test_ranges(self):
+        with appx.util.temp_dir() as d:
+            for level in ['-0', '-1', '-9']:
+                (package, data) = self._make_package(d, [level])
+                self._check_ranges(package, data)
+
+    def test_only_needed_blocks_are_inflated(self):
+        with appx.util.temp_dir() as d:
+            (package, data) = self._make_package(d, ['-9'])
+            with zipfile.ZipFile(package) as zip:
+                info = zip.getinfo('sub%20dir/big.txt')
+            # Corrupt the first block of the file.
+            with open(package, 'r+b') as f:
+                f.seek(info.header_offset + 26)
+                (name_size, extra_size) = struct.unpack('<HH', f.read(4))
+                f.seek(info.header_offset + 30 + name_size + extra_size)
+                f.write('\xff' * 16)
+            self.assertEqual(
+                data[BLOCK_SIZE * 4:BLOCK_SIZE * 4 + 1000],
+                self._cat(package, 'sub dir/big.txt', [
+                    '--offset={}'.format(BLOCK_SIZE * 4), '--length=1000',
+                ]))
+            process = subprocess.Popen(
+                [appx_exe(), 'cat', package, 'sub dir/big.txt'],
+                stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('Malformed ZIP file', stderr)
+
+    def test_damaged_block(self):
+        with appx.util.temp_dir() as d:
+            (package, data) = self._make_package(d, ['-1'])
+            with zipfile.ZipFile(package) as zip:
+                info = zip.getinfo('sub%20dir/big.txt')
+            # Random data is stored in DEFLATE blocks, so changing a byte
+            # still inflates, to the wrong data.
+            with open(package, 'r+b') as f:
+                f.seek(info.header_offset + 26)
+                (name_size, extra_size) = struct.unpack('<HH', f.read(4))
+                f.seek(info.header_offset + 30 + name_size + extra_size + 1000)
+                byte = f.read(1)
+                f.seek(-1, os.SEEK_CUR)
+                f.write(chr(ord(byte) ^ 0xff))
+            self.assertEqual(
+                data[BLOCK_SIZE * 4:BLOCK_SIZE * 4 + 1000],
+                self._cat(package, 'sub dir/big.txt', [
+                    '--offset={}'.format(BLOCK_SIZE * 4), '--length=1000',
+                ]))
+            for jobs in ['1', '3']:
+                process = subprocess.Popen(
+                    [appx_exe(), 'cat', '--offset=10', '--length=100', '-j',
+                     jobs, package, 'sub dir/big.txt'],
+                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+                (stdout, stderr) = process.communicate()
+                self.assertEqual(1, process.returncode)
+                self.assertIn('bad block', stderr)
+
+    def test_package_without_block_map(self):
+        with appx.util.temp_dir() as d:
+            package = os.path.join(d, 'test.zip')
+            data = ''.join('line {}\n'.format(i) for i in range(100000))
+            with zipfile.ZipFile(package, 'w', zipfile.ZIP_DEFLATED) as zip:
+                zip.writestr('a.txt', data)
+            self.assertEqual(
+                data[300000:300100],
+                self._cat(package, 'a.txt',
+                          ['--offset=300000', '--length=100']))
+
+    def _make_foreign_package(self, d, last_size=None):
+        '''
+        Writes a package with a block map, as another tool might, whose
+        file is one DEFLATE stream rather than independent blocks.
+        last_size overrides the last block's Size attribute.
+        '''
+        package = os.path.join(d, 'foreign.appx')
+        data = ''.join('line {}\n'.format(i) for i in range(100000))
+        with zipfile.ZipFile(package, 'w', zipfile.ZIP_DEFLATED) as archive:
+            archive.writestr('a.txt', data)
+            compressed_size = archive.getinfo('a.txt').compress_size
+        chunks = [data[i:i + BLOCK_SIZE]
+                  for i in range(0, len(data), BLOCK_SIZE)]
+        sizes = [compressed_size // len(chunks)] * len(chunks)
+        if last_size is not None:
+            sizes[-1] = last_size
+        blocks = ''.join(
+            '<Block Hash="{}" Size="{}"/>'.format(
+                base64.b64encode(hashlib.sha256(chunk).digest()), size)
+            for (chunk, size) in zip(chunks, sizes))
+        with zipfile.ZipFile(package, 'a', zipfile.ZIP_DEFLATED) as archive:
+            archive.writestr(
+                'AppxBlockMap.xml',
+                '<?xml version="1.0" encoding="UTF-8"?><BlockMap>'
+                '<File Name="a.txt" Size="{}" LfhSize="35">{}</File>'
+                '</BlockMap>'.format(len(data), blocks))
+        return (package, data)
+
+    def test_package_with_dependent_blocks(self):
+        with appx.util.temp_dir() as d:
+            (package, data) = self._make_foreign_package(d)
+            for jobs in ['1', '3']:
+                self.assertEqual(
+                    data[BLOCK_SIZE * 4:BLOCK_SIZE * 4 + 1000],
+                    self._cat(package, 'a.txt', [
+                        '--offset={}'.format(BLOCK_SIZE * 4),
+                        '--length=1000', '-j', jobs,
+                    ]))
+
+    def test_bad_block_sizes(self):
+        with appx.util.temp_dir() as d:
+            for size in ['-1', '0', 'x', '12x', '99999999999999999999',
+                         '100000000']:
+                (package, _) = self._make_foreign_package(d, size)
+                process = subprocess.Popen(
+                    [appx_exe(), 'cat', '--offset=1', package, 'a.txt'],
+                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+                (_, stderr) = process.communicate()
+                self.assertEqual(1, process.returncode)
+                self.assertIn('bad block size', stderr)
+
+    def test_missing_file(self):
+        with appx.util.temp_dir() as d:
+            (package, _) = self._make_package(d, ['-0'])
+            process = subprocess.Popen(
+                [appx_exe(), 'cat', package, 'missing.txt'],
+                stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('File not in package', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,144 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe, test_key_path
+import appx.util
+import hashlib
+import os
+import struct
+import subprocess
+import unittest
+import zipfile
+
+CATALOG = 'AppxMetadata/CodeIntegrity.cat'
+
+class TestCodeIntegrity(unittest.TestCase):
+    '''
+    Ensures signed packages list their binaries' Authenticode hashes in
+    AppxMetadata/CodeIntegrity.cat, and the signature covers the catalog.
+    '''
+
+    def _make_pe(self, path, body_size, has_certificate):
+        '''
+        Writes a PE32+ image with no sections. Returns its Authenticode
+        hash.
+        '''
+        pe_offset = 0x80
+        dos_header = 'MZ' + '\0' * (0x3c - 2) + struct.pack('<I', pe_offset)
+        dos_header += '\0' * (pe_offset - len(dos_header))
+        coff_header = 'PE\0\0' + struct.pack('<HHIIIHH', 0x8664, 0, 0, 0, 0,
+                                             240, 0x22)
+        optional_header = bytearray(240)
+        struct.pack_into('<H', optional_header, 0, 0x20b)
+        struct.pack_into('<I', optional_header, 64, 0x12345678)
+        struct.pack_into('<I', optional_header, 108, 16)
+        headers_size = len(dos_header) + len(coff_header) + 240
+        body = os.urandom(body_size)
+        certificate = 'certificate table' if has_certificate else ''
+        if has_certificate:
+            struct.pack_into('<II', optional_header, 144,
+                             headers_size + body_size, len(certificate))
+        data = dos_header + coff_header + str(optional_header) + body + \
+            certificate
+        with open(path, 'wb') as f:
+            f.write(data)
+
+        checksum = len(dos_header) + len(coff_header) + 64
+        certificate_directory = len(dos_header) + len(coff_header) + 144
+        hashed = data[:checksum] + \
+            data[checksum + 4:certificate_directory] + \
+            data[certificate_directory + 8:headers_size + body_size]
+        return hashlib.sha256(hashed).digest()
+
+    def _tag(self, image_hash):
+        return image_hash.encode('hex').upper().encode('utf-16-le')
+
+    def _make_inputs(self, d):
+        input_dir = appx.util.make_input_tree(d, {
+            'c.dll': 'not a PE image',
+            'd.txt': 'MZ',
+        })
+        os.mkdir(os.path.join(input_dir, 'lib'))
+        hashes = {
+            'a.exe': self._make_pe(os.path.join(input_dir, 'a.exe'), 300000,
+                                   False),
+            'lib/b.DLL': self._make_pe(os.path.join(input_dir, 'lib', 'b.DLL'),
+                                       1000, True),
+        }
+        return (input_dir, hashes)
+
+    def _check_catalog(self, package, hashes):
+        with zipfile.ZipFile(package) as zip:
+            self.assertIsNone(zip.testzip())
+            names = zip.namelist()
+            self.assertEqual(1, names.count(CATALOG))
+            self.assertEqual(names.index(CATALOG) + 1,
+                             names.index('AppxBlockMap.xml'))
+            catalog = zip.read(CATALOG)
+            self.assertIn('CodeIntegrity.cat', zip.read('AppxBlockMap.xml'))
+            signature = zip.read('AppxSignature.p7x')
+        for name, image_hash in hashes.items():
+            self.assertIn(image_hash, catalog)
+            self.assertIn(self._tag(image_hash), catalog)
+            self.assertIn(name.encode('utf-16-le'), catalog)
+        self.assertNotIn('c.dll'.encode('utf-16-le'), catalog)
+        self.assertIn('AXCI' + hashlib.sha256(catalog).digest(), signature)
+
+    def test_signed_package_has_catalog(self):
+        with appx.util.temp_dir() as d:
+            (input_dir, hashes) = self._make_inputs(d)
+            for jobs in ['1', '2']:
+                package = os.path.join(d, 'package.appx')
+                subprocess.check_call([appx_exe(), '-j', jobs,
+                                       '-c', test_key_path(),
+                                       '-o', package, input_dir])
+                self._check_catalog(package, hashes)
+
+    def test_no_catalog_without_binaries_or_signature(self):
+        with appx.util.temp_dir() as d:
+            (input_dir, hashes) = self._make_inputs(d)
+            package = os.path.join(d, 'package.appx')
+            appx.util.build_appx(package, [input_dir])
+            with zipfile.ZipFile(package) as zip:
+                self.assertNotIn(CATALOG, zip.namelist())
+
+            subprocess.check_call([appx_exe(), '-c', test_key_path(),
+                                   '-o', package,
+                                   os.path.join(input_dir, 'c.dll')])
+            with zipfile.ZipFile(package) as zip:
+                self.assertNotIn(CATALOG, zip.namelist())
+                self.assertIn('AXCI' + '\0' * 32,
+                              zip.read('AppxSignature.p7x'))
+
+    def test_catalog_input_is_rejected_when_signing(self):
+        with appx.util.temp_dir() as d:
+            (input_dir, hashes) = self._make_inputs(d)
+            package = os.path.join(d, 'package.appx')
+            process = subprocess.Popen(
+                [appx_exe(), '-c', test_key_path(), '-o', package,
+                 input_dir, CATALOG + '=' + os.path.join(input_dir, 'c.dll')],
+                stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertNotEqual(0, process.returncode)
+            self.assertIn('must not be an input', stderr)
+
+    def test_append_updates_catalog(self):
+        with appx.util.temp_dir() as d:
+            (input_dir, hashes) = self._make_inputs(d)
+            new_hash = self._make_pe(os.path.join(d, 'e.dll'), 5000, False)
+            package = os.path.join(d, 'package.appx')
+            subprocess.check_call([appx_exe(), '-c', test_key_path(),
+                                   '-o', package, input_dir])
+            subprocess.check_call([appx_exe(), 'append',
+                                   '-c', test_key_path(), package,
+                                   'e.dll=' + os.path.join(d, 'e.dll')])
+            hashes['e.dll'] = new_hash
+            self._check_catalog(package, hashes)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,111 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+from xml.etree import ElementTree
+import appx.util
+import os
+import re
+import subprocess
+import unittest
+import zipfile
+
+class TestContentGroups(unittest.TestCase):
+    '''
+    Ensures the appx tool lays out files by content group and generates
+    AppxContentGroupMap.xml.
+    '''
+
+    _names = ['AppxManifest.xml', 'app.exe', 'Assets/Level1/a.dat',
+              'Assets/Level1/b.dat', 'Assets/Level2/c.dat', 'other.txt']
+
+    def _build(self, d, content_groups):
+        appx.util.make_input_tree(
+            d, dict((name, 'Contents of {}\n'.format(name))
+                    for name in self._names))
+        with open(os.path.join(d, 'groups.txt'), 'w') as groups_file:
+            groups_file.write(content_groups)
+        output = os.path.join(d, 'test.appx')
+        appx.util.build_appx(output, ['-9',
+                                      '-g', os.path.join(d, 'groups.txt'),
+                                      os.path.join(d, 'input')])
+        return zipfile.ZipFile(output)
+
+    @staticmethod
+    def _parse_xml(text):
+        # XML namespaces are a pain to deal with
+        return ElementTree.fromstring(re.sub(' xmlns="[^"]+"', '', text,
+                                             count=1))
+
+    def test_layout_and_map(self):
+        with appx.util.temp_dir() as d:
+            with self._build(d, '[ContentGroups]\n'
+                                '"Level2" "Assets/Level2/*"\n'
+                                '"Level1" "Assets/Level1/*"\n'
+                                '"Level2" "Assets/Level1/b.dat"\n'
+                                '"Required" "app.exe"\n') as zip:
+                self.assertIsNone(zip.testzip())
+                self.assertEqual([
+                    'AppxManifest.xml',
+                    'app.exe',
+                    'other.txt',
+                    'Assets/Level1/b.dat',
+                    'Assets/Level2/c.dat',
+                    'Assets/Level1/a.dat',
+                    'AppxMetadata/AppxContentGroupMap.xml',
+                    'AppxBlockMap.xml',
+                    '[Content_Types].xml',
+                ], zip.namelist())
+
+                group_map = self._parse_xml(
+                    zip.read('AppxMetadata/AppxContentGroupMap.xml'))
+                groups = [
+                    (group.get('Name'),
+                     [f.get('Name') for f in group.findall('File')])
+                    for group in group_map.findall('.//ContentGroup')]
+                self.assertEqual([
+                    ('Required', ['AppxManifest.xml', 'app.exe',
+                                  'other.txt']),
+                    ('Level2', ['Assets\\Level1\\b.dat',
+                                'Assets\\Level2\\c.dat']),
+                    ('Level1', ['Assets\\Level1\\a.dat']),
+                ], groups)
+                self.assertIsNotNone(
+                    group_map.find('./Required/ContentGroup[@Name="Required"]'))
+                self.assertEqual(
+                    2, len(group_map.findall('./Automatic/ContentGroup')))
+
+                block_map = self._parse_xml(zip.read('AppxBlockMap.xml'))
+                self.assertIsNotNone(block_map.find(
+                    './/File[@Name="AppxMetadata\\AppxContentGroupMap.xml"]'))
+
+                content_types = self._parse_xml(
+                    zip.read('[Content_Types].xml'))
+                override = content_types.find(
+                    './/Override[@PartName='
+                    '"/AppxMetadata/AppxContentGroupMap.xml"]')
+                self.assertIsNotNone(override)
+                self.assertEqual(
+                    'application/vnd.ms-appx.contentgroupmap+xml',
+                    override.get('ContentType'))
+
+    def test_malformed(self):
+        with appx.util.temp_dir() as d:
+            with open(os.path.join(d, 'groups.txt'), 'w') as groups_file:
+                groups_file.write('[ContentGroups]\n"Level1"\n')
+            process = subprocess.Popen([
+                appx_exe(), '-o', os.path.join(d, 'test.appx'),
+                '-g', os.path.join(d, 'groups.txt'), d,
+            ], stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('Malformed content group file', stderr)
+            self.assertIn('groups.txt', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,196 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import hashlib
+import os
+import subprocess
+import unittest
+import zipfile
+
+class TestContentStore(unittest.TestCase):
+    '''
+    Ensures inputs can be read from a content-addressed store named by a
+    content manifest, giving the same package as materialized inputs.
+    '''
+
+    FILES = {
+        'AppxManifest.xml': '<Package/>' * 100,
+        'App.exe': os.urandom(200000),
+        'Assets/Logo.png': os.urandom(1000),
+        'Assets/Copy.png': None,
+        'empty.dat': '',
+        'zeros.dat': '\0' * 300000,
+    }
+
+    def _contents(self, name):
+        return self.FILES[name] if self.FILES[name] is not None \
+            else self.FILES['Assets/Logo.png']
+
+    def _make_store(self, d, sharded=()):
+        '''
+        Writes the files to a store, in subdirectories for names in
+        sharded, and returns (store_dir, manifest_path).
+        '''
+        store_dir = os.path.join(d, 'store')
+        os.makedirs(store_dir)
+        lines = ['[ContentStore]']
+        for name in sorted(self.FILES):
+            data = self._contents(name)
+            digest = hashlib.sha256(data).hexdigest()
+            blob_dir = store_dir
+            if name in sharded:
+                blob_dir = os.path.join(store_dir, digest[:2])
+                if not os.path.isdir(blob_dir):
+                    os.makedirs(blob_dir)
+            with open(os.path.join(blob_dir, digest), 'wb') as f:
+                f.write(data)
+            lines.append('"{}/{}" "{}"'.format(digest, len(data), name))
+        manifest = os.path.join(d, 'manifest')
+        with open(manifest, 'wb') as f:
+            f.write('\n'.join(lines) + '\n')
+        return (store_dir, manifest)
+
+    def _make_tree(self, d):
+        return appx.util.make_input_tree(
+            d, dict((name, self._contents(name)) for name in self.FILES))
+
+    def _read(self, path):
+        with open(path, 'rb') as f:
+            return f.read()
+
+    def _call(self, args):
+        with open(os.devnull, 'wb') as devnull:
+            return subprocess.call([appx_exe()] + args, stdout=devnull,
+                                   stderr=devnull)
+
+    def test_same_as_materialized_tree(self):
+        with appx.util.temp_dir() as d:
+            (store_dir, manifest) = self._make_store(
+                d, sharded=['App.exe', 'zeros.dat'])
+            input_dir = self._make_tree(d)
+            tree_package = os.path.join(d, 'tree.appx')
+            store_package = os.path.join(d, 'store.appx')
+            for args in [['-0'], ['-6'], ['-9', '-j', '3']]:
+                tree_data = appx.util.build_appx(tree_package,
+                                                 args + [input_dir])
+                store_data = appx.util.build_appx(
+                    store_package, ['--content-store', store_dir,
+                                    '--content-manifest', manifest] + args)
+                self.assertTrue(tree_data == store_data)
+
+    def test_mixed_with_local_files(self):
+        with appx.util.temp_dir() as d:
+            (store_dir, manifest) = self._make_store(d)
+            local = os.path.join(d, 'local.txt')
+            with open(local, 'wb') as f:
+                f.write('local file')
+            package = os.path.join(d, 'test.appx')
+            appx.util.build_appx(
+                package, ['--content-store', store_dir,
+                          '--content-manifest', manifest,
+                          'local.txt=' + local])
+            with zipfile.ZipFile(package) as zip:
+                self.assertEqual('local file', zip.read('local.txt'))
+                for name in self.FILES:
+                    self.assertTrue(self._contents(name) == zip.read(name))
+
+    def test_stamps_are_digests(self):
+        with appx.util.temp_dir() as d:
+            (store_dir, manifest) = self._make_store(d)
+            sidecar = os.path.join(d, 'sidecar')
+            package = os.path.join(d, 'test.appx')
+            args = ['-o', package, '--incremental', sidecar, '-6',
+                    '--content-store', store_dir, '--content-manifest',
+                    manifest]
+            subprocess.check_call([appx_exe()] + args)
+            # Rewriting a blob with the same contents (as materializing it
+            # again would) keeps its record.
+            for name in os.listdir(store_dir):
+                path = os.path.join(store_dir, name)
+                data = self._read(path)
+                os.remove(path)
+                with open(path, 'wb') as f:
+                    f.write(data)
+            with open(sidecar) as f:
+                before = f.read()
+            subprocess.check_call([appx_exe()] + args)
+            with open(sidecar) as f:
+                # Each record's change count is unchanged.
+                self.assertEqual(before.splitlines()[1:],
+                                 f.read().splitlines()[1:])
+
+    def test_bad_blobs_are_rejected(self):
+        with appx.util.temp_dir() as d:
+            (store_dir, manifest) = self._make_store(d)
+            package = os.path.join(d, 'test.appx')
+            base = ['-o', package, '--content-store', store_dir,
+                    '--content-manifest']
+            digest = hashlib.sha256(self.FILES['App.exe']).hexdigest()
+            for line in ['"{}/{}" "a"'.format(digest, 1),
+                         '"{}/{}" "a"'.format('ab' * 32, 1),
+                         '"{}" "a"'.format(digest),
+                         '"{}/x" "a"'.format(digest),
+                         '"nothex/1" "a"',
+                         # Truncated hash.
+                         '"{}/{}" "a"'.format(
+                             digest[:-2], len(self.FILES['App.exe']))]:
+                bad = os.path.join(d, 'bad')
+                with open(bad, 'wb') as f:
+                    f.write('[ContentStore]\n' + line + '\n')
+                self.assertNotEqual(0, self._call(base + [bad]))
+            self.assertNotEqual(0, self._call(
+                ['-o', package, '--content-manifest', manifest]))
+
+    def test_repeated_blobs(self):
+        with appx.util.temp_dir() as d:
+            (store_dir, manifest) = self._make_store(d)
+            data = self.FILES['App.exe']
+            digest = hashlib.sha256(data).hexdigest()
+            copies = os.path.join(d, 'copies')
+            with open(copies, 'wb') as f:
+                f.write('[ContentStore]\n' + ''.join(
+                    '"{}/{}" "copy{}.exe"\n'.format(digest, len(data), i)
+                    for i in range(20)))
+            package = os.path.join(d, 'test.appx')
+            for args in [['-6'], ['-O', 'input', '-6', '-j', '3']]:
+                appx.util.build_appx(
+                    package, ['--content-store', store_dir,
+                              '--content-manifest', manifest,
+                              '--content-manifest', copies] + args)
+                with zipfile.ZipFile(package) as zip:
+                    for i in range(20):
+                        self.assertTrue(
+                            data == zip.read('copy{}.exe'.format(i)))
+
+            # The same hash with another size is rejected.
+            with open(copies, 'ab') as f:
+                f.write('"{}/{}" "other.exe"\n'.format(digest, len(data) + 1))
+            self.assertNotEqual(0, self._call(
+                ['-o', package, '--content-store', store_dir,
+                 '--content-manifest', copies]))
+
+    def test_upper_case_digests(self):
+        with appx.util.temp_dir() as d:
+            (store_dir, manifest) = self._make_store(d, sharded=['App.exe'])
+            with open(manifest, 'rb') as f:
+                lines = f.read().splitlines()
+            with open(manifest, 'wb') as f:
+                f.write('\n'.join([lines[0]] + [l.upper() for l in lines[1:]
+                                                if 'App.exe' in l]) + '\n')
+            package = os.path.join(d, 'test.appx')
+            appx.util.build_appx(
+                package, ['--content-store', store_dir,
+                          '--content-manifest', manifest])
+            with zipfile.ZipFile(package) as zip:
+                self.assertTrue(self.FILES['App.exe'] ==
+                                zip.read('APP.EXE'))
+
+if __name__ == '__main__':
+    unittest.main()
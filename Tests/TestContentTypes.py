@@ -22,15 +22,23 @@ class TestContentTypes(unittest.TestCase):
 
     _default_content_type = 'application/octet-stream'
 
-    def _get_content_types_xml(self, filename):
+    def _get_content_types_xml(self, *filenames, **kwargs):
         with appx.util.temp_dir() as d:
-            file_path = os.path.join(d, filename)
-            with open(file_path, 'w') as test_file:
-                pass # os.mknod requires super-user on OS X
+            args = []
+            if 'content_types' in kwargs:
+                types_path = os.path.join(d, 'types.txt')
+                with open(types_path, 'w') as types_file:
+                    types_file.write(kwargs['content_types'])
+                args += ['-C', types_path]
+            input_dir = os.path.join(d, 'input')
+            os.mkdir(input_dir)
+            for filename in filenames:
+                file_path = os.path.join(input_dir, filename)
+                with open(file_path, 'w') as test_file:
+                    pass # os.mknod requires super-user on OS X
             output_appx = os.path.join(d, 'test.appx')
             subprocess.check_call([appx_exe(),
-                                   '-o', output_appx,
-                                   file_path])
+                                   '-o', output_appx] + args + [input_dir])
             with zipfile.ZipFile(output_appx) as test_appx:
                 content_types_text = test_appx.read('[Content_Types].xml')
                 # XML namespaces are a pain to deal with
@@ -63,5 +71,47 @@ class TestContentTypes(unittest.TestCase):
         self.assertEqual(self._default_content_type,
                          extension_element.get('ContentType'))
 
+    def test_extensions_are_declared_once_ignoring_case(self):
+        content_types_xml = self._get_content_types_xml(
+            'a.PNG', 'b.png', 'c.Png', 'd.txt', 'e.txt')
+        defaults = content_types_xml.findall('.//Default')
+        extensions = [e.get('Extension').lower() for e in defaults]
+        self.assertEqual(1, extensions.count('png'))
+        self.assertEqual(1, extensions.count('txt'))
+        png_element = [e for e in defaults
+                       if e.get('Extension').lower() == 'png'][0]
+        self.assertEqual('image/png', png_element.get('ContentType'))
+
+    def test_content_type_file(self):
+        content_types_xml = self._get_content_types_xml(
+            'a.svg', 'b.PNG', 'c.txt',
+            content_types='[ContentTypes]\n'
+                          '"svg" "image/svg+xml"\n'
+                          '"png" "image/x-png"\n')
+        for extension, content_type in [
+                ('svg', 'image/svg+xml'),
+                ('PNG', 'image/x-png'),
+                ('txt', self._default_content_type)]:
+            element = content_types_xml.find(
+                './/Default[@Extension="{}"]'.format(extension))
+            self.assertIsNotNone(element)
+            self.assertEqual(content_type, element.get('ContentType'))
+
+    def test_malformed_content_type_file(self):
+        with appx.util.temp_dir() as d:
+            types_path = os.path.join(d, 'types.txt')
+            with open(types_path, 'w') as types_file:
+                types_file.write('[ContentTypes]\n"a.b" "text/plain"\n')
+            input_path = os.path.join(d, 'a.txt')
+            with open(input_path, 'w') as input_file:
+                pass
+            process = subprocess.Popen(
+                [appx_exe(), '-C', types_path,
+                 '-o', os.path.join(d, 'test.appx'), input_path],
+                stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertNotEqual(0, process.returncode)
+            self.assertIn('Invalid file extension', stderr)
+
 if __name__ == '__main__':
     unittest.main()
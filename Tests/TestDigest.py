@@ -0,0 +1,116 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe, test_key_path
+import appx.util
+import hashlib
+import os
+import subprocess
+import unittest
+
+ALGORITHMS = ['sha256', 'md5', 'sha1', 'sha512']
+
+class TestDigest(unittest.TestCase):
+    '''
+    Ensures --digest hashes the whole package as it is written.
+    '''
+
+    def _make_inputs(self, d):
+        return appx.util.make_input_tree(d, {
+            'random.bin': os.urandom(300000),
+            'sub/text.txt': 'some text ' * 20000,
+            'zeros.dat': '\0' * 200000,
+        })
+
+    def _digests(self, data):
+        return dict((a, hashlib.new(a, data).hexdigest())
+                    for a in ALGORITHMS)
+
+    def _parse(self, output):
+        return dict(line.split(' ') for line in output.splitlines())
+
+    def _read(self, path):
+        with open(path, 'rb') as f:
+            return f.read()
+
+    def test_digests_match_package(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            package = os.path.join(d, 'test.appx')
+            for args in [['-0'], ['-6'], ['-9', '-j', '3'],
+                         ['-6', '-c', test_key_path()],
+                         ['-1', '-j', '2', '-c', test_key_path()],
+                         ['-O', 'input', '-6']]:
+                output = subprocess.check_output(
+                    [appx_exe(), '-o', package,
+                     '--digest', ','.join(ALGORITHMS).upper()] +
+                    args + [input_dir])
+                self.assertEqual(self._digests(self._read(package)),
+                                 self._parse(output))
+
+    def test_pipe_output(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            digest_file = os.path.join(d, 'digests')
+            package = subprocess.check_output(
+                [appx_exe(), '-o', '/dev/stdout', '-6',
+                 '--digest', 'sha256,md5', '--digest-file', digest_file,
+                 input_dir])
+            self.assertEqual(
+                {'sha256': hashlib.sha256(package).hexdigest(),
+                 'md5': hashlib.md5(package).hexdigest()},
+                self._parse(self._read(digest_file)))
+
+    def test_kept_prefix_is_hashed(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            package = os.path.join(d, 'test.appx')
+            args = [appx_exe(), '-o', package, '--incremental',
+                    os.path.join(d, 'sidecar'), '--digest', 'sha256', '-6',
+                    input_dir]
+            subprocess.check_output(args)
+            with open(os.path.join(input_dir, 'zeros.dat'), 'ab') as f:
+                f.write('more')
+            output = subprocess.check_output(args)
+            self.assertEqual(
+                {'sha256': hashlib.sha256(self._read(package)).hexdigest()},
+                self._parse(output))
+
+    def test_split_resources(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            with open(os.path.join(input_dir, 'AppxManifest.xml'), 'wb') as f:
+                f.write('''<?xml version="1.0" encoding="utf-8"?>
+<Package
+  xmlns="http://schemas.microsoft.com/appx/manifest/foundation/windows10">
+  <Identity Name="Test.App" Publisher="CN=Test" Version="1.0.0.0"/>
+</Package>
+''')
+            with open(os.path.join(input_dir, 'Logo.scale-200.png'),
+                      'wb') as f:
+                f.write('logo')
+            bundle = os.path.join(d, 'test.appxbundle')
+            output = subprocess.check_output(
+                [appx_exe(), '--split-resources', '-o', bundle,
+                 '--digest', 'sha256', input_dir])
+            self.assertEqual(
+                {'sha256': hashlib.sha256(self._read(bundle)).hexdigest()},
+                self._parse(output))
+
+    def test_unsupported_algorithm(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            with open(os.devnull, 'wb') as devnull:
+                for digest in ['sha256,nosuchhash', ',']:
+                    self.assertNotEqual(0, subprocess.call(
+                        [appx_exe(), '-o', os.path.join(d, 'test.appx'),
+                         '--digest', digest, input_dir],
+                        stdout=devnull, stderr=devnull))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,121 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe, test_key_path
+import appx.util
+import os
+import random
+import subprocess
+import unittest
+import urllib
+import zipfile
+
+class TestDryRun(unittest.TestCase):
+    '''
+    Ensures --dry-run estimates the layout of the package a build writes.
+    '''
+
+    def _make_inputs(self, d, large=False):
+        files = {
+            'AppxManifest.xml': '<Package/>' * 100,
+            'empty.dat': '',
+            'random.bin': os.urandom(100000),
+            'sub dir/text.txt': 'some text ' * 10000,
+        }
+        if large:
+            # Larger than the minimum sample, so only parts are compressed.
+            rng = random.Random(0)
+            for i in range(3):
+                files['large{}.txt'.format(i)] = ''.join(
+                    rng.choice('abcdefgh \n') for _ in range(3000000))
+        return appx.util.make_input_tree(d, files)
+
+    def _dry_run(self, args):
+        output = subprocess.check_output([appx_exe(), '--dry-run'] + args)
+        lines = output.splitlines()
+        self.assertEqual(['offset', 'size', 'compressed', 'low', 'high',
+                          'name'], lines[0].split())
+        entries = []
+        for line in lines[1:lines.index('')]:
+            fields = line.split(None, 5)
+            entries.append({
+                'offset': int(fields[0]), 'size': int(fields[1]),
+                'compressed': int(fields[2]), 'low': int(fields[3]),
+                'high': int(fields[4]), 'name': fields[5],
+            })
+        summary = lines[lines.index('') + 1].split()
+        self.assertEqual(['Package', 'size:'], summary[:2])
+        size = {
+            'estimate': int(summary[2]),
+            'low': int(summary[4].lstrip('(')),
+            'high': int(summary[6].rstrip(')')),
+        }
+        return (entries, size)
+
+    def _build(self, d, args):
+        package = os.path.join(d, 'test.appx')
+        appx.util.build_appx(package, args)
+        with zipfile.ZipFile(package) as package_zip:
+            infos = package_zip.infolist()
+        return (infos, os.path.getsize(package))
+
+    def test_small_package_is_exact(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            for args in [['-0'], ['-6'], ['-9', '-j', '2'], ['-X']]:
+                (entries, size) = self._dry_run(args + [input_dir])
+                self.assertEqual(size['low'], size['high'])
+                (infos, package_size) = self._build(d, args + [input_dir])
+                self.assertEqual(package_size, size['estimate'])
+                self.assertEqual(
+                    [urllib.unquote(i.filename) for i in infos],
+                    [e['name'] for e in entries])
+                for (info, entry) in zip(infos, entries):
+                    self.assertEqual(info.header_offset, entry['offset'])
+                    self.assertEqual(info.file_size, entry['size'])
+                    self.assertEqual(info.compress_size, entry['compressed'])
+
+    def test_large_package_is_within_bounds(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d, large=True)
+            for args in [['-0'], ['-6'], ['-9', '-c', test_key_path()]]:
+                (entries, size) = self._dry_run(args + [input_dir])
+                (infos, package_size) = self._build(d, args + [input_dir])
+                if args == ['-0']:
+                    self.assertEqual(package_size, size['estimate'])
+                self.assertLessEqual(size['low'], package_size)
+                self.assertGreaterEqual(size['high'], package_size)
+                self.assertLess(abs(package_size - size['estimate']),
+                                package_size * 0.02)
+                self.assertEqual(
+                    [urllib.unquote(i.filename) for i in infos],
+                    [e['name'] for e in entries])
+                for (info, entry) in zip(infos, entries):
+                    self.assertLessEqual(entry['low'], info.compress_size)
+                    self.assertGreaterEqual(entry['high'],
+                                            info.compress_size)
+
+    def test_nothing_is_written(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            package = os.path.join(d, 'test.appx')
+            subprocess.check_output([appx_exe(), '--dry-run', '-o', package,
+                                     '-6', input_dir])
+            self.assertFalse(os.path.exists(package))
+
+    def test_checkpoints_are_rejected(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            with open(os.devnull, 'wb') as devnull:
+                self.assertNotEqual(0, subprocess.call(
+                    [appx_exe(), '--dry-run', '-k',
+                     os.path.join(d, 'checkpoint'), input_dir],
+                    stdout=devnull, stderr=devnull))
+
+if __name__ == '__main__':
+    unittest.main()
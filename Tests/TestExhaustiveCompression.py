@@ -0,0 +1,65 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+import appx.util
+import os
+import random
+import unittest
+import zipfile
+
+class TestExhaustiveCompression(unittest.TestCase):
+    '''
+    Ensures the exhaustive DEFLATE encoder (-X) creates valid packages which
+    are no larger than with -9.
+    '''
+
+    def _make_inputs(self, d):
+        rng = random.Random(42)
+        words = ['<Item', ' Name="', 'alpha', 'beta', 'gamma', '"/>', '\n']
+        contents = {
+            'empty': '',
+            'one': 'x',
+            'zeros': '\0' * 200000,
+            'random': os.urandom(70000),
+            'text': ''.join(rng.choice(words) for _ in range(20000)),
+            'block': ''.join(chr(rng.randrange(8)) for _ in range(65536)),
+            'block_plus_one': ''.join(chr(rng.randrange(8))
+                                      for _ in range(65537)),
+        }
+        return (appx.util.make_input_tree(d, contents), contents)
+
+    def _build(self, d, input_dir, name, args):
+        return appx.util.build_appx(os.path.join(d, name),
+                                    args + [input_dir])
+
+    def test_smaller_than_best(self):
+        with appx.util.temp_dir() as d:
+            input_dir, contents = self._make_inputs(d)
+            self._build(d, input_dir, 'best.appx', ['-9'])
+            self._build(d, input_dir, 'exhaustive.appx', ['-X'])
+            with zipfile.ZipFile(os.path.join(d, 'best.appx')) as best, \
+                    zipfile.ZipFile(os.path.join(d, 'exhaustive.appx')) as zip:
+                self.assertIsNone(zip.testzip())
+                for name, data in contents.items():
+                    self.assertEqual(data, zip.read(name))
+                    self.assertLessEqual(zip.getinfo(name).compress_size,
+                                         best.getinfo(name).compress_size)
+                self.assertLess(zip.getinfo('text').compress_size,
+                                best.getinfo('text').compress_size)
+
+    def test_identical_output(self):
+        with appx.util.temp_dir() as d:
+            input_dir, _ = self._make_inputs(d)
+            serial = self._build(d, input_dir, 'serial.appx',
+                                 ['-X', '-j', '1'])
+            parallel = self._build(d, input_dir, 'parallel.appx',
+                                   ['-X', '-j', '4'])
+            self.assertEqual(serial, parallel)
+
+if __name__ == '__main__':
+    unittest.main()
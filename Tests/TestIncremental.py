@@ -0,0 +1,242 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe, test_key_path
+import appx.util
+import hashlib
+import os
+import re
+import struct
+import subprocess
+import unittest
+import zipfile
+
+CATALOG = 'AppxMetadata/CodeIntegrity.cat'
+
+class TestIncremental(unittest.TestCase):
+    '''
+    Ensures --incremental keeps the records of unchanged leading files and
+    gives the same package as a full build.
+    '''
+
+    def _make_pe(self, path, body_size):
+        pe_offset = 0x80
+        dos_header = 'MZ' + '\0' * (0x3c - 2) + struct.pack('<I', pe_offset)
+        dos_header += '\0' * (pe_offset - len(dos_header))
+        coff_header = 'PE\0\0' + struct.pack('<HHIIIHH', 0x8664, 0, 0, 0, 0,
+                                             240, 0x22)
+        optional_header = bytearray(240)
+        struct.pack_into('<H', optional_header, 0, 0x20b)
+        struct.pack_into('<I', optional_header, 108, 16)
+        with open(path, 'wb') as f:
+            f.write(dos_header + coff_header + str(optional_header) +
+                    os.urandom(body_size))
+
+    def _make_inputs(self, d):
+        input_dir = appx.util.make_input_tree(d, {
+            'c.dat': os.urandom(100000),
+            'z.txt': 'text ' * 30000,
+        })
+        os.mkdir(os.path.join(input_dir, 'lib'))
+        self._make_pe(os.path.join(input_dir, 'a.exe'), 200000)
+        self._make_pe(os.path.join(input_dir, 'lib', 'b.dll'), 1000)
+        return input_dir
+
+    def _read(self, path):
+        with open(path, 'rb') as f:
+            return f.read()
+
+    def _append(self, path, data):
+        with open(path, 'ab') as f:
+            f.write(data)
+
+    def _assert_same(self, full, incremental):
+        '''
+        Checks an incremental build against a full build. Signatures and
+        signed catalogs (listed in the block map) include the signing time,
+        so for signed packages only the inputs and the catalogs' image
+        hashes are compared, and the signature's AXPC digest is checked
+        against the package.
+        '''
+        with zipfile.ZipFile(full) as full_zip:
+            with zipfile.ZipFile(incremental) as incremental_zip:
+                if 'AppxSignature.p7x' not in full_zip.namelist():
+                    self.assertTrue(self._read(full) ==
+                                    self._read(incremental))
+                    return
+                self.assertIsNone(incremental_zip.testzip())
+                catalog = full_zip.getinfo(CATALOG)
+                self.assertEqual(catalog.header_offset,
+                                 incremental_zip.getinfo(CATALOG).header_offset)
+                self.assertTrue(
+                    self._read(full)[:catalog.header_offset] ==
+                    self._read(incremental)[:catalog.header_offset])
+                self.assertEqual(
+                    *[sorted(re.findall('(?:[0-9A-F]\0){64}',
+                                        zip.read(CATALOG)))
+                      for zip in [full_zip, incremental_zip]])
+                signature = incremental_zip.getinfo('AppxSignature.p7x')
+                axpc = hashlib.sha256(
+                    self._read(incremental)[:signature.header_offset])
+                self.assertIn('AXPC' + axpc.digest(),
+                              incremental_zip.read(signature))
+
+    def _build(self, d, input_dir, args, incremental=True):
+        package = os.path.join(d, 'incremental.appx' if incremental
+                               else 'full.appx')
+        extra = ['--incremental', os.path.join(d, 'sidecar')] \
+            if incremental else []
+        # Not appx.util.build_appx: tests corrupt packages on purpose.
+        subprocess.check_call([appx_exe(), '-o', package] + extra + args +
+                              [input_dir])
+        return package
+
+    def _corrupt(self, package, name):
+        '''
+        Flips a byte of a file's data without changing the package's
+        modification time. Returns the byte's offset.
+        '''
+        with zipfile.ZipFile(package) as zip:
+            info = zip.getinfo(name)
+        offset = info.header_offset + 30 + len(name) + 1
+        times = package + '.times'
+        open(times, 'wb').close()
+        subprocess.check_call(['touch', '-r', package, times])
+        with open(package, 'r+b') as f:
+            f.seek(offset)
+            byte = f.read(1)
+            f.seek(offset)
+            f.write(chr(ord(byte) ^ 0xff))
+        subprocess.check_call(['touch', '-r', times, package])
+        os.remove(times)
+        return offset
+
+    def test_same_as_full_build(self):
+        for args in [['-0'], ['-6'], ['-6', '-j', '3'],
+                     ['-9', '-c', test_key_path()],
+                     ['-1', '-j', '3', '-c', test_key_path()]]:
+            with appx.util.temp_dir() as d:
+                input_dir = self._make_inputs(d)
+                package = self._build(d, input_dir, args)
+                self._assert_same(
+                    self._build(d, input_dir, args, incremental=False),
+                    package)
+                for (name, data) in [('z.txt', 'more text'),
+                                     ('c.dat', 'more data'),
+                                     ('lib/b.dll', 'more code')]:
+                    self._append(os.path.join(input_dir, name), data)
+                    self._build(d, input_dir, args)
+                    self._assert_same(
+                        self._build(d, input_dir, args, incremental=False),
+                        package)
+
+    def test_unchanged_records_are_kept(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            args = ['-6']
+            package = self._build(d, input_dir, args)
+            # The corrupted byte is kept only if a.exe is not written again.
+            offset = self._corrupt(package, 'a.exe')
+            self._append(os.path.join(input_dir, 'z.txt'), 'more text')
+            self._build(d, input_dir, args)
+            full = self._read(self._build(d, input_dir, args,
+                                          incremental=False))
+            incremental = self._read(package)
+            self.assertEqual(len(full), len(incremental))
+            self.assertNotEqual(full[offset], incremental[offset])
+            self.assertTrue(full[:offset] + full[offset + 1:] ==
+                            incremental[:offset] + incremental[offset + 1:])
+
+    def test_changed_package_is_rebuilt(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            package = self._build(d, input_dir, ['-6'])
+            self._corrupt(package, 'a.exe')
+            os.utime(package, None)
+            self._append(os.path.join(input_dir, 'z.txt'), 'more text')
+            self._build(d, input_dir, ['-6'])
+            self._assert_same(
+                self._build(d, input_dir, ['-6'], incremental=False),
+                package)
+
+    def test_changed_options_are_rebuilt(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            package = self._build(d, input_dir, ['-6'])
+            self._corrupt(package, 'a.exe')
+            for args in [['-9'], ['-9', '-c', test_key_path()]]:
+                self._build(d, input_dir, args)
+                self._assert_same(
+                    self._build(d, input_dir, args, incremental=False),
+                    package)
+
+    def _catalog_hashes(self, package):
+        with zipfile.ZipFile(package) as zip:
+            return sorted(re.findall('(?:[0-9A-F]\0){64}', zip.read(CATALOG)))
+
+    def test_signed_append_uses_sidecar(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            args = ['-6', '-c', test_key_path()]
+            package = self._build(d, input_dir, args)
+            new_dir = os.path.join(d, 'new')
+            os.mkdir(new_dir)
+            self._make_pe(os.path.join(new_dir, 'd.exe'), 5000)
+            with open(os.path.join(new_dir, 'e.txt'), 'wb') as f:
+                f.write('e')
+            expected = self._catalog_hashes(self._build(
+                d, input_dir, args + ['d.exe=' + os.path.join(new_dir, 'd.exe'),
+                                      'e.txt=' + os.path.join(new_dir, 'e.txt')],
+                incremental=False))
+
+            # The kept records are neither hashed nor read again, so the
+            # corrupted byte is in neither the signature nor the catalog.
+            offset = self._corrupt(package, 'a.exe')
+            for name in ['d.exe', 'e.txt']:
+                subprocess.check_call(
+                    [appx_exe(), 'append', '--incremental',
+                     os.path.join(d, 'sidecar')] + args +
+                    [package, name + '=' + os.path.join(new_dir, name)])
+                data = self._read(package)
+                restored = data[:offset] + chr(ord(data[offset]) ^ 0xff) + \
+                    data[offset + 1:]
+                with zipfile.ZipFile(package) as zip:
+                    signature = zip.getinfo('AppxSignature.p7x')
+                    axpc = hashlib.sha256(restored[:signature.header_offset])
+                    self.assertIn('AXPC' + axpc.digest(), zip.read(signature))
+            self.assertEqual(expected, self._catalog_hashes(package))
+
+    def test_stable_order(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            args = ['-O', 'stable', '-6']
+            package = self._build(d, input_dir, args)
+            for data in ['more', 'and more']:
+                self._append(os.path.join(input_dir, 'c.dat'), data)
+                self._build(d, input_dir, args)
+            with open(os.path.join(input_dir, 'new.txt'), 'wb') as f:
+                f.write('new')
+            os.remove(os.path.join(input_dir, 'z.txt'))
+            self._build(d, input_dir, args)
+            with zipfile.ZipFile(package) as zip:
+                self.assertIsNone(zip.testzip())
+                self.assertEqual(
+                    ['a.exe', 'lib/b.dll', 'c.dat', 'new.txt'],
+                    [n for n in zip.namelist()
+                     if n not in ['AppxBlockMap.xml', '[Content_Types].xml']])
+
+    def test_stable_order_requires_incremental(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            with open(os.devnull, 'wb') as devnull:
+                self.assertNotEqual(0, subprocess.call(
+                    [appx_exe(), '-o', os.path.join(d, 'test.appx'), '-O',
+                     'stable', input_dir], stdout=devnull, stderr=devnull))
+
+if __name__ == '__main__':
+    unittest.main()
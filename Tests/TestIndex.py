@@ -0,0 +1,117 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import test_key_path
+import appx.util
+import base64
+import hashlib
+import json
+import os
+import struct
+import unittest
+import zipfile
+import zlib
+
+class TestIndex(unittest.TestCase):
+    '''
+    Ensures --index describes where each file and block is in the package.
+    '''
+
+    def _make_inputs(self, d):
+        return appx.util.make_random_input_tree(d, [0, 1, 65536, 200000],
+                                                sub_dir='sub dir')
+
+    def _read_binary_index(self, path):
+        with open(path, 'rb') as f:
+            data = f.read()
+        self.assertEqual('APPXIDX1', data[:8])
+        (count,) = struct.unpack_from('<I', data, 8)
+        pos = 12
+        entries = []
+        for _ in range(count):
+            (name_size,) = struct.unpack_from('<H', data, pos)
+            pos += 2
+            name = data[pos:pos + name_size].decode('utf-8')
+            pos += name_size
+            fields = struct.unpack_from('<QIQQIHI', data, pos)
+            pos += struct.calcsize('<QIQQIHI')
+            blocks = []
+            for _ in range(fields[6]):
+                hash = base64.b64encode(data[pos:pos + 32])
+                (offset, size) = struct.unpack_from('<QI', data, pos + 32)
+                pos += 32 + struct.calcsize('<QI')
+                blocks.append({'hash': hash, 'offset': offset, 'size': size})
+            entries.append({
+                'name': name, 'headerOffset': fields[0],
+                'headerSize': fields[1], 'compressedSize': fields[2],
+                'uncompressedSize': fields[3], 'crc32': fields[4],
+                'compression': fields[5], 'blocks': blocks,
+            })
+        self.assertEqual(len(data), pos)
+        return {'entries': entries}
+
+    def _check_index(self, package, index):
+        with open(package, 'rb') as f:
+            package_data = f.read()
+        with zipfile.ZipFile(package) as package_zip:
+            infos = package_zip.infolist()
+            self.assertEqual(len(infos), len(index['entries']))
+            for (info, entry) in zip(infos, index['entries']):
+                self.assertEqual(info.header_offset, entry['headerOffset'])
+                self.assertEqual(info.compress_size, entry['compressedSize'])
+                self.assertEqual(info.file_size, entry['uncompressedSize'])
+                self.assertEqual(info.CRC & 0xffffffff, entry['crc32'])
+                self.assertEqual(info.compress_type, entry['compression'])
+                self.assertEqual(30 + len(info.filename), entry['headerSize'])
+                contents = package_zip.read(info)
+                for (i, block) in enumerate(entry['blocks']):
+                    stored = package_data[block['offset']:
+                                          block['offset'] + block['size']]
+                    if entry['compression'] == zipfile.ZIP_DEFLATED:
+                        stored = zlib.decompressobj(-15).decompress(stored)
+                    self.assertEqual(contents[i * 65536:(i + 1) * 65536],
+                                     stored)
+                    self.assertEqual(
+                        base64.b64encode(hashlib.sha256(stored).digest()),
+                        block['hash'])
+                if not entry['name'].startswith('Appx') and \
+                        entry['name'] != '[Content_Types].xml':
+                    self.assertEqual((len(contents) + 65535) // 65536,
+                                     len(entry['blocks']))
+
+    def test_index(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            for args in [['-0'], ['-6', '-j', '2'],
+                         ['-9', '-c', test_key_path()]]:
+                package = os.path.join(d, 'test.appx')
+                json_path = os.path.join(d, 'index.json')
+                binary_path = os.path.join(d, 'index.bin')
+                appx.util.build_appx(package, ['--index', json_path] + args +
+                                     [input_dir])
+                with open(json_path) as f:
+                    json_index = json.load(f)
+                self.assertIn('sub dir/file1.dat',
+                              [e['name'] for e in json_index['entries']])
+                self._check_index(package, json_index)
+
+                appx.util.build_appx(package, ['--index', binary_path] +
+                                     args + [input_dir])
+                binary_index = self._read_binary_index(binary_path)
+                # The signature has a signing time, so its contents and
+                # sizes can differ between the two builds.
+                for index in [json_index, binary_index]:
+                    for entry in index['entries']:
+                        if entry['name'] == 'AppxSignature.p7x':
+                            for key in ['crc32', 'compressedSize',
+                                        'uncompressedSize']:
+                                del entry[key]
+                self.assertEqual(json_index, binary_index)
+
+if __name__ == '__main__':
+    unittest.main()
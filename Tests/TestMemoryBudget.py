@@ -0,0 +1,91 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import os
+import resource
+import subprocess
+import unittest
+import zipfile
+
+class TestMemoryBudget(unittest.TestCase):
+    '''
+    Ensures the appx tool can package large files under a hard memory limit
+    when given a memory budget.
+    '''
+
+    # Address space limit for the appx process, like a container's memory
+    # limit. Smaller than the largest input file.
+    _address_space_limit = 40 * 1024 * 1024
+    _stack_limit = 1024 * 1024
+
+    def _make_inputs(self, d):
+        return appx.util.make_input_tree(d, {
+            'big.dat': os.urandom(64 * 1024 * 1024),
+            'text.txt': 'Hello, world!\n' * 100000,
+        })
+
+    def _build(self, output, args, limit=None):
+        def set_limit():
+            if limit is not None:
+                resource.setrlimit(resource.RLIMIT_AS, (limit, limit))
+                # Each thread reserves address space for its stack (sized by
+                # RLIMIT_STACK, often 8 MiB) which it does not use.
+                resource.setrlimit(resource.RLIMIT_STACK,
+                                   (self._stack_limit, self._stack_limit))
+        process = subprocess.Popen([appx_exe(), '-o', output] + args,
+                                   preexec_fn=set_limit,
+                                   stderr=subprocess.PIPE)
+        (_, stderr) = process.communicate()
+        return (process.returncode, stderr)
+
+    def test_large_corpus_under_limit(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            for level in ['-0', '-9']:
+                limited = os.path.join(d, 'limited.appx')
+                (returncode, stderr) = self._build(
+                    limited, [level, '-m', '4M', input_dir],
+                    limit=self._address_space_limit)
+                self.assertEqual(0, returncode, stderr)
+                with zipfile.ZipFile(limited) as zip:
+                    self.assertIsNone(zip.testzip())
+
+                unlimited_data = appx.util.build_appx(
+                    os.path.join(d, 'unlimited.appx'), [level, input_dir])
+                with open(limited, 'rb') as f:
+                    limited_data = f.read()
+                self.assertEqual(unlimited_data, limited_data)
+
+    def test_parallel_under_limit(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            limited = os.path.join(d, 'limited.appx')
+            (returncode, stderr) = self._build(
+                limited, ['-9', '-j', '4', '-m', '4M', input_dir],
+                limit=self._address_space_limit)
+            self.assertEqual(0, returncode, stderr)
+            with zipfile.ZipFile(limited) as zip:
+                self.assertIsNone(zip.testzip())
+
+            unlimited_data = appx.util.build_appx(
+                os.path.join(d, 'unlimited.appx'), ['-9', input_dir])
+            with open(limited, 'rb') as f:
+                limited_data = f.read()
+            self.assertEqual(unlimited_data, limited_data)
+
+    def test_invalid_limit(self):
+        with appx.util.temp_dir() as d:
+            (returncode, stderr) = self._build(
+                os.path.join(d, 'test.appx'), ['-m', '4X', d])
+            self.assertEqual(1, returncode)
+            self.assertIn('Invalid memory limit', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import os
+import subprocess
+import unittest
+import zipfile
+
+class TestOrder(unittest.TestCase):
+    '''
+    Ensures the appx tool writes files in a deterministic order.
+    '''
+
+    _names = ['b.txt', 'a.txt', 'dir/c.txt', 'Z.txt', 'dir/a.txt']
+
+    def _make_inputs(self, d):
+        appx.util.make_input_tree(
+            d, dict((name, 'Contents of {}\n'.format(name))
+                    for name in self._names))
+
+    def _build(self, d, args):
+        output = os.path.join(d, 'test.appx')
+        data = appx.util.build_appx(output, args)
+        with zipfile.ZipFile(output) as zip:
+            names = [n for n in zip.namelist()
+                     if n not in ('AppxBlockMap.xml', '[Content_Types].xml')]
+        return (names, data)
+
+    def _file_args(self, d, names):
+        return ['{}={}'.format(name, os.path.join(d, 'input', name))
+                for name in names]
+
+    def test_sorted_by_default(self):
+        with appx.util.temp_dir() as d:
+            self._make_inputs(d)
+            (names, data) = self._build(d, self._file_args(d, self._names))
+            self.assertEqual(sorted(self._names), names)
+            (_, reversed_data) = self._build(
+                d, self._file_args(d, list(reversed(self._names))))
+            self.assertEqual(data, reversed_data)
+            (_, directory_data) = self._build(d, [os.path.join(d, 'input')])
+            self.assertEqual(data, directory_data)
+
+    def test_input_order(self):
+        with appx.util.temp_dir() as d:
+            self._make_inputs(d)
+            (names, _) = self._build(
+                d, ['-O', 'input'] + self._file_args(d, self._names))
+            self.assertEqual(self._names, names)
+
+    def test_order_file(self):
+        with appx.util.temp_dir() as d:
+            self._make_inputs(d)
+            with open(os.path.join(d, 'order.txt'), 'w') as order_file:
+                order_file.write('dir/c.txt\n\nb.txt\n')
+            (names, _) = self._build(
+                d, ['-O', os.path.join(d, 'order.txt')] +
+                self._file_args(d, self._names))
+            self.assertEqual(['dir/c.txt', 'b.txt', 'Z.txt', 'a.txt',
+                              'dir/a.txt'], names)
+
+    def test_order_file_unknown_name(self):
+        with appx.util.temp_dir() as d:
+            self._make_inputs(d)
+            with open(os.path.join(d, 'order.txt'), 'w') as order_file:
+                order_file.write('missing.txt\n')
+            process = subprocess.Popen(
+                [appx_exe(), '-o', os.path.join(d, 'test.appx'),
+                 '-O', os.path.join(d, 'order.txt')] +
+                self._file_args(d, self._names), stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('missing.txt', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
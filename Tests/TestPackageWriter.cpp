@@ -0,0 +1,329 @@
+//
+// Copyright (c) 2016-present, Facebook, Inc.
+// All rights reserved.
+//
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree.
+
+// Ensures PackageWriter writes the same package as WriteAppx, applies
+// backpressure, can be abandoned, and reports errors, and that writers in
+// one process do not share a thread limit.
+
+#include <APPX/APPX.h>
+#include <APPX/File.h>
+#include <APPX/PackageWriter.h>
+#include <APPX/Parallel.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace facebook::appx;
+
+namespace {
+    void Check(bool condition, const std::string &message)
+    {
+        if (!condition) {
+            throw std::runtime_error(message);
+        }
+    }
+
+    // A directory deleted with its files.
+    class TemporaryDirectory
+    {
+    public:
+        TemporaryDirectory()
+        {
+            const char *tmp = std::getenv("TMPDIR");
+            std::string pattern =
+                std::string(tmp ? tmp : "/tmp") + "/appx-test-XXXXXX";
+            std::vector<char> path(pattern.begin(), pattern.end());
+            path.push_back('\0');
+            if (!mkdtemp(path.data())) {
+                throw ErrnoException("mkdtemp");
+            }
+            this->path = path.data();
+        }
+
+        ~TemporaryDirectory()
+        {
+            for (const std::string &file : this->files) {
+                unlink(file.c_str());
+            }
+            rmdir(this->path.c_str());
+        }
+
+        std::string File(const std::string &name)
+        {
+            this->files.push_back(this->path + "/" + name);
+            return this->files.back();
+        }
+
+    private:
+        std::string path;
+        std::vector<std::string> files;
+    };
+
+    // Half random and half compressible, so both stored and deflated
+    // blocks are written.
+    std::vector<std::uint8_t> MakeData(std::size_t size, unsigned seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<std::uint8_t> data(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            data[i] = i < size / 2 ? static_cast<std::uint8_t>(random())
+                                   : static_cast<std::uint8_t>('a' + i % 7);
+        }
+        return data;
+    }
+
+    std::vector<std::uint8_t> ReadFile(const std::string &path)
+    {
+        FilePtr file = Open(path, "rb");
+        std::vector<std::uint8_t> data;
+        std::uint8_t buffer[65536];
+        while (std::size_t size = Read(file, sizeof(buffer), buffer)) {
+            data.insert(data.end(), buffer, buffer + size);
+        }
+        return data;
+    }
+
+    void WriteFile(const std::string &path,
+                   const std::vector<std::uint8_t> &data)
+    {
+        FilePtr file = Open(path, "wb");
+        Write(file, data.size(), data.data());
+    }
+
+    // Sizes of the inputs: empty, within a block, and spanning blocks.
+    const std::size_t kSizes[] = {0, 1000, 200000, 70000, 5};
+
+    void TestSameAsWriteAppx(TemporaryDirectory &directory)
+    {
+        std::vector<FileListEntry> fileNames;
+        std::vector<std::vector<std::uint8_t>> inputs;
+        for (std::size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+            std::string name = "dir/file" + std::to_string(i) + ".dat";
+            inputs.push_back(MakeData(kSizes[i], i));
+            fileNames.emplace_back(name, directory.File(std::to_string(i)));
+            WriteFile(fileNames.back().second, inputs.back());
+        }
+
+        for (unsigned jobs : {1, 4}) {
+            APPXOptions options;
+            options.compressionLevel = 6;
+            options.jobs = jobs;
+            std::string expected = directory.File("expected.appx");
+            WriteAppx(Open(expected, "wb"), fileNames, options);
+
+            std::string output = directory.File("output.appx");
+            {
+                PackageWriter writer(Open(output, "wb"), options, 1 << 20);
+                for (std::size_t i = 0; i < inputs.size(); ++i) {
+                    writer.BeginEntry(fileNames[i].first);
+                    // Uneven chunks, so entries' blocks span chunks.
+                    for (std::size_t offset = 0; offset < inputs[i].size();
+                         offset += 7777) {
+                        writer.Write(
+                            std::min<std::size_t>(7777,
+                                                  inputs[i].size() - offset),
+                            inputs[i].data() + offset);
+                    }
+                    writer.EndEntry();
+                }
+                std::exception_ptr doneError = nullptr;
+                bool isDone = false;
+                writer.Finish([&](std::exception_ptr error) {
+                    isDone = true;
+                    doneError = error;
+                });
+                writer.Wait();
+                Check(isDone && !doneError, "done was not called on success");
+            }
+            Check(ReadFile(expected) == ReadFile(output),
+                  "package differs from WriteAppx with " +
+                      std::to_string(jobs) + " jobs");
+        }
+    }
+
+    void TestBackpressure(TemporaryDirectory &directory)
+    {
+        const std::size_t kLimit = 65536;
+        std::mutex mutex;
+        std::condition_variable changed;
+        bool isReady = false;
+        unsigned readyCalls = 0;
+        APPXOptions options;
+        options.jobs = 1;
+        PackageWriter writer(Open(directory.File("backpressure.appx"), "wb"),
+                             options, kLimit, [&]() {
+                                 std::lock_guard<std::mutex> lock(mutex);
+                                 isReady = true;
+                                 ++readyCalls;
+                                 changed.notify_all();
+                             });
+
+        std::vector<std::uint8_t> data = MakeData(4 << 20, 0);
+        unsigned blockedWrites = 0;
+        writer.BeginEntry("big.dat");
+        for (std::size_t offset = 0; offset < data.size(); offset += 16384) {
+            if (!writer.Write(16384, data.data() + offset)) {
+                ++blockedWrites;
+                std::unique_lock<std::mutex> lock(mutex);
+                Check(changed.wait_for(lock, std::chrono::seconds(60),
+                                       [&]() { return isReady; }),
+                      "ready was not called");
+                isReady = false;
+            }
+        }
+        writer.EndEntry();
+        writer.Finish();
+        writer.Wait();
+        Check(blockedWrites > 0, "Write never returned false");
+        std::lock_guard<std::mutex> lock(mutex);
+        Check(readyCalls == blockedWrites,
+              "ready was not called once per blocked Write");
+    }
+
+    void TestAbandon(TemporaryDirectory &directory)
+    {
+        // The background thread is waiting for the open entry's data.
+        for (unsigned jobs : {1, 2}) {
+            APPXOptions options;
+            options.jobs = jobs;
+            PackageWriter writer(Open(directory.File("abandoned.appx"), "wb"),
+                                 options, 1 << 20);
+            writer.BeginEntry("a.dat");
+            writer.Write(3, reinterpret_cast<const std::uint8_t *>("abc"));
+        }
+    }
+
+    void TestErrors(TemporaryDirectory &directory)
+    {
+        std::string path = directory.File("readonly.appx");
+        WriteFile(path, {});
+        for (unsigned jobs : {1, 2}) {
+            APPXOptions options;
+            options.jobs = jobs;
+            // Writes fail with EBADF.
+            PackageWriter writer(Open(path, "rb"), options, 1 << 20);
+            std::vector<std::uint8_t> data = MakeData(1 << 20, 0);
+            bool threw = false;
+            try {
+                // Keep adding entries until the failure reaches the caller,
+                // which must see the original error.
+                for (unsigned i = 0; i < 1000; ++i) {
+                    writer.BeginEntry("file" + std::to_string(i));
+                    writer.Write(data.size(), data.data());
+                    writer.EndEntry();
+                }
+                writer.Finish();
+                writer.Wait();
+            } catch (const ErrnoException &e) {
+                threw = e.error == EBADF;
+            }
+            Check(threw, "the write error was not rethrown");
+        }
+
+        // Once writing failed, Finish calls done with the error.
+        APPXOptions options;
+        PackageWriter writer(Open(path, "rb"), options, 1 << 20);
+        std::vector<std::uint8_t> data = MakeData(1 << 20, 0);
+        writer.BeginEntry("a.dat");
+        writer.Write(data.size(), data.data());
+        writer.EndEntry();
+        std::exception_ptr doneError = nullptr;
+        writer.Finish([&](std::exception_ptr error) { doneError = error; });
+        bool threw = false;
+        try {
+            writer.Wait();
+        } catch (const ErrnoException &) {
+            threw = true;
+        }
+        Check(threw, "Wait did not rethrow the error");
+        Check(doneError != nullptr, "done was not called with the error");
+    }
+
+    void TestIndependentThreadLimits(TemporaryDirectory &)
+    {
+        // While one top-level ParallelFor holds both of its threads,
+        // another (as in a second writer) still gets its own.
+        std::mutex mutex;
+        std::condition_variable changed;
+        unsigned outerRunning = 0;
+        bool outerDone = false;
+        std::thread outer([&]() {
+            ParallelFor(2, 2, [&](std::size_t) {
+                std::unique_lock<std::mutex> lock(mutex);
+                ++outerRunning;
+                changed.notify_all();
+                changed.wait_for(lock, std::chrono::seconds(60),
+                                 [&]() { return outerDone; });
+            });
+        });
+
+        bool isConcurrent = true;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait_for(lock, std::chrono::seconds(60),
+                             [&]() { return outerRunning == 2; });
+        }
+        unsigned innerRunning = 0;
+        ParallelFor(2, 2, [&](std::size_t) {
+            std::unique_lock<std::mutex> lock(mutex);
+            ++innerRunning;
+            changed.notify_all();
+            if (!changed.wait_for(lock, std::chrono::seconds(10),
+                                  [&]() { return innerRunning == 2; })) {
+                isConcurrent = false;
+            }
+        });
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            outerDone = true;
+            changed.notify_all();
+        }
+        outer.join();
+        Check(isConcurrent, "a ParallelFor was limited by an unrelated one");
+    }
+}
+
+int main()
+{
+    struct Test
+    {
+        const char *name;
+        void (*run)(TemporaryDirectory &);
+    };
+    const Test kTests[] = {
+        {"SameAsWriteAppx", TestSameAsWriteAppx},
+        {"Backpressure", TestBackpressure},
+        {"Abandon", TestAbandon},
+        {"Errors", TestErrors},
+        {"IndependentThreadLimits", TestIndependentThreadLimits},
+    };
+    int status = 0;
+    for (const Test &test : kTests) {
+        try {
+            TemporaryDirectory directory;
+            test.run(directory);
+            std::cout << test.name << ": OK" << std::endl;
+        } catch (const std::exception &e) {
+            std::cout << test.name << ": FAILED: " << e.what() << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}
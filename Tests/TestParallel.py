@@ -0,0 +1,64 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import os
+import random
+import subprocess
+import unittest
+import zipfile
+
+class TestParallel(unittest.TestCase):
+    '''
+    Ensures the appx tool creates identical packages regardless of the number
+    of threads.
+    '''
+
+    def _make_inputs(self, d):
+        rng = random.Random(42)
+        return appx.util.make_random_input_tree(
+            d, [rng.choice([0, 1, 1000, 65536, 65537, 200000])
+                for _ in range(20)])
+
+    def _build(self, d, input_dir, name, args):
+        return appx.util.build_appx(os.path.join(d, name),
+                                    args + [input_dir])
+
+    def test_identical_output(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            for level in ['-0', '-9']:
+                serial = self._build(d, input_dir, 'serial.appx',
+                                     [level, '-j', '1'])
+                for jobs in ['2', '4', '0']:
+                    parallel = self._build(d, input_dir, 'parallel.appx',
+                                           [level, '-j', jobs])
+                    self.assertEqual(serial, parallel)
+
+    def test_signed(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            self._build(d, input_dir, 'test.appx',
+                        ['-9', '-j', '4', '-c', appx.util.test_key_path()])
+            with zipfile.ZipFile(os.path.join(d, 'test.appx')) as zip:
+                self.assertIn('AppxSignature.p7x', zip.namelist())
+
+    def test_invalid_job_count(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            process = subprocess.Popen([
+                appx_exe(), '-o', os.path.join(d, 'test.appx'),
+                '-j', 'many', input_dir,
+            ], stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('Invalid job count', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import os
+import subprocess
+import unittest
+import zipfile
+
+BUNDLE_MANIFEST = '''<?xml version="1.0" encoding="UTF-8"?>
+<Bundle xmlns="http://schemas.microsoft.com/appx/2013/bundle">
+  <Packages>
+    <Package FileName="a.appx" Offset="a.appx-offset"/>
+  </Packages>
+</Bundle>
+'''
+
+class TestPipeline(unittest.TestCase):
+    '''
+    Ensures packaging files while inputs are still being discovered (with
+    -O input) gives the same package as discovering all inputs first.
+    '''
+
+    def _make_inputs(self, d):
+        return appx.util.make_random_input_tree(
+            d, [0, 1, 4095, 65537, 300000], sub_dir='sub')
+
+    def _build(self, d, name, args, stdin=None, cwd=None):
+        return appx.util.build_appx(os.path.join(d, name),
+                                    ['-O', 'input'] + args, stdin, cwd)
+
+    def _build_both(self, d, args, stdin=None, cwd=None):
+        '''
+        Builds a package with a pipelined file list, and with the whole file
+        list discovered first (forced by -k), returning both.
+        '''
+        pipelined = self._build(d, 'pipelined', args, stdin, cwd)
+        whole = self._build(
+            d, 'whole', ['-k', os.path.join(d, 'checkpoint')] + args, stdin,
+            cwd)
+        return (pipelined, whole)
+
+    def test_same_as_whole_list(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            mapping = '[Files]\n"{}" "mapped.dat"\n"{}" "file2.dat"\n'.format(
+                os.path.join(input_dir, 'file4.dat'),
+                os.path.join(input_dir, 'file0.dat'))
+            for jobs in ['1', '2']:
+                (pipelined, whole) = self._build_both(
+                    d, ['-6', '-j', jobs, '-f', '-', input_dir,
+                        'last.dat=' + os.path.join(input_dir, 'file2.dat')],
+                    mapping)
+                self.assertEqual(whole, pipelined)
+            with zipfile.ZipFile(os.path.join(d, 'pipelined')) as zip:
+                self.assertEqual(
+                    ['mapped.dat', 'file2.dat', 'file0.dat',
+                     'file4.dat', 'sub/file1.dat', 'sub/file3.dat',
+                     'last.dat', 'AppxBlockMap.xml', '[Content_Types].xml'],
+                    zip.namelist())
+
+    def test_relative_inputs(self):
+        with appx.util.temp_dir() as d:
+            self._make_inputs(d)
+            for jobs in ['1', '2']:
+                (pipelined, whole) = self._build_both(
+                    d, ['-6', '-j', jobs, 'input',
+                        'last.dat=' + os.path.join('input', 'file2.dat')],
+                    cwd=d)
+                self.assertEqual(whole, pipelined)
+
+    def test_bundle_manifest_last(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            manifest = os.path.join(d, 'AppxBundleManifest.xml')
+            with open(manifest, 'w') as f:
+                f.write(BUNDLE_MANIFEST)
+            package = os.path.join(d, 'a.appx')
+            appx.util.build_appx(package, [input_dir])
+            (pipelined, whole) = self._build_both(
+                d, ['-b', 'AppxMetadata/AppxBundleManifest.xml=' + manifest,
+                    'a.appx=' + package])
+            self.assertEqual(whole, pipelined)
+            with zipfile.ZipFile(os.path.join(d, 'pipelined')) as zip:
+                self.assertEqual(
+                    ['a.appx', 'AppxMetadata/AppxBundleManifest.xml',
+                     'AppxBlockMap.xml', '[Content_Types].xml'],
+                    zip.namelist())
+
+    def _check_fails(self, d, args, message):
+        process = subprocess.Popen(
+            [appx_exe(), '-o', os.path.join(d, 'output'), '-O', 'input'] +
+            args, stderr=subprocess.PIPE)
+        (_, stderr) = process.communicate()
+        self.assertEqual(1, process.returncode)
+        self.assertIn(message, stderr)
+
+    def test_discovery_error(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            missing = os.path.join(d, 'missing')
+            self._check_fails(d, ['-j', '2', input_dir, missing], missing)
+
+    def test_missing_inputs(self):
+        with appx.util.temp_dir() as d:
+            empty_dir = os.path.join(d, 'empty')
+            os.mkdir(empty_dir)
+            self._check_fails(d, [empty_dir], 'Missing inputs')
+
+if __name__ == '__main__':
+    unittest.main()
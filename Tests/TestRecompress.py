@@ -0,0 +1,158 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe, test_key_path
+import appx.util
+import os
+import subprocess
+import unittest
+import zipfile
+
+BUNDLE_MANIFEST = '''<?xml version="1.0" encoding="UTF-8"?>
+<Bundle xmlns="http://schemas.microsoft.com/appx/2013/bundle">
+  <Packages>
+    <Package FileName="a.appx" Offset="a.appx-offset" Size="{a_size}"/>
+    <Package FileName="b.appx" Offset="b.appx-offset" Size="{b_size}"/>
+  </Packages>
+</Bundle>
+'''
+
+class TestRecompress(unittest.TestCase):
+    '''
+    Ensures recompressing a package gives the same package as creating it
+    with the new options.
+    '''
+
+    def _make_inputs(self, d):
+        return appx.util.make_random_input_tree(
+            d, [0, 1, 4095, 65537, 300000], sub_dir='sub dir')
+
+    def _build(self, d, name, args):
+        output = os.path.join(d, name)
+        appx.util.build_appx(output, args)
+        return output
+
+    def _recompress(self, d, name, package, args):
+        output = os.path.join(d, name)
+        subprocess.check_call([appx_exe(), 'recompress', '-o', output] +
+                              args + [package])
+        with zipfile.ZipFile(output) as zip:
+            self.assertIsNone(zip.testzip())
+        return output
+
+    def _read(self, path):
+        with open(path, 'rb') as f:
+            return f.read()
+
+    def test_same_as_creating(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            stored = self._build(d, 'stored.appx', ['-0', input_dir])
+            expected = self._build(d, 'expected.appx', ['-9', input_dir])
+            for jobs in ['1', '2']:
+                output = self._recompress(
+                    d, 'output.appx', stored, ['-9', '-j', jobs])
+                self.assertEqual(self._read(expected), self._read(output))
+            # Recompressing back gives the original package.
+            output = self._recompress(d, 'output.appx', expected, ['-0'])
+            self.assertEqual(self._read(stored), self._read(output))
+
+    def _build_bundle(self, d, name, level, a, b, extra):
+        manifest = os.path.join(d, 'AppxBundleManifest.xml')
+        with open(manifest, 'w') as f:
+            f.write(BUNDLE_MANIFEST.format(a_size=os.path.getsize(a),
+                                           b_size=os.path.getsize(b)))
+        return self._build(d, name, [
+            '-b', level,
+            'AppxMetadata/AppxBundleManifest.xml=' + manifest,
+            'a.appx=' + a,
+            'b.appx=' + b,
+            'extra.txt=' + extra,
+        ])
+
+    def test_bundle(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            extra = os.path.join(input_dir, 'file4.dat')
+            stored_a = self._build(d, 'stored_a.appx', ['-0', input_dir])
+            a = self._build(d, 'a.appx', ['-9', input_dir])
+            b = self._build(d, 'b.appx', ['-9', input_dir])
+            stored = self._build_bundle(d, 'stored.appxbundle', '-0',
+                                        stored_a, b, extra)
+            # The packages in the bundle are recompressed too, and their
+            # sizes in the bundle manifest updated.
+            expected = self._build_bundle(d, 'expected.appxbundle', '-9',
+                                          a, b, extra)
+            output = self._recompress(d, 'output.appxbundle', stored, ['-9'])
+            self.assertEqual(self._read(expected), self._read(output))
+            with zipfile.ZipFile(output) as zip:
+                self.assertEqual(self._read(a), zip.read('a.appx'))
+                manifest = zip.read('AppxMetadata/AppxBundleManifest.xml')
+                self.assertIn('Size="{}"'.format(os.path.getsize(a)),
+                              manifest)
+            self.assertLess(os.path.getsize(a), os.path.getsize(stored_a))
+
+    def test_signed_bundle(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            a = self._build(d, 'a.appx', ['-0', input_dir])
+            stored = self._build_bundle(d, 'stored.appxbundle', '-0', a, a,
+                                        os.path.join(input_dir, 'file0.dat'))
+            signed = self._recompress(d, 'signed.appxbundle', stored,
+                                      ['-6', '-c', test_key_path()])
+            with zipfile.ZipFile(signed) as zip:
+                self.assertIn('AppxSignature.p7x', zip.namelist())
+                for name in ['a.appx', 'b.appx']:
+                    package = os.path.join(d, name)
+                    with open(package, 'wb') as f:
+                        f.write(zip.read(name))
+                    with zipfile.ZipFile(package) as package_zip:
+                        self.assertIsNone(package_zip.testzip())
+                        self.assertIn('AppxSignature.p7x',
+                                      package_zip.namelist())
+
+    def test_signed(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            stored = self._build(d, 'stored.appx', ['-0', input_dir])
+            signed = self._recompress(d, 'signed.appx', stored,
+                                      ['-6', '-c', test_key_path()])
+            with zipfile.ZipFile(signed) as zip:
+                self.assertIn('AppxSignature.p7x', zip.namelist())
+            # Signatures are regenerated, not copied.
+            unsigned = self._recompress(d, 'unsigned.appx', signed, ['-0'])
+            self.assertEqual(self._read(stored), self._read(unsigned))
+
+    def test_invalid_package(self):
+        with appx.util.temp_dir() as d:
+            package = os.path.join(d, 'bogus.appx')
+            with open(package, 'wb') as f:
+                f.write('not a zip file' * 10)
+            process = subprocess.Popen([
+                appx_exe(), 'recompress', '-o', os.path.join(d, 'out.appx'),
+                package,
+            ], stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('Malformed ZIP file', stderr)
+
+    def test_in_place(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            stored = self._build(d, 'stored.appx', ['-0', input_dir])
+            before = self._read(stored)
+            process = subprocess.Popen([
+                appx_exe(), 'recompress', '-9', '-o', stored, stored,
+            ], stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('in place', stderr)
+            self.assertEqual(before, self._read(stored))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,202 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe, test_key_path
+import appx.util
+import io
+import os
+import re
+import subprocess
+import unittest
+import xml.etree.ElementTree as ElementTree
+import zipfile
+
+BUNDLE_NS = '{http://schemas.microsoft.com/appx/2013/bundle}'
+FOUNDATION_NS = \
+    '{http://schemas.microsoft.com/appx/manifest/foundation/windows10}'
+UAP_NS = '{http://schemas.microsoft.com/appx/manifest/uap/windows10}'
+
+MANIFEST = '''<?xml version="1.0" encoding="utf-8"?>
+<Package
+  xmlns="http://schemas.microsoft.com/appx/manifest/foundation/windows10"
+  xmlns:uap="http://schemas.microsoft.com/appx/manifest/uap/windows10"
+  IgnorableNamespaces="uap">
+  <Identity Name="Test.App" Publisher="CN=Test &amp; Co" Version="1.2.3.0"
+            ProcessorArchitecture="x64"/>
+  <Properties>
+    <DisplayName>Test</DisplayName>
+    <PublisherDisplayName>Test</PublisherDisplayName>
+    <Logo>Assets\\Logo.png</Logo>
+  </Properties>
+  <Dependencies>
+    <TargetDeviceFamily Name="Windows.Universal" MinVersion="10.0.0.0"
+                        MaxVersionTested="10.0.0.0"/>
+  </Dependencies>
+  <Resources>
+    <Resource Language="en-US"/>
+    <Resource uap:Scale="100"/>
+  </Resources>
+</Package>
+'''
+
+class TestResourceBundle(unittest.TestCase):
+    '''
+    Ensures --split-resources splits an app into a main package and
+    resource packages by the qualifiers in file paths.
+    '''
+
+    FILES = {
+        'AppxManifest.xml': MANIFEST,
+        'App.exe': 'app',
+        'Assets/Logo.png': 'logo',
+        'Assets/Logo.scale-100.png': 'default scale logo',
+        'Assets/scale-200/Wide.png': 'scale 200 wide',
+        'Assets/Logo.scale-200.png': 'scale 200 logo',
+        'Assets/Logo.lang-fr_scale-200.png': 'french scale 200 logo',
+        'Strings/lang-en-US/Resources.resw': 'english',
+        'Strings/language-fr/Resources.resw': 'french',
+        'Textures/dxfl-dx11/Sky.dds': 'sky',
+        'Notes/language.txt': 'not a qualifier',
+    }
+
+    EXPECTED_PACKAGES = {
+        'Test.App_1.2.3.0_x64.appx': (None, {}, [
+            'App.exe', 'AppxManifest.xml', 'Assets/Logo.png',
+            'Assets/Logo.scale-100.png', 'Notes/language.txt',
+            'Strings/lang-en-US/Resources.resw',
+        ]),
+        'Test.App_1.2.3.0_split.dxfeaturelevel-dx11.appx': (
+            'split.dxfeaturelevel-dx11', {'DXFeatureLevel': 'dx11'}, [
+                'Textures/dxfl-dx11/Sky.dds',
+            ]),
+        'Test.App_1.2.3.0_split.language-fr.appx': (
+            'split.language-fr', {'Language': 'fr'}, [
+                'Strings/language-fr/Resources.resw',
+            ]),
+        'Test.App_1.2.3.0_split.language-fr.scale-200.appx': (
+            'split.language-fr.scale-200',
+            {'Language': 'fr', 'Scale': '200'}, [
+                'Assets/Logo.lang-fr_scale-200.png',
+            ]),
+        'Test.App_1.2.3.0_split.scale-200.appx': (
+            'split.scale-200', {'Scale': '200'}, [
+                'Assets/Logo.scale-200.png', 'Assets/scale-200/Wide.png',
+            ]),
+    }
+
+    def _make_inputs(self, d):
+        return appx.util.make_input_tree(d, self.FILES)
+
+    def _resources(self, element, ns):
+        resources = {}
+        for resource in element.find(ns + 'Resources'):
+            for (name, value) in resource.attrib.items():
+                resources[re.sub(r'^\{.*\}', '', name)] = value
+        return resources
+
+    def _check_bundle(self, bundle_path, signed):
+        with zipfile.ZipFile(bundle_path) as bundle:
+            infos = dict((i.filename, i) for i in bundle.infolist())
+            bundle_manifest = ElementTree.fromstring(
+                bundle.read('AppxMetadata/AppxBundleManifest.xml'))
+            identity = bundle_manifest.find(BUNDLE_NS + 'Identity')
+            self.assertEqual('Test.App', identity.get('Name'))
+            self.assertEqual('CN=Test & Co', identity.get('Publisher'))
+            self.assertEqual('1.2.3.0', identity.get('Version'))
+
+            packages = bundle_manifest.find(BUNDLE_NS + 'Packages')
+            self.assertEqual(sorted(self.EXPECTED_PACKAGES),
+                             sorted(p.get('FileName') for p in packages))
+            self.assertEqual(signed, 'AppxSignature.p7x' in infos)
+            for package in packages:
+                file_name = package.get('FileName')
+                (resource_id, resources, files) = \
+                    self.EXPECTED_PACKAGES[file_name]
+                info = infos[file_name]
+                self.assertEqual(zipfile.ZIP_STORED, info.compress_type)
+                self.assertEqual(info.header_offset + 30 + len(file_name),
+                                 int(package.get('Offset')))
+                self.assertEqual(info.file_size, int(package.get('Size')))
+                if resource_id is None:
+                    self.assertEqual('application', package.get('Type'))
+                    self.assertEqual('x64', package.get('Architecture'))
+                    self.assertEqual({'Language': 'en-us', 'Scale': '100'},
+                                     self._resources(package, BUNDLE_NS))
+                else:
+                    self.assertEqual('resource', package.get('Type'))
+                    self.assertEqual(resource_id, package.get('ResourceId'))
+                    self.assertEqual(resources,
+                                     self._resources(package, BUNDLE_NS))
+
+                child = zipfile.ZipFile(io.BytesIO(bundle.read(info)))
+                names = child.namelist()
+                self.assertEqual(signed, 'AppxSignature.p7x' in names)
+                generated = ['AppxBlockMap.xml', '[Content_Types].xml',
+                             'AppxSignature.p7x',
+                             'AppxMetadata/CodeIntegrity.cat']
+                if resource_id is not None:
+                    generated.append('AppxManifest.xml')
+                self.assertEqual(sorted(files),
+                                 sorted(n for n in names
+                                        if n not in generated))
+                for name in files:
+                    self.assertEqual(self.FILES[name], child.read(name))
+                if resource_id is None:
+                    self.assertEqual(MANIFEST,
+                                     child.read('AppxManifest.xml'))
+                    continue
+                manifest = ElementTree.fromstring(
+                    child.read('AppxManifest.xml'))
+                identity = manifest.find(FOUNDATION_NS + 'Identity')
+                self.assertEqual('Test.App', identity.get('Name'))
+                self.assertEqual('CN=Test & Co', identity.get('Publisher'))
+                self.assertEqual(resource_id, identity.get('ResourceId'))
+                self.assertEqual(
+                    'Test', manifest.find(FOUNDATION_NS + 'Properties')
+                        .find(FOUNDATION_NS + 'DisplayName').text)
+                self.assertIsNotNone(
+                    manifest.find(FOUNDATION_NS + 'Dependencies'))
+                self.assertEqual(resources,
+                                 self._resources(manifest, FOUNDATION_NS))
+
+    def test_split(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            bundle_path = os.path.join(d, 'test.appxbundle')
+            for args in [['-0'], ['-9', '-j', '3'],
+                         ['-6', '-c', test_key_path()]]:
+                appx.util.build_appx(bundle_path,
+                                     ['--split-resources'] + args +
+                                     [input_dir])
+                self._check_bundle(bundle_path, '-c' in args)
+
+    def test_missing_manifest(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            os.remove(os.path.join(input_dir, 'AppxManifest.xml'))
+            with open(os.devnull, 'wb') as devnull:
+                self.assertNotEqual(0, subprocess.call(
+                    [appx_exe(), '--split-resources', '-o',
+                     os.path.join(d, 'test.appxbundle'), input_dir],
+                    stderr=devnull))
+
+    def test_pri_file(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            with open(os.path.join(input_dir, 'resources.pri'), 'wb') as f:
+                f.write('index')
+            bundle_path = os.path.join(d, 'test.appxbundle')
+            process = subprocess.Popen([
+                appx_exe(), '--split-resources', '-o', bundle_path, input_dir,
+            ], stderr=subprocess.PIPE)
+            (_, stderr) = process.communicate()
+            self.assertEqual(1, process.returncode)
+            self.assertIn('PRI file: resources.pri', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import os
+import shutil
+import subprocess
+import unittest
+
+class TestResume(unittest.TestCase):
+    '''
+    Ensures a build interrupted after writing some files can be resumed
+    from its checkpoint, giving the same package as an uninterrupted build.
+    '''
+
+    def _write(self, path, size, seed):
+        with open(path, 'wb') as f:
+            f.write(appx.util.partly_random(size, seed))
+
+    def _read(self, path):
+        with open(path, 'rb') as f:
+            return f.read()
+
+    def _run(self, args):
+        process = subprocess.Popen([appx_exe()] + args,
+                                   stderr=subprocess.PIPE)
+        (_, stderr) = process.communicate()
+        return (process.returncode, stderr)
+
+    def _interrupt(self, d, args):
+        '''
+        Runs a build which fails on its last input (a directory), then
+        replaces that input with a file of the same size so the build can
+        be resumed. Returns (input_dir, last_input, checkpoint).
+        '''
+        input_dir = appx.util.make_random_input_tree(
+            d, [1000, 200000, 0, 70000])
+        last_input = os.path.join(d, 'last')
+        os.mkdir(last_input)
+        checkpoint = os.path.join(d, 'output.checkpoint')
+        (returncode, _) = self._run(
+            ['-o', os.path.join(d, 'output.appx'), '-k', checkpoint] +
+            args + [input_dir, 'z.dat=' + last_input])
+        self.assertEqual(1, returncode)
+        self.assertTrue(os.path.exists(checkpoint))
+        size = os.path.getsize(last_input)
+        os.rmdir(last_input)
+        self._write(last_input, size, 9)
+        return (input_dir, last_input, checkpoint)
+
+    def test_same_as_uninterrupted(self):
+        for jobs in ['1', '2']:
+            with appx.util.temp_dir() as d:
+                args = ['-6', '-j', jobs]
+                (input_dir, last_input, checkpoint) = self._interrupt(d, args)
+                if jobs == '1':
+                    with open(checkpoint) as f:
+                        self.assertEqual(5, len(f.readlines()))
+
+                expected = os.path.join(d, 'expected.appx')
+                appx.util.build_appx(expected, args +
+                                     [input_dir, 'z.dat=' + last_input])
+                output = os.path.join(d, 'output.appx')
+                subprocess.check_call([appx_exe(), '-o', output,
+                                       '--checkpoint', checkpoint,
+                                       '--resume'] + args +
+                                      [input_dir, 'z.dat=' + last_input])
+                self.assertEqual(self._read(expected), self._read(output))
+                self.assertFalse(os.path.exists(checkpoint))
+
+    def test_resume_without_checkpoint(self):
+        with appx.util.temp_dir() as d:
+            input_path = os.path.join(d, 'a.dat')
+            self._write(input_path, 1000, 0)
+            expected = os.path.join(d, 'expected.appx')
+            appx.util.build_appx(expected, [input_path])
+            output = os.path.join(d, 'output.appx')
+            shutil.copyfile(expected, output)
+            with open(output, 'ab') as f:
+                f.write('garbage')
+            subprocess.check_call([appx_exe(), '-o', output, '-r',
+                                   '-k', os.path.join(d, 'checkpoint'),
+                                   input_path])
+            self.assertEqual(self._read(expected), self._read(output))
+
+    def test_changed_input_of_same_size(self):
+        for jobs in ['1', '2']:
+            with appx.util.temp_dir() as d:
+                args = ['-6', '-j', jobs]
+                (input_dir, last_input, checkpoint) = self._interrupt(d, args)
+                # file1.dat was written before the interruption; its records
+                # and those after it must be written again.
+                changed = os.path.join(input_dir, 'file1.dat')
+                size = os.path.getsize(changed)
+                self._write(changed, size, 8)
+                self.assertEqual(size, os.path.getsize(changed))
+
+                expected = os.path.join(d, 'expected.appx')
+                appx.util.build_appx(expected, args +
+                                     [input_dir, 'z.dat=' + last_input])
+                output = os.path.join(d, 'output.appx')
+                subprocess.check_call([appx_exe(), '-o', output,
+                                       '--checkpoint', checkpoint,
+                                       '--resume'] + args +
+                                      [input_dir, 'z.dat=' + last_input])
+                self.assertEqual(self._read(expected), self._read(output))
+
+    def test_different_inputs(self):
+        with appx.util.temp_dir() as d:
+            (input_dir, last_input, checkpoint) = self._interrupt(d, ['-6'])
+            (returncode, stderr) = self._run(
+                ['-o', os.path.join(d, 'output.appx'), '-k', checkpoint,
+                 '-r', '-9', input_dir, 'z.dat=' + last_input])
+            self.assertEqual(1, returncode)
+            self.assertIn('Checkpoint is for different inputs', stderr)
+
+    def test_modified_output(self):
+        with appx.util.temp_dir() as d:
+            (input_dir, last_input, checkpoint) = self._interrupt(d, ['-6'])
+            output = os.path.join(d, 'output.appx')
+            with open(output, 'r+b') as f:
+                f.seek(100)
+                byte = f.read(1)
+                f.seek(100)
+                f.write(chr(ord(byte) ^ 1))
+            (returncode, stderr) = self._run(
+                ['-o', output, '-k', checkpoint, '-r', '-6', input_dir,
+                 'z.dat=' + last_input])
+            self.assertEqual(1, returncode)
+            self.assertIn('Output does not match checkpoint', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
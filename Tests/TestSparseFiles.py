@@ -0,0 +1,92 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+import appx.util
+import os
+import random
+import unittest
+import zipfile
+
+BLOCK_SIZE = 65536
+
+class TestSparseFiles(unittest.TestCase):
+    '''
+    Ensures sparse files and runs of zeros are packaged the same as the
+    equivalent files written out in full.
+    '''
+
+    def _files(self, scale):
+        rng = random.Random(3)
+        data = ''.join(chr(rng.randrange(256)) for _ in range(5000))
+        text = 'some text ' * 7000
+        # (size, [(offset, data)]) for each file.
+        return {
+            'holes.dat': (scale * BLOCK_SIZE + 10, [
+                (0, 'head'), (3 * BLOCK_SIZE - 100, data),
+                (5 * BLOCK_SIZE + 17, text),
+                (scale * BLOCK_SIZE, 'tail'),
+            ]),
+            'trailing-hole.dat': (scale * BLOCK_SIZE // 2, [(100, text)]),
+            'all-hole.dat': (4 * BLOCK_SIZE + 1, []),
+            'zero-padded.dat': (9 * BLOCK_SIZE, [
+                (BLOCK_SIZE + 5, data), (7 * BLOCK_SIZE, text),
+            ]),
+        }
+
+    def _make_inputs(self, d, name, sparse, scale):
+        input_dir = os.path.join(d, name)
+        os.mkdir(input_dir)
+        for (file_name, (size, pieces)) in self._files(scale).items():
+            with open(os.path.join(input_dir, file_name), 'wb') as f:
+                if sparse and file_name != 'zero-padded.dat':
+                    for (offset, data) in pieces:
+                        f.seek(offset)
+                        f.write(data)
+                    f.truncate(size)
+                else:
+                    contents = bytearray(size)
+                    for (offset, data) in pieces:
+                        contents[offset:offset + len(data)] = data
+                    f.write(contents)
+        return input_dir
+
+    def _build(self, d, input_dir, args):
+        return appx.util.build_appx(os.path.join(d, 'test.appx'),
+                                    args + [input_dir])
+
+    def _check_same_as_dense(self, scale, arg_lists):
+        with appx.util.temp_dir() as d:
+            sparse_dir = self._make_inputs(d, 'sparse', True, scale)
+            dense_dir = self._make_inputs(d, 'dense', False, scale)
+            for args in arg_lists:
+                self.assertEqual(self._build(d, dense_dir, args),
+                                 self._build(d, sparse_dir, args))
+
+    def test_same_as_dense(self):
+        self._check_same_as_dense(64, [
+            ['-0'], ['-1'], ['-6'], ['-9', '-j', '3'],
+            ['-6', '-p', 'nocache'], ['-6', '--block-memo', '1M'],
+        ])
+
+    def test_exhaustive(self):
+        self._check_same_as_dense(12, [['-X']])
+
+    def test_contents(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d, 'sparse', True, 64)
+            self._build(d, input_dir, ['-6'])
+            with zipfile.ZipFile(os.path.join(d, 'test.appx')) as package:
+                for (file_name, (size, pieces)) in self._files(64).items():
+                    contents = package.read(file_name)
+                    self.assertEqual(size, len(contents))
+                    for (offset, data) in pieces:
+                        self.assertEqual(
+                            data, contents[offset:offset + len(data)])
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,68 @@
+#!/usr/bin/env python2.7
+#
+# Copyright (c) 2016-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+from appx.util import appx_exe
+import appx.util
+import os
+import subprocess
+import unittest
+import zipfile
+
+class TestTimeBudget(unittest.TestCase):
+    '''
+    Ensures the appx tool chooses compression levels within a time budget.
+    '''
+
+    def _make_inputs(self, d):
+        files = {'empty.txt': ''}
+        for i in range(4):
+            files['text{}.txt'.format(i)] = ''.join(
+                'line {} of file {}\n'.format(j, i) for j in range(20000))
+            files['random{}.dat'.format(i)] = os.urandom(300000)
+        return appx.util.make_input_tree(d, files)
+
+    def _build(self, d, input_dir, args):
+        output = os.path.join(d, 'test.appx')
+        appx.util.build_appx(output, args + [input_dir])
+        with zipfile.ZipFile(output) as zip:
+            return dict((info.filename, info.compress_type)
+                        for info in zip.infolist())
+
+    def test_generous_budget(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            for args in [['-t', '1000'], ['-T', '1000', '-j', '2']]:
+                types = self._build(d, input_dir, args)
+                for i in range(4):
+                    self.assertEqual(zipfile.ZIP_DEFLATED,
+                                     types['text{}.txt'.format(i)])
+                    self.assertEqual(zipfile.ZIP_STORED,
+                                     types['random{}.dat'.format(i)])
+
+    def test_tiny_budget(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            types = self._build(d, input_dir, ['-9', '-T', '0.000001'])
+            for i in range(4):
+                self.assertEqual(zipfile.ZIP_STORED,
+                                 types['text{}.txt'.format(i)])
+
+    def test_invalid_budget(self):
+        with appx.util.temp_dir() as d:
+            input_dir = self._make_inputs(d)
+            for budget in ['0', '-1', 'soon']:
+                process = subprocess.Popen([
+                    appx_exe(), '-o', os.path.join(d, 'test.appx'),
+                    '-t', budget, input_dir,
+                ], stderr=subprocess.PIPE)
+                (_, stderr) = process.communicate()
+                self.assertEqual(1, process.returncode)
+                self.assertIn('Invalid time budget', stderr)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -8,7 +8,9 @@
 import contextlib
 import os
 import shutil
+import subprocess
 import tempfile
+import zipfile
 
 @contextlib.contextmanager
 def temp_dir():
@@ -29,3 +31,56 @@ def test_dir_path():
 
 def test_key_path():
     return os.path.join(test_dir_path(), 'App_TemporaryKey.pfx')
+
+def partly_random(size, seed):
+    '''
+    Returns size bytes of random data followed by text, which compress to
+    about half their size.
+    '''
+    return os.urandom(size // 2) + \
+        ('file {} '.format(seed) * size)[:size - size // 2]
+
+def make_input_tree(d, files, name='input'):
+    '''
+    Creates a directory in d holding files, a dict from relative paths to
+    contents, and returns its path.
+    '''
+    input_dir = os.path.join(d, name)
+    os.makedirs(input_dir)
+    for (path, contents) in files.items():
+        path = os.path.join(input_dir, path)
+        if not os.path.isdir(os.path.dirname(path)):
+            os.makedirs(os.path.dirname(path))
+        with open(path, 'wb') as f:
+            f.write(contents)
+    return input_dir
+
+def make_random_input_tree(d, sizes, name='input', sub_dir=None):
+    '''
+    Creates a directory in d with a partly random file{i}.dat of each size,
+    odd-numbered ones in sub_dir if given, and returns its path.
+    '''
+    files = {}
+    for (i, size) in enumerate(sizes):
+        path = 'file{}.dat'.format(i)
+        if sub_dir is not None and i % 2:
+            path = os.path.join(sub_dir, path)
+        files[path] = partly_random(size, i)
+    return make_input_tree(d, files, name)
+
+def build_appx(output, args, stdin=None, cwd=None):
+    '''
+    Runs the appx tool to write the package output, checks the package's
+    CRC-32s, and returns its bytes.
+    '''
+    process = subprocess.Popen([appx_exe(), '-o', output] + args,
+                               stdin=subprocess.PIPE, cwd=cwd)
+    process.communicate(stdin)
+    if process.returncode != 0:
+        raise subprocess.CalledProcessError(process.returncode, appx_exe())
+    with zipfile.ZipFile(output) as package:
+        bad_name = package.testzip()
+        if bad_name is not None:
+            raise Exception('Bad CRC-32 for {} in {}'.format(bad_name, output))
+    with open(output, 'rb') as f:
+        return f.read()